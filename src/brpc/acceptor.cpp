@@ -41,6 +41,8 @@ Acceptor::Acceptor(bthread_keytable_pool_t* pool)
     , _force_ssl(false)
     , _ssl_ctx(nullptr) 
     , _socket_mode(SOCKET_MODE_TCP)
+    , _write_coalesce_us(0)
+    , _write_coalesce_bytes(0)
     , _bthread_tag(BTHREAD_TAG_DEFAULT) {
 }
 
@@ -286,6 +288,8 @@ void Acceptor::OnNewConnectionsUntilEAGAIN(Socket* acception) {
         options.force_ssl = am->_force_ssl;
         options.initial_ssl_ctx = am->_ssl_ctx;
         options.socket_mode = am->_socket_mode;
+        options.write_coalesce_us = am->_write_coalesce_us;
+        options.write_coalesce_bytes = am->_write_coalesce_bytes;
         options.bthread_tag = am->_bthread_tag;
         if (Socket::Create(options, &socket_id) != 0) {
             LOG(ERROR) << "Fail to create Socket";
@@ -113,6 +113,9 @@ private:
 
     // Choose to use a certain socket: 0 TCP, 1 RDMA
     SocketMode _socket_mode;
+    // See ServerOptions.write_coalesce_us and write_coalesce_bytes.
+    int32_t _write_coalesce_us;
+    int32_t _write_coalesce_bytes;
 
     // Acceptor belongs to this tag
     bthread_tag_t _bthread_tag;
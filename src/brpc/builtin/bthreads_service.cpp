@@ -17,6 +17,7 @@
 
 
 #include "bthread/bthread.h"
+#include "bthread/stack_arena.h"        // describe_stack_arenas
 #include "brpc/closure_guard.h"        // ClosureGuard
 #include "brpc/controller.h"           // Controller
 #include "brpc/builtin/common.h"
@@ -48,6 +49,8 @@ void BthreadsService::default_method(::google::protobuf::RpcController* cntl_bas
         os << "Use /bthreads/<bthread_id>\n";
         os << "To check all living bthread, use /bthreads/all\n";
 #endif // BRPC_BTHREAD_TRACER
+        os << '\n';
+        ::bthread::describe_stack_arenas(os);
     } else {
         bool enable_trace = false;
 #ifdef BRPC_BTHREAD_TRACER
@@ -390,6 +390,15 @@ bool SupportGzip(Controller* cntl) {
     return encodings->find("gzip") != std::string::npos;
 }
 
+bool SupportDeflate(Controller* cntl) {
+    const std::string* encodings =
+        cntl->http_request().GetHeader("Accept-Encoding");
+    if (encodings == nullptr) {
+        return false;
+    }
+    return encodings->find("deflate") != std::string::npos;
+}
+
 void Time2GMT(time_t t, char* buf, size_t size) {
     struct tm tm;
     gmtime_r(&t, &tm);
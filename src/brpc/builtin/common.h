@@ -122,6 +122,9 @@ const char* GetProgramChecksum();
 // True if the http requester support gzip compression.
 bool SupportGzip(Controller* cntl);
 
+// True if the http requester support deflate(zlib) compression.
+bool SupportDeflate(Controller* cntl);
+
 void Time2GMT(time_t t, char* buf, size_t size);
 
 template <typename T>
@@ -135,6 +135,7 @@ void ConnectionsService::PrintConnections(
             "<th>OutBytes/m</th>"
             "<th>Out/m</th>"
             "<th>Rtt/Var(ms)</th>"
+            "<th>ReadSize</th>"
             "<th>SocketId</th>"
             "</tr>\n";
     } else {
@@ -145,7 +146,7 @@ void ConnectionsService::PrintConnections(
         os << "SSL|Protocol    |fd   |"
             "InBytes/s|In/s  |InBytes/m |In/m    |"
             "OutBytes/s|Out/s |OutBytes/m|Out/m   |"
-            "Rtt/Var(ms)|SocketId\n";
+            "Rtt/Var(ms)|ReadSize|SocketId\n";
     }
 
     const char* const bar = (use_html ? "</td><td>" : "|");
@@ -191,7 +192,8 @@ void ConnectionsService::PrintConnections(
                << min_width("-", 6) << bar
                << min_width("-", 10) << bar
                << min_width("-", 8) << bar
-               << min_width("-", 11) << bar;
+               << min_width("-", 11) << bar
+               << min_width("-", 8) << bar;
         } else {
             {
                 SocketUniquePtr agent_sock;
@@ -308,7 +310,8 @@ void ConnectionsService::PrintConnections(
                << min_width(stat.out_num_messages_s, 6) << bar
                << min_width(stat.out_size_m, 10) << bar
                << min_width(stat.out_num_messages_m, 8) << bar
-               << min_width(rtt_display, 11) << bar;
+               << min_width(rtt_display, 11) << bar
+               << min_width(ptr->_avg_read_size, 8) << bar;
         }
 
         if (use_html) {
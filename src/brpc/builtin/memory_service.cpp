@@ -17,6 +17,7 @@
 
 #include "butil/time.h"
 #include "butil/logging.h"
+#include "butil/iobuf_block_allocator.h"
 #include "brpc/controller.h"           // Controller
 #include "brpc/closure_guard.h"        // ClosureGuard
 #include "brpc/builtin/memory_service.h"
@@ -59,6 +60,13 @@ static void get_tcmalloc_memory_info(butil::IOBuf& out) {
     os.move_to(out);
 }
 
+static void get_iobuf_memory_info(butil::IOBuf& out) {
+    butil::IOBufBuilder os;
+    os << "------------------------------------------------\n";
+    butil::iobuf::describe_block_allocator(os);
+    os.move_to(out);
+}
+
 static void get_jemalloc_memory_info(Controller* cntl) {
     const brpc::URI& uri = cntl->http_request().uri();
     cntl->http_response().set_content_type("text/plain");
@@ -66,6 +74,10 @@ static void get_jemalloc_memory_info(Controller* cntl) {
     const std::string* uri_opts = uri.GetQuery("opts");
     std::string opts = !uri_opts || uri_opts->empty() ? "Ja" : *uri_opts;
     cntl->response_attachment().append(StatsPrint(opts));
+    if (opts.find('J') == std::string::npos) {
+        // Not mixed with JSON output.
+        get_iobuf_memory_info(cntl->response_attachment());
+    }
 }
 
 void MemoryService::default_method(::google::protobuf::RpcController* cntl_base,
@@ -78,11 +90,14 @@ void MemoryService::default_method(::google::protobuf::RpcController* cntl_base,
     butil::IOBuf& resp = cntl->response_attachment();
 
     if (IsTCMallocEnabled()) {
-        butil::IOBufBuilder os;
+        get_iobuf_memory_info(resp);
         get_tcmalloc_memory_info(resp);
     } else if (HasJemalloc()) {
         // support ip:port/memory?opts=Ja
         get_jemalloc_memory_info(cntl);
+    } else if (butil::iobuf::is_hugepage_block_allocator_used()) {
+        get_iobuf_memory_info(resp);
+        resp.append("tcmalloc or jemalloc is not enabled\n");
     } else {
         resp.append("tcmalloc or jemalloc is not enabled");
         cntl->http_response().set_status_code(HTTP_STATUS_FORBIDDEN);
@@ -15,15 +15,20 @@
 // specific language governing permissions and limitations
 // under the License.
 
-
-#include <vector>
-#include <iomanip>
+#include <inttypes.h>                       // PRId64
+#include <stdio.h>                          // snprintf
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <gflags/gflags.h>
+#include "butil/iobuf.h"                    // butil::IOBufAppender
+#include "butil/strings/string_number_conversions.h"
 #include "brpc/controller.h"                // Controller
 #include "brpc/server.h"                    // Server
 #include "brpc/closure_guard.h"             // ClosureGuard
 #include "brpc/builtin/prometheus_metrics_service.h"
 #include "brpc/builtin/common.h"
+#include "brpc/policy/gzip_compress.h"      // GzipCompress
 #include "bvar/bvar.h"
 
 namespace bvar {
@@ -34,22 +39,32 @@ DECLARE_int32(bvar_max_dump_multi_dimension_metric_number);
 }
 
 namespace brpc {
+namespace policy {
+DECLARE_int32(http_body_compress_threshold);
+}
 
 // Defined in server.cpp
 extern const char* const g_server_info_prefix;
 
 // This is a class that convert bvar result to prometheus output.
-// Currently the output only includes gauge and summary for two
-// reasons:
+// Currently the output only includes gauge, summary and histogram for
+// following reasons:
 // 1) We cannot tell gauge and counter just from name and what's
 // more counter is just another gauge.
-// 2) Histogram and summary is equivalent except that histogram
-// calculates quantiles in the server side.
+// 2) LatencyRecorders are output as summaries which carry quantiles
+// calculated in the process.
+// 3) bvar::LogLinearHistogram (including latency histograms of
+// LatencyRecorders with -bvar_latency_histogram) are output as histograms
+// whose buckets are the non-empty log-linear buckets, so that quantiles can
+// be aggregated across instances in the server side.
+// The output is appended to an IOBufAppender directly rather than being
+// formatted by ostream or std::string, no memory is allocated for most
+// variables, which matters when there're hundreds of thousands of them.
 class PrometheusMetricsDumper : public bvar::Dumper {
 public:
-    explicit PrometheusMetricsDumper(butil::IOBufBuilder* os,
+    explicit PrometheusMetricsDumper(butil::IOBufAppender* app,
                                      const std::string& server_prefix)
-        : _os(os)
+        : _app(app)
         , _server_prefix(server_prefix) {
     }
 
@@ -64,6 +79,16 @@ private:
     bool DumpLatencyRecorderSuffix(const butil::StringPiece& name,
                                    const butil::StringPiece& desc);
 
+    // Return true iff desc is output by bvar::LogLinearHistogram.
+    bool DumpHistogram(const butil::StringPiece& name,
+                       const butil::StringPiece& desc);
+
+    // Append "# HELP <name>\n# TYPE <name> <type>\n".
+    void AppendComment(const butil::StringPiece& name,
+                       const butil::StringPiece& type);
+    void AppendInt(int64_t v) { _app->append_decimal(v); }
+    void AppendUint(uint64_t v);
+
     // 6 is the number of bvars in LatencyRecorder that indicating percentiles
     static const int NPERCENTILES = 6;
 
@@ -79,9 +104,11 @@ private:
                                                      const butil::StringPiece& desc);
 
 private:
-    butil::IOBufBuilder* _os;
+    butil::IOBufAppender* _app;
     const std::string _server_prefix;
     std::map<std::string, SummaryItems> _m;
+    // Reused by all histograms, which is too large to be put on stack.
+    std::unique_ptr<bvar::detail::HistogramBuckets> _histogram;
 };
 
 butil::StringPiece GetMetricsName(const std::string& name) {
@@ -90,6 +117,23 @@ butil::StringPiece GetMetricsName(const std::string& name) {
     return butil::StringPiece(name.data(), size);
 }
 
+void PrometheusMetricsDumper::AppendComment(const butil::StringPiece& name,
+                                            const butil::StringPiece& type) {
+    _app->append("# HELP ");
+    _app->append(name);
+    _app->append("\n# TYPE ");
+    _app->append(name);
+    _app->push_back(' ');
+    _app->append(type);
+    _app->push_back('\n');
+}
+
+void PrometheusMetricsDumper::AppendUint(uint64_t v) {
+    // append_decimal() takes long.
+    char buf[24];
+    _app->append(buf, snprintf(buf, sizeof(buf), "%" PRIu64, v));
+}
+
 bool PrometheusMetricsDumper::dump(const std::string& name,
                                    const butil::StringPiece& desc) {
     if (!desc.empty() && desc[0] == '"') {
@@ -101,12 +145,15 @@ bool PrometheusMetricsDumper::dump(const std::string& name,
         // Leave it to DumpLatencyRecorderSuffix to output Summary.
         return true;
     }
-
-    auto metrics_name = GetMetricsName(name);
-
-    *_os << "# HELP " << metrics_name << '\n'
-         << "# TYPE " << metrics_name << " gauge" << '\n'
-         << name << " " << desc << '\n';
+    const butil::StringPiece metrics_name = GetMetricsName(name);
+    if (DumpHistogram(metrics_name, desc)) {
+        return true;
+    }
+    AppendComment(metrics_name, "gauge");
+    _app->append(name);
+    _app->push_back(' ');
+    _app->append(desc);
+    _app->push_back('\n');
     return true;
 }
 
@@ -115,13 +162,15 @@ bool PrometheusMetricsDumper::dump_mvar(const std::string& name, const butil::St
         // there is no necessary to monitor string in prometheus
         return true;
     }
-    *_os << name << " " << desc << "\n";
+    _app->append(name);
+    _app->push_back(' ');
+    _app->append(desc);
+    _app->push_back('\n');
     return true;
 }
 
 bool PrometheusMetricsDumper::dump_comment(const std::string& name, const std::string& type) {
-    *_os << "# HELP " << name << '\n'
-         << "# TYPE " << name << " " << type << '\n';
+    AppendComment(name, type);
     return true;
 }
 
@@ -135,7 +184,6 @@ PrometheusMetricsDumper::ProcessLatencyRecorderSuffix(const butil::StringPiece&
         "_latency_999", "_latency_9999", "_max_latency"
     };
     CHECK(NPERCENTILES == arraysize(latency_names));
-    const std::string desc_str = desc.as_string();
     butil::StringPiece metric_name(name);
     for (int i = 0; i < NPERCENTILES; ++i) {
         if (!metric_name.ends_with(latency_names[i])) {
@@ -143,7 +191,7 @@ PrometheusMetricsDumper::ProcessLatencyRecorderSuffix(const butil::StringPiece&
         }
         metric_name.remove_suffix(latency_names[i].size());
         SummaryItems* si = &_m[metric_name.as_string()];
-        si->latency_percentiles[i] = desc_str;
+        si->latency_percentiles[i].assign(desc.data(), desc.size());
         if (i == NPERCENTILES - 1) {
             // '_max_latency' is the last suffix name that appear in the sorted bvar
             // list, which means all related percentiles have been gathered and we are
@@ -156,13 +204,15 @@ PrometheusMetricsDumper::ProcessLatencyRecorderSuffix(const butil::StringPiece&
     if (metric_name.ends_with("_latency")) {
         metric_name.remove_suffix(8);
         SummaryItems* si = &_m[metric_name.as_string()];
-        si->latency_avg = strtoll(desc_str.data(), nullptr, 10);
+        si->latency_avg = 0;
+        butil::StringToInt64(desc, &si->latency_avg);
         return si;
     }
     if (metric_name.ends_with("_count")) {
         metric_name.remove_suffix(6);
         SummaryItems* si = &_m[metric_name.as_string()];
-        si->count = strtoll(desc_str.data(), nullptr, 10);
+        si->count = 0;
+        butil::StringToInt64(desc, &si->count);
         return si;
     }
     return nullptr;
@@ -181,30 +231,92 @@ bool PrometheusMetricsDumper::DumpLatencyRecorderSuffix(
     if (!si->IsComplete()) {
         return true;
     }
-    *_os << "# HELP " << si->metric_name << '\n'
-         << "# TYPE " << si->metric_name << " summary\n"
-         << si->metric_name << "{quantile=\""
-         << (double)(bvar::FLAGS_bvar_latency_p1) / 100 << "\"} "
-         << si->latency_percentiles[0] << '\n'
-         << si->metric_name << "{quantile=\""
-         << (double)(bvar::FLAGS_bvar_latency_p2) / 100 << "\"} "
-         << si->latency_percentiles[1] << '\n'
-         << si->metric_name << "{quantile=\""
-         << (double)(bvar::FLAGS_bvar_latency_p3) / 100 << "\"} "
-         << si->latency_percentiles[2] << '\n'
-         << si->metric_name << "{quantile=\"0.999\"} "
-         << si->latency_percentiles[3] << '\n'
-         << si->metric_name << "{quantile=\"0.9999\"} "
-         << si->latency_percentiles[4] << '\n'
-         << si->metric_name << "{quantile=\"1\"} "
-         << si->latency_percentiles[5] << '\n'
-         << si->metric_name << "{quantile=\"avg\"} "
-         << si->latency_avg << '\n'
-         << si->metric_name << "_sum "
-         // There is no sum of latency in bvar output, just use
-         // average * count as approximation
-         << si->latency_avg * si->count << '\n'
-         << si->metric_name << "_count " << si->count << '\n';
+    const int quantiles[] = {
+        bvar::FLAGS_bvar_latency_p1, bvar::FLAGS_bvar_latency_p2,
+        bvar::FLAGS_bvar_latency_p3
+    };
+    const butil::StringPiece metric_name(si->metric_name);
+    AppendComment(metric_name, "summary");
+    char buf[32];
+    for (size_t i = 0; i < arraysize(quantiles); ++i) {
+        _app->append(metric_name);
+        _app->append(buf, snprintf(buf, sizeof(buf), "{quantile=\"%g\"} ",
+                                   quantiles[i] / 100.0));
+        _app->append(si->latency_percentiles[i]);
+        _app->push_back('\n');
+    }
+    _app->append(metric_name);
+    _app->append("{quantile=\"0.999\"} ");
+    _app->append(si->latency_percentiles[3]);
+    _app->push_back('\n');
+    _app->append(metric_name);
+    _app->append("{quantile=\"0.9999\"} ");
+    _app->append(si->latency_percentiles[4]);
+    _app->push_back('\n');
+    _app->append(metric_name);
+    _app->append("{quantile=\"1\"} ");
+    _app->append(si->latency_percentiles[5]);
+    _app->push_back('\n');
+    _app->append(metric_name);
+    _app->append("{quantile=\"avg\"} ");
+    AppendInt(si->latency_avg);
+    _app->push_back('\n');
+    _app->append(metric_name);
+    // There is no sum of latency in bvar output, just use
+    // average * count as approximation
+    _app->append("_sum ");
+    AppendInt(si->latency_avg * si->count);
+    _app->push_back('\n');
+    _app->append(metric_name);
+    _app->append("_count ");
+    AppendInt(si->count);
+    _app->push_back('\n');
+    return true;
+}
+
+bool PrometheusMetricsDumper::DumpHistogram(const butil::StringPiece& name,
+                                            const butil::StringPiece& desc) {
+    if (!desc.starts_with("{\"count\":")) {
+        return false;
+    }
+    if (_histogram == nullptr) {
+        _histogram.reset(new bvar::detail::HistogramBuckets);
+    }
+    bvar::detail::HistogramBuckets* b = _histogram.get();
+    if (b->parse(desc) != 0) {
+        return false;
+    }
+    AppendComment(name, "histogram");
+    // Buckets of prometheus are cumulative and `le' is inclusive, which is
+    // just the upper bound of a log-linear bucket.
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < bvar::detail::HistogramBuckets::NBUCKET; ++i) {
+        if (b->counts[i] == 0) {
+            continue;
+        }
+        cumulative += b->counts[i];
+        _app->append(name);
+        _app->append("_bucket{le=\"");
+        AppendInt(bvar::detail::HistogramBuckets::bucket_upper_bound(i));
+        _app->append("\"} ");
+        AppendUint(cumulative);
+        _app->push_back('\n');
+    }
+    // Counters are not read atomically as a whole, make sure that the last
+    // bucket is not less than the previous ones.
+    const uint64_t count = std::max(cumulative, b->count);
+    _app->append(name);
+    _app->append("_bucket{le=\"+Inf\"} ");
+    AppendUint(count);
+    _app->push_back('\n');
+    _app->append(name);
+    _app->append("_sum ");
+    AppendInt(b->sum);
+    _app->push_back('\n');
+    _app->append(name);
+    _app->append("_count ");
+    AppendUint(count);
+    _app->push_back('\n');
     return true;
 }
 
@@ -215,29 +327,53 @@ void PrometheusMetricsService::default_method(::google::protobuf::RpcController*
     ClosureGuard done_guard(done);
     Controller *cntl = static_cast<Controller*>(cntl_base);
     cntl->http_response().set_content_type("text/plain");
-    if (DumpPrometheusMetricsToIOBuf(&cntl->response_attachment()) != 0) {
+    butil::IOBuf buf;
+    if (DumpPrometheusMetricsToIOBuf(&buf) != 0) {
         cntl->SetFailed("Fail to dump metrics");
         return;
     }
+    // Scraped metrics are highly compressible texts. Compress them here
+    // rather than by the http protocol which knows nothing about deflate.
+    const char* encoding = nullptr;
+    policy::GzipCompressOptions options;
+    if (buf.size() >= (size_t)policy::FLAGS_http_body_compress_threshold) {
+        if (SupportGzip(cntl)) {
+            encoding = "gzip";
+            options.format = google::protobuf::io::GzipOutputStream::GZIP;
+        } else if (SupportDeflate(cntl)) {
+            encoding = "deflate";
+            options.format = google::protobuf::io::GzipOutputStream::ZLIB;
+        }
+    }
+    if (encoding != nullptr) {
+        butil::IOBuf compressed;
+        if (policy::GzipCompress(buf, &compressed, &options)) {
+            cntl->http_response().SetHeader("Content-Encoding", encoding);
+            cntl->response_attachment().swap(compressed);
+            return;
+        }
+        LOG(ERROR) << "Fail to compress metrics with " << encoding
+                   << ", send them uncompressed";
+    }
+    cntl->response_attachment().swap(buf);
 }
 
 int DumpPrometheusMetricsToIOBuf(butil::IOBuf* output) {
-    butil::IOBufBuilder os;
-    PrometheusMetricsDumper dumper(&os, g_server_info_prefix);
+    butil::IOBufAppender appender;
+    PrometheusMetricsDumper dumper(&appender, g_server_info_prefix);
     const int ndump = bvar::Variable::dump_exposed(&dumper, nullptr);
     if (ndump < 0) {
         return -1;
     }
-    os.move_to(*output);
 
     if (bvar::FLAGS_bvar_max_dump_multi_dimension_metric_number > 0) {
-        PrometheusMetricsDumper dumper_md(&os, g_server_info_prefix);
+        PrometheusMetricsDumper dumper_md(&appender, g_server_info_prefix);
         const int ndump_md = bvar::MVariableBase::dump_exposed(&dumper_md, nullptr);
         if (ndump_md < 0) {
             return -1;
         }
-        output->append(butil::IOBuf::Movable(os.buf()));
     }
+    appender.move_to(*output);
     return 0;
 }
 
@@ -64,6 +64,8 @@ ChannelOptions::ChannelOptions()
     , succeed_without_server(true)
     , log_succeed_without_server(true)
     , socket_mode(SOCKET_MODE_TCP)
+    , write_coalesce_us(0)
+    , write_coalesce_bytes(0)
     , auth(nullptr)
     , backup_request_policy(nullptr)
     , retry_policy(nullptr)
@@ -83,7 +85,8 @@ static ChannelSignature ComputeChannelSignature(const ChannelOptions& opt) {
         opt.client_host.empty() &&
         opt.device_name.empty() &&
         opt.connection_group.empty() &&
-        opt.hc_option.health_check_path.empty()) {
+        opt.hc_option.health_check_path.empty() &&
+        opt.write_coalesce_us <= 0) {
         // Returning zeroized result by default is more intuitive for users.
         return ChannelSignature();
     }
@@ -139,6 +142,16 @@ static ChannelSignature ComputeChannelSignature(const ChannelOptions& opt) {
         }
         if (opt.socket_mode == SOCKET_MODE_RDMA) {
             buf.append("|rdma");
+        } else if (opt.socket_mode == SOCKET_MODE_IO_URING) {
+            buf.append("|io_uring");
+        } else if (opt.socket_mode == SOCKET_MODE_SHM) {
+            buf.append("|shm");
+        }
+        if (opt.write_coalesce_us > 0) {
+            buf.append("|wcus=");
+            buf.append(std::to_string(opt.write_coalesce_us));
+            buf.append("|wcb=");
+            buf.append(std::to_string(opt.write_coalesce_bytes));
         }
         butil::MurmurHash3_x64_128_Update(&mm_ctx, buf.data(), buf.size());
         buf.clear();
@@ -393,6 +406,8 @@ int Channel::InitSingle(const butil::EndPoint& server_addr_and_port,
     opt.local_side = client_endpoint;
     opt.initial_ssl_ctx = ssl_ctx;
     opt.socket_mode = _options.socket_mode;
+    opt.write_coalesce_us = _options.write_coalesce_us;
+    opt.write_coalesce_bytes = _options.write_coalesce_bytes;
     opt.hc_option = _options.hc_option;
     opt.device_name = _options.device_name;
     if (SocketMapInsert(SocketMapKey(server_addr_and_port, sig),
@@ -435,6 +450,8 @@ int Channel::Init(const char* ns_url,
     ns_opt.succeed_without_server = _options.succeed_without_server;
     ns_opt.log_succeed_without_server = _options.log_succeed_without_server;
     ns_opt.socket_option.socket_mode = _options.socket_mode;
+    ns_opt.socket_option.write_coalesce_us = _options.write_coalesce_us;
+    ns_opt.socket_option.write_coalesce_bytes = _options.write_coalesce_bytes;
     ns_opt.channel_signature = ComputeChannelSignature(_options);
     ns_opt.socket_option.hc_option =  _options.hc_option;
     ns_opt.socket_option.local_side = client_endpoint;
@@ -106,10 +106,26 @@ struct ChannelOptions {
     const ChannelSSLOptions& ssl_options() const { return *_ssl_options; }
     ChannelSSLOptions* mutable_ssl_options();
 
-    // Let this channel Choose to use a certain socket: 0 SOCKET_MODE_TCP, 1 SOCKET_MODE_RDMA.
+    // Let this channel Choose to use a certain socket: 0 SOCKET_MODE_TCP, 1 SOCKET_MODE_RDMA,
+    // 3 SOCKET_MODE_IO_URING (requires compiling with BRPC_WITH_IO_URING),
+    // 4 SOCKET_MODE_SHM (Linux only, falls back to TCP if the server is not
+    // on the same host or not in SOCKET_MODE_SHM).
     // Default: SOCKET_MODE_TCP
     SocketMode socket_mode;
 
+    // If positive, connections of this channel wait up to so many
+    // microseconds before writing to merge concurrent requests into fewer
+    // writes, which saves syscalls of pipelined or highly concurrent
+    // callers at the cost of latency.
+    // Default: 0 (write immediately)
+    int32_t write_coalesce_us;
+
+    // [Only effective when write_coalesce_us is positive]
+    // Write without waiting for the rest of `write_coalesce_us' once so
+    // many bytes are queued. Non-positive means no limit.
+    // Default: 0
+    int32_t write_coalesce_bytes;
+
     // Turn on authentication for this channel if `auth' is not nullptr.
     // Note `auth' will not be deleted by channel and must remain valid when
     // the channel is being used.
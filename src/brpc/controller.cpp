@@ -944,6 +944,11 @@ void Controller::OnVersionedRPCReturned(const CompletionInfo& info,
             if (backoff_time_us > 0 &&
                 backoff_time_us < _deadline_us - butil::gettimeofday_us()) {
                 // No need to do retry backoff when the backoff time is longer than the remaining rpc time.
+                if (g) {
+                    // A stackless task still runs on the stack of the main
+                    // task and would be taken as a pthread task otherwise.
+                    g->promote_stackless_task();
+                }
                 if (retry_policy->CanRetryBackoffInPthread() ||
                     (g && !g->is_current_pthread_task())) {
                     bthread_usleep(backoff_time_us);
@@ -22,9 +22,12 @@
 #include "butil/logging.h"                            // LOG
 #include "butil/third_party/murmurhash3/murmurhash3.h"// fmix32
 #include "bvar/latency_recorder.h"                    // bvar::LatencyRecorder
+#include "bvar/reducer.h"                             // bvar::Adder
 #include "bthread/bthread.h"                          // bthread_start_background
+#include "bthread/unstable.h"                         // bthread_flush
 #include "bthread/task_group.h"                        // TaskGroup::address_meta
 #include "brpc/event_dispatcher.h"
+#include "brpc/reloadable_flags.h"
 
 DECLARE_int32(task_group_ntags);
 
@@ -36,12 +39,24 @@ DEFINE_bool(event_dispatcher_edisp_unsched, false,
 
 DEFINE_bool(usercode_in_pthread, false, 
             "Call user's callback in pthreads, use bthreads otherwise");
+DEFINE_bool(event_dispatcher_batch_input, false,
+            "Start bthreads for all sockets readable in one round of "
+            "epoll_wait without signaling idle workers and wake them up once "
+            "after the round, instead of switching to each bthread in place");
+BRPC_VALIDATE_GFLAG(event_dispatcher_batch_input, PassValidate);
+DEFINE_int32(event_dispatcher_busy_poll_us, 0,
+             "Max microseconds that an event dispatcher polls epoll without "
+             "blocking before sleeping in epoll_wait. The actual window adapts "
+             "to how often polling finds events. <=0 disables busy polling");
+BRPC_VALIDATE_GFLAG(event_dispatcher_busy_poll_us, PassValidate);
 DEFINE_bool(usercode_in_coroutine, false,
             "User's callback are run in coroutine, no bthread or pthread blocking call");
 
 static EventDispatcher* g_edisp = nullptr;
 static bvar::LatencyRecorder* g_edisp_read_lantency = nullptr;
 static bvar::LatencyRecorder* g_edisp_write_lantency = nullptr;
+static bvar::Adder<int64_t>* g_edisp_busy_poll_hit = nullptr;
+static bvar::Adder<int64_t>* g_edisp_busy_poll_miss = nullptr;
 static pthread_once_t g_edisp_once = PTHREAD_ONCE_INIT;
 
 bool EventDispatcherUnsched() {
@@ -60,6 +75,8 @@ static void StopAndJoinGlobalDispatchers() {
 void InitializeGlobalDispatchers() {
     g_edisp_read_lantency = new bvar::LatencyRecorder("event_dispatcher_read");
     g_edisp_write_lantency = new bvar::LatencyRecorder("event_dispatcher_write");
+    g_edisp_busy_poll_hit = new bvar::Adder<int64_t>("event_dispatcher_busy_poll_hit");
+    g_edisp_busy_poll_miss = new bvar::Adder<int64_t>("event_dispatcher_busy_poll_miss");
 
     g_edisp = new EventDispatcher[FLAGS_task_group_ntags * FLAGS_event_dispatcher_num];
     for (int i = 0; i < FLAGS_task_group_ntags; ++i) {
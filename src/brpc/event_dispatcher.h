@@ -28,6 +28,8 @@
 namespace brpc {
 
 DECLARE_bool(event_dispatcher_edisp_unsched);
+DECLARE_bool(event_dispatcher_batch_input);
+DECLARE_int32(event_dispatcher_busy_poll_us);
 
 // Unique identifier of a IOEventData.
 // Users shall store EventDataId instead of EventData and call EventData::Address()
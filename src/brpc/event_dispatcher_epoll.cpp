@@ -201,6 +201,9 @@ void* EventDispatcher::RunThis(void* arg) {
 }
 
 void EventDispatcher::Run() {
+    // Current window of busy polling, grows when polling finds events and
+    // shrinks when it does not, bounded by FLAGS_event_dispatcher_busy_poll_us.
+    int64_t poll_window_us = 0;
     while (!_stop) {
         epoll_event e[32];
 #ifdef BRPC_ADDITIONAL_EPOLL
@@ -210,7 +213,35 @@ void EventDispatcher::Run() {
             n = epoll_wait(_event_dispatcher_fd, e, ARRAY_SIZE(e), -1);
         }
 #else
-        const int n = epoll_wait(_event_dispatcher_fd, e, ARRAY_SIZE(e), -1);
+        int n = 0;
+        const int64_t max_poll_us = FLAGS_event_dispatcher_busy_poll_us;
+        if (max_poll_us > 0 && poll_window_us > 0) {
+            poll_window_us = std::min(poll_window_us, max_poll_us);
+            const int64_t deadline_us =
+                butil::cpuwide_time_us() + poll_window_us;
+            do {
+                n = epoll_wait(_event_dispatcher_fd, e, ARRAY_SIZE(e), 0);
+            } while (n == 0 && !_stop && butil::cpuwide_time_us() < deadline_us);
+            if (n > 0) {
+                *g_edisp_busy_poll_hit << 1;
+                poll_window_us = std::min(poll_window_us * 2, max_poll_us);
+            } else if (n == 0) {
+                *g_edisp_busy_poll_miss << 1;
+                poll_window_us /= 2;
+            }
+        }
+        if (n == 0) {
+            const int64_t begin_us = max_poll_us > 0 ? butil::cpuwide_time_us() : 0;
+            n = epoll_wait(_event_dispatcher_fd, e, ARRAY_SIZE(e), -1);
+            if (max_poll_us > 0 && n > 0) {
+                // Start polling again if the events would have been caught
+                // by polling, namely they arrived soon.
+                const int64_t waited_us = butil::cpuwide_time_us() - begin_us;
+                if (waited_us <= max_poll_us) {
+                    poll_window_us = std::max(poll_window_us * 2, waited_us + 1);
+                }
+            }
+        }
 #endif
         if (_stop) {
             // epoll_ctl/epoll_wait should have some sort of memory fencing
@@ -226,6 +257,11 @@ void EventDispatcher::Run() {
             PLOG(FATAL) << "Fail to epoll_wait epfd=" << _event_dispatcher_fd;
             break;
         }
+        // Bthreads of the input events are queued without signaling and
+        // workers are woken up once, see Transport::ProcessEvent.
+        const bool batch_input = FLAGS_event_dispatcher_batch_input;
+        const bthread_attr_t input_attr =
+            batch_input ? (_thread_attr | BTHREAD_NOSIGNAL) : _thread_attr;
         for (int i = 0; i < n; ++i) {
             if (e[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)
 #ifdef BRPC_SOCKET_HAS_EOF
@@ -234,10 +270,13 @@ void EventDispatcher::Run() {
                 ) {
                 int64_t start_ns = butil::cpuwide_time_ns();
                 // We don't care about the return value.
-                CallInputEventCallback(e[i].data.u64, e[i].events, _thread_attr);
+                CallInputEventCallback(e[i].data.u64, e[i].events, input_attr);
                 (*g_edisp_read_lantency) << (butil::cpuwide_time_ns() - start_ns);
             }
         }
+        if (batch_input) {
+            bthread_flush();
+        }
         for (int i = 0; i < n; ++i) {
             if (e[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
                 int64_t start_ns = butil::cpuwide_time_ns();
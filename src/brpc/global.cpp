@@ -70,6 +70,7 @@
 // Protocols
 #include "brpc/protocol.h"
 #include "brpc/policy/rdma_handshake_protocol.h"
+#include "brpc/policy/shm_handshake_protocol.h"
 #include "brpc/policy/baidu_rpc_protocol.h"
 #include "brpc/policy/http_rpc_protocol.h"
 #include "brpc/policy/http2_rpc_protocol.h"
@@ -101,6 +102,7 @@
 #include "brpc/socket_map.h"          // SocketMapList
 #include "brpc/server.h"
 #include "brpc/trackme.h"             // TrackMe
+#include "brpc/metrics_pusher.h"      // PushMetricsPeriodically
 #include "brpc/details/usercode_backup_pool.h"
 #if defined(OS_LINUX)
 #include <malloc.h>                   // malloc_trim
@@ -276,6 +278,8 @@ static void* GlobalUpdate(void*) {
 
         TrackMe();
 
+        PushMetricsPeriodically();
+
         if (!IsDummyServerRunning()
             && g_running_server_count.load(butil::memory_order_relaxed) == 0
             && fw.check_and_consume() > 0) {
@@ -444,6 +448,15 @@ static void GlobalInitializeOrDieImpl() {
         exit(1);
     }
 
+    Protocol shm_handshake_protocol = {
+        ParseShmHandshake, nullptr, nullptr,
+        ProcessShmHandshake, nullptr,
+        nullptr, nullptr, nullptr,
+        CONNECTION_TYPE_ALL, "shm_handshake" };
+    if (RegisterProtocol(PROTOCOL_SHM_HANDSHAKE, shm_handshake_protocol) != 0) {
+        exit(1);
+    }
+
     Protocol baidu_protocol = { ParseRpcMessage,
                                 SerializeRpcRequest, PackRpcRequest,
                                 ProcessRpcRequest, ProcessRpcResponse,
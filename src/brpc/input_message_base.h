@@ -48,6 +48,18 @@ public:
     int64_t received_us() const { return _received_us; }
     int64_t base_real_us() const { return _base_real_us; }
 
+    // [Internal] Timeout of processing this message given by the peer, set
+    // by parsers so that the bthread processing the message is started with
+    // the deadline, see -bthread_deadline_scheduling. 0 means no timeout.
+    void set_process_timeout_ms(int32_t timeout_ms)
+    { _process_timeout_ms = timeout_ms; }
+    // Absolute deadline (butil::gettimeofday_us()) of processing this
+    // message, 0 if there's no timeout.
+    int64_t process_deadline_us() const {
+        return _process_timeout_ms <= 0 ? 0 :
+            _base_real_us + _received_us + _process_timeout_ms * 1000L;
+    }
+
 protected:
     virtual ~InputMessageBase();
 
@@ -61,6 +73,7 @@ friend class Transport;
     SocketUniquePtr _socket;
     void (*_process)(InputMessageBase* msg);
     const void* _arg;
+    int32_t _process_timeout_ms{0};
 };
 
 } // namespace brpc
@@ -76,10 +76,43 @@ DECLARE_bool(usercode_in_pthread);
 DECLARE_bool(usercode_in_coroutine);
 DECLARE_uint64(max_body_size);
 
+extern SocketVarsCollector* g_vars;
+
 const size_t MSG_SIZE_WINDOW = 10;  // Take last so many message into stat.
+const size_t READ_SIZE_WINDOW = 8;  // Decay of bytes read from each event.
 const size_t MIN_ONCE_READ = 4096;
 const size_t MAX_ONCE_READ = 524288;
 
+size_t InputMessenger::OnceReadSize(const Socket* m) {
+    size_t once_read = 0;
+    if (m->_avg_read_size != 0) {
+        // Leave some room to read a larger event in one call.
+        once_read = m->_avg_read_size + m->_avg_read_size / 2;
+    } else {
+        once_read = m->_avg_msg_size * 16;
+    }
+    if (once_read < MIN_ONCE_READ) {
+        once_read = MIN_ONCE_READ;
+    } else if (once_read > MAX_ONCE_READ) {
+        once_read = MAX_ONCE_READ;
+    }
+    return once_read;
+}
+
+void InputMessenger::UpdateReadSize(Socket* m, size_t event_bytes) {
+    g_vars->read_bytes_per_event << event_bytes;
+    g_vars->read_bytes_per_event_histogram << event_bytes;
+    // Keep the estimate far from overflowing.
+    event_bytes = std::min(event_bytes, MAX_ONCE_READ * 2);
+    const size_t old_avg = m->_avg_read_size;
+    if (old_avg != 0) {
+        m->_avg_read_size = (old_avg * (READ_SIZE_WINDOW - 1) + event_bytes)
+            / READ_SIZE_WINDOW;
+    } else {
+        m->_avg_read_size = event_bytes;
+    }
+}
+
 ParseResult InputMessenger::CutInputMessage(
         Socket* m, size_t* index, bool read_eof) {
     const int preferred = m->preferred_index();
@@ -329,18 +362,13 @@ void InputMessenger::OnNewMessages(Socket* m) {
     // OK in most cases.
     InputMessageClosure last_msg;
     bool read_eof = false;
+    // Bytes read from current event, and bytes to read next time.
+    size_t event_bytes = 0;
+    size_t once_read = OnceReadSize(m);
     while (!read_eof) {
         const int64_t received_us = butil::cpuwide_time_us();
         const int64_t base_realtime = butil::gettimeofday_us() - received_us;
 
-        // Calculate bytes to be read.
-        size_t once_read = m->_avg_msg_size * 16;
-        if (once_read < MIN_ONCE_READ) {
-            once_read = MIN_ONCE_READ;
-        } else if (once_read > MAX_ONCE_READ) {
-            once_read = MAX_ONCE_READ;
-        }
-
         // Read.
         const ssize_t nr = m->DoRead(once_read);
         if (nr <= 0) {
@@ -359,11 +387,25 @@ void InputMessenger::OnNewMessages(Socket* m) {
                 m->SetFailed(saved_errno, "Fail to read from %s: %s",
                              m->description().c_str(), berror(saved_errno));
                 return;
-            } else if (!m->MoreReadEvents(&progress)) {
-                return;
-            } else { // new events during processing
+            } else {
+                // All data of the event is read.
+                if (event_bytes != 0) {
+                    UpdateReadSize(m, event_bytes);
+                    event_bytes = 0;
+                    once_read = OnceReadSize(m);
+                }
+                if (!m->MoreReadEvents(&progress)) {
+                    return;
+                }
+                // new events during processing
                 continue;
             }
+        } else {
+            event_bytes += nr;
+            if ((size_t)nr >= once_read && once_read < MAX_ONCE_READ) {
+                // More data than expected, read more in next call.
+                once_read = std::min(once_read * 2, MAX_ONCE_READ);
+            }
         }
 
         if (messenger->ProcessNewMessage(m, nr, read_eof, received_us,
@@ -551,6 +593,8 @@ void InputMessageBase::Destroy() {
         _socket->CheckEOF();
         _socket.reset();
     }
+    // Messages are pooled by subclasses.
+    _process_timeout_ms = 0;
     DestroyImpl();
     // This object may be destroyed, don't touch fields anymore.
 }
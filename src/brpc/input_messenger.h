@@ -32,8 +32,13 @@ class RdmaEndpoint;
 namespace ubring {
 class UBShmEndpoint;
 }
+namespace shm {
+class ShmEndpoint;
+}
 class TcpTransport;
 class RdmaTransport;
+class IoUringTransport;
+class ShmTransport;
 struct InputMessageHandler {
     // The callback to cut a message from `source'.
     // Returned message will be passed to process_request or process_response
@@ -97,6 +102,9 @@ class InputMessenger : public SocketUser {
 friend class Socket;
 friend class TcpTransport;
 friend class RdmaTransport;
+friend class IoUringTransport;
+friend class ShmTransport;
+friend class shm::ShmEndpoint;
 friend class rdma::RdmaEndpoint;
 friend class ubring::UBShmEndpoint;
 public:
@@ -148,6 +156,12 @@ private:
             const uint64_t received_us, const uint64_t base_realtime,
             InputMessageClosure& last_msg);
 
+    // Bytes to read from `m' at the beginning of an input event, estimated
+    // from bytes read from previous events.
+    static size_t OnceReadSize(const Socket* m);
+    // Update the estimate with `event_bytes' read from an input event.
+    static void UpdateReadSize(Socket* m, size_t event_bytes);
+
     // User-supplied scissors and handlers.
     // the index of handler is exactly the same as the protocol
     InputMessageHandler* _handlers;
@@ -0,0 +1,632 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#if BRPC_WITH_IO_URING
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <gflags/gflags.h>
+#include "butil/logging.h"
+#include "bthread/bthread.h"
+#include "bthread/unstable.h"
+#include "bvar/bvar.h"
+#include "brpc/reloadable_flags.h"
+#include "brpc/io_uring_transport.h"
+#include "brpc/io_uring/io_uring_context.h"
+
+namespace brpc {
+namespace iouring {
+
+DEFINE_int32(io_uring_num_rings, 1,
+             "Number of io_uring instances shared by sockets in "
+             "SOCKET_MODE_IO_URING");
+DEFINE_int32(io_uring_queue_depth, 1024,
+             "Number of submission queue entries of each io_uring");
+DEFINE_int32(io_uring_recv_buffer_count, 4096,
+             "Number of provided buffers of each io_uring, must be a power "
+             "of 2 not greater than 32768");
+DEFINE_int32(io_uring_recv_buffer_size, 8192,
+             "Size of each provided buffer for multishot recv");
+DEFINE_bool(io_uring_sqpoll, false,
+            "Let a kernel thread poll submission queues so that most "
+            "submissions need no syscall");
+DEFINE_int32(io_uring_sqpoll_idle_ms, 10,
+             "Milliseconds before the polling kernel thread goes to sleep");
+DEFINE_int32(io_uring_submit_retries, 3,
+             "Times of yielding to wait for room in the submission queue "
+             "before a send fails with EAGAIN and is retried by the writer");
+
+// Max number of iovecs of one SENDMSG
+static const size_t MAX_SEND_IOV = 256;
+
+static bvar::Adder<int64_t> g_io_uring_enter("io_uring_enter_count");
+static bvar::Adder<int64_t> g_io_uring_cqe("io_uring_cqe_count");
+static bvar::Adder<int64_t> g_io_uring_recv_enobufs("io_uring_recv_enobufs_count");
+static bvar::Adder<int64_t> g_io_uring_recv_deferred("io_uring_recv_deferred_count");
+
+static IoUringContext* g_contexts = nullptr;
+static int g_ncontext = 0;
+static pthread_once_t g_init_once = PTHREAD_ONCE_INIT;
+static bool g_io_uring_available = false;
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, nullptr, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode,
+                                 const void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+inline unsigned LoadAcquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+inline void StoreRelease(unsigned* p, unsigned v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+IoUringContext::IoUringContext()
+    : _index(-1)
+    , _ring_fd(-1)
+    , _event_fd(-1)
+    , _event_socket_id(INVALID_SOCKET_ID)
+    , _sq_ring_ptr(nullptr)
+    , _sq_ring_size(0)
+    , _cq_ring_ptr(nullptr)
+    , _cq_ring_size(0)
+    , _sqes(nullptr)
+    , _sqes_size(0)
+    , _sq_head(nullptr)
+    , _sq_tail(nullptr)
+    , _sq_flags(nullptr)
+    , _sq_array(nullptr)
+    , _sq_mask(0)
+    , _sq_entries(0)
+    , _sq_local_tail(0)
+    , _cq_head(nullptr)
+    , _cq_tail(nullptr)
+    , _cq_mask(0)
+    , _cqes(nullptr)
+    , _sqpoll(false)
+    , _buf_ring(nullptr)
+    , _buf_ring_size(0)
+    , _buf_local_tail(0)
+    , _buf_base(nullptr)
+    , _buf_size(0)
+    , _buf_count(0)
+    , _nfree_buf(0) {
+}
+
+IoUringContext::~IoUringContext() {
+    // Contexts live until the process exits, the ring is closed along
+    // with the process so that in-flight requests never touch freed memory.
+}
+
+int IoUringContext::SetupRing() {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP;
+    if (FLAGS_io_uring_sqpoll) {
+        p.flags |= IORING_SETUP_SQPOLL;
+        p.sq_thread_idle = FLAGS_io_uring_sqpoll_idle_ms;
+    }
+    _ring_fd = sys_io_uring_setup(FLAGS_io_uring_queue_depth, &p);
+    if (_ring_fd < 0) {
+        PLOG(WARNING) << "Fail to io_uring_setup";
+        return -1;
+    }
+    if (!(p.features & IORING_FEAT_NODROP)) {
+        LOG(WARNING) << "io_uring of this kernel may drop completions";
+        return -1;
+    }
+    _sqpoll = FLAGS_io_uring_sqpoll;
+
+    _sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap) {
+        _sq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+        _cq_ring_size = _sq_ring_size;
+    }
+    _sq_ring_ptr = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (_sq_ring_ptr == MAP_FAILED) {
+        PLOG(WARNING) << "Fail to mmap SQ ring";
+        return -1;
+    }
+    if (single_mmap) {
+        _cq_ring_ptr = _sq_ring_ptr;
+    } else {
+        _cq_ring_ptr = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (_cq_ring_ptr == MAP_FAILED) {
+            PLOG(WARNING) << "Fail to mmap CQ ring";
+            return -1;
+        }
+    }
+    _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+    _sqes = (io_uring_sqe*)mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        PLOG(WARNING) << "Fail to mmap SQEs";
+        return -1;
+    }
+
+    char* sq = (char*)_sq_ring_ptr;
+    _sq_head = (unsigned*)(sq + p.sq_off.head);
+    _sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    _sq_flags = (unsigned*)(sq + p.sq_off.flags);
+    _sq_array = (unsigned*)(sq + p.sq_off.array);
+    _sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    _sq_entries = *(unsigned*)(sq + p.sq_off.ring_entries);
+    _sq_local_tail = *_sq_tail;
+
+    char* cq = (char*)_cq_ring_ptr;
+    _cq_head = (unsigned*)(cq + p.cq_off.head);
+    _cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    _cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    _cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+int IoUringContext::SetupBufferRing() {
+    _buf_count = FLAGS_io_uring_recv_buffer_count;
+    _buf_size = FLAGS_io_uring_recv_buffer_size;
+    if (_buf_count == 0 || _buf_count > 32768 ||
+        (_buf_count & (_buf_count - 1)) != 0) {
+        LOG(ERROR) << "Invalid io_uring_recv_buffer_count=" << _buf_count;
+        return -1;
+    }
+    if (_buf_size == 0) {
+        LOG(ERROR) << "Invalid io_uring_recv_buffer_size=" << _buf_size;
+        return -1;
+    }
+    _buf_ring_size = _buf_count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, _buf_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        PLOG(WARNING) << "Fail to allocate buffer ring";
+        return -1;
+    }
+    _buf_ring = (io_uring_buf*)ring;
+    void* base = mmap(nullptr, _buf_count * _buf_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        PLOG(WARNING) << "Fail to allocate " << _buf_count * _buf_size
+                      << " bytes for provided buffers";
+        return -1;
+    }
+    _buf_base = (char*)base;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)_buf_ring;
+    reg.ring_entries = _buf_count;
+    reg.bgid = 0;
+    if (sys_io_uring_register(_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        PLOG(WARNING) << "Fail to register provided buffer ring";
+        return -1;
+    }
+    BAIDU_SCOPED_LOCK(_buf_mutex);
+    for (unsigned bid = 0; bid < _buf_count; ++bid) {
+        io_uring_buf* b = &_buf_ring[_buf_local_tail & (_buf_count - 1)];
+        b->addr = (uint64_t)(_buf_base + bid * _buf_size);
+        b->len = _buf_size;
+        b->bid = bid;
+        ++_buf_local_tail;
+    }
+    // The tail of the ring overlaps `resv' of the first entry.
+    __atomic_store_n(&_buf_ring[0].resv, _buf_local_tail, __ATOMIC_RELEASE);
+    _nfree_buf.store(_buf_count, butil::memory_order_relaxed);
+    return 0;
+}
+
+int IoUringContext::Init(int index) {
+    _index = index;
+    if (SetupRing() != 0 || SetupBufferRing() != 0) {
+        return -1;
+    }
+    _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_event_fd < 0) {
+        PLOG(WARNING) << "Fail to create eventfd";
+        return -1;
+    }
+    if (sys_io_uring_register(_ring_fd, IORING_REGISTER_EVENTFD, &_event_fd, 1) != 0) {
+        PLOG(WARNING) << "Fail to register eventfd to io_uring";
+        return -1;
+    }
+    SocketOptions opt;
+    opt.fd = _event_fd;
+    opt.user = this;
+    opt.on_edge_triggered_events = OnCompletionEvent;
+    if (Socket::Create(opt, &_event_socket_id) != 0) {
+        LOG(WARNING) << "Fail to create socket for completions of io_uring";
+        return -1;
+    }
+    return 0;
+}
+
+io_uring_sqe* IoUringContext::GetSqeLocked() {
+    if (_sq_local_tail - LoadAcquire(_sq_head) >= _sq_entries) {
+        // Full, push pending entries to the kernel and check again.
+        if (SubmitLocked() != 0 ||
+            _sq_local_tail - LoadAcquire(_sq_head) >= _sq_entries) {
+            errno = EAGAIN;
+            return nullptr;
+        }
+    }
+    const unsigned idx = _sq_local_tail & _sq_mask;
+    io_uring_sqe* sqe = &_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[idx] = idx;
+    ++_sq_local_tail;
+    return sqe;
+}
+
+int IoUringContext::SubmitLocked() {
+    StoreRelease(_sq_tail, _sq_local_tail);
+    if (_sqpoll) {
+        // Pairs with the barrier in the kernel before it sets NEED_WAKEUP.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (LoadAcquire(_sq_flags) & IORING_SQ_NEED_WAKEUP) {
+            g_io_uring_enter << 1;
+            sys_io_uring_enter(_ring_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        return 0;
+    }
+    while (true) {
+        const unsigned to_submit = _sq_local_tail - LoadAcquire(_sq_head);
+        if (to_submit == 0) {
+            return 0;
+        }
+        g_io_uring_enter << 1;
+        const int rc = sys_io_uring_enter(_ring_fd, to_submit, 0, 0);
+        if (rc >= 0) {
+            return 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EBUSY) {
+            // Entries are kept in the SQ and submitted next time.
+            return 0;
+        }
+        PLOG(WARNING) << "Fail to io_uring_enter";
+        return -1;
+    }
+}
+
+int IoUringContext::ArmRecv(IoUringRecvOp* op) {
+    BAIDU_SCOPED_LOCK(_sq_mutex);
+    {
+        BAIDU_SCOPED_LOCK(op->mutex);
+        if (op->cancelled || op->armed || op->eof || op->error != 0) {
+            return 0;
+        }
+        op->armed = true;
+    }
+    io_uring_sqe* sqe = GetSqeLocked();
+    if (sqe == nullptr) {
+        {
+            BAIDU_SCOPED_LOCK(op->mutex);
+            op->armed = false;
+        }
+        // The SQ is full since the kernel does not consume it when the CQ
+        // is full. Retry after completions are reaped, otherwise the socket
+        // would never receive again.
+        g_io_uring_recv_deferred << 1;
+        op->AddRef();
+        _deferred_ops.push_back(op);
+        return 0;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = op->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (uint64_t)(IoUringOp*)op;
+    // Referenced by the kernel until the final completion.
+    op->AddRef();
+    // The entry is submitted with later ones if io_uring_enter fails.
+    SubmitLocked();
+    return 0;
+}
+
+void IoUringContext::RetryDeferredRecvs() {
+    std::vector<IoUringRecvOp*> deferred;
+    {
+        BAIDU_SCOPED_LOCK(_sq_mutex);
+        deferred.swap(_deferred_ops);
+    }
+    for (size_t i = 0; i < deferred.size(); ++i) {
+        ArmRecv(deferred[i]);
+        deferred[i]->RemoveRef();
+    }
+}
+
+void IoUringContext::CancelRecv(IoUringRecvOp* op) {
+    bool armed = false;
+    butil::IOBuf pending;
+    {
+        BAIDU_SCOPED_LOCK(op->mutex);
+        op->cancelled = true;
+        armed = op->armed;
+        op->pending.swap(pending);
+    }
+    // Release provided buffers outside the lock since recycling may re-arm
+    // other recv ops.
+    pending.clear();
+    if (!armed) {
+        return;
+    }
+    BAIDU_SCOPED_LOCK(_sq_mutex);
+    io_uring_sqe* sqe = GetSqeLocked();
+    if (sqe == nullptr) {
+        LOG(ERROR) << "Fail to cancel recv of fd=" << op->fd;
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(IoUringOp*)op;
+    // Completion of the cancellation itself is ignored.
+    sqe->user_data = 0;
+    SubmitLocked();
+}
+
+int IoUringContext::SubmitSend(int fd, IoUringSendOp** ops, size_t nops) {
+    if (nops > _sq_entries) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (int ntry = 0; ; ++ntry) {
+        {
+            BAIDU_SCOPED_LOCK(_sq_mutex);
+            // Linked entries must be submitted together, make room for all
+            // of them before pushing any.
+            if (_sq_local_tail - LoadAcquire(_sq_head) + nops > _sq_entries &&
+                SubmitLocked() != 0) {
+                return -1;
+            }
+            if (_sq_local_tail - LoadAcquire(_sq_head) + nops <= _sq_entries) {
+                for (size_t i = 0; i < nops; ++i) {
+                    io_uring_sqe* sqe = GetSqeLocked();
+                    CHECK(sqe != nullptr);
+                    sqe->opcode = IORING_OP_SENDMSG;
+                    sqe->fd = fd;
+                    sqe->addr = (uint64_t)&ops[i]->msg;
+                    sqe->len = 1;
+                    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+                    if (i + 1 < nops) {
+                        sqe->flags = IOSQE_IO_LINK;
+                    }
+                    sqe->user_data = (uint64_t)(IoUringOp*)ops[i];
+                }
+                // `ops' belong to the ring once they're in the SQ. If
+                // io_uring_enter fails, they're submitted with later entries.
+                SubmitLocked();
+                return 0;
+            }
+        }
+        if (ntry >= FLAGS_io_uring_submit_retries) {
+            errno = EAGAIN;
+            return -1;
+        }
+        // The kernel does not consume the SQ when the CQ is full. Yield
+        // without holding _sq_mutex so that the reaping bthread, which
+        // re-arms recvs under the mutex, can make progress.
+        bthread_yield();
+    }
+}
+
+void IoUringContext::RecycleBuffer(uint16_t bid) {
+    std::vector<IoUringRecvOp*> starved;
+    {
+        BAIDU_SCOPED_LOCK(_buf_mutex);
+        io_uring_buf* b = &_buf_ring[_buf_local_tail & (_buf_count - 1)];
+        b->addr = (uint64_t)(_buf_base + bid * _buf_size);
+        b->len = _buf_size;
+        b->bid = bid;
+        ++_buf_local_tail;
+        __atomic_store_n(&_buf_ring[0].resv, _buf_local_tail, __ATOMIC_RELEASE);
+        _nfree_buf.fetch_add(1, butil::memory_order_relaxed);
+        starved.swap(_starved_ops);
+    }
+    for (size_t i = 0; i < starved.size(); ++i) {
+        ArmRecv(starved[i]);
+        starved[i]->RemoveRef();
+    }
+}
+
+void IoUringContext::HandleRecvCompletion(IoUringRecvOp* op,
+                                          const io_uring_cqe& cqe) {
+    const bool more = (cqe.flags & IORING_CQE_F_MORE);
+    bool notify = false;
+    bool rearm = false;
+    bool recycle = false;
+    uint16_t bid = 0;
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        _nfree_buf.fetch_sub(1, butil::memory_order_relaxed);
+    }
+    {
+        BAIDU_SCOPED_LOCK(op->mutex);
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            if (op->cancelled || cqe.res <= 0) {
+                recycle = true;
+            } else {
+                op->pending.append_user_data(
+                    _buf_base + bid * _buf_size, cqe.res,
+                    [this, bid](void*) { RecycleBuffer(bid); });
+                notify = true;
+            }
+        }
+        if (!more) {
+            op->armed = false;
+            if (op->cancelled) {
+                // Nothing to do.
+            } else if (cqe.res == 0) {
+                op->eof = true;
+                notify = true;
+            } else if (cqe.res == -ENOBUFS) {
+                g_io_uring_recv_enobufs << 1;
+                rearm = true;
+            } else if (cqe.res < 0 && cqe.res != -ECANCELED) {
+                op->error = -cqe.res;
+                notify = true;
+            } else {
+                // Multishot stopped for other reasons (e.g. CQ overflowed).
+                rearm = true;
+            }
+        }
+    }
+    if (recycle) {
+        RecycleBuffer(bid);
+    }
+    if (rearm && cqe.res == -ENOBUFS) {
+        BAIDU_SCOPED_LOCK(_buf_mutex);
+        if (_nfree_buf.load(butil::memory_order_relaxed) == 0) {
+            // Re-armed by RecycleBuffer() when some buffer is released.
+            op->AddRef();
+            _starved_ops.push_back(op);
+            rearm = false;
+        }
+    }
+    if (rearm) {
+        ArmRecv(op);
+    }
+    if (notify) {
+        IoUringTransport::OnRecvReady(op->socket_id,
+                                      BTHREAD_ATTR_NORMAL | BTHREAD_NOSIGNAL);
+    }
+    if (!more) {
+        // Dereference by the kernel.
+        op->RemoveRef();
+    }
+}
+
+void IoUringContext::HandleSendCompletion(IoUringSendOp* op,
+                                          const io_uring_cqe& cqe) {
+    IoUringTransport::OnSendDone(op->socket_id, op->fd_version,
+                                 cqe.res, op->nbytes);
+    delete op;
+}
+
+void IoUringContext::ReapCompletions() {
+    while (true) {
+        unsigned head = *_cq_head;
+        const unsigned tail = LoadAcquire(_cq_tail);
+        if (head == tail) {
+            if (LoadAcquire(_sq_flags) & IORING_SQ_CQ_OVERFLOW) {
+                // Flush overflowed completions into the CQ.
+                g_io_uring_enter << 1;
+                sys_io_uring_enter(_ring_fd, 0, 0, IORING_ENTER_GETEVENTS);
+                if (LoadAcquire(_cq_tail) != head) {
+                    continue;
+                }
+            }
+            break;
+        }
+        for (; head != tail; ++head) {
+            // Copy the entry out so that the slot is reusable by the kernel.
+            const io_uring_cqe cqe = _cqes[head & _cq_mask];
+            StoreRelease(_cq_head, head + 1);
+            g_io_uring_cqe << 1;
+            IoUringOp* op = (IoUringOp*)cqe.user_data;
+            if (op == nullptr) {
+                continue;
+            }
+            if (op->kind == IoUringOp::RECV) {
+                HandleRecvCompletion(static_cast<IoUringRecvOp*>(op), cqe);
+            } else {
+                HandleSendCompletion(static_cast<IoUringSendOp*>(op), cqe);
+            }
+        }
+    }
+    // The kernel consumes the SQ again after the CQ is drained.
+    RetryDeferredRecvs();
+    // Bthreads processing received data were started with BTHREAD_NOSIGNAL.
+    bthread_flush();
+}
+
+void IoUringContext::OnCompletionEvent(Socket* m) {
+    IoUringContext* ctx = static_cast<IoUringContext*>(m->user());
+    int progress = Socket::PROGRESS_INIT;
+    do {
+        uint64_t count = 0;
+        // Reset the eventfd before reaping so that completions posted
+        // afterwards trigger another event.
+        ssize_t nr = read(m->fd(), &count, sizeof(count));
+        (void)nr;
+        ctx->ReapCompletions();
+    } while (m->MoreReadEvents(&progress));
+}
+
+void IoUringContext::Describe(std::ostream& os) const {
+    os << "io_uring_index=" << _index
+       << " io_uring_sqpoll=" << _sqpoll
+       << " io_uring_sq_entries=" << _sq_entries
+       << " io_uring_recv_buffers=" << _buf_count << 'x' << _buf_size;
+}
+
+static void GlobalIoUringInitializeImpl() {
+    const int n = std::max(FLAGS_io_uring_num_rings, 1);
+    IoUringContext* contexts = new IoUringContext[n];
+    for (int i = 0; i < n; ++i) {
+        if (contexts[i].Init(i) != 0) {
+            // Leak `contexts' deliberately since some of them may have been
+            // referenced by sockets already.
+            return;
+        }
+    }
+    g_contexts = contexts;
+    g_ncontext = n;
+    g_io_uring_available = true;
+}
+
+void GlobalIoUringInitializeOrDie() {
+    if (pthread_once(&g_init_once, GlobalIoUringInitializeImpl) != 0) {
+        LOG(FATAL) << "Fail to pthread_once GlobalIoUringInitialize";
+        exit(1);
+    }
+    if (!g_io_uring_available) {
+        LOG(FATAL) << "Fail to initialize io_uring environment";
+        exit(1);
+    }
+}
+
+IoUringContext* GetIoUringContext(int fd) {
+    CHECK(g_contexts != nullptr) << "io_uring is not initialized";
+    return &g_contexts[(unsigned)fd % g_ncontext];
+}
+
+bool IsIoUringAvailable() {
+    return g_io_uring_available;
+}
+
+}  // namespace iouring
+}  // namespace brpc
+
+#endif  // BRPC_WITH_IO_URING
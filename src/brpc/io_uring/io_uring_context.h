@@ -0,0 +1,204 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_IO_URING_CONTEXT_H
+#define BRPC_IO_URING_CONTEXT_H
+
+#if BRPC_WITH_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <vector>
+#include "butil/atomicops.h"
+#include "butil/iobuf.h"
+#include "butil/synchronization/lock.h"
+#include "brpc/socket.h"
+
+namespace brpc {
+namespace iouring {
+
+class IoUringContext;
+
+// Common header of everything whose address is put into `user_data' of a SQE.
+struct IoUringOp {
+    enum Kind {
+        RECV = 1,
+        SEND = 2
+    };
+    explicit IoUringOp(Kind k) : kind(k) {}
+    Kind kind;
+};
+
+// State of the multishot recv armed on one socket. Shared by the owning
+// IoUringTransport and the kernel (while armed), freed when both released it.
+struct IoUringRecvOp : public IoUringOp {
+    IoUringRecvOp(IoUringContext* c, SocketId id, int fd_in, uint64_t fd_ver)
+        : IoUringOp(RECV), ctx(c), socket_id(id), fd(fd_in)
+        , fd_version(fd_ver), nref(1), armed(false), cancelled(false)
+        , eof(false), error(0) {}
+
+    void AddRef() { nref.fetch_add(1, butil::memory_order_relaxed); }
+    void RemoveRef() {
+        if (nref.fetch_sub(1, butil::memory_order_release) == 1) {
+            butil::atomic_thread_fence(butil::memory_order_acquire);
+            delete this;
+        }
+    }
+
+    IoUringContext* const ctx;
+    const SocketId socket_id;
+    const int fd;
+    const uint64_t fd_version;
+    butil::atomic<int> nref;
+
+    // Protects fields below.
+    butil::Mutex mutex;
+    bool armed;
+    bool cancelled;
+    bool eof;
+    int error;
+    // Received data not yet taken by Socket::DoRead. Blocks are the provided
+    // buffers of the ring, returned to the ring when the IOBuf releases them.
+    butil::IOBuf pending;
+};
+
+// One or more linked SENDMSG submitted for a socket. Holds references of the
+// IOBuf blocks until the kernel is done with them.
+struct IoUringSendOp : public IoUringOp {
+    IoUringSendOp() : IoUringOp(SEND), socket_id(INVALID_SOCKET_ID)
+                    , fd_version(0), nbytes(0) {
+        memset(&msg, 0, sizeof(msg));
+    }
+
+    SocketId socket_id;
+    uint64_t fd_version;
+    size_t nbytes;
+    butil::IOBuf data;
+    std::vector<iovec> iov;
+    msghdr msg;
+};
+
+// An io_uring instance shared by all io_uring sockets hashed onto it.
+// Submissions are serialized by a mutex, completions are reaped by a single
+// bthread triggered by an eventfd registered to the ring and watched by the
+// EventDispatcher, just like other fds in brpc.
+class IoUringContext : public SocketUser {
+public:
+    IoUringContext();
+    ~IoUringContext();
+
+    // Create the ring, the provided buffer ring and the completion socket.
+    int Init(int index);
+
+    // Arm (or re-arm) the multishot recv of `op'. If the submission queue is
+    // full, the recv is armed after completions are reaped. Always returns 0.
+    int ArmRecv(IoUringRecvOp* op);
+
+    // Cancel the multishot recv of `op'. No more data is delivered to op
+    // after this function returns.
+    void CancelRecv(IoUringRecvOp* op);
+
+    // Submit `ops' as a chain of linked SENDMSG to `fd'.
+    // Returns 0 when `ops' are owned by the ring, -1 otherwise and `ops' are
+    // not touched. errno is EAGAIN if the submission queue stays full.
+    int SubmitSend(int fd, IoUringSendOp** ops, size_t nops);
+
+    // True when less than half of provided buffers are free. Received data
+    // is copied out of provided buffers in this case, otherwise messages
+    // larger than all buffers would never be completed.
+    bool IsShortOfBuffers() const {
+        return _nfree_buf.load(butil::memory_order_relaxed) * 2 < _buf_count;
+    }
+
+    int index() const { return _index; }
+    void Describe(std::ostream& os) const;
+
+    // Called by IOBuf when a provided buffer is not referenced anymore.
+    void RecycleBuffer(uint16_t bid);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(IoUringContext);
+
+    // Edge-triggered callback of the eventfd.
+    static void OnCompletionEvent(Socket* m);
+    void ReapCompletions();
+    void HandleRecvCompletion(IoUringRecvOp* op, const io_uring_cqe& cqe);
+    void HandleSendCompletion(IoUringSendOp* op, const io_uring_cqe& cqe);
+    // Arm recv ops deferred by ArmRecv() because the SQ was full.
+    void RetryDeferredRecvs();
+
+    int SetupRing();
+    int SetupBufferRing();
+    // Called with _sq_mutex held.
+    io_uring_sqe* GetSqeLocked();
+    int SubmitLocked();
+
+    int _index;
+    int _ring_fd;
+    int _event_fd;
+    SocketId _event_socket_id;
+
+    butil::Mutex _sq_mutex;
+    void* _sq_ring_ptr;
+    size_t _sq_ring_size;
+    void* _cq_ring_ptr;
+    size_t _cq_ring_size;
+    io_uring_sqe* _sqes;
+    size_t _sqes_size;
+    unsigned* _sq_head;
+    unsigned* _sq_tail;
+    unsigned* _sq_flags;
+    unsigned* _sq_array;
+    unsigned _sq_mask;
+    unsigned _sq_entries;
+    unsigned _sq_local_tail;
+    // Recv ops failed to be armed because the SQ was full. Protected by
+    // _sq_mutex.
+    std::vector<IoUringRecvOp*> _deferred_ops;
+    unsigned* _cq_head;
+    unsigned* _cq_tail;
+    unsigned _cq_mask;
+    io_uring_cqe* _cqes;
+    bool _sqpoll;
+
+    // Provided buffer ring. Protected by _buf_mutex.
+    butil::Mutex _buf_mutex;
+    io_uring_buf* _buf_ring;
+    size_t _buf_ring_size;
+    uint16_t _buf_local_tail;
+    char* _buf_base;
+    size_t _buf_size;
+    unsigned _buf_count;
+    butil::atomic<unsigned> _nfree_buf;
+    // Recv ops that ran out of buffers, re-armed when buffers are recycled.
+    std::vector<IoUringRecvOp*> _starved_ops;
+};
+
+// Initialize io_uring environment. Exit if failed.
+void GlobalIoUringInitializeOrDie();
+
+// Get the context which serves `fd'.
+IoUringContext* GetIoUringContext(int fd);
+
+// Return true if io_uring is usable by this process.
+bool IsIoUringAvailable();
+
+}  // namespace iouring
+}  // namespace brpc
+
+#endif  // BRPC_WITH_IO_URING
+#endif  // BRPC_IO_URING_CONTEXT_H
@@ -0,0 +1,324 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#if BRPC_WITH_IO_URING
+
+#include "bthread/butex.h"
+#include "brpc/io_uring_transport.h"
+#include "brpc/input_messenger.h"
+#include "brpc/server.h"
+#include "brpc/io_uring/io_uring_context.h"
+
+namespace brpc {
+DECLARE_bool(usercode_in_coroutine);
+DECLARE_bool(usercode_in_pthread);
+
+extern SocketVarsCollector* g_vars;
+
+// Max number of IOBuf blocks in one SENDMSG, same with IOBUF_IOV_MAX.
+static const size_t MAX_SEND_BLOCKS = 256;
+// Max number of SENDMSG in one chain.
+static const size_t MAX_SEND_CHAIN = 16;
+
+void IoUringTransport::Init(Socket* socket, const SocketOptions& options) {
+    _socket = socket;
+    _default_connect = options.app_connect;
+    _on_edge_trigger = options.on_edge_triggered_events;
+    if (options.need_on_edge_trigger && _on_edge_trigger == nullptr) {
+        _on_edge_trigger = InputMessenger::OnNewMessages;
+    }
+}
+
+void IoUringTransport::Release() {
+    CancelRecv();
+    _nsend_inflight.store(0, butil::memory_order_relaxed);
+}
+
+int IoUringTransport::Reset(int32_t expected_nref) {
+    CancelRecv();
+    _nsend_inflight.store(0, butil::memory_order_relaxed);
+    return 0;
+}
+
+std::shared_ptr<AppConnect> IoUringTransport::Connect() {
+    return _default_connect;
+}
+
+int IoUringTransport::StartRecv(int fd) {
+    CancelRecv();
+    _ctx = iouring::GetIoUringContext(fd);
+    _recv_op = new iouring::IoUringRecvOp(
+        _ctx, _socket->id(), fd, _socket->fd_version());
+    return _ctx->ArmRecv(_recv_op);
+}
+
+void IoUringTransport::StopRecv(int) {
+    CancelRecv();
+}
+
+void IoUringTransport::CancelRecv() {
+    if (_recv_op == nullptr) {
+        return;
+    }
+    _ctx->CancelRecv(_recv_op);
+    _recv_op->RemoveRef();
+    _recv_op = nullptr;
+}
+
+ssize_t IoUringTransport::DoRead(butil::IOPortal* buf, size_t) {
+    if (_recv_op == nullptr) {
+        errno = EINVAL;
+        return -1;
+    }
+    butil::IOBuf data;
+    {
+        BAIDU_SCOPED_LOCK(_recv_op->mutex);
+        if (_recv_op->pending.empty()) {
+            if (_recv_op->error != 0) {
+                errno = _recv_op->error;
+                return -1;
+            }
+            if (_recv_op->eof) {
+                return 0;
+            }
+            errno = EAGAIN;
+            return -1;
+        }
+        _recv_op->pending.swap(data);
+    }
+    const ssize_t nr = data.size();
+    if (_ctx->IsShortOfBuffers()) {
+        // Data may be kept by the parser for long (e.g. a large message not
+        // completely received yet), copy it to give back provided buffers.
+        const size_t nblock = data.backing_block_num();
+        for (size_t i = 0; i < nblock; ++i) {
+            butil::StringPiece blk = data.backing_block(i);
+            buf->append(blk.data(), blk.size());
+        }
+    } else {
+        buf->append(butil::IOBuf::Movable(data));
+    }
+    return nr;
+}
+
+int IoUringTransport::CutFromIOBuf(butil::IOBuf* buf) {
+    butil::IOBuf* data_arr[1] = { buf };
+    return CutFromIOBufList(data_arr, 1);
+}
+
+ssize_t IoUringTransport::CutFromIOBufList(butil::IOBuf** buf, size_t ndata) {
+    if (_nsend_inflight.load(butil::memory_order_acquire) != 0) {
+        // Previous chain is not completed yet, data of different chains
+        // must not be interleaved.
+        errno = EAGAIN;
+        return -1;
+    }
+    const int fd = _socket->fd();
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    iouring::IoUringSendOp* ops[MAX_SEND_CHAIN];
+    // Index of the IOBuf where each op was cut from.
+    size_t op_buf[MAX_SEND_CHAIN];
+    size_t nops = 0;
+    ssize_t nw = 0;
+    for (size_t i = 0; i < ndata && nops < MAX_SEND_CHAIN; ++i) {
+        while (!buf[i]->empty() && nops < MAX_SEND_CHAIN) {
+            iouring::IoUringSendOp* op = new iouring::IoUringSendOp;
+            op->socket_id = _socket->id();
+            op->fd_version = _socket->fd_version();
+            const size_t nblock = std::min(buf[i]->backing_block_num(),
+                                           MAX_SEND_BLOCKS);
+            size_t len = 0;
+            for (size_t j = 0; j < nblock; ++j) {
+                len += buf[i]->backing_block(j).size();
+            }
+            // Hold the blocks until the kernel is done with them.
+            buf[i]->cutn(&op->data, len);
+            op->iov.reserve(nblock);
+            for (size_t j = 0; j < op->data.backing_block_num(); ++j) {
+                butil::StringPiece blk = op->data.backing_block(j);
+                op->iov.push_back({ (void*)blk.data(), blk.size() });
+            }
+            op->msg.msg_iov = op->iov.data();
+            op->msg.msg_iovlen = op->iov.size();
+            op->nbytes = len;
+            nw += len;
+            op_buf[nops] = i;
+            ops[nops++] = op;
+        }
+    }
+    if (nops == 0) {
+        return 0;
+    }
+    _nsend_inflight.fetch_add(nops, butil::memory_order_release);
+    if (_ctx == nullptr) {
+        _ctx = iouring::GetIoUringContext(fd);
+    }
+    if (_ctx->SubmitSend(fd, ops, nops) != 0) {
+        // Nothing was submitted, put the data back in order and drop ops.
+        const int saved_errno = errno;
+        _nsend_inflight.fetch_sub(nops, butil::memory_order_relaxed);
+        for (size_t k = nops; k > 0; --k) {
+            iouring::IoUringSendOp* op = ops[k - 1];
+            op->data.append(*buf[op_buf[k - 1]]);
+            buf[op_buf[k - 1]]->swap(op->data);
+            delete op;
+        }
+        if (saved_errno != EAGAIN) {
+            _socket->SetFailed(saved_errno, "Fail to submit io_uring sends of %s: %s",
+                               _socket->description().c_str(), berror(saved_errno));
+        }
+        errno = saved_errno;
+        return -1;
+    }
+    return nw;
+}
+
+int IoUringTransport::WaitEpollOut(butil::atomic<int>* _epollout_butex,
+                                   bool pollin, const timespec duetime) {
+    const int expected_val = _epollout_butex->load(butil::memory_order_acquire);
+    if (_nsend_inflight.load(butil::memory_order_acquire) == 0) {
+        return 0;
+    }
+    g_vars->nwaitepollout << 1;
+    if (bthread::butex_wait(_epollout_butex, expected_val, &duetime) < 0) {
+        if (errno != EAGAIN && errno != ETIMEDOUT) {
+            const int saved_errno = errno;
+            PLOG(WARNING) << "Fail to wait io_uring sends of " << _socket;
+            _socket->SetFailed(saved_errno,
+                               "Fail to wait io_uring sends of %s: %s",
+                               _socket->description().c_str(),
+                               berror(saved_errno));
+        }
+    }
+    // Failures of sends are reported by completions instead of writes.
+    return _socket->Failed() ? 1 : 0;
+}
+
+void IoUringTransport::OnSendDone(SocketId id, uint64_t fd_version,
+                                  int res, size_t nbytes) {
+    SocketUniquePtr s;
+    if (Socket::Address(id, &s) != 0) {
+        return;
+    }
+    if (s->fd_version() != fd_version || s->fd() < 0) {
+        // Completion of a previous connection.
+        return;
+    }
+    IoUringTransport* t = static_cast<IoUringTransport*>(s->_transport.get());
+    if (res < 0) {
+        if (res != -ECANCELED) {
+            s->SetFailed(-res, "Fail to send to %s: %s",
+                         s->description().c_str(), berror(-res));
+        } else {
+            // Cancelled because a previous send in the chain failed, which
+            // has set the socket failed already.
+        }
+    } else if ((size_t)res != nbytes) {
+        s->SetFailed(EPIPE, "Sent %d of %zu bytes to %s",
+                     res, nbytes, s->description().c_str());
+    }
+    if (t->_nsend_inflight.fetch_sub(1, butil::memory_order_acq_rel) == 1) {
+        s->WakeAsEpollOut();
+    }
+}
+
+void IoUringTransport::OnRecvReady(SocketId id, const bthread_attr_t& attr) {
+    Socket::OnInputEvent((void*)id, 0, attr);
+}
+
+void IoUringTransport::ProcessEvent(bthread_attr_t attr) {
+    // Called in the bthread reaping completions which flushes created
+    // bthreads all together.
+    bthread_t tid;
+    if (FLAGS_usercode_in_coroutine) {
+        OnEdge(_socket);
+    } else if (bthread_start_background(&tid, &attr, OnEdge, _socket) != 0) {
+        LOG(FATAL) << "Fail to start ProcessEvent";
+        OnEdge(_socket);
+    }
+}
+
+void IoUringTransport::QueueMessage(InputMessageClosure& input_msg,
+                                    int* num_bthread_created, bool) {
+    InputMessageBase* to_run_msg = input_msg.release();
+    if (!to_run_msg) {
+        return;
+    }
+    bthread_t th;
+    bthread_attr_t tmp =
+        (FLAGS_usercode_in_pthread ? BTHREAD_ATTR_PTHREAD : BTHREAD_ATTR_NORMAL) |
+        BTHREAD_NOSIGNAL;
+    tmp.keytable_pool = _socket->keytable_pool();
+    tmp.tag = bthread_self_tag();
+    bthread_attr_set_name(&tmp, "ProcessInputMessage");
+    if (!FLAGS_usercode_in_coroutine && StartProcessInputMessage(
+            &th, &tmp, to_run_msg) == 0) {
+        ++*num_bthread_created;
+    } else {
+        ProcessInputMessage(to_run_msg);
+    }
+}
+
+void IoUringTransport::Debug(std::ostream& os) {
+    if (_ctx != nullptr) {
+        _ctx->Describe(os);
+        os << '\n';
+    }
+    if (_recv_op != nullptr) {
+        BAIDU_SCOPED_LOCK(_recv_op->mutex);
+        os << "io_uring_recv_armed=" << _recv_op->armed
+           << "\nio_uring_recv_pending=" << _recv_op->pending.size() << '\n';
+    }
+    os << "io_uring_send_inflight="
+       << _nsend_inflight.load(butil::memory_order_relaxed) << '\n';
+}
+
+int IoUringTransport::ContextInitOrDie(bool serverOrNot, const void* _options) {
+    if (serverOrNot) {
+        if (!OptionsAvailableOverIoUring(static_cast<const ServerOptions*>(_options))) {
+            return -1;
+        }
+    } else {
+        if (!OptionsAvailableForIoUring(static_cast<const ChannelOptions*>(_options))) {
+            return -1;
+        }
+    }
+    iouring::GlobalIoUringInitializeOrDie();
+    return 0;
+}
+
+bool IoUringTransport::OptionsAvailableForIoUring(const ChannelOptions* opt) {
+    if (opt->has_ssl_options()) {
+        LOG(WARNING) << "Cannot use SSL and io_uring at the same time";
+        return false;
+    }
+    return true;
+}
+
+bool IoUringTransport::OptionsAvailableOverIoUring(const ServerOptions* opt) {
+    if (opt->has_ssl_options()) {
+        LOG(WARNING) << "SSL is not supported by io_uring";
+        return false;
+    }
+    return true;
+}
+
+} // namespace brpc
+#endif // BRPC_WITH_IO_URING
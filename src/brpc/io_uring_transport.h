@@ -0,0 +1,83 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_IO_URING_TRANSPORT_H
+#define BRPC_IO_URING_TRANSPORT_H
+
+#if BRPC_WITH_IO_URING
+#include "brpc/socket.h"
+#include "brpc/channel.h"
+#include "brpc/transport.h"
+
+namespace brpc {
+namespace iouring {
+class IoUringContext;
+struct IoUringRecvOp;
+}
+
+// Transport over plain TCP sockets whose reads and writes are submitted to
+// io_uring instead of being done with read/writev after epoll events:
+//  - Reads are done by a multishot recv selecting buffers from a provided
+//    buffer ring. The buffers are appended into the read buffer of the
+//    socket as IOBuf blocks without copying.
+//  - Writes cut IOBuf blocks into linked SENDMSG. At most one chain is in
+//    flight per socket, following writes wait for its completion as if
+//    they were waiting for EPOLLOUT.
+class IoUringTransport : public Transport {
+friend class TransportFactory;
+friend class iouring::IoUringContext;
+public:
+    void Init(Socket* socket, const SocketOptions& options) override;
+    void Release() override;
+    int Reset(int32_t expected_nref) override;
+    std::shared_ptr<AppConnect> Connect() override;
+    int CutFromIOBuf(butil::IOBuf* buf) override;
+    ssize_t CutFromIOBufList(butil::IOBuf** buf, size_t ndata) override;
+    int WaitEpollOut(butil::atomic<int>* _epollout_butex, bool pollin, const timespec duetime) override;
+    void ProcessEvent(bthread_attr_t attr) override;
+    void QueueMessage(InputMessageClosure& inputMsg, int* num_bthread_created, bool last_msg) override;
+    void Debug(std::ostream &os) override;
+    // Arm the multishot recv on `fd' instead of adding `fd' into
+    // EventDispatcher.
+    int StartRecv(int fd) override;
+    // Stop delivering data of current fd.
+    void StopRecv(int fd) override;
+    // Move data received so far into `buf', `size_hint' is ignored.
+    // -1 with errno=EAGAIN means nothing to read now.
+    ssize_t DoRead(butil::IOPortal* buf, size_t size_hint) override;
+
+    static int ContextInitOrDie(bool serverOrNot, const void* _options);
+
+private:
+    static bool OptionsAvailableForIoUring(const ChannelOptions* opt);
+    static bool OptionsAvailableOverIoUring(const ServerOptions* opt);
+    // Called by IoUringContext when data, EOF or error of the recv is ready.
+    static void OnRecvReady(SocketId id, const bthread_attr_t& attr);
+    // Called by IoUringContext when a send chain completes.
+    static void OnSendDone(SocketId id, uint64_t fd_version, int res, size_t nbytes);
+    // Cancel the recv op of current fd if it exists.
+    void CancelRecv();
+
+    iouring::IoUringContext* _ctx = nullptr;
+    iouring::IoUringRecvOp* _recv_op = nullptr;
+    // Number of SENDMSG submitted but not completed.
+    butil::atomic<int> _nsend_inflight{0};
+};
+
+} // namespace brpc
+#endif // BRPC_WITH_IO_URING
+#endif //BRPC_IO_URING_TRANSPORT_H
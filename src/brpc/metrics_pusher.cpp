@@ -0,0 +1,336 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <stdlib.h>                                 // strtod
+#include <string.h>                                 // memcpy
+#include <algorithm>                                // std::sort
+#include <gflags/gflags.h>
+#include "butil/logging.h"
+#include "butil/string_printf.h"
+#include "butil/string_splitter.h"                  // KeyValuePairsSplitter
+#include "butil/third_party/murmurhash3/murmurhash3.h"
+#include "butil/time.h"
+#include "bthread/bthread.h"
+#include "brpc/controller.h"
+#include "brpc/reloadable_flags.h"
+#include "brpc/builtin/prometheus_metrics_service.h" // DumpPrometheusMetricsToIOBuf
+#include "brpc/policy/snappy_compress.h"             // SnappyCompress
+#include "brpc/prometheus_remote_write.pb.h"
+#include "brpc/metrics_pusher.h"
+
+namespace brpc {
+
+DEFINE_string(bvar_push_url, "", "Push exposed bvars to this url in the "
+              "format of prometheus remote write periodically, e.g. "
+              "http://127.0.0.1:9090/api/v1/write. Empty means not pushing");
+DEFINE_int32(bvar_push_interval, 10, "Push bvars every so many seconds");
+DEFINE_string(bvar_push_labels, "", "Labels added to all series pushed, "
+              "in the form of `k1=v1,k2=v2', e.g. job=foo,instance=host:8000");
+DEFINE_int32(bvar_push_full_interval, 60, "Series not changed are pushed "
+             "again after so many seconds, non-positive values mean that "
+             "all series are pushed every time");
+DEFINE_int32(bvar_push_max_series_per_request, 2000,
+             "Max number of series in one push request");
+DEFINE_int32(bvar_push_timeout_ms, 3000, "Timeout of push requests");
+BRPC_VALIDATE_GFLAG(bvar_push_interval, PositiveInteger);
+BRPC_VALIDATE_GFLAG(bvar_push_max_series_per_request, PositiveInteger);
+BRPC_VALIDATE_GFLAG(bvar_push_timeout_ms, PositiveInteger);
+
+// Requests of a push are sent in parallel, but not too many at the same time.
+static const size_t MAX_CONCURRENT_REQUESTS = 8;
+
+MetricsPusherOptions::MetricsPusherOptions()
+    : max_series_per_request(2000)
+    , full_push_interval_s(60)
+    , timeout_ms(3000) {}
+
+MetricsPusher::MetricsPusher()
+    : _last_full_push_ms(0)
+    , _failed(false) {}
+
+MetricsPusher::~MetricsPusher() {}
+
+int MetricsPusher::Init(const std::string& url,
+                        const MetricsPusherOptions* options) {
+    if (options) {
+        _options = *options;
+    }
+    if (_options.max_series_per_request <= 0) {
+        LOG(ERROR) << "Invalid max_series_per_request="
+                   << _options.max_series_per_request;
+        return -1;
+    }
+    ChannelOptions chan_options;
+    chan_options.protocol = PROTOCOL_HTTP;
+    chan_options.timeout_ms = _options.timeout_ms;
+    if (_channel.Init(url.c_str(), "", &chan_options) != 0) {
+        LOG(ERROR) << "Fail to init channel to " << url;
+        return -1;
+    }
+    _url = url;
+    return 0;
+}
+
+// Parse `k1="v1",k2="v2"}' into labels of `ts'.
+static bool ParseLabels(butil::StringPiece s, prometheus::TimeSeries* ts) {
+    while (!s.starts_with("}")) {
+        const size_t eq = s.find("=\"");
+        if (eq == butil::StringPiece::npos) {
+            return false;
+        }
+        prometheus::Label* label = ts->add_labels();
+        label->set_name(s.data(), eq);
+        s.remove_prefix(eq + 2);
+        std::string* value = label->mutable_value();
+        size_t i = 0;
+        for (; i < s.size() && s[i] != '"'; ++i) {
+            if (s[i] == '\\' && i + 1 < s.size()) {
+                ++i;
+                value->push_back(s[i] == 'n' ? '\n' : s[i]);
+            } else {
+                value->push_back(s[i]);
+            }
+        }
+        if (i == s.size()) {
+            return false;
+        }
+        s.remove_prefix(i + 1);
+        if (s.starts_with(",")) {
+            s.remove_prefix(1);
+        }
+    }
+    return s.size() == 1;
+}
+
+static bool LabelLess(const prometheus::Label* l1, const prometheus::Label* l2) {
+    return l1->name() < l2->name();
+}
+
+bool MetricsPusher::AppendSeries(const butil::StringPiece& line,
+                                 int64_t timestamp_ms, bool full,
+                                 prometheus::WriteRequest* req) {
+    // <name>[{<label>="<value>",...}] <value>
+    const size_t space = line.rfind(' ');
+    if (space == butil::StringPiece::npos || space == 0) {
+        return false;
+    }
+    const butil::StringPiece key = line.substr(0, space);
+    const butil::StringPiece value_str = line.substr(space + 1);
+    char buf[64];
+    if (value_str.empty() || value_str.size() >= sizeof(buf)) {
+        return false;
+    }
+    memcpy(buf, value_str.data(), value_str.size());
+    buf[value_str.size()] = '\0';
+    char* endptr = nullptr;
+    const double value = strtod(buf, &endptr);
+    if (*endptr != '\0') {
+        return false;
+    }
+
+    uint64_t hash[2];
+    butil::MurmurHash3_x64_128(key.data(), key.size(), 0, hash);
+    _new_values[hash[0]] = value;
+    if (!full) {
+        auto it = _values.find(hash[0]);
+        if (it != _values.end() && it->second == value) {
+            return false;
+        }
+    }
+
+    prometheus::TimeSeries* ts = req->add_timeseries();
+    const size_t brace = key.find('{');
+    prometheus::Label* name = ts->add_labels();
+    name->set_name("__name__");
+    name->set_value(key.data(), std::min(brace, key.size()));
+    if (brace != butil::StringPiece::npos &&
+        !ParseLabels(key.substr(brace + 1), ts)) {
+        LOG_EVERY_SECOND(WARNING) << "Invalid labels in `" << key << '\'';
+        req->mutable_timeseries()->RemoveLast();
+        return false;
+    }
+    const int nlabel = ts->labels_size();
+    for (size_t i = 0; i < _options.labels.size(); ++i) {
+        // Labels of the series take precedence.
+        bool found = false;
+        for (int j = 0; j < nlabel && !found; ++j) {
+            found = (ts->labels(j).name() == _options.labels[i].first);
+        }
+        if (!found) {
+            prometheus::Label* label = ts->add_labels();
+            label->set_name(_options.labels[i].first);
+            label->set_value(_options.labels[i].second);
+        }
+    }
+    std::sort(ts->mutable_labels()->pointer_begin(),
+              ts->mutable_labels()->pointer_end(), LabelLess);
+    prometheus::Sample* sample = ts->add_samples();
+    sample->set_value(value);
+    sample->set_timestamp(timestamp_ms);
+    return true;
+}
+
+int MetricsPusher::AddBatch(prometheus::WriteRequest* req) {
+    _batches.resize(_batches.size() + 1);
+    if (!policy::SnappyCompress(*req, &_batches.back().first)) {
+        _batches.pop_back();
+        return -1;
+    }
+    _batches.back().second = req->timeseries_size();
+    req->Clear();
+    return 0;
+}
+
+int MetricsPusher::SendBatches() {
+    int nsent = 0;
+    bool failed = false;
+    for (size_t i = 0; i < _batches.size(); i += MAX_CONCURRENT_REQUESTS) {
+        const size_t n = std::min(MAX_CONCURRENT_REQUESTS, _batches.size() - i);
+        Controller cntls[MAX_CONCURRENT_REQUESTS];
+        for (size_t j = 0; j < n; ++j) {
+            Controller& cntl = cntls[j];
+            cntl.http_request().uri() = _url;
+            cntl.http_request().set_method(HTTP_METHOD_POST);
+            cntl.http_request().set_content_type("application/x-protobuf");
+            cntl.http_request().SetHeader("Content-Encoding", "snappy");
+            cntl.http_request().SetHeader("X-Prometheus-Remote-Write-Version",
+                                          "0.1.0");
+            cntl.request_attachment().swap(_batches[i + j].first);
+            _channel.CallMethod(nullptr, &cntl, nullptr, nullptr, DoNothing());
+        }
+        for (size_t j = 0; j < n; ++j) {
+            Join(cntls[j].call_id());
+            if (cntls[j].Failed()) {
+                LOG_EVERY_SECOND(WARNING) << "Fail to push metrics to " << _url
+                                          << ", " << cntls[j].ErrorText();
+                failed = true;
+            } else {
+                nsent += _batches[i + j].second;
+            }
+        }
+    }
+    _batches.clear();
+    return failed ? -1 : nsent;
+}
+
+int MetricsPusher::Push() {
+    butil::IOBuf buf;
+    if (DumpPrometheusMetricsToIOBuf(&buf) != 0) {
+        LOG(WARNING) << "Fail to dump metrics";
+        return -1;
+    }
+    const std::string text = buf.to_string();
+    buf.clear();
+
+    const int64_t now_ms = butil::gettimeofday_ms();
+    const bool full = _failed || _options.full_push_interval_s <= 0 ||
+        now_ms >= _last_full_push_ms + _options.full_push_interval_s * 1000L;
+    _new_values.clear();
+    _new_values.reserve(_values.size());
+    _batches.clear();
+    prometheus::WriteRequest req;
+    for (butil::StringSplitter sp(text.data(), text.data() + text.size(), '\n');
+         sp; ++sp) {
+        const butil::StringPiece line(sp.field(), sp.length());
+        if (line.starts_with("#")) {
+            continue;
+        }
+        if (AppendSeries(line, now_ms, full, &req) &&
+            req.timeseries_size() >= _options.max_series_per_request &&
+            AddBatch(&req) != 0) {
+            return -1;
+        }
+    }
+    if (req.timeseries_size() > 0 && AddBatch(&req) != 0) {
+        return -1;
+    }
+    const int nsent = SendBatches();
+    _values.swap(_new_values);
+    _failed = (nsent < 0);
+    if (full && !_failed) {
+        _last_full_push_ms = now_ms;
+    }
+    return nsent;
+}
+
+// Only one push runs at the same time.
+static butil::atomic<bool> s_pushing(false);
+// Accessed by the caller of PushMetricsPeriodically() only.
+static int64_t s_last_push_us = 0;
+
+static void* PushMetricsThread(void*) {
+    // Recreated when flags are changed.
+    static MetricsPusher* s_pusher = nullptr;
+    static std::string* s_config = nullptr;
+    const std::string config = butil::string_printf(
+        "%s %s %d %d %d", FLAGS_bvar_push_url.c_str(),
+        FLAGS_bvar_push_labels.c_str(), FLAGS_bvar_push_full_interval,
+        FLAGS_bvar_push_max_series_per_request, FLAGS_bvar_push_timeout_ms);
+    if (s_config == nullptr || *s_config != config) {
+        if (s_config == nullptr) {
+            s_config = new std::string;
+        }
+        *s_config = config;
+        delete s_pusher;
+        s_pusher = nullptr;
+        MetricsPusherOptions options;
+        options.max_series_per_request = FLAGS_bvar_push_max_series_per_request;
+        options.full_push_interval_s = FLAGS_bvar_push_full_interval;
+        options.timeout_ms = FLAGS_bvar_push_timeout_ms;
+        for (butil::KeyValuePairsSplitter sp(FLAGS_bvar_push_labels, ',', '=');
+             sp; ++sp) {
+            if (!sp.key().empty()) {
+                options.labels.push_back(std::make_pair(
+                    sp.key().as_string(), sp.value().as_string()));
+            }
+        }
+        MetricsPusher* pusher = new MetricsPusher;
+        if (pusher->Init(FLAGS_bvar_push_url, &options) == 0) {
+            s_pusher = pusher;
+        } else {
+            delete pusher;
+        }
+    }
+    if (s_pusher) {
+        s_pusher->Push();
+    }
+    s_pushing.store(false, butil::memory_order_release);
+    return nullptr;
+}
+
+// Called in global.cpp
+void PushMetricsPeriodically() {
+    if (FLAGS_bvar_push_url.empty()) {
+        return;
+    }
+    const int64_t now = butil::cpuwide_time_us();
+    if (now < s_last_push_us + FLAGS_bvar_push_interval * 1000000L) {
+        return;
+    }
+    if (s_pushing.exchange(true, butil::memory_order_acquire)) {
+        // The last push is not done yet.
+        return;
+    }
+    s_last_push_us = now;
+    bthread_t th;
+    if (bthread_start_background(&th, nullptr, PushMetricsThread, nullptr) != 0) {
+        LOG(ERROR) << "Fail to start bthread to push metrics";
+        s_pushing.store(false, butil::memory_order_relaxed);
+    }
+}
+
+} // namespace brpc
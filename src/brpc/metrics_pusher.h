@@ -0,0 +1,130 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+
+#ifndef BRPC_METRICS_PUSHER_H
+#define BRPC_METRICS_PUSHER_H
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "butil/iobuf.h"
+#include "butil/macros.h"
+#include "butil/strings/string_piece.h"
+#include "brpc/channel.h"
+
+namespace brpc {
+
+namespace prometheus {
+class WriteRequest;
+}
+
+struct MetricsPusherOptions {
+    // Constructed with default options.
+    MetricsPusherOptions();
+
+    // Max number of series in one request, more series are split into
+    // multiple requests.
+    // Default: 2000
+    int max_series_per_request;
+
+    // Series whose values are not changed since the last push are not sent
+    // again unless they're not sent for so many seconds. Non-positive
+    // values mean that all series are sent in every push.
+    // Default: 60
+    int full_push_interval_s;
+
+    // Timeout of each request in milliseconds.
+    // Default: 3000
+    int32_t timeout_ms;
+
+    // Labels added to all series, which identify this process in the
+    // server, e.g. {"job", "foo"}, {"instance", "10.0.0.1:8000"}.
+    std::vector<std::pair<std::string, std::string> > labels;
+};
+
+// Push exposed bvars to a server accepting the prometheus remote write
+// protocol, e.g. prometheus with --web.enable-remote-write-receiver or
+// VictoriaMetrics, rather than being pulled from /brpc_metrics by the
+// server. The series pushed are the same as the ones in /brpc_metrics
+// (thus dumped by Variable::dump_exposed() and MVariableBase::dump_exposed()),
+// encoded in prometheus.WriteRequest and compressed by snappy.
+// Example:
+//   brpc::MetricsPusherOptions options;
+//   options.labels.push_back(std::make_pair("job", "foo"));
+//   brpc::MetricsPusher pusher;
+//   pusher.Init("http://127.0.0.1:9090/api/v1/write", &options);
+//   pusher.Push();  // call periodically
+// Most users don't need this class, just set -bvar_push_url and bvars will
+// be pushed every -bvar_push_interval seconds by brpc.
+class MetricsPusher {
+public:
+    MetricsPusher();
+    ~MetricsPusher();
+
+    // Push to `url' which is a http or https url. Use default options if
+    // `options' is nullptr.
+    // Returns 0 on success, -1 otherwise.
+    int Init(const std::string& url, const MetricsPusherOptions* options);
+
+    // Dump and push series changed since the last push (see comments of
+    // MetricsPusherOptions::full_push_interval_s). Blocks until all
+    // requests finish. If any request failed, all series will be sent in
+    // the next push.
+    // Returns number of series pushed, -1 on error.
+    // [Not thread-safe] Don't call this function concurrently.
+    int Push();
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(MetricsPusher);
+
+    // Append the sample in `line' of the prometheus text format to `req'
+    // if it's changed or `full' is true.
+    // Returns true if the sample is appended.
+    bool AppendSeries(const butil::StringPiece& line, int64_t timestamp_ms,
+                      bool full, prometheus::WriteRequest* req);
+
+    // Append serialized and compressed `req' to _batches and clear `req'.
+    // Returns 0 on success, -1 otherwise.
+    int AddBatch(prometheus::WriteRequest* req);
+
+    // Send all _batches, returns number of series sent or -1.
+    int SendBatches();
+
+    std::string _url;
+    MetricsPusherOptions _options;
+    Channel _channel;
+    // Hashes of series => values pushed.
+    std::unordered_map<uint64_t, double> _values;
+    std::unordered_map<uint64_t, double> _new_values;
+    int64_t _last_full_push_ms;
+    bool _failed;
+    // Compressed requests and number of series in them.
+    std::vector<std::pair<butil::IOBuf, int> > _batches;
+};
+
+// [Internal] Call this function every second (or every several seconds)
+// to push bvars to -bvar_push_url every -bvar_push_interval seconds in a
+// background bthread.
+void PushMetricsPeriodically();
+
+} // namespace brpc
+
+
+#endif // BRPC_METRICS_PUSHER_H
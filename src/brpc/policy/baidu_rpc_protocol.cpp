@@ -51,6 +51,10 @@ extern "C" {
 void bthread_assign_data(void* data);
 }
 
+namespace bthread {
+DECLARE_bool(bthread_deadline_scheduling);
+}
+
 
 namespace brpc {
 namespace policy {
@@ -102,6 +106,63 @@ static void SerializeRpcHeaderAndMeta(
     }
 }
 
+// Skip a field of wire type `wire_type' (no groups in RpcMeta).
+static bool SkipPbField(google::protobuf::io::CodedInputStream* input,
+                        uint32_t wire_type) {
+    uint64_t u64 = 0;
+    uint32_t u32 = 0;
+    switch (wire_type) {
+    case 0:  // varint
+        return input->ReadVarint64(&u64);
+    case 1:  // fixed64
+        return input->ReadLittleEndian64(&u64);
+    case 2:  // length-delimited
+        return input->ReadVarint32(&u32) && input->Skip(u32);
+    case 5:  // fixed32
+        return input->ReadLittleEndian32(&u32);
+    default:
+        return false;
+    }
+}
+
+// Get RpcRequestMeta.timeout_ms from serialized RpcMeta without parsing the
+// whole meta, which is done later in the bthread processing the request.
+// Returns 0 if it's not a request or the timeout is not set.
+static int32_t PeekRequestTimeoutMs(const butil::IOBuf& meta) {
+    butil::IOBufAsZeroCopyInputStream zero_copy_input(meta);
+    google::protobuf::io::CodedInputStream input(&zero_copy_input);
+    uint32_t tag = 0;
+    while ((tag = input.ReadTag()) != 0) {
+        if (tag != ((RpcMeta::kRequestFieldNumber << 3) | 2)) {
+            if (!SkipPbField(&input, tag & 7)) {
+                return 0;
+            }
+            continue;
+        }
+        uint32_t length = 0;
+        if (!input.ReadVarint32(&length)) {
+            return 0;
+        }
+        input.PushLimit(length);
+        int32_t timeout_ms = 0;
+        while ((tag = input.ReadTag()) != 0) {
+            if (tag == ((RpcRequestMeta::kTimeoutMsFieldNumber << 3) | 0)) {
+                uint32_t value = 0;
+                if (!input.ReadVarint32(&value)) {
+                    return 0;
+                }
+                // The last one wins, same as parsing.
+                timeout_ms = (int32_t)value;
+            } else if (!SkipPbField(&input, tag & 7)) {
+                return 0;
+            }
+        }
+        // Requests have only one RpcRequestMeta in practice.
+        return timeout_ms;
+    }
+    return 0;
+}
+
 ParseResult ParseRpcMessage(butil::IOBuf* source, Socket* socket,
                             bool /*read_eof*/, const void*) {
     char header_buf[12];
@@ -142,6 +203,9 @@ ParseResult ParseRpcMessage(butil::IOBuf* source, Socket* socket,
     MostCommonMessage* msg = MostCommonMessage::Get();
     source->cutn(&msg->meta, meta_size);
     source->cutn(&msg->payload, body_size - meta_size);
+    if (bthread::FLAGS_bthread_deadline_scheduling) {
+        msg->set_process_timeout_ms(PeekRequestTimeoutMs(msg->meta));
+    }
     return MakeMessage(msg);
 }
 
@@ -578,6 +642,41 @@ bool DeserializeRpcMessage(const butil::IOBuf& data, Controller& cntl,
     return false;
 }
 
+namespace {
+// Set deadline of the calling bthread to the deadline of the client during
+// processing of the request, so that it's preferred over requests with later
+// deadlines by -bthread_deadline_scheduling. The bthread is usually started
+// with the deadline already (see ParseRpcMessage()), this is for requests
+// processed in place. The deadline is restored on destruction since the
+// bthread may go on processing other messages.
+class ScopedRequestDeadline {
+public:
+    explicit ScopedRequestDeadline(const InputMessageBase* msg)
+        : _saved_deadline_us(-1) {
+        const int64_t deadline_us = msg->process_deadline_us();
+        if (deadline_us == 0) {
+            return;
+        }
+        int64_t saved_deadline_us = 0;
+        if (bthread_get_deadline(&saved_deadline_us) != 0) {
+            // Not in a bthread.
+            return;
+        }
+        _saved_deadline_us = saved_deadline_us;
+        bthread_set_deadline(deadline_us);
+    }
+    ~ScopedRequestDeadline() {
+        if (_saved_deadline_us >= 0) {
+            bthread_set_deadline(_saved_deadline_us);
+        }
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ScopedRequestDeadline);
+    int64_t _saved_deadline_us;
+};
+}  // namespace
+
 void ProcessRpcRequest(InputMessageBase* msg_base) {
     const int64_t start_parse_us = butil::cpuwide_time_us();
     DestroyingPtr<MostCommonMessage> msg(static_cast<MostCommonMessage*>(msg_base));
@@ -624,6 +723,7 @@ void ProcessRpcRequest(InputMessageBase* msg_base) {
     if (request_meta.has_timeout_ms()) {
         cntl->set_timeout_ms(request_meta.timeout_ms());
     }
+    ScopedRequestDeadline request_deadline(msg.get());
     cntl->set_request_content_type(meta.content_type());
     cntl->set_request_compress_type((CompressType)meta.compress_type());
     cntl->set_request_checksum_type((ChecksumType)meta.checksum_type());
@@ -156,14 +156,16 @@ inline const ReplicaPolicy* GetReplicaPolicy(ConsistentHashingLoadBalancerType t
 
 } // namespace
 
-ConsistentHashingLoadBalancer::ConsistentHashingLoadBalancer(
+template <typename DataPolicy>
+BasicConsistentHashingLoadBalancer<DataPolicy>::BasicConsistentHashingLoadBalancer(
     ConsistentHashingLoadBalancerType type)
     : _num_replicas(FLAGS_chash_num_replicas), _type(type) {
     CHECK(GetReplicaPolicy(_type))
         << "Fail to find replica policy for consistency lb type: '" << _type << '\'';
 }
 
-size_t ConsistentHashingLoadBalancer::AddBatch(
+template <typename DataPolicy>
+size_t BasicConsistentHashingLoadBalancer<DataPolicy>::AddBatch(
         std::vector<Node> &bg, const std::vector<Node> &fg, 
         const std::vector<Node> &servers, bool *executed) {
     if (*executed) {
@@ -178,7 +180,8 @@ size_t ConsistentHashingLoadBalancer::AddBatch(
     return bg.size() - fg.size();
 }
 
-size_t ConsistentHashingLoadBalancer::RemoveBatch(
+template <typename DataPolicy>
+size_t BasicConsistentHashingLoadBalancer<DataPolicy>::RemoveBatch(
         std::vector<Node> &bg, const std::vector<Node> &fg,
         const std::vector<ServerId> &servers, bool *executed) {
     if (*executed) {
@@ -215,7 +218,8 @@ size_t ConsistentHashingLoadBalancer::RemoveBatch(
     return fg.size() - bg.size();
 }
 
-size_t ConsistentHashingLoadBalancer::Remove(
+template <typename DataPolicy>
+size_t BasicConsistentHashingLoadBalancer<DataPolicy>::Remove(
         std::vector<Node> &bg, const std::vector<Node> &fg,
         const ServerId& server, bool *executed) {
     if (*executed) {
@@ -231,7 +235,9 @@ size_t ConsistentHashingLoadBalancer::Remove(
     return fg.size() - bg.size();
 }
 
-bool ConsistentHashingLoadBalancer::AddServer(const ServerId& server) {
+template <typename DataPolicy>
+bool BasicConsistentHashingLoadBalancer<DataPolicy>::AddServer(
+    const ServerId& server) {
     std::vector<Node> add_nodes;
     add_nodes.reserve(_num_replicas);
     if (!GetReplicaPolicy(_type)->Build(server, _num_replicas, &add_nodes)) {
@@ -245,7 +251,8 @@ bool ConsistentHashingLoadBalancer::AddServer(const ServerId& server) {
     return ret != 0;
 }
 
-size_t ConsistentHashingLoadBalancer::AddServersInBatch(
+template <typename DataPolicy>
+size_t BasicConsistentHashingLoadBalancer<DataPolicy>::AddServersInBatch(
     const std::vector<ServerId> &servers) {
     std::vector<Node> add_nodes;
     add_nodes.reserve(servers.size() * _num_replicas);
@@ -268,14 +275,17 @@ size_t ConsistentHashingLoadBalancer::AddServersInBatch(
     return n;
 }
 
-bool ConsistentHashingLoadBalancer::RemoveServer(const ServerId& server) {
+template <typename DataPolicy>
+bool BasicConsistentHashingLoadBalancer<DataPolicy>::RemoveServer(
+    const ServerId& server) {
     bool executed = false;
     const size_t ret = _db_hash_ring.ModifyWithForeground(Remove, server, &executed);
     CHECK(ret == 0 || ret == _num_replicas);
     return ret != 0;
 }
 
-size_t ConsistentHashingLoadBalancer::RemoveServersInBatch(
+template <typename DataPolicy>
+size_t BasicConsistentHashingLoadBalancer<DataPolicy>::RemoveServersInBatch(
     const std::vector<ServerId> &servers) {
     bool executed = false;
     const size_t ret = _db_hash_ring.ModifyWithForeground(RemoveBatch, servers, &executed);
@@ -284,8 +294,12 @@ size_t ConsistentHashingLoadBalancer::RemoveServersInBatch(
     return n;
 }
 
-LoadBalancer *ConsistentHashingLoadBalancer::New(const butil::StringPiece& params) const {
-    ConsistentHashingLoadBalancer* lb = new ConsistentHashingLoadBalancer(_type);
+template <typename DataPolicy>
+LoadBalancer *
+BasicConsistentHashingLoadBalancer<DataPolicy>::New(
+    const butil::StringPiece& params) const {
+    BasicConsistentHashingLoadBalancer* lb =
+        new BasicConsistentHashingLoadBalancer(_type);
     if (!lb->SetParameters(params)) {
         delete lb;
         lb = nullptr;
@@ -293,11 +307,13 @@ LoadBalancer *ConsistentHashingLoadBalancer::New(const butil::StringPiece& param
     return lb;
 }
 
-void ConsistentHashingLoadBalancer::Destroy() {
+template <typename DataPolicy>
+void BasicConsistentHashingLoadBalancer<DataPolicy>::Destroy() {
     delete this;
 }
 
-int ConsistentHashingLoadBalancer::SelectServer(
+template <typename DataPolicy>
+int BasicConsistentHashingLoadBalancer<DataPolicy>::SelectServer(
     const SelectIn &in, SelectOut *out) {
     if (!in.has_request_code) {
         LOG(ERROR) << "Controller.set_request_code() is required";
@@ -307,7 +323,7 @@ int ConsistentHashingLoadBalancer::SelectServer(
         LOG(ERROR) << "request_code must be 32-bit currently";
         return EINVAL;
     }
-    butil::DoublyBufferedData<std::vector<Node> >::ScopedPtr s;
+    typename HashRing::ScopedPtr s;
     if (_db_hash_ring.Read(&s) != 0) {
         return ENOMEM;
     }
@@ -333,7 +349,8 @@ int ConsistentHashingLoadBalancer::SelectServer(
     return EHOSTDOWN;
 }
 
-void ConsistentHashingLoadBalancer::Describe(
+template <typename DataPolicy>
+void BasicConsistentHashingLoadBalancer<DataPolicy>::Describe(
     std::ostream &os, const DescribeOptions& options) {
     if (!options.verbose) {
         os << "c_hash";
@@ -363,12 +380,13 @@ void ConsistentHashingLoadBalancer::Describe(
     os << "}\n";
 }
 
-void ConsistentHashingLoadBalancer::GetLoads(
+template <typename DataPolicy>
+void BasicConsistentHashingLoadBalancer<DataPolicy>::GetLoads(
     std::map<butil::EndPoint, double> *load_map) {
     load_map->clear();
     std::map<butil::EndPoint, uint32_t> count_map;
     do {
-        butil::DoublyBufferedData<std::vector<Node> >::ScopedPtr s;
+        typename HashRing::ScopedPtr s;
         if (_db_hash_ring.Read(&s) != 0) {
             break;
         }
@@ -388,7 +406,9 @@ void ConsistentHashingLoadBalancer::GetLoads(
     }
 }
 
-bool ConsistentHashingLoadBalancer::SetParameters(const butil::StringPiece& params) {
+template <typename DataPolicy>
+bool BasicConsistentHashingLoadBalancer<DataPolicy>::SetParameters(
+    const butil::StringPiece& params) {
     for (butil::KeyValuePairsSplitter sp(params.begin(), params.end(), ' ', '=');
             sp; ++sp) {
         if (sp.value().empty()) {
@@ -406,5 +426,8 @@ bool ConsistentHashingLoadBalancer::SetParameters(const butil::StringPiece& para
     return true;
 }
 
+template class BasicConsistentHashingLoadBalancer<butil::DoublyBufferedPolicy>;
+template class BasicConsistentHashingLoadBalancer<butil::EpochBufferedPolicy>;
+
 }  // namespace policy
 } // namespace brpc
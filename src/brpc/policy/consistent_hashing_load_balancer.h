@@ -24,6 +24,7 @@
 #include <vector>                                       // std::vector
 #include "butil/endpoint.h"                              // butil::EndPoint
 #include "butil/containers/doubly_buffered_data.h"
+#include "butil/containers/epoch_buffered_data.h"
 #include "brpc/load_balancer.h"
 
 
@@ -41,25 +42,31 @@ enum ConsistentHashingLoadBalancerType {
     CONS_HASH_LB_LAST = 3
 };
 
-class ConsistentHashingLoadBalancer : public LoadBalancer {
+struct ConsistentHashingNode {
+    uint32_t hash;
+    ServerId server_sock;
+    butil::EndPoint server_addr;  // To make sorting stable among all clients
+    bool operator<(const ConsistentHashingNode &rhs) const {
+        if (hash < rhs.hash) { return true; }
+        if (hash > rhs.hash) { return false; }
+        if (server_addr < rhs.server_addr) { return true; }
+        if (server_addr > rhs.server_addr) { return false; }
+        // compare by tag if has the same ip-port
+        return server_sock.tag < rhs.server_sock.tag;
+    }
+    bool operator<(const uint32_t code) const {
+        return hash < code;
+    }
+};
+
+// `DataPolicy' selects the container of the hash ring:
+// butil::DoublyBufferedPolicy or butil::EpochBufferedPolicy.
+template <typename DataPolicy>
+class BasicConsistentHashingLoadBalancer : public LoadBalancer {
 public:
-    struct Node {
-        uint32_t hash;
-        ServerId server_sock;
-        butil::EndPoint server_addr;  // To make sorting stable among all clients
-        bool operator<(const Node &rhs) const {
-            if (hash < rhs.hash) { return true; }
-            if (hash > rhs.hash) { return false; }
-            if (server_addr < rhs.server_addr) { return true; }
-            if (server_addr > rhs.server_addr) { return false; }
-            // compare by tag if has the same ip-port
-            return server_sock.tag < rhs.server_sock.tag;
-        }
-        bool operator<(const uint32_t code) const {
-            return hash < code;
-        }
-    };
-    explicit ConsistentHashingLoadBalancer(ConsistentHashingLoadBalancerType type);
+    typedef ConsistentHashingNode Node;
+    explicit BasicConsistentHashingLoadBalancer(
+        ConsistentHashingLoadBalancerType type);
     bool AddServer(const ServerId& server);
     bool RemoveServer(const ServerId& server);
     size_t AddServersInBatch(const std::vector<ServerId> &servers);
@@ -80,9 +87,16 @@ private:
                          const ServerId& server, bool *executed);
     size_t _num_replicas;
     ConsistentHashingLoadBalancerType _type;
-    butil::DoublyBufferedData<std::vector<Node> > _db_hash_ring;
+    typedef typename DataPolicy::template Data<std::vector<Node> > HashRing;
+
+    HashRing _db_hash_ring;
 };
 
+typedef BasicConsistentHashingLoadBalancer<butil::DoublyBufferedPolicy>
+    ConsistentHashingLoadBalancer;
+typedef BasicConsistentHashingLoadBalancer<butil::EpochBufferedPolicy>
+    EpochConsistentHashingLoadBalancer;
+
 }  // namespace policy
 } // namespace brpc
 
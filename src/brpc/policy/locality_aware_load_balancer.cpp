@@ -41,17 +41,19 @@ static const size_t INITIAL_WEIGHT_TREE_SIZE = 128;
 static const int64_t WEIGHT_SCALE =
     std::numeric_limits<int64_t>::max() / 72000000 / (INITIAL_WEIGHT_TREE_SIZE - 1);
 
-LocalityAwareLoadBalancer::LocalityAwareLoadBalancer()
-    : _total(0) {
+template <typename DataPolicy>
+BasicLocalityAwareLoadBalancer<DataPolicy>::BasicLocalityAwareLoadBalancer() {
 }
 
-LocalityAwareLoadBalancer::~LocalityAwareLoadBalancer() {
+template <typename DataPolicy>
+BasicLocalityAwareLoadBalancer<DataPolicy>::~BasicLocalityAwareLoadBalancer() {
     _db_servers.ModifyWithForeground(RemoveAll);
 }
 
-bool LocalityAwareLoadBalancer::Add(Servers& bg, const Servers& fg,
-                                    SocketId id,
-                                    LocalityAwareLoadBalancer* lb) {
+template <typename DataPolicy>
+bool BasicLocalityAwareLoadBalancer<DataPolicy>::Add(
+    Servers& bg, const Servers& fg, SocketId id,
+    BasicLocalityAwareLoadBalancer* lb) {
     if (bg.weight_tree.capacity() < INITIAL_WEIGHT_TREE_SIZE) {
         bg.weight_tree.reserve(INITIAL_WEIGHT_TREE_SIZE);
     }
@@ -103,8 +105,9 @@ bool LocalityAwareLoadBalancer::Add(Servers& bg, const Servers& fg,
     return true;
 }
 
-bool LocalityAwareLoadBalancer::Remove(
-    Servers& bg, SocketId id, LocalityAwareLoadBalancer* lb) {
+template <typename DataPolicy>
+bool BasicLocalityAwareLoadBalancer<DataPolicy>::Remove(
+    Servers& bg, SocketId id, BasicLocalityAwareLoadBalancer* lb) {
     size_t* pindex = bg.server_map.seek(id);
     if (nullptr == pindex) {
         // The id does not exist.
@@ -191,7 +194,9 @@ bool LocalityAwareLoadBalancer::Remove(
     return true;
 }
 
-bool LocalityAwareLoadBalancer::RemoveAll(Servers& bg, const Servers& fg) {
+template <typename DataPolicy>
+bool BasicLocalityAwareLoadBalancer<DataPolicy>::RemoveAll(
+    Servers& bg, const Servers& fg) {
     bg.server_map.clear();
     if (!fg.weight_tree.empty()) {
         for (size_t i = 0; i < bg.weight_tree.size(); ++i) {
@@ -202,9 +207,10 @@ bool LocalityAwareLoadBalancer::RemoveAll(Servers& bg, const Servers& fg) {
     return true;
 }
 
-size_t LocalityAwareLoadBalancer::BatchAdd(
+template <typename DataPolicy>
+size_t BasicLocalityAwareLoadBalancer<DataPolicy>::BatchAdd(
     Servers& bg, const Servers& fg, const std::vector<SocketId>& servers,
-    LocalityAwareLoadBalancer* lb) {
+    BasicLocalityAwareLoadBalancer* lb) {
     size_t count = 0;
     for (size_t i = 0; i < servers.size(); ++i) {
         count += !!Add(bg, fg, servers[i], lb);
@@ -213,9 +219,10 @@ size_t LocalityAwareLoadBalancer::BatchAdd(
 }
 
 // FIXME(gejun): not work
-size_t LocalityAwareLoadBalancer::BatchRemove(
+template <typename DataPolicy>
+size_t BasicLocalityAwareLoadBalancer<DataPolicy>::BatchRemove(
     Servers& bg, const std::vector<SocketId>& servers,
-    LocalityAwareLoadBalancer* lb) {
+    BasicLocalityAwareLoadBalancer* lb) {
     size_t count = 0;
     for (size_t i = 0; i < servers.size(); ++i) {
         count += !!Remove(bg, servers[i], lb);
@@ -223,7 +230,9 @@ size_t LocalityAwareLoadBalancer::BatchRemove(
     return count;
 }
 
-bool LocalityAwareLoadBalancer::AddServer(const ServerId& id) {
+template <typename DataPolicy>
+bool BasicLocalityAwareLoadBalancer<DataPolicy>::AddServer(
+    const ServerId& id) {
     if (_id_mapper.AddServer(id)) {
         RPC_VLOG << "LALB: added " << id;
         return _db_servers.ModifyWithForeground(Add, id.id, this);
@@ -232,7 +241,9 @@ bool LocalityAwareLoadBalancer::AddServer(const ServerId& id) {
     }
 }
 
-bool LocalityAwareLoadBalancer::RemoveServer(const ServerId& id) {
+template <typename DataPolicy>
+bool BasicLocalityAwareLoadBalancer<DataPolicy>::RemoveServer(
+    const ServerId& id) {
     if (_id_mapper.RemoveServer(id)) {
         RPC_VLOG << "LALB: removed " << id;
         return _db_servers.Modify(Remove, id.id, this);
@@ -241,7 +252,8 @@ bool LocalityAwareLoadBalancer::RemoveServer(const ServerId& id) {
     }
 }
 
-size_t LocalityAwareLoadBalancer::AddServersInBatch(
+template <typename DataPolicy>
+size_t BasicLocalityAwareLoadBalancer<DataPolicy>::AddServersInBatch(
     const std::vector<ServerId>& servers) {
     std::vector<SocketId> & ids = _id_mapper.AddServers(servers);
     RPC_VLOG << "LALB: added " << ids.size();
@@ -249,7 +261,8 @@ size_t LocalityAwareLoadBalancer::AddServersInBatch(
     return servers.size();
 }
 
-size_t LocalityAwareLoadBalancer::RemoveServersInBatch(
+template <typename DataPolicy>
+size_t BasicLocalityAwareLoadBalancer<DataPolicy>::RemoveServersInBatch(
     const std::vector<ServerId>& servers) {
     std::vector<SocketId> & ids = _id_mapper.RemoveServers(servers);
     RPC_VLOG << "LALB: removed " << ids.size();
@@ -262,8 +275,10 @@ size_t LocalityAwareLoadBalancer::RemoveServersInBatch(
     // return _db_servers.Modify(BatchRemove, servers, this);
 }
 
-int LocalityAwareLoadBalancer::SelectServer(const SelectIn& in, SelectOut* out) {
-    butil::DoublyBufferedData<Servers>::ScopedPtr s;
+template <typename DataPolicy>
+int BasicLocalityAwareLoadBalancer<DataPolicy>::SelectServer(
+    const SelectIn& in, SelectOut* out) {
+    typename ServersData::ScopedPtr s;
     if (_db_servers.Read(&s) != 0) {
         return ENOMEM;
     }
@@ -356,8 +371,10 @@ int LocalityAwareLoadBalancer::SelectServer(const SelectIn& in, SelectOut* out)
     return EHOSTDOWN;
 }
 
-void LocalityAwareLoadBalancer::Feedback(const CallInfo& info) {        
-    butil::DoublyBufferedData<Servers>::ScopedPtr s;
+template <typename DataPolicy>
+void BasicLocalityAwareLoadBalancer<DataPolicy>::Feedback(
+    const CallInfo& info) {
+    typename ServersData::ScopedPtr s;
     if (_db_servers.Read(&s) != 0) {
         return;
     }
@@ -374,7 +391,7 @@ void LocalityAwareLoadBalancer::Feedback(const CallInfo& info) {
     }
 }
 
-int64_t LocalityAwareLoadBalancer::Weight::Update(
+int64_t LocalityAwareLoadBalancerBase::Weight::Update(
     const CallInfo& ci, size_t index) {
     const int64_t end_time_us = butil::gettimeofday_us();
     const int64_t latency = end_time_us - ci.begin_time_us;
@@ -470,16 +487,20 @@ int64_t LocalityAwareLoadBalancer::Weight::Update(
     return ResetWeight(index, end_time_us);
 }
 
-LocalityAwareLoadBalancer*
-LocalityAwareLoadBalancer::New(const butil::StringPiece&) const {
-    return new LocalityAwareLoadBalancer;
+template <typename DataPolicy>
+BasicLocalityAwareLoadBalancer<DataPolicy>*
+BasicLocalityAwareLoadBalancer<DataPolicy>::New(
+    const butil::StringPiece&) const {
+    return new BasicLocalityAwareLoadBalancer;
 }
 
-void LocalityAwareLoadBalancer::Destroy() {
+template <typename DataPolicy>
+void BasicLocalityAwareLoadBalancer<DataPolicy>::Destroy() {
     delete this;
 }
 
-void LocalityAwareLoadBalancer::Weight::Describe(std::ostream& os, int64_t now) {
+void LocalityAwareLoadBalancerBase::Weight::Describe(
+    std::ostream& os, int64_t now) {
     std::unique_lock<butil::Mutex> mu(_mutex);
     int64_t begin_time_sum = _begin_time_sum;
     int begin_time_count = _begin_time_count;
@@ -512,7 +533,8 @@ void LocalityAwareLoadBalancer::Weight::Describe(std::ostream& os, int64_t now)
         << " expected_qps=" << qps;
 }
 
-void LocalityAwareLoadBalancer::Describe(
+template <typename DataPolicy>
+void BasicLocalityAwareLoadBalancer<DataPolicy>::Describe(
     std::ostream& os, const DescribeOptions& options) {
     if (!options.verbose) {
         os << "la";
@@ -520,7 +542,7 @@ void LocalityAwareLoadBalancer::Describe(
     }
     os << "LocalityAware{total="
        << _total.load(butil::memory_order_relaxed) << ' ';
-    butil::DoublyBufferedData<Servers>::ScopedPtr s;
+    typename ServersData::ScopedPtr s;
     if (_db_servers.Read(&s) != 0) {
         os << "fail to read _db_servers";
     } else {
@@ -546,7 +568,7 @@ void LocalityAwareLoadBalancer::Describe(
     os << '}';
 }
 
-LocalityAwareLoadBalancer::Weight::Weight(int64_t initial_weight)
+LocalityAwareLoadBalancerBase::Weight::Weight(int64_t initial_weight)
     : _weight(initial_weight)
     , _base_weight(initial_weight)
     , _begin_time_sum(0)
@@ -558,10 +580,10 @@ LocalityAwareLoadBalancer::Weight::Weight(int64_t initial_weight)
     , _time_q(_time_q_items, sizeof(_time_q_items), butil::NOT_OWN_STORAGE) {
 }
 
-LocalityAwareLoadBalancer::Weight::~Weight() {
+LocalityAwareLoadBalancerBase::Weight::~Weight() {
 }
 
-int64_t LocalityAwareLoadBalancer::Weight::Disable() {
+int64_t LocalityAwareLoadBalancerBase::Weight::Disable() {
     BAIDU_SCOPED_LOCK(_mutex);
     const int64_t saved = _weight;
     _base_weight = -1;
@@ -569,7 +591,7 @@ int64_t LocalityAwareLoadBalancer::Weight::Disable() {
     return saved;
 }
 
-int64_t LocalityAwareLoadBalancer::Weight::MarkOld(size_t index) {
+int64_t LocalityAwareLoadBalancerBase::Weight::MarkOld(size_t index) {
     BAIDU_SCOPED_LOCK(_mutex);
     const int64_t saved = _weight;
     _old_weight = saved;
@@ -578,7 +600,8 @@ int64_t LocalityAwareLoadBalancer::Weight::MarkOld(size_t index) {
     return saved;
 }
         
-std::pair<int64_t, int64_t> LocalityAwareLoadBalancer::Weight::ClearOld() {
+std::pair<int64_t, int64_t>
+LocalityAwareLoadBalancerBase::Weight::ClearOld() {
     BAIDU_SCOPED_LOCK(_mutex);
     const int64_t old_weight = _old_weight;
     const int64_t diff = _old_diff_sum;
@@ -588,5 +611,8 @@ std::pair<int64_t, int64_t> LocalityAwareLoadBalancer::Weight::ClearOld() {
     return std::make_pair(old_weight, diff);
 }
 
+template class BasicLocalityAwareLoadBalancer<butil::DoublyBufferedPolicy>;
+template class BasicLocalityAwareLoadBalancer<butil::EpochBufferedPolicy>;
+
 }  // namespace policy
 } // namespace brpc
@@ -24,6 +24,7 @@
 #include <map>                                         // std::map
 #include "butil/containers/flat_map.h"                  // FlatMap
 #include "butil/containers/doubly_buffered_data.h"      // DoublyBufferedData
+#include "butil/containers/epoch_buffered_data.h"       // EpochBufferedData
 #include "butil/containers/bounded_queue.h"             // BoundedQueue
 #include "brpc/load_balancer.h"
 #include "brpc/controller.h"
@@ -35,24 +36,12 @@ namespace policy {
 DECLARE_int64(min_weight);
 DECLARE_double(punish_inflight_ratio);
 
-// Locality-aware is an iterative algorithm to send requests to servers which
-// have lowest expected latencies. Read docs/cn/lalb.md to get a peek at the
-// algorithm. The implementation is complex.
-class LocalityAwareLoadBalancer : public LoadBalancer {
-public:
-    LocalityAwareLoadBalancer();
-    ~LocalityAwareLoadBalancer() override;
-    bool AddServer(const ServerId& id) override;
-    bool RemoveServer(const ServerId& id) override;
-    size_t AddServersInBatch(const std::vector<ServerId>& servers) override;
-    size_t RemoveServersInBatch(const std::vector<ServerId>& servers) override;
-    LocalityAwareLoadBalancer* New(const butil::StringPiece&) const override;
-    void Destroy() override;
-    int SelectServer(const SelectIn& in, SelectOut* out) override;
-    void Feedback(const CallInfo& info) override;
-    void Describe(std::ostream& os, const DescribeOptions& options) override;
+// Parts of LocalityAwareLoadBalancer not depending on the container of
+// servers.
+class LocalityAwareLoadBalancerBase : public LoadBalancer {
+protected:
+    LocalityAwareLoadBalancerBase() : _total(0) {}
 
-private:
     struct TimeInfo {
         int64_t latency_sum;         // microseconds
         int64_t end_time_us;
@@ -127,17 +116,6 @@ private:
         // Not require position `index' to exist.
         void UpdateParentWeights(int64_t diff, size_t index) const;
     };
-    static bool Add(Servers& bg, const Servers& fg,
-                    SocketId id, LocalityAwareLoadBalancer*);
-    static bool Remove(Servers& bg, SocketId id,
-                       LocalityAwareLoadBalancer*);
-    static size_t BatchAdd(Servers& bg, const Servers& fg,
-                         const std::vector<SocketId>& servers,
-                         LocalityAwareLoadBalancer*);
-    static size_t BatchRemove(Servers& bg, 
-                              const std::vector<SocketId>& servers,
-                              LocalityAwareLoadBalancer*);
-    static bool RemoveAll(Servers& bg, const Servers& fg);
 
     // Add a entry to _left_weights.
     butil::atomic<int64_t>* PushLeft() {
@@ -147,12 +125,55 @@ private:
     void PopLeft() { _left_weights.pop_back(); }
 
     butil::atomic<int64_t> _total;
-    butil::DoublyBufferedData<Servers> _db_servers;
     std::deque<int64_t> _left_weights;
     ServerId2SocketIdMapper _id_mapper;
 };
 
-inline void LocalityAwareLoadBalancer::Servers::UpdateParentWeights(
+// Locality-aware is an iterative algorithm to send requests to servers which
+// have lowest expected latencies. Read docs/cn/lalb.md to get a peek at the
+// algorithm. The implementation is complex.
+// DataPolicy selects the container of servers, see epoch_buffered_data.h.
+template <typename DataPolicy>
+class BasicLocalityAwareLoadBalancer : public LocalityAwareLoadBalancerBase {
+public:
+    BasicLocalityAwareLoadBalancer();
+    ~BasicLocalityAwareLoadBalancer() override;
+    bool AddServer(const ServerId& id) override;
+    bool RemoveServer(const ServerId& id) override;
+    size_t AddServersInBatch(const std::vector<ServerId>& servers) override;
+    size_t RemoveServersInBatch(const std::vector<ServerId>& servers) override;
+    BasicLocalityAwareLoadBalancer* New(
+        const butil::StringPiece&) const override;
+    void Destroy() override;
+    int SelectServer(const SelectIn& in, SelectOut* out) override;
+    void Feedback(const CallInfo& info) override;
+    void Describe(std::ostream& os, const DescribeOptions& options) override;
+
+private:
+    typedef typename DataPolicy::template Data<Servers> ServersData;
+
+    static bool Add(Servers& bg, const Servers& fg,
+                    SocketId id, BasicLocalityAwareLoadBalancer*);
+    static bool Remove(Servers& bg, SocketId id,
+                       BasicLocalityAwareLoadBalancer*);
+    static size_t BatchAdd(Servers& bg, const Servers& fg,
+                         const std::vector<SocketId>& servers,
+                         BasicLocalityAwareLoadBalancer*);
+    static size_t BatchRemove(Servers& bg, 
+                              const std::vector<SocketId>& servers,
+                              BasicLocalityAwareLoadBalancer*);
+    static bool RemoveAll(Servers& bg, const Servers& fg);
+
+    ServersData _db_servers;
+};
+
+typedef BasicLocalityAwareLoadBalancer<butil::DoublyBufferedPolicy>
+LocalityAwareLoadBalancer;
+// Reads servers without locking thread-local mutexes.
+typedef BasicLocalityAwareLoadBalancer<butil::EpochBufferedPolicy>
+EpochLocalityAwareLoadBalancer;
+
+inline void LocalityAwareLoadBalancerBase::Servers::UpdateParentWeights(
     int64_t diff, size_t index) const {
     while (index != 0) {
         const size_t parent_index = (index - 1) >> 1;
@@ -164,7 +185,7 @@ inline void LocalityAwareLoadBalancer::Servers::UpdateParentWeights(
     }
 }
 
-inline int64_t LocalityAwareLoadBalancer::Weight::ResetWeight(
+inline int64_t LocalityAwareLoadBalancerBase::Weight::ResetWeight(
     size_t index, int64_t now_us) {
     int64_t new_weight = _base_weight;
     if (_begin_time_count > 0) {
@@ -188,8 +209,8 @@ inline int64_t LocalityAwareLoadBalancer::Weight::ResetWeight(
     return diff;
 }
 
-inline LocalityAwareLoadBalancer::Weight::AddInflightResult
-LocalityAwareLoadBalancer::Weight::AddInflight(
+inline LocalityAwareLoadBalancerBase::Weight::AddInflightResult
+LocalityAwareLoadBalancerBase::Weight::AddInflight(
     const SelectIn& in, size_t index, int64_t dice) {
     BAIDU_SCOPED_LOCK(_mutex);
     if (Disabled()) {
@@ -208,7 +229,7 @@ LocalityAwareLoadBalancer::Weight::AddInflight(
     return r;
 }
 
-inline int64_t LocalityAwareLoadBalancer::Weight::MarkFailed(
+inline int64_t LocalityAwareLoadBalancerBase::Weight::MarkFailed(
     size_t index, int64_t avg_weight) {
     BAIDU_SCOPED_LOCK(_mutex);
     if (_base_weight <= avg_weight) {
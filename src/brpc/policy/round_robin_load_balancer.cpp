@@ -26,7 +26,9 @@
 namespace brpc {
 namespace policy {
 
-bool RoundRobinLoadBalancer::Add(Servers& bg, const ServerId& id) {
+template <typename DataPolicy>
+bool BasicRoundRobinLoadBalancer<DataPolicy>::Add(
+    Servers& bg, const ServerId& id) {
     if (bg.server_list.capacity() < 128) {
         bg.server_list.reserve(128);
     }
@@ -39,7 +41,9 @@ bool RoundRobinLoadBalancer::Add(Servers& bg, const ServerId& id) {
     return true;
 }
 
-bool RoundRobinLoadBalancer::Remove(Servers& bg, const ServerId& id) {
+template <typename DataPolicy>
+bool BasicRoundRobinLoadBalancer<DataPolicy>::Remove(
+    Servers& bg, const ServerId& id) {
     std::map<ServerId, size_t>::iterator it = bg.server_map.find(id);
     if (it != bg.server_map.end()) {
         const size_t index = it->second;
@@ -52,7 +56,8 @@ bool RoundRobinLoadBalancer::Remove(Servers& bg, const ServerId& id) {
     return false;
 }
 
-size_t RoundRobinLoadBalancer::BatchAdd(
+template <typename DataPolicy>
+size_t BasicRoundRobinLoadBalancer<DataPolicy>::BatchAdd(
     Servers& bg, const std::vector<ServerId>& servers) {
     size_t count = 0;
     for (size_t i = 0; i < servers.size(); ++i) {
@@ -61,7 +66,8 @@ size_t RoundRobinLoadBalancer::BatchAdd(
     return count;
 }
 
-size_t RoundRobinLoadBalancer::BatchRemove(
+template <typename DataPolicy>
+size_t BasicRoundRobinLoadBalancer<DataPolicy>::BatchRemove(
     Servers& bg, const std::vector<ServerId>& servers) {
     size_t count = 0;
     for (size_t i = 0; i < servers.size(); ++i) {
@@ -70,15 +76,18 @@ size_t RoundRobinLoadBalancer::BatchRemove(
     return count;
 }
 
-bool RoundRobinLoadBalancer::AddServer(const ServerId& id) {
+template <typename DataPolicy>
+bool BasicRoundRobinLoadBalancer<DataPolicy>::AddServer(const ServerId& id) {
     return _db_servers.Modify(Add, id);
 }
 
-bool RoundRobinLoadBalancer::RemoveServer(const ServerId& id) {
+template <typename DataPolicy>
+bool BasicRoundRobinLoadBalancer<DataPolicy>::RemoveServer(const ServerId& id) {
     return _db_servers.Modify(Remove, id);
 }
 
-size_t RoundRobinLoadBalancer::AddServersInBatch(
+template <typename DataPolicy>
+size_t BasicRoundRobinLoadBalancer<DataPolicy>::AddServersInBatch(
     const std::vector<ServerId>& servers) {
     const size_t n = _db_servers.Modify(BatchAdd, servers);
     LOG_IF(ERROR, n != servers.size())
@@ -87,14 +96,17 @@ size_t RoundRobinLoadBalancer::AddServersInBatch(
     return n;
 }
 
-size_t RoundRobinLoadBalancer::RemoveServersInBatch(
+template <typename DataPolicy>
+size_t BasicRoundRobinLoadBalancer<DataPolicy>::RemoveServersInBatch(
     const std::vector<ServerId>& servers) {
     const size_t n = _db_servers.Modify(BatchRemove, servers);
     return n;
 }
 
-int RoundRobinLoadBalancer::SelectServer(const SelectIn& in, SelectOut* out) {
-    butil::DoublyBufferedData<Servers, TLS>::ScopedPtr s;
+template <typename DataPolicy>
+int BasicRoundRobinLoadBalancer<DataPolicy>::SelectServer(
+    const SelectIn& in, SelectOut* out) {
+    typename ServersData::ScopedPtr s;
     if (_db_servers.Read(&s) != 0) {
         return ENOMEM;
     }
@@ -132,9 +144,11 @@ int RoundRobinLoadBalancer::SelectServer(const SelectIn& in, SelectOut* out) {
     return EHOSTDOWN;
 }
 
-RoundRobinLoadBalancer* RoundRobinLoadBalancer::New(
+template <typename DataPolicy>
+BasicRoundRobinLoadBalancer<DataPolicy>*
+BasicRoundRobinLoadBalancer<DataPolicy>::New(
     const butil::StringPiece& params) const {
-    RoundRobinLoadBalancer* lb = new RoundRobinLoadBalancer;
+    BasicRoundRobinLoadBalancer* lb = new BasicRoundRobinLoadBalancer;
     if (!lb->SetParameters(params)) {
         delete lb;
         lb = nullptr;
@@ -142,18 +156,20 @@ RoundRobinLoadBalancer* RoundRobinLoadBalancer::New(
     return lb;
 }
 
-void RoundRobinLoadBalancer::Destroy() {
+template <typename DataPolicy>
+void BasicRoundRobinLoadBalancer<DataPolicy>::Destroy() {
     delete this;
 }
 
-void RoundRobinLoadBalancer::Describe(
+template <typename DataPolicy>
+void BasicRoundRobinLoadBalancer<DataPolicy>::Describe(
     std::ostream &os, const DescribeOptions& options) {
     if (!options.verbose) {
         os << "rr";
         return;
     }
     os << "RoundRobin{";
-    butil::DoublyBufferedData<Servers, TLS>::ScopedPtr s;
+    typename ServersData::ScopedPtr s;
     if (_db_servers.Read(&s) != 0) {
         os << "fail to read _db_servers";
     } else {
@@ -165,9 +181,14 @@ void RoundRobinLoadBalancer::Describe(
     os << '}';
 }
 
-bool RoundRobinLoadBalancer::SetParameters(const butil::StringPiece& params) {
+template <typename DataPolicy>
+bool BasicRoundRobinLoadBalancer<DataPolicy>::SetParameters(
+    const butil::StringPiece& params) {
     return GetRecoverPolicyByParams(params, &_cluster_recover_policy);
 }
 
+template class BasicRoundRobinLoadBalancer<butil::DoublyBufferedPolicy>;
+template class BasicRoundRobinLoadBalancer<butil::EpochBufferedPolicy>;
+
 }  // namespace policy
 } // namespace brpc
@@ -22,6 +22,7 @@
 #include <vector>                                      // std::vector
 #include <map>                                         // std::map
 #include "butil/containers/doubly_buffered_data.h"
+#include "butil/containers/epoch_buffered_data.h"
 #include "brpc/load_balancer.h"
 #include "brpc/cluster_recover_policy.h"
 
@@ -30,14 +31,17 @@ namespace policy {
 
 // This LoadBalancer selects server evenly. Selected numbers of servers(added
 // at the same time) are very close.
-class RoundRobinLoadBalancer : public LoadBalancer {
+// `DataPolicy' selects the container of servers: butil::DoublyBufferedPolicy
+// or butil::EpochBufferedPolicy.
+template <typename DataPolicy>
+class BasicRoundRobinLoadBalancer : public LoadBalancer {
 public:
     bool AddServer(const ServerId& id) override;
     bool RemoveServer(const ServerId& id) override;
     size_t AddServersInBatch(const std::vector<ServerId>& servers) override;
     size_t RemoveServersInBatch(const std::vector<ServerId>& servers) override;
     int SelectServer(const SelectIn& in, SelectOut* out) override;
-    RoundRobinLoadBalancer* New(const butil::StringPiece&) const override;
+    BasicRoundRobinLoadBalancer* New(const butil::StringPiece&) const override;
     void Destroy() override;
     void Describe(std::ostream&, const DescribeOptions& options) override;
 
@@ -57,10 +61,17 @@ private:
     static size_t BatchAdd(Servers& bg, const std::vector<ServerId>& servers);
     static size_t BatchRemove(Servers& bg, const std::vector<ServerId>& servers);
 
-    butil::DoublyBufferedData<Servers, TLS> _db_servers;
+    typedef typename DataPolicy::template Data<Servers, TLS> ServersData;
+
+    ServersData _db_servers;
     std::shared_ptr<ClusterRecoverPolicy> _cluster_recover_policy;
 };
 
+typedef BasicRoundRobinLoadBalancer<butil::DoublyBufferedPolicy>
+    RoundRobinLoadBalancer;
+typedef BasicRoundRobinLoadBalancer<butil::EpochBufferedPolicy>
+    EpochRoundRobinLoadBalancer;
+
 }  // namespace policy
 } // namespace brpc
 
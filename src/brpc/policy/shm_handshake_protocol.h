@@ -0,0 +1,47 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_POLICY_SHM_HANDSHAKE_PROTOCOL_H
+#define BRPC_POLICY_SHM_HANDSHAKE_PROTOCOL_H
+
+// Same with rdma_handshake_protocol.h, the handshake of shared memory is
+// served by all servers so that a client connecting to a server not in
+// SOCKET_MODE_SHM gets a refusing hello and falls back to TCP on the same
+// connection.
+
+#include "butil/iobuf.h"
+#include "brpc/input_message_base.h"
+#include "brpc/parse_result.h"
+#include "brpc/socket.h"
+
+namespace brpc {
+namespace policy {
+
+// Parse binary format of shm handshake.
+ParseResult ParseShmHandshake(butil::IOBuf* source, Socket* socket,
+                              bool read_eof, const void* arg);
+
+// Actions to a shm handshake request, which is left unimplemented.
+// All requests are processed in the parsing process. This function
+// must be declared since server only enables shm handshake as a
+// server-side protocol when this function is declared.
+void ProcessShmHandshake(InputMessageBase* msg);
+
+}  // namespace policy
+}  // namespace brpc
+
+#endif  // BRPC_POLICY_SHM_HANDSHAKE_PROTOCOL_H
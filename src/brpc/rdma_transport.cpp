@@ -137,7 +137,9 @@ void RdmaTransport::ProcessEvent(bthread_attr_t attr) {
     bthread_t tid;
     if (FLAGS_usercode_in_coroutine) {
         OnEdge(_socket);
-    } else if (!EventDispatcherUnsched()) {
+    } else if (!EventDispatcherUnsched() && !(attr.flags & BTHREAD_NOSIGNAL)) {
+        // NOSIGNAL is set by EventDispatcher batching input events, which
+        // flushes the bthreads after all events are dispatched.
         auto rc = bthread_start_urgent(&tid, &attr, OnEdge, _socket);
         if (rc != 0) {
             LOG(FATAL) << "Fail to start ProcessEvent";
@@ -175,8 +177,8 @@ void RdmaTransport::QueueMessage(InputMessageClosure& input_msg,
     tmp.tag = bthread_self_tag();
     bthread_attr_set_name(&tmp, "ProcessInputMessage");
 
-    if (!FLAGS_usercode_in_coroutine && bthread_start_background(
-            &th, &tmp, ProcessInputMessage, to_run_msg) == 0) {
+    if (!FLAGS_usercode_in_coroutine && StartProcessInputMessage(
+            &th, &tmp, to_run_msg) == 0) {
         ++*num_bthread_created;
     } else {
         ProcessInputMessage(to_run_msg);
@@ -148,6 +148,8 @@ ServerOptions::ServerOptions()
     , has_builtin_services(true)
     , force_ssl(false)
     , socket_mode(SOCKET_MODE_TCP)
+    , write_coalesce_us(0)
+    , write_coalesce_bytes(0)
     , baidu_master_service(nullptr)
     , http_master_service(nullptr)
     , health_reporter(nullptr)
@@ -618,6 +620,10 @@ BUTIL_FORCE_INLINE bool is_rdma_handshake_protocol(const char* name) {
     return strcmp(name, "rdma_handshake") == 0;
 }
 
+BUTIL_FORCE_INLINE bool is_shm_handshake_protocol(const char* name) {
+    return strcmp(name, "shm_handshake") == 0;
+}
+
 Acceptor* Server::BuildAcceptor() {
     std::set<std::string> whitelist;
     for (butil::StringSplitter sp(_options.enabled_protocols.c_str(), ' ');
@@ -638,6 +644,7 @@ Acceptor* Server::BuildAcceptor() {
         if (has_whitelist &&
             !is_http_protocol(protocols[i].name) &&
             !is_rdma_handshake_protocol(protocols[i].name) &&
+            !is_shm_handshake_protocol(protocols[i].name) &&
             !whitelist.erase(protocols[i].name)) {
             // the protocol is not allowed to serve.
             RPC_VLOG << "Skip protocol=" << protocols[i].name;
@@ -1152,6 +1159,8 @@ int Server::StartInternal(const butil::EndPoint& endpoint,
                 return -1;
             }
             _am->_socket_mode = _options.socket_mode;
+            _am->_write_coalesce_us = _options.write_coalesce_us;
+            _am->_write_coalesce_bytes = _options.write_coalesce_bytes;
             _am->_bthread_tag = _options.bthread_tag;
         }
         // Set `_status' to RUNNING before accepting connections
@@ -224,10 +224,23 @@ struct ServerOptions {
     // Force ssl for all connections of the port to Start().
     bool force_ssl;
 
-    // the server socket mode uses tcp or rdma or other
+    // the server socket mode uses tcp or rdma or io_uring or shm or other
     // Default: SOCKET_MODE_TCP
     SocketMode socket_mode;
 
+    // If positive, connections accepted by this server wait up to so many
+    // microseconds before writing to merge concurrent requests into fewer
+    // writes, which saves syscalls of pipelined
+    // clients at the cost of latency.
+    // Default: 0 (write immediately)
+    int32_t write_coalesce_us;
+
+    // [Only effective when write_coalesce_us is positive]
+    // Write without waiting for the rest of `write_coalesce_us' once so
+    // many bytes are queued. Non-positive means no limit.
+    // Default: 0
+    int32_t write_coalesce_bytes;
+
     // [CAUTION] This option is for implementing specialized baidu-std proxies,
     // most users don't need it. Don't change this option unless you fully
     // understand the description below.
@@ -0,0 +1,668 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "brpc/shm/shm_endpoint.h"
+
+#if defined(OS_LINUX)
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <gflags/gflags.h>
+#include "butil/endpoint.h"
+#include "butil/fast_rand.h"
+#include "butil/fd_guard.h"
+#include "butil/logging.h"
+#include "butil/macros.h"
+#include "butil/raw_pack.h"
+#include "butil/string_printf.h"
+#include "butil/sys_byteorder.h"
+#include "butil/time.h"
+#include "bthread/bthread.h"
+#include "bthread/butex.h"
+#include "bvar/reducer.h"
+#include "brpc/errno.pb.h"
+#include "brpc/input_messenger.h"
+#include "brpc/shm_transport.h"
+#include "brpc/shm/shm_handshake.h"
+
+namespace brpc {
+namespace shm {
+
+DEFINE_bool(shm_trace_verbose, false,
+            "Print log message verbosely of shared memory connections");
+
+static const int WAIT_TIMEOUT_MS = 50;
+// Number of fds sent by the client: memfd, eventfd of the client and
+// eventfd of the server.
+static const int NUM_PASSED_FDS = 3;
+
+static pthread_once_t g_shm_vars_once = PTHREAD_ONCE_INIT;
+static bvar::Adder<int64_t>* g_shm_notify = nullptr;
+static bvar::Adder<int64_t>* g_shm_wait_space = nullptr;
+
+static void CreateShmVars() {
+    g_shm_notify = new bvar::Adder<int64_t>("shm_notify_count");
+    g_shm_wait_space = new bvar::Adder<int64_t>("shm_wait_space_count");
+}
+
+void GlobalShmInitialize() {
+    pthread_once(&g_shm_vars_once, CreateShmVars);
+}
+
+void ShmConnect::StartConnect(const Socket* socket,
+                              void (*done)(int err, void* data),
+                              void* data) {
+    ShmTransport* shm_transport =
+        static_cast<ShmTransport*>(socket->_transport.get());
+    CHECK(shm_transport->_shm_ep != nullptr);
+    SocketUniquePtr s;
+    if (Socket::Address(socket->id(), &s) != 0) {
+        return;
+    }
+    _done = done;
+    _data = data;
+    bthread_t tid;
+    bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+    bthread_attr_set_name(&attr, "ShmProcessHandshakeAtClient");
+    if (bthread_start_background(&tid, &attr,
+                                 ShmEndpoint::ProcessHandshakeAtClient,
+                                 shm_transport->_shm_ep) < 0) {
+        LOG(FATAL) << "Fail to start handshake bthread";
+        Run();
+    } else {
+        s.release();
+    }
+}
+
+void ShmConnect::StopConnect(Socket* socket) { }
+
+void ShmConnect::Run() {
+    _done(errno, _data);
+}
+
+ShmTransport* ShmEndpoint::GetShmTransport(const Socket* s) {
+    return static_cast<ShmTransport*>(s->_transport.get());
+}
+
+ShmEndpoint::ShmEndpoint(Socket* s)
+    : _socket(s)
+    , _state(UNINIT)
+    , _read_butex(bthread::butex_create_checked<butil::atomic<int> >())
+    , _local_efd(-1)
+    , _remote_efd(-1)
+    , _wait_space(false)
+    , _listen_fd(-1)
+    , _token(0) {}
+
+ShmEndpoint::~ShmEndpoint() {
+    Reset();
+    bthread::butex_destroy(_read_butex);
+}
+
+void ShmEndpoint::DeallocateResources() {
+    if (_local_efd >= 0) {
+        _io_event.RemoveConsumer(_local_efd);
+    }
+    _io_event.Reset();
+    if (_local_efd >= 0) {
+        close(_local_efd);
+        _local_efd = -1;
+    }
+    if (_remote_efd >= 0) {
+        close(_remote_efd);
+        _remote_efd = -1;
+    }
+    CloseListener();
+    _producer.Reset();
+    _consumer.Reset();
+    // Blocks still referenced by IOBuf keep the memory mapped.
+    _region.reset();
+    _wait_space.store(false, butil::memory_order_relaxed);
+}
+
+void ShmEndpoint::Reset() {
+    DeallocateResources();
+    _token = 0;
+    _state.store(UNINIT, butil::memory_order_relaxed);
+}
+
+void ShmEndpoint::CloseListener() {
+    if (_listen_fd >= 0) {
+        close(_listen_fd);
+        _listen_fd = -1;
+    }
+}
+
+void ShmEndpoint::NotifyRemote() {
+    const uint64_t one = 1;
+    // Fails only when the counter overflows, the peer is notified anyway.
+    butil::ignore_result(write(_remote_efd, &one, sizeof(one)));
+    *g_shm_notify << 1;
+}
+
+int ShmEndpoint::Start(ShmRegion* region, int q, int local_efd, int remote_efd) {
+    _region.reset(region);
+    _local_efd = local_efd;
+    _remote_efd = remote_efd;
+    _producer.Init(region, q);
+    _consumer.Init(region, 1 - q);
+    _io_event.set_bthread_tag(_socket->_io_event.bthread_tag());
+    if (_io_event.Init((void*)_socket->id()) != 0) {
+        return -1;
+    }
+    if (_io_event.AddConsumer(_local_efd) != 0) {
+        PLOG(WARNING) << "Fail to add eventfd of " << _socket->description()
+                      << " into EventDispatcher";
+        return -1;
+    }
+    return 0;
+}
+
+static bool IsSameHost(int fd) {
+    butil::EndPoint local;
+    butil::EndPoint remote;
+    if (butil::get_local_side(fd, &local) != 0 ||
+        butil::get_remote_side(fd, &remote) != 0) {
+        return false;
+    }
+    if (butil::is_endpoint_extended(remote)) {
+        // IPv6 and unix domain sockets.
+        return false;
+    }
+    return remote.ip == local.ip ||
+           (ntohl(butil::ip2int(remote.ip)) >> 24) == 127;
+}
+
+void* ShmEndpoint::ProcessHandshakeAtClient(void* arg) {
+    ShmEndpoint* ep = static_cast<ShmEndpoint*>(arg);
+    SocketUniquePtr s(ep->_socket);
+    ShmConnect::RunGuard rg((ShmConnect*)s->_app_connect.get());
+    ShmTransport* shm_transport = ShmEndpoint::GetShmTransport(s.get());
+
+    LOG_IF(INFO, FLAGS_shm_trace_verbose)
+        << "Start handshake on " << s->description();
+
+    if (!IsSameHost(s->fd())) {
+        // The server can't be reached by shared memory, don't bother it.
+        LOG_IF(INFO, FLAGS_shm_trace_verbose)
+            << "Not same host, fallback to tcp:" << s->description();
+        errno = 0;
+        shm_transport->_shm_state = ShmTransport::SHM_OFF;
+        ep->_state.store(FALLBACK_TCP, butil::memory_order_release);
+        return nullptr;
+    }
+    ep->_state.store(HANDSHAKING, butil::memory_order_relaxed);
+
+    char hello[SERVER_HELLO_LEN];
+    memset(hello, 0, CLIENT_HELLO_LEN);
+    memcpy(hello, HELLO_MAGIC, HELLO_MAGIC_LEN);
+    butil::RawPacker(hello + HELLO_MAGIC_LEN)
+        .pack16(CLIENT_HELLO_LEN).pack16(HELLO_VERSION);
+    if (ep->WriteToFd(hello, CLIENT_HELLO_LEN) < 0) {
+        const int saved_errno = errno;
+        PLOG(WARNING) << "Fail to send hello message to server:"
+                      << s->description();
+        s->SetFailed(saved_errno, "Fail to complete shm handshake from %s: %s",
+                     s->description().c_str(), berror(saved_errno));
+        ep->_state.store(FAILED, butil::memory_order_relaxed);
+        return nullptr;
+    }
+
+    uint16_t version = 0;
+    uint64_t token = 0;
+    std::string name;
+    errno = 0;
+    if (ep->ReadFromFd(hello, SERVER_HELLO_LEN) < 0 ||
+        UnpackServerHello(hello, &version, &token, &name) != 0) {
+        const int saved_errno = (errno != 0 ? errno : EPROTO);
+        PLOG(WARNING) << "Fail to receive hello from server:"
+                      << s->description();
+        s->SetFailed(saved_errno, "Fail to complete shm handshake from %s: %s",
+                     s->description().c_str(), berror(saved_errno));
+        ep->_state.store(FAILED, butil::memory_order_relaxed);
+        return nullptr;
+    }
+
+    if (version < HELLO_VERSION) {
+        LOG_IF(INFO, FLAGS_shm_trace_verbose)
+            << "Server refuses shm, fallback to tcp:" << s->description();
+        shm_transport->_shm_state = ShmTransport::SHM_OFF;
+    } else if (ep->SetupAtClient(token, name) != 0) {
+        LOG(WARNING) << "Fail to setup shm, fallback to tcp:"
+                     << s->description();
+        ep->DeallocateResources();
+        shm_transport->_shm_state = ShmTransport::SHM_OFF;
+    } else {
+        shm_transport->_shm_state = ShmTransport::SHM_ON;
+    }
+
+    const bool shm_on = shm_transport->_shm_state == ShmTransport::SHM_ON;
+    uint32_t flags_be = butil::HostToNet32(shm_on ? HELLO_ACK_SHM_OK : 0);
+    if (ep->WriteToFd(&flags_be, HELLO_ACK_LEN) < 0) {
+        const int saved_errno = errno;
+        PLOG(WARNING) << "Fail to send Ack Message to server:"
+                      << s->description();
+        s->SetFailed(saved_errno, "Fail to complete shm handshake from %s: %s",
+                     s->description().c_str(), berror(saved_errno));
+        ep->_state.store(FAILED, butil::memory_order_relaxed);
+        return nullptr;
+    }
+
+    if (shm_on) {
+        ep->_state.store(ESTABLISHED, butil::memory_order_release);
+        LOG_IF(INFO, FLAGS_shm_trace_verbose)
+            << "Client handshake ends (use shm) on " << s->description();
+    } else {
+        ep->_state.store(FALLBACK_TCP, butil::memory_order_release);
+        LOG_IF(INFO, FLAGS_shm_trace_verbose)
+            << "Client handshake ends (use tcp) on " << s->description();
+    }
+    errno = 0;
+    return nullptr;
+}
+
+static socklen_t MakeAbstractAddress(const std::string& name, sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // The leading '\0' makes the name abstract, which disappears with the
+    // socket and needs no cleanup.
+    memcpy(addr->sun_path + 1, name.data(), name.size());
+    return offsetof(sockaddr_un, sun_path) + 1 + name.size();
+}
+
+int ShmEndpoint::SetupAtClient(uint64_t token, const std::string& name) {
+    if (name.empty()) {
+        return -1;
+    }
+    int memfd = -1;
+    butil::intrusive_ptr<ShmRegion> region = ShmRegion::Create(
+        FLAGS_shm_ring_size, FLAGS_shm_block_size, FLAGS_shm_block_num, &memfd);
+    if (region == nullptr) {
+        return -1;
+    }
+    butil::fd_guard memfd_guard(memfd);
+    butil::fd_guard local_efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    butil::fd_guard remote_efd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (local_efd < 0 || remote_efd < 0) {
+        PLOG(WARNING) << "Fail to create eventfd";
+        return -1;
+    }
+    butil::fd_guard sock(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (sock < 0) {
+        PLOG(WARNING) << "Fail to create unix socket";
+        return -1;
+    }
+    sockaddr_un addr;
+    const socklen_t addr_len = MakeAbstractAddress(name, &addr);
+    if (connect(sock, (sockaddr*)&addr, addr_len) != 0) {
+        // Different network namespaces for example.
+        PLOG(WARNING) << "Fail to connect to shm listener of "
+                      << _socket->description();
+        return -1;
+    }
+
+    const int fds[NUM_PASSED_FDS] = { memfd, local_efd, remote_efd };
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    iovec iov = { &token, sizeof(token) };
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(token)) {
+        PLOG(WARNING) << "Fail to send fds to " << _socket->description();
+        return -1;
+    }
+    return Start(region.get(), 0, local_efd.release(), remote_efd.release());
+}
+
+int ShmEndpoint::Listen(std::string* name) {
+    butil::fd_guard fd(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (fd < 0) {
+        PLOG(WARNING) << "Fail to create unix socket";
+        return -1;
+    }
+    *name = butil::string_printf("brpc_shm_%d_%016" PRIx64,
+                                 (int)getpid(), butil::fast_rand());
+    sockaddr_un addr;
+    const socklen_t addr_len = MakeAbstractAddress(*name, &addr);
+    if (bind(fd, (sockaddr*)&addr, addr_len) != 0) {
+        PLOG(WARNING) << "Fail to bind " << *name;
+        return -1;
+    }
+    if (listen(fd, 1) != 0) {
+        PLOG(WARNING) << "Fail to listen " << *name;
+        return -1;
+    }
+    _token = butil::fast_rand();
+    _listen_fd = fd.release();
+    return 0;
+}
+
+int ShmEndpoint::SetupAtServer() {
+    // The client sent the fds before the ACK, no need to wait.
+    butil::fd_guard conn(accept4(_listen_fd, nullptr, nullptr,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC));
+    CloseListener();
+    if (conn < 0) {
+        PLOG(WARNING) << "Fail to accept shm connection of "
+                      << _socket->description();
+        return -1;
+    }
+    uint64_t token = 0;
+    char control[CMSG_SPACE(sizeof(int) * NUM_PASSED_FDS)];
+    iovec iov = { &token, sizeof(token) };
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    const ssize_t nr = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    butil::fd_guard fds[NUM_PASSED_FDS];
+    int nfd = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); nr >= 0 && cmsg != nullptr;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const int* data = (const int*)CMSG_DATA(cmsg);
+        const int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < n; ++i) {
+            if (nfd < NUM_PASSED_FDS) {
+                fds[nfd++].reset(data[i]);
+            } else {
+                close(data[i]);
+            }
+        }
+    }
+    if (nr != (ssize_t)sizeof(token) || (msg.msg_flags & MSG_CTRUNC) ||
+        nfd != NUM_PASSED_FDS || token != _token) {
+        LOG(WARNING) << "Invalid shm setup message from "
+                     << _socket->description();
+        return -1;
+    }
+    butil::intrusive_ptr<ShmRegion> region = ShmRegion::Map(fds[0]);
+    if (region == nullptr) {
+        return -1;
+    }
+    // The server writes queue 1 and is notified by the eventfd of the server.
+    return Start(region.get(), 1, fds[2].release(), fds[1].release());
+}
+
+ParseResult ShmEndpoint::ExecuteServerHandshake(butil::IOBuf* source, Socket* s) {
+    ShmTransport* shm_transport = ShmEndpoint::GetShmTransport(s);
+    ShmEndpoint* ep = shm_transport->_shm_ep;
+    CHECK(ep != nullptr);
+
+    if (!InHandshake(s)) {
+        // Phase 1: read the client hello, reply the server hello.
+        if (source->size() < HELLO_MAGIC_LEN) {
+            return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+        }
+        char magic[HELLO_MAGIC_LEN];
+        CHECK_EQ(source->copy_to(magic, HELLO_MAGIC_LEN), HELLO_MAGIC_LEN);
+        if (memcmp(magic, HELLO_MAGIC, HELLO_MAGIC_LEN) != 0) {
+            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+        }
+        uint16_t version = 0;
+        const int r = CutClientHello(source, &version);
+        if (r == 0) {
+            return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+        }
+        if (r < 0) {
+            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+        }
+        ep->_state.store(HANDSHAKING, butil::memory_order_relaxed);
+        std::string name;
+        uint16_t reply_version = 0;
+        if (version >= HELLO_VERSION && ep->Listen(&name) == 0) {
+            reply_version = HELLO_VERSION;
+        } else {
+            shm_transport->_shm_state = ShmTransport::SHM_OFF;
+        }
+        char hello[SERVER_HELLO_LEN];
+        PackServerHello(reply_version, ep->_token, name, hello);
+        butil::IOBuf packet;
+        packet.append(hello, sizeof(hello));
+        if (s->Write(&packet) != 0) {
+            PLOG(WARNING) << "Fail to send server hello to " << s->description();
+            ep->_state.store(FAILED, butil::memory_order_relaxed);
+            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+        }
+        s->reset_parsing_context(ShmHandshakeContext::Create());
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+
+    // Phase 2: cut the 4B ACK and finalize.
+    if (source->size() < HELLO_ACK_LEN) {
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+    uint32_t flags_be = 0;
+    CHECK_EQ(source->cutn(&flags_be, HELLO_ACK_LEN), HELLO_ACK_LEN);
+    s->reset_parsing_context(nullptr);
+    if (!(butil::NetToHost32(flags_be) & HELLO_ACK_SHM_OK)) {
+        LOG_IF(INFO, FLAGS_shm_trace_verbose)
+            << "Server handshake ends (use tcp) on " << s->description();
+        ep->CloseListener();
+        shm_transport->_shm_state = ShmTransport::SHM_OFF;
+        ep->_state.store(FALLBACK_TCP, butil::memory_order_release);
+        // Following bytes are messages over TCP.
+        return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+    }
+    if (ep->_listen_fd < 0) {
+        LOG(WARNING) << "Client wants shm in ACK but server refused: "
+                     << s->description();
+        ep->_state.store(FAILED, butil::memory_order_relaxed);
+        return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+    }
+    if (!source->empty()) {
+        LOG(WARNING) << "Unexpected bytes after handshake ACK, drop connection: "
+                     << s->description();
+        ep->_state.store(FAILED, butil::memory_order_relaxed);
+        return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+    }
+    if (ep->SetupAtServer() != 0) {
+        // The client can't fall back after an OK ACK.
+        ep->DeallocateResources();
+        ep->_state.store(FAILED, butil::memory_order_relaxed);
+        return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+    }
+    LOG_IF(INFO, FLAGS_shm_trace_verbose)
+        << "Server handshake ends (use shm) on " << s->description();
+    shm_transport->_shm_state = ShmTransport::SHM_ON;
+    ep->_state.store(ESTABLISHED, butil::memory_order_release);
+    return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+}
+
+void ShmEndpoint::OnNewDataFromTcp(Socket* m) {
+    ShmEndpoint* ep = ShmEndpoint::GetShmTransport(m)->_shm_ep;
+    CHECK(ep != nullptr);
+
+    int progress = Socket::PROGRESS_INIT;
+    while (true) {
+        const State state = ep->_state.load(butil::memory_order_acquire);
+        if (state == ESTABLISHED || state == FALLBACK_TCP) {
+            // DoRead() of ShmTransport reads the ring or the TCP connection.
+            InputMessenger::OnNewMessages(m);
+            return;
+        } else if (state == HANDSHAKING) {
+            ep->_read_butex->fetch_add(1, butil::memory_order_release);
+            bthread::butex_wake(ep->_read_butex);
+        } else {
+            // The connection may be closed or reset before the client starts
+            // handshake. This will be handled by client handshake. Ignore here.
+        }
+        if (!m->MoreReadEvents(&progress)) {
+            break;
+        }
+    }
+}
+
+int ShmEndpoint::OnInputEvent(void* user_data, uint32_t,
+                              const bthread_attr_t& thread_attr) {
+    SocketUniquePtr s;
+    if (Socket::Address(reinterpret_cast<SocketId>(user_data), &s) != 0) {
+        return -1;
+    }
+    ShmEndpoint* ep = ShmEndpoint::GetShmTransport(s.get())->_shm_ep;
+    if (ep == nullptr ||
+        ep->_state.load(butil::memory_order_acquire) != ESTABLISHED) {
+        return 0;
+    }
+    uint64_t count = 0;
+    butil::ignore_result(read(ep->_local_efd, &count, sizeof(count)));
+    if (ep->_wait_space.exchange(false, butil::memory_order_relaxed)) {
+        s->WakeAsEpollOut();
+    }
+    // The peer notifies both new data and new space, the later one results
+    // in a spurious read which is cheap.
+    return Socket::OnInputEvent(user_data, 0, thread_attr);
+}
+
+int ShmEndpoint::ReadFromFd(void* data, size_t len) {
+    const int fd = _socket->fd();
+    size_t received = 0;
+    while (received < len) {
+        const int expected_val = _read_butex->load(butil::memory_order_acquire);
+        const timespec duetime = butil::milliseconds_from_now(WAIT_TIMEOUT_MS);
+        const ssize_t nr = read(fd, (char*)data + received, len - received);
+        if (nr > 0) {
+            received += nr;
+        } else if (nr == 0) {
+            errno = EEOF;
+            return -1;
+        } else if (errno != EAGAIN && errno != EINTR) {
+            return -1;
+        } else if (errno == EAGAIN &&
+                   bthread::butex_wait(_read_butex, expected_val, &duetime) < 0 &&
+                   errno != EWOULDBLOCK && errno != ETIMEDOUT) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int ShmEndpoint::WriteToFd(const void* data, size_t len) {
+    const int fd = _socket->fd();
+    size_t written = 0;
+    while (written < len) {
+        const ssize_t nw = write(fd, (const char*)data + written, len - written);
+        if (nw >= 0) {
+            written += nw;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN) {
+            return -1;
+        }
+        const timespec duetime = butil::milliseconds_from_now(WAIT_TIMEOUT_MS);
+        if (_socket->WaitEpollOut(fd, true, &duetime) != 0 && errno != ETIMEDOUT) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+ssize_t ShmEndpoint::CutFromIOBufList(butil::IOBuf** data, size_t ndata) {
+    bool notify = false;
+    const ssize_t nw = _producer.CutFromIOBufList(data, ndata, &notify);
+    if (notify) {
+        NotifyRemote();
+    }
+    return nw;
+}
+
+ssize_t ShmEndpoint::DoRead(butil::IOBuf* buf, size_t size_hint) {
+    bool notify = false;
+    ssize_t nr = _consumer.AppendTo(buf, size_hint, &notify);
+    if (notify) {
+        NotifyRemote();
+    }
+    if (nr != 0) {
+        return nr;
+    }
+    // Nothing in the ring, the TCP connection tells whether the peer is
+    // still alive.
+    char c = 0;
+    const ssize_t ntcp = read(_socket->fd(), &c, 1);
+    if (ntcp == 0) {
+        return 0;
+    }
+    if (ntcp > 0) {
+        LOG(WARNING) << "Read unexpected data from " << _socket->description();
+        errno = EPROTO;
+        return -1;
+    }
+    if (errno != EAGAIN) {
+        return -1;
+    }
+    if (_consumer.WaitForData()) {
+        nr = _consumer.AppendTo(buf, size_hint, &notify);
+        if (notify) {
+            NotifyRemote();
+        }
+        if (nr != 0) {
+            return nr;
+        }
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+bool ShmEndpoint::IsWritable() const {
+    return _producer.IsWritable();
+}
+
+bool ShmEndpoint::WaitForSpace() {
+    *g_shm_wait_space << 1;
+    // Set before asking the peer to notify, see OnInputEvent().
+    _wait_space.store(true, butil::memory_order_relaxed);
+    return _producer.WaitForSpace();
+}
+
+void ShmEndpoint::DebugInfo(std::ostream& os) const {
+    os << "shm_state=" << (int)_state.load(butil::memory_order_relaxed);
+    if (_region != nullptr) {
+        os << "\nshm_region_size=" << _region->size()
+           << "\nshm_ring_size=" << _region->ring_size()
+           << "\nshm_send_pending_bytes=" << _producer.pending_bytes()
+           << "\nshm_recv_pending_bytes=" << _consumer.pending_bytes()
+           << "\nshm_local_efd=" << _local_efd
+           << "\nshm_remote_efd=" << _remote_efd;
+    }
+    os << '\n';
+}
+
+}  // namespace shm
+}  // namespace brpc
+
+#endif  // OS_LINUX
@@ -0,0 +1,167 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_SHM_SHM_ENDPOINT_H
+#define BRPC_SHM_SHM_ENDPOINT_H
+
+#include "butil/build_config.h"
+
+#if defined(OS_LINUX)
+
+#include <ostream>
+#include "butil/atomicops.h"
+#include "butil/iobuf.h"
+#include "butil/macros.h"
+#include "brpc/event_dispatcher.h"
+#include "brpc/parse_result.h"
+#include "brpc/socket.h"
+#include "brpc/shm/shm_ring.h"
+
+namespace brpc {
+class ShmTransport;
+namespace shm {
+
+DECLARE_bool(shm_trace_verbose);
+
+// Create global variables of shared memory connections.
+void GlobalShmInitialize();
+
+class ShmConnect : public AppConnect {
+public:
+    void StartConnect(const Socket* socket,
+                      void (*done)(int err, void* data), void* data) override;
+    void StopConnect(Socket*) override;
+    struct RunGuard {
+        RunGuard(ShmConnect* sc) { this_sc = sc; }
+        ~RunGuard() { if (this_sc) this_sc->Run(); }
+        ShmConnect* this_sc;
+    };
+
+private:
+    void Run();
+    void (*_done)(int, void*){nullptr};
+    void* _data{nullptr};
+};
+
+// Shared memory channel of a Socket. The TCP connection of the socket is
+// kept to negotiate, to pass the fds and to detect the closing of the peer,
+// while messages go through a pair of rings in the memory shared by both
+// sides. Each side has an eventfd watched by EventDispatcher which is
+// written by the peer when it needs attention.
+class ShmEndpoint {
+friend class ShmConnect;
+public:
+    explicit ShmEndpoint(Socket* s);
+    ~ShmEndpoint();
+
+    // Reset the endpoint (for next use).
+    void Reset();
+
+    // Cut data from the given IOBuf list into the ring.
+    // Returns bytes cut if success, -1 if failed and errno set.
+    ssize_t CutFromIOBufList(butil::IOBuf** data, size_t ndata);
+
+    // Read data from the ring into `buf'. When the ring is empty, the TCP
+    // connection is checked for EOF.
+    // Returns bytes read, 0 on EOF, -1 if failed and errno set.
+    ssize_t DoRead(butil::IOBuf* buf, size_t size_hint);
+
+    // Whether the endpoint can send more data.
+    bool IsWritable() const;
+
+    // Ask to wake up writers of the socket when the ring has space.
+    // Returns true if the ring is writable already.
+    bool WaitForSpace();
+
+    void DebugInfo(std::ostream& os) const;
+
+    // Callback when there is new epollin event on the TCP fd.
+    // Only used by client-side sockets.
+    static void OnNewDataFromTcp(Socket* m);
+
+    // Real handshake of server-side shared memory sockets.
+    static ParseResult ExecuteServerHandshake(butil::IOBuf* source, Socket* s);
+
+    // Callbacks of the eventfd, `user_data' is id of the socket.
+    static int OnInputEvent(void* user_data, uint32_t events,
+                            const bthread_attr_t& thread_attr);
+    static int OnOutputEvent(void*, uint32_t, const bthread_attr_t&) {
+        return 0;
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ShmEndpoint);
+
+    enum State {
+        UNINIT = 0,
+        HANDSHAKING,
+        ESTABLISHED,
+        FALLBACK_TCP,
+        FAILED
+    };
+
+    static ShmTransport* GetShmTransport(const Socket* s);
+    static void* ProcessHandshakeAtClient(void* arg);
+
+    // Read or write exactly `len' bytes of the TCP connection during
+    // handshake. Returns 0 on success, -1 otherwise.
+    int ReadFromFd(void* data, size_t len);
+    int WriteToFd(const void* data, size_t len);
+
+    // Client side: create the shared memory and send its fds to the server
+    // listening on `name'. Returns 0 on success, -1 otherwise.
+    int SetupAtClient(uint64_t token, const std::string& name);
+    // Server side: listen on an abstract unix socket for the fds.
+    // Returns 0 on success, -1 otherwise.
+    int Listen(std::string* name);
+    // Server side: accept the fds sent by the client.
+    // Returns 0 on success, -1 otherwise.
+    int SetupAtServer();
+    // Start using the rings. `q' is the queue written by this side.
+    int Start(ShmRegion* region, int q, int local_efd, int remote_efd);
+
+    void DeallocateResources();
+    void NotifyRemote();
+    void CloseListener();
+
+    Socket* _socket;
+    butil::atomic<State> _state;
+    // Woken up by new data of the TCP connection during client handshake.
+    butil::atomic<int>* _read_butex;
+
+    butil::intrusive_ptr<ShmRegion> _region;
+    ShmProducer _producer;
+    ShmConsumer _consumer;
+    // Written by the remote side to notify this side, watched by
+    // EventDispatcher.
+    int _local_efd;
+    // Written by this side to notify the remote side.
+    int _remote_efd;
+    IOEvent<ShmEndpoint> _io_event;
+    // Set when writers wait for space of the ring.
+    butil::atomic<bool> _wait_space;
+
+    // Listening unix socket of server-side handshake.
+    int _listen_fd;
+    uint64_t _token;
+};
+
+}  // namespace shm
+}  // namespace brpc
+
+#endif  // OS_LINUX
+#endif  // BRPC_SHM_SHM_ENDPOINT_H
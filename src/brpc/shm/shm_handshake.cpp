@@ -0,0 +1,152 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "brpc/shm/shm_handshake.h"
+
+#include <string.h>
+#include "butil/iobuf.h"
+#include "butil/logging.h"
+#include "butil/object_pool.h"
+#include "butil/raw_pack.h"
+#include "brpc/socket.h"
+#if defined(OS_LINUX)
+#include "brpc/shm/shm_endpoint.h"
+#endif
+
+namespace brpc {
+namespace shm {
+
+ShmHandshakeContext* ShmHandshakeContext::Create() {
+    return butil::get_object<ShmHandshakeContext>();
+}
+
+void ShmHandshakeContext::Destroy() {
+    butil::return_object(this);
+}
+
+int CutClientHello(butil::IOBuf* source, uint16_t* version) {
+    constexpr size_t HDR_LEN = HELLO_MAGIC_LEN + 4;
+    if (source->size() < HDR_LEN) {
+        return 0;
+    }
+    char hdr[HDR_LEN];
+    CHECK_EQ(source->copy_to(hdr, sizeof(hdr)), sizeof(hdr));
+    if (memcmp(hdr, HELLO_MAGIC, HELLO_MAGIC_LEN) != 0) {
+        return -1;
+    }
+    uint16_t msg_len = 0;
+    butil::RawUnpacker(hdr + HELLO_MAGIC_LEN).unpack16(msg_len).unpack16(*version);
+    // Newer clients may append fields to the hello.
+    if (msg_len < CLIENT_HELLO_LEN || msg_len > HELLO_MSG_LEN_MAX) {
+        return -1;
+    }
+    if (source->size() < msg_len) {
+        return 0;
+    }
+    CHECK_EQ(source->pop_front(msg_len), msg_len);
+    return 1;
+}
+
+void PackServerHello(uint16_t version, uint64_t token,
+                     const std::string& name, char* buf) {
+    memset(buf, 0, SERVER_HELLO_LEN);
+    memcpy(buf, HELLO_MAGIC, HELLO_MAGIC_LEN);
+    const size_t name_len = std::min(name.size(), HELLO_NAME_MAX_LEN);
+    butil::RawPacker(buf + HELLO_MAGIC_LEN)
+        .pack16(SERVER_HELLO_LEN)
+        .pack16(version)
+        .pack64(token)
+        .pack16(name_len);
+    memcpy(buf + SERVER_HELLO_LEN - HELLO_NAME_MAX_LEN, name.data(), name_len);
+}
+
+int UnpackServerHello(const char* buf, uint16_t* version, uint64_t* token,
+                      std::string* name) {
+    if (memcmp(buf, HELLO_MAGIC, HELLO_MAGIC_LEN) != 0) {
+        return -1;
+    }
+    uint16_t msg_len = 0;
+    uint16_t name_len = 0;
+    butil::RawUnpacker(buf + HELLO_MAGIC_LEN)
+        .unpack16(msg_len)
+        .unpack16(*version)
+        .unpack64(*token)
+        .unpack16(name_len);
+    if (msg_len != SERVER_HELLO_LEN || name_len > HELLO_NAME_MAX_LEN) {
+        return -1;
+    }
+    name->assign(buf + SERVER_HELLO_LEN - HELLO_NAME_MAX_LEN, name_len);
+    return 0;
+}
+
+bool InHandshake(Socket* socket) {
+    // Other protocols may keep their contexts in the socket as well.
+    return dynamic_cast<ShmHandshakeContext*>(socket->parsing_context()) != nullptr;
+}
+
+static ParseResult FallbackServerHandshake(butil::IOBuf* source, Socket* socket) {
+    if (!InHandshake(socket)) {
+        // Phase 1: consume the client hello and reply a refusing hello.
+        if (source->size() < HELLO_MAGIC_LEN) {
+            return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+        }
+        char magic[HELLO_MAGIC_LEN];
+        CHECK_EQ(source->copy_to(magic, HELLO_MAGIC_LEN), HELLO_MAGIC_LEN);
+        if (memcmp(magic, HELLO_MAGIC, HELLO_MAGIC_LEN) != 0) {
+            return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+        }
+        uint16_t version = 0;
+        const int r = CutClientHello(source, &version);
+        if (r == 0) {
+            return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+        }
+        if (r < 0) {
+            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+        }
+        char hello[SERVER_HELLO_LEN];
+        PackServerHello(0, 0, std::string(), hello);
+        butil::IOBuf packet;
+        packet.append(hello, sizeof(hello));
+        if (socket->Write(&packet) != 0) {
+            PLOG(WARNING) << "Fail to send shm fallback hello to "
+                          << socket->description();
+            return MakeParseError(PARSE_ERROR_ABSOLUTELY_WRONG);
+        }
+        socket->reset_parsing_context(ShmHandshakeContext::Create());
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+
+    // Phase 2: drain the 4B ACK, following bytes are requests over TCP.
+    if (source->size() < HELLO_ACK_LEN) {
+        return MakeParseError(PARSE_ERROR_NOT_ENOUGH_DATA);
+    }
+    CHECK_EQ(source->pop_front(HELLO_ACK_LEN), HELLO_ACK_LEN);
+    socket->reset_parsing_context(nullptr);
+    return MakeParseError(PARSE_ERROR_TRY_OTHERS);
+}
+
+ParseResult ExecuteServerHandshake(butil::IOBuf* source, Socket* socket) {
+#if defined(OS_LINUX)
+    if (socket->socket_mode() == SOCKET_MODE_SHM) {
+        return ShmEndpoint::ExecuteServerHandshake(source, socket);
+    }
+#endif
+    return FallbackServerHandshake(source, socket);
+}
+
+}  // namespace shm
+}  // namespace brpc
@@ -0,0 +1,85 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_SHM_SHM_HANDSHAKE_H
+#define BRPC_SHM_SHM_HANDSHAKE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "brpc/destroyable.h"
+#include "brpc/parse_result.h"
+
+namespace butil {
+class IOBuf;
+}
+
+namespace brpc {
+class Socket;
+namespace shm {
+
+// Handshake of shared memory connections, carried by the TCP connection:
+//   client hello: [ "SHM1" 4B ][ msg_len 2B ][ version 2B ][ reserved 24B ]
+//   server hello: [ "SHM1" 4B ][ msg_len 2B ][ version 2B ][ token 8B ]
+//                 [ name_len 2B ][ name 46B ]
+//   client ACK:   [ flags 4B ]
+// All integers are big-endian. A server refusing shared memory replies
+// version 0. Otherwise the client connects to the abstract unix socket
+// `name' and sends the token along with the memfd and eventfds of the
+// connection before the ACK.
+// The client hello is long enough for parsers tried before the handshake
+// (e.g. nshead, which checks the magic at offset 24) to reject it instead
+// of waiting for more data.
+constexpr const char* HELLO_MAGIC = "SHM1";
+constexpr size_t HELLO_MAGIC_LEN = 4;
+constexpr uint16_t HELLO_VERSION = 1;
+constexpr size_t CLIENT_HELLO_LEN = 32;
+constexpr size_t SERVER_HELLO_LEN = 64;
+constexpr size_t HELLO_MSG_LEN_MAX = 4096;
+constexpr size_t HELLO_NAME_MAX_LEN = 46;
+constexpr size_t HELLO_ACK_LEN = 4;
+constexpr uint32_t HELLO_ACK_SHM_OK = 0x1;
+
+struct ShmHandshakeContext : public Destroyable {
+    static ShmHandshakeContext* Create();
+    void Destroy() override;
+};
+
+// True if the server side of `socket' is waiting for the ACK.
+bool InHandshake(Socket* socket);
+
+// Cut the client hello from `source' and get its version.
+// Returns 1 on success, 0 if the hello is incomplete, -1 if it's malformed.
+int CutClientHello(butil::IOBuf* source, uint16_t* version);
+
+// Serialize the server hello into `buf' of SERVER_HELLO_LEN bytes.
+void PackServerHello(uint16_t version, uint64_t token,
+                     const std::string& name, char* buf);
+
+// Parse the server hello in `buf' of SERVER_HELLO_LEN bytes.
+// Returns 0 on success, -1 if it's malformed.
+int UnpackServerHello(const char* buf, uint16_t* version, uint64_t* token,
+                      std::string* name);
+
+// Parse the handshake from `source'. Shared memory sockets run the real
+// handshake, others reply a refusing hello so that clients fall back to TCP.
+ParseResult ExecuteServerHandshake(butil::IOBuf* source, Socket* socket);
+
+}  // namespace shm
+}  // namespace brpc
+
+#endif  // BRPC_SHM_SHM_HANDSHAKE_H
@@ -0,0 +1,498 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "brpc/shm/shm_ring.h"
+
+#if defined(OS_LINUX)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <gflags/gflags.h>
+#include "butil/fd_guard.h"
+#include "butil/logging.h"
+#include "butil/scoped_lock.h"
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+namespace brpc {
+namespace shm {
+
+DEFINE_int32(shm_ring_size, 1024 * 1024,
+             "Bytes of the ring of each direction of a shared memory "
+             "connection, must be power of 2");
+DEFINE_int32(shm_block_size, 64 * 1024,
+             "Bytes of each block used to pass large data of a shared "
+             "memory connection");
+DEFINE_int32(shm_block_num, 32,
+             "Number of blocks of each direction of a shared memory connection");
+DEFINE_int32(shm_block_min_size, 16 * 1024,
+             "Data of at least so many bytes is passed in blocks instead of "
+             "the ring, which saves one copy");
+
+static const uint64_t SHM_PAGE_SIZE = 4096;
+static const uint32_t SHM_MIN_RING_SIZE = 4096;
+// A record with at least one byte of inline data.
+static const uint64_t SHM_MIN_INLINE_SPACE = 2 * sizeof(ShmRecord);
+
+inline uint64_t AlignUp(uint64_t n, uint64_t align) {
+    return (n + align - 1) / align * align;
+}
+
+struct ShmLayout {
+    uint64_t queue_header_off;
+    uint64_t ring_off;
+    uint64_t free_ring_off;
+    uint64_t block_off;
+    uint64_t size;
+};
+
+static bool ComputeLayout(uint32_t ring_size, uint32_t block_size,
+                          uint32_t block_num, ShmLayout* layout) {
+    if (ring_size < SHM_MIN_RING_SIZE || (ring_size & (ring_size - 1)) != 0) {
+        LOG(ERROR) << "Invalid shm ring_size=" << ring_size;
+        return false;
+    }
+    if (block_size == 0 || block_size % sizeof(ShmRecord) != 0 ||
+        block_num >= SHM_INLINE_BLOCK) {
+        LOG(ERROR) << "Invalid shm block_size=" << block_size
+                   << " block_num=" << block_num;
+        return false;
+    }
+    uint64_t off = AlignUp(sizeof(ShmRegionHeader), BAIDU_CACHELINE_SIZE);
+    layout->queue_header_off = off;
+    off += 2 * sizeof(ShmQueueHeader);
+    off = AlignUp(off, SHM_PAGE_SIZE);
+    layout->ring_off = off;
+    off += 2 * (uint64_t)ring_size;
+    layout->free_ring_off = off;
+    off += 2 * AlignUp((uint64_t)block_num * sizeof(uint32_t), BAIDU_CACHELINE_SIZE);
+    off = AlignUp(off, SHM_PAGE_SIZE);
+    layout->block_off = off;
+    off += 2 * (uint64_t)block_size * block_num;
+    layout->size = off;
+    return true;
+}
+
+ShmRegion::ShmRegion()
+    : _addr(nullptr)
+    , _size(0)
+    , _header(nullptr) {
+    for (int i = 0; i < 2; ++i) {
+        _queue[i].header = nullptr;
+        _queue[i].ring = nullptr;
+        _queue[i].free_ring = nullptr;
+        _queue[i].blocks = nullptr;
+    }
+}
+
+ShmRegion::~ShmRegion() {
+    if (_addr != nullptr) {
+        munmap(_addr, _size);
+    }
+}
+
+int ShmRegion::Setup(void* addr, uint64_t size) {
+    _addr = addr;
+    _size = size;
+    _header = static_cast<ShmRegionHeader*>(addr);
+    if (_header->magic != SHM_REGION_MAGIC ||
+        _header->version != SHM_REGION_VERSION) {
+        LOG(WARNING) << "Unknown shm region magic=" << _header->magic
+                     << " version=" << _header->version;
+        return -1;
+    }
+    ShmLayout layout;
+    if (!ComputeLayout(_header->ring_size, _header->block_size,
+                       _header->block_num, &layout)) {
+        return -1;
+    }
+    if (layout.size != _header->size || layout.size > size) {
+        LOG(WARNING) << "Unmatched shm region size=" << size
+                     << " expected=" << layout.size;
+        return -1;
+    }
+    char* base = static_cast<char*>(addr);
+    const uint64_t free_ring_size = AlignUp(
+        (uint64_t)_header->block_num * sizeof(uint32_t), BAIDU_CACHELINE_SIZE);
+    for (int i = 0; i < 2; ++i) {
+        _queue[i].header = reinterpret_cast<ShmQueueHeader*>(
+            base + layout.queue_header_off) + i;
+        _queue[i].ring = base + layout.ring_off + (uint64_t)i * _header->ring_size;
+        _queue[i].free_ring = reinterpret_cast<uint32_t*>(
+            base + layout.free_ring_off + i * free_ring_size);
+        _queue[i].blocks = base + layout.block_off +
+            (uint64_t)i * _header->block_size * _header->block_num;
+    }
+    return 0;
+}
+
+butil::intrusive_ptr<ShmRegion> ShmRegion::Create(uint32_t ring_size,
+                                                  uint32_t block_size,
+                                                  uint32_t block_num,
+                                                  int* memfd) {
+    ShmLayout layout;
+    if (!ComputeLayout(ring_size, block_size, block_num, &layout)) {
+        return nullptr;
+    }
+    butil::fd_guard fd(syscall(__NR_memfd_create, "brpc_shm",
+                               MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd < 0) {
+        PLOG(WARNING) << "Fail to memfd_create";
+        return nullptr;
+    }
+    if (ftruncate(fd, layout.size) != 0) {
+        PLOG(WARNING) << "Fail to ftruncate memfd to " << layout.size;
+        return nullptr;
+    }
+    // The peer maps the memory as well, forbid resizing which makes
+    // accesses of either side crash with SIGBUS.
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        PLOG(WARNING) << "Fail to seal memfd";
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, layout.size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(WARNING) << "Fail to mmap " << layout.size << " bytes";
+        return nullptr;
+    }
+    // The memory of memfd is zero-filled.
+    ShmRegionHeader* header = static_cast<ShmRegionHeader*>(addr);
+    header->magic = SHM_REGION_MAGIC;
+    header->version = SHM_REGION_VERSION;
+    header->ring_size = ring_size;
+    header->block_size = block_size;
+    header->block_num = block_num;
+    header->size = layout.size;
+    butil::intrusive_ptr<ShmRegion> region(new ShmRegion);
+    if (region->Setup(addr, layout.size) != 0) {
+        return nullptr;
+    }
+    for (int i = 0; i < 2; ++i) {
+        ShmQueueHeader* qh = region->queue_header(i);
+        // Consumers are not watching yet, the first data must notify.
+        qh->consumer_waiting.store(1, butil::memory_order_relaxed);
+        // All blocks are given to producers at the beginning.
+        uint32_t* free_ring = region->free_ring(i);
+        for (uint32_t id = 0; id < block_num; ++id) {
+            free_ring[id] = id;
+        }
+        qh->free_tail.store(block_num, butil::memory_order_release);
+    }
+    *memfd = fd.release();
+    return region;
+}
+
+butil::intrusive_ptr<ShmRegion> ShmRegion::Map(int memfd) {
+    const int seals = fcntl(memfd, F_GET_SEALS);
+    if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        LOG(WARNING) << "Refuse to map shm region which can be shrunk";
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(memfd, &st) != 0) {
+        PLOG(WARNING) << "Fail to fstat memfd";
+        return nullptr;
+    }
+    if ((uint64_t)st.st_size < sizeof(ShmRegionHeader)) {
+        LOG(WARNING) << "Too small shm region size=" << st.st_size;
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, memfd, 0);
+    if (addr == MAP_FAILED) {
+        PLOG(WARNING) << "Fail to mmap " << st.st_size << " bytes";
+        return nullptr;
+    }
+    butil::intrusive_ptr<ShmRegion> region(new ShmRegion);
+    // Unmapped by the destructor when Setup() fails.
+    if (region->Setup(addr, st.st_size) != 0) {
+        return nullptr;
+    }
+    return region;
+}
+
+void ShmRegion::ReturnBlock(int q, uint32_t id) {
+    Queue& queue = _queue[q];
+    BAIDU_SCOPED_LOCK(queue.free_mutex);
+    const uint32_t tail = queue.header->free_tail.load(butil::memory_order_relaxed);
+    queue.free_ring[tail % _header->block_num] = id;
+    queue.header->free_tail.store(tail + 1, butil::memory_order_release);
+}
+
+ShmProducer::ShmProducer()
+    : _q(0)
+    , _header(nullptr)
+    , _ring(nullptr)
+    , _ring_mask(0)
+    , _tail(0) {}
+
+void ShmProducer::Init(ShmRegion* region, int q) {
+    _region.reset(region);
+    _q = q;
+    _header = region->queue_header(q);
+    _ring = region->ring(q);
+    _ring_mask = region->ring_size() - 1;
+    _tail = _header->tail.load(butil::memory_order_relaxed);
+    _free_blocks.clear();
+    _free_blocks.reserve(region->block_num());
+}
+
+void ShmProducer::Reset() {
+    _region.reset();
+    _header = nullptr;
+    _ring = nullptr;
+    _ring_mask = 0;
+    _tail = 0;
+    _free_blocks.clear();
+}
+
+bool ShmProducer::ReclaimBlocks() {
+    const uint32_t block_num = _region->block_num();
+    const uint32_t tail = _header->free_tail.load(butil::memory_order_acquire);
+    uint32_t head = _header->free_head.load(butil::memory_order_relaxed);
+    if (tail - head > block_num) {
+        LOG_EVERY_SECOND(WARNING) << "Corrupted free_ring of shm queue";
+        return false;
+    }
+    const uint32_t* free_ring = _region->free_ring(_q);
+    for (; head != tail; ++head) {
+        const uint32_t id = free_ring[head % block_num];
+        if (id < block_num) {
+            _free_blocks.push_back(id);
+        }
+    }
+    _header->free_head.store(head, butil::memory_order_release);
+    return !_free_blocks.empty();
+}
+
+// Cut `n' bytes from from[*i], from[*i+1]... into `dst'.
+static void CutIntoBuffer(butil::IOBuf** from, size_t ndata, size_t* i,
+                          char* dst, size_t n) {
+    while (n > 0 && *i < ndata) {
+        const size_t m = from[*i]->cutn(dst, n);
+        dst += m;
+        n -= m;
+        if (from[*i]->empty()) {
+            ++*i;
+        }
+    }
+}
+
+void ShmProducer::CutIntoRing(butil::IOBuf** from, size_t ndata, size_t* i,
+                              uint64_t pos, size_t n) {
+    const size_t ring_size = _ring_mask + 1;
+    const size_t off = pos & _ring_mask;
+    const size_t first = std::min(n, ring_size - off);
+    CutIntoBuffer(from, ndata, i, _ring + off, first);
+    CutIntoBuffer(from, ndata, i, _ring, n - first);
+}
+
+ssize_t ShmProducer::CutFromIOBufList(butil::IOBuf** from, size_t ndata,
+                                      bool* notify) {
+    *notify = false;
+    size_t left = 0;
+    for (size_t j = 0; j < ndata; ++j) {
+        left += from[j]->size();
+    }
+    if (left == 0) {
+        return 0;
+    }
+    const uint64_t ring_size = _ring_mask + 1;
+    const uint32_t block_size = _region->block_size();
+    const size_t block_min_size = FLAGS_shm_block_min_size;
+    uint64_t head = _header->head.load(butil::memory_order_acquire);
+    size_t i = 0;
+    ssize_t nw = 0;
+    while (left > 0) {
+        uint64_t space = ring_size - (_tail - head);
+        if (space < SHM_MIN_INLINE_SPACE) {
+            head = _header->head.load(butil::memory_order_acquire);
+            space = ring_size - (_tail - head);
+            if (space < SHM_MIN_INLINE_SPACE) {
+                break;
+            }
+        }
+        while (from[i]->empty()) {
+            ++i;
+        }
+        ShmRecord rec;
+        if (left >= block_min_size &&
+            (!_free_blocks.empty() || ReclaimBlocks())) {
+            rec.block = _free_blocks.back();
+            _free_blocks.pop_back();
+            rec.len = std::min(left, (size_t)block_size);
+            CutIntoBuffer(from, ndata, &i, _region->block(_q, rec.block), rec.len);
+            memcpy(_ring + (_tail & _ring_mask), &rec, sizeof(rec));
+            _tail += sizeof(rec);
+        } else {
+            rec.block = SHM_INLINE_BLOCK;
+            rec.len = std::min(left, (size_t)(space - sizeof(rec)));
+            memcpy(_ring + (_tail & _ring_mask), &rec, sizeof(rec));
+            CutIntoRing(from, ndata, &i, _tail + sizeof(rec), rec.len);
+            _tail += sizeof(rec) + AlignUp(rec.len, sizeof(ShmRecord));
+        }
+        left -= rec.len;
+        nw += rec.len;
+    }
+    if (nw == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    _header->tail.store(_tail, butil::memory_order_release);
+    // Pair with the fence in ShmConsumer::WaitForData(), either the consumer
+    // sees the new tail or we see its waiting flag.
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    if (_header->consumer_waiting.load(butil::memory_order_relaxed) != 0 &&
+        _header->consumer_waiting.exchange(0, butil::memory_order_relaxed) != 0) {
+        *notify = true;
+    }
+    return nw;
+}
+
+bool ShmProducer::IsWritable() const {
+    const uint64_t head = _header->head.load(butil::memory_order_acquire);
+    return _ring_mask + 1 - (_tail - head) >= SHM_MIN_INLINE_SPACE;
+}
+
+bool ShmProducer::WaitForSpace() {
+    _header->producer_waiting.store(1, butil::memory_order_relaxed);
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    return IsWritable();
+}
+
+size_t ShmProducer::pending_bytes() const {
+    return _tail - _header->head.load(butil::memory_order_relaxed);
+}
+
+ShmConsumer::ShmConsumer()
+    : _q(0)
+    , _header(nullptr)
+    , _ring(nullptr)
+    , _ring_mask(0)
+    , _head(0) {}
+
+void ShmConsumer::Init(ShmRegion* region, int q) {
+    _region.reset(region);
+    _q = q;
+    _header = region->queue_header(q);
+    _ring = region->ring(q);
+    _ring_mask = region->ring_size() - 1;
+    _head = _header->head.load(butil::memory_order_relaxed);
+}
+
+void ShmConsumer::Reset() {
+    _region.reset();
+    _header = nullptr;
+    _ring = nullptr;
+    _ring_mask = 0;
+    _head = 0;
+}
+
+ssize_t ShmConsumer::AppendTo(butil::IOBuf* buf, size_t max_size, bool* notify) {
+    *notify = false;
+    const uint64_t tail = _header->tail.load(butil::memory_order_acquire);
+    if (tail == _head) {
+        return 0;
+    }
+    const uint64_t ring_size = _ring_mask + 1;
+    if (tail - _head > ring_size || (tail - _head) % sizeof(ShmRecord) != 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    const uint32_t block_size = _region->block_size();
+    const uint32_t block_num = _region->block_num();
+    ssize_t nr = 0;
+    while (_head != tail && (size_t)nr < max_size) {
+        ShmRecord rec;
+        memcpy(&rec, _ring + (_head & _ring_mask), sizeof(rec));
+        if (rec.len == 0) {
+            errno = EPROTO;
+            return -1;
+        }
+        if (rec.block == SHM_INLINE_BLOCK) {
+            const uint64_t padded = AlignUp(rec.len, sizeof(ShmRecord));
+            if (padded > tail - _head - sizeof(rec)) {
+                errno = EPROTO;
+                return -1;
+            }
+            const size_t off = (_head + sizeof(rec)) & _ring_mask;
+            const size_t first = std::min((size_t)rec.len, (size_t)(ring_size - off));
+            buf->append(_ring + off, first);
+            buf->append(_ring, rec.len - first);
+            _head += sizeof(rec) + padded;
+        } else {
+            if (rec.block >= block_num || rec.len > block_size) {
+                errno = EPROTO;
+                return -1;
+            }
+            ShmRegion* region = _region.get();
+            const int q = _q;
+            const uint32_t id = rec.block;
+            region->AddRefManually();
+            buf->append_user_data(region->block(q, id), rec.len,
+                                  [region, q, id](void*) {
+                                      region->ReturnBlock(q, id);
+                                      region->RemoveRefManually();
+                                  });
+            _head += sizeof(rec);
+        }
+        nr += rec.len;
+    }
+    _header->head.store(_head, butil::memory_order_release);
+    // Pair with the fence in ShmProducer::WaitForSpace().
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    if (_header->producer_waiting.load(butil::memory_order_relaxed) != 0 &&
+        _header->producer_waiting.exchange(0, butil::memory_order_relaxed) != 0) {
+        *notify = true;
+    }
+    return nr;
+}
+
+bool ShmConsumer::Empty() const {
+    return _header->tail.load(butil::memory_order_acquire) == _head;
+}
+
+bool ShmConsumer::WaitForData() {
+    _header->consumer_waiting.store(1, butil::memory_order_relaxed);
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    return !Empty();
+}
+
+size_t ShmConsumer::pending_bytes() const {
+    return _header->tail.load(butil::memory_order_relaxed) - _head;
+}
+
+}  // namespace shm
+}  // namespace brpc
+
+#endif  // OS_LINUX
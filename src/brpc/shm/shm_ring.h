@@ -0,0 +1,215 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_SHM_RING_H
+#define BRPC_SHM_RING_H
+
+#include "butil/build_config.h"
+
+#if defined(OS_LINUX)
+
+#include <vector>
+#include <gflags/gflags_declare.h>
+#include "butil/atomicops.h"
+#include "butil/intrusive_ptr.hpp"
+#include "butil/iobuf.h"
+#include "butil/macros.h"
+#include "butil/shared_object.h"
+#include "butil/synchronization/lock.h"
+
+namespace brpc {
+namespace shm {
+
+DECLARE_int32(shm_ring_size);
+DECLARE_int32(shm_block_size);
+DECLARE_int32(shm_block_num);
+DECLARE_int32(shm_block_min_size);
+
+// Layout of the shared memory of a connection, created by the client:
+//
+//   ShmRegionHeader | ShmQueueHeader[2] | ring[2] | free_ring[2] | blocks[2]
+//
+// Queue 0 carries data from the client to the server, queue 1 the reverse.
+// Each queue is a single-producer single-consumer byte ring of records.
+// A record is an 8-byte ShmRecord followed by inline data (padded to 8
+// bytes), or just an ShmRecord referring to one of the blocks of the queue.
+// Blocks are filled by the producer, appended into IOBuf of the consumer
+// without copying and given back through free_ring when the IOBuf releases
+// them.
+
+static const uint32_t SHM_REGION_MAGIC = 0x53484D52;  // "SHMR"
+static const uint32_t SHM_REGION_VERSION = 1;
+// `block' of a record whose data follows the record in the ring.
+static const uint32_t SHM_INLINE_BLOCK = 0xFFFFFFFF;
+
+struct ShmRecord {
+    uint32_t len;
+    uint32_t block;
+};
+
+struct ShmRegionHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t block_size;
+    uint32_t block_num;
+    uint32_t reserved;
+    uint64_t size;
+};
+
+struct ShmQueueHeader {
+    // Written by the producer.
+    BAIDU_CACHELINE_ALIGNMENT butil::atomic<uint64_t> tail;
+    butil::atomic<uint32_t> producer_waiting;
+    // Written by the consumer.
+    BAIDU_CACHELINE_ALIGNMENT butil::atomic<uint64_t> head;
+    butil::atomic<uint32_t> consumer_waiting;
+    // Number of blocks ever given back by the consumer.
+    BAIDU_CACHELINE_ALIGNMENT butil::atomic<uint32_t> free_tail;
+    // Number of given-back blocks ever taken by the producer.
+    BAIDU_CACHELINE_ALIGNMENT butil::atomic<uint32_t> free_head;
+};
+
+// Mapping of the shared memory. Referenced by the endpoint and by every
+// block appended into IOBuf, so that the memory is unmapped after both
+// the connection and the data received from it are gone.
+class ShmRegion : public butil::SharedObject {
+public:
+    // Create a region backed by a new memfd whose fd is returned in `memfd'
+    // to be sent to the peer. Returns nullptr on error.
+    static butil::intrusive_ptr<ShmRegion> Create(uint32_t ring_size,
+                                                  uint32_t block_size,
+                                                  uint32_t block_num,
+                                                  int* memfd);
+    // Map the region created by the peer. `memfd' is not closed.
+    // Returns nullptr on error.
+    static butil::intrusive_ptr<ShmRegion> Map(int memfd);
+
+    uint32_t ring_size() const { return _header->ring_size; }
+    uint32_t block_size() const { return _header->block_size; }
+    uint32_t block_num() const { return _header->block_num; }
+    uint64_t size() const { return _size; }
+
+    ShmQueueHeader* queue_header(int q) const { return _queue[q].header; }
+    char* ring(int q) const { return _queue[q].ring; }
+    uint32_t* free_ring(int q) const { return _queue[q].free_ring; }
+    char* block(int q, uint32_t id) const {
+        return _queue[q].blocks + (size_t)id * _header->block_size;
+    }
+
+    // Give block `id' of queue `q' back to the producer. Called when IOBuf
+    // releases the block, possibly in any thread.
+    void ReturnBlock(int q, uint32_t id);
+
+private:
+    ShmRegion();
+    ~ShmRegion() override;
+    DISALLOW_COPY_AND_ASSIGN(ShmRegion);
+
+    int Setup(void* addr, uint64_t size);
+
+    struct Queue {
+        ShmQueueHeader* header;
+        char* ring;
+        uint32_t* free_ring;
+        char* blocks;
+        // Serialize ReturnBlock() which is called by different IOBuf.
+        butil::Mutex free_mutex;
+    };
+
+    void* _addr;
+    uint64_t _size;
+    ShmRegionHeader* _header;
+    Queue _queue[2];
+};
+
+// The writing side of a queue. Not thread-safe, Socket writes one
+// WriteRequest list at a time.
+class ShmProducer {
+public:
+    ShmProducer();
+    void Init(ShmRegion* region, int q);
+    void Reset();
+
+    // Cut data from `from' into the queue, data of at least
+    // FLAGS_shm_block_min_size bytes is copied into blocks. Set `*notify'
+    // if the consumer should be notified.
+    // Returns bytes cut, -1 with errno=EAGAIN if the queue is full.
+    ssize_t CutFromIOBufList(butil::IOBuf** from, size_t ndata, bool* notify);
+
+    // True if a record with some data can be written.
+    bool IsWritable() const;
+
+    // Ask the consumer to notify after it consumes something. Returns
+    // true if the queue became writable meanwhile.
+    bool WaitForSpace();
+
+    size_t pending_bytes() const;
+
+private:
+    // Take blocks given back by the consumer.
+    bool ReclaimBlocks();
+    // Cut `n' bytes from `from' into ring at position `pos'.
+    void CutIntoRing(butil::IOBuf** from, size_t ndata, size_t* i,
+                     uint64_t pos, size_t n);
+
+    butil::intrusive_ptr<ShmRegion> _region;
+    int _q;
+    ShmQueueHeader* _header;
+    char* _ring;
+    uint64_t _ring_mask;
+    uint64_t _tail;
+    std::vector<uint32_t> _free_blocks;
+};
+
+// The reading side of a queue. Not thread-safe, Socket reads in one
+// bthread at a time.
+class ShmConsumer {
+public:
+    ShmConsumer();
+    void Init(ShmRegion* region, int q);
+    void Reset();
+
+    // Move at most about `max_size' bytes from the queue into `buf'. Data in
+    // blocks is appended without copying. Set `*notify' if the producer
+    // should be notified.
+    // Returns bytes moved, 0 if the queue is empty, -1 with errno=EPROTO if
+    // the queue is corrupted.
+    ssize_t AppendTo(butil::IOBuf* buf, size_t max_size, bool* notify);
+
+    bool Empty() const;
+
+    // Ask the producer to notify after it writes something. Returns true
+    // if the queue became non-empty meanwhile.
+    bool WaitForData();
+
+    size_t pending_bytes() const;
+
+private:
+    butil::intrusive_ptr<ShmRegion> _region;
+    int _q;
+    ShmQueueHeader* _header;
+    char* _ring;
+    uint64_t _ring_mask;
+    uint64_t _head;
+};
+
+}  // namespace shm
+}  // namespace brpc
+
+#endif  // OS_LINUX
+#endif  // BRPC_SHM_RING_H
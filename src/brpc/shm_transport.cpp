@@ -0,0 +1,181 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include "brpc/shm_transport.h"
+
+#if defined(OS_LINUX)
+
+#include "bthread/butex.h"
+#include "brpc/event_dispatcher.h"
+#include "brpc/tcp_transport.h"
+#include "brpc/input_messenger.h"
+#include "brpc/server.h"
+#include "brpc/shm/shm_endpoint.h"
+
+namespace brpc {
+
+extern SocketVarsCollector* g_vars;
+
+void ShmTransport::Init(Socket* socket, const SocketOptions& options) {
+    CHECK(_shm_ep == nullptr);
+    if (options.socket_mode == SOCKET_MODE_SHM) {
+        _shm_ep = new shm::ShmEndpoint(socket);
+        _shm_state = SHM_UNKNOWN;
+    } else {
+        _shm_state = SHM_OFF;
+        socket->_socket_mode = SOCKET_MODE_TCP;
+    }
+    _socket = socket;
+    _default_connect = options.app_connect;
+    _on_edge_trigger = options.on_edge_triggered_events;
+    if (options.need_on_edge_trigger && _on_edge_trigger == nullptr) {
+        // Same with RdmaTransport, server-side sockets run the handshake
+        // in the parser while client-side ones run it in a bthread waiting
+        // for data woken by OnNewDataFromTcp.
+        if (options.user == static_cast<SocketUser*>(get_client_side_messenger())) {
+            _on_edge_trigger = shm::ShmEndpoint::OnNewDataFromTcp;
+        } else {
+            _on_edge_trigger = InputMessenger::OnNewMessages;
+        }
+    }
+    _tcp_transport = std::make_shared<TcpTransport>();
+    _tcp_transport->Init(socket, options);
+}
+
+void ShmTransport::Release() {
+    if (_shm_ep) {
+        delete _shm_ep;
+        _shm_ep = nullptr;
+        _shm_state = SHM_UNKNOWN;
+    }
+}
+
+int ShmTransport::Reset(int32_t expected_nref) {
+    if (_shm_ep) {
+        _shm_ep->Reset();
+        _shm_state = SHM_UNKNOWN;
+    }
+    return 0;
+}
+
+std::shared_ptr<AppConnect> ShmTransport::Connect() {
+    if (_default_connect == nullptr) {
+        return std::make_shared<shm::ShmConnect>();
+    }
+    return _default_connect;
+}
+
+int ShmTransport::CutFromIOBuf(butil::IOBuf* buf) {
+    butil::IOBuf* data_arr[1] = { buf };
+    return CutFromIOBufList(data_arr, 1);
+}
+
+ssize_t ShmTransport::CutFromIOBufList(butil::IOBuf** buf, size_t ndata) {
+    if (_shm_ep && _shm_state == SHM_ON) {
+        return _shm_ep->CutFromIOBufList(buf, ndata);
+    }
+    return _tcp_transport->CutFromIOBufList(buf, ndata);
+}
+
+ssize_t ShmTransport::DoRead(butil::IOPortal* buf, size_t size_hint) {
+    if (_shm_ep && _shm_state == SHM_ON) {
+        return _shm_ep->DoRead(buf, size_hint);
+    }
+    return buf->append_from_file_descriptor(_socket->fd(), size_hint);
+}
+
+int ShmTransport::WaitEpollOut(butil::atomic<int>* _epollout_butex,
+                               bool pollin, const timespec duetime) {
+    if (_shm_state != SHM_ON) {
+        return _tcp_transport->WaitEpollOut(_epollout_butex, pollin, duetime);
+    }
+    const int expected_val = _epollout_butex->load(butil::memory_order_acquire);
+    CHECK(_shm_ep != nullptr);
+    if (_shm_ep->IsWritable() || _shm_ep->WaitForSpace()) {
+        return 0;
+    }
+    g_vars->nwaitepollout << 1;
+    if (bthread::butex_wait(_epollout_butex, expected_val, &duetime) < 0) {
+        if (errno != EAGAIN && errno != ETIMEDOUT) {
+            const int saved_errno = errno;
+            PLOG(WARNING) << "Fail to wait shm ring of " << _socket;
+            _socket->SetFailed(saved_errno, "Fail to wait shm ring of %s: %s",
+                               _socket->description().c_str(),
+                               berror(saved_errno));
+        }
+    }
+    // Writing into the ring does not fail when the peer is gone.
+    return _socket->Failed() ? 1 : 0;
+}
+
+void ShmTransport::ProcessEvent(bthread_attr_t attr) {
+    _tcp_transport->ProcessEvent(attr);
+}
+
+void ShmTransport::QueueMessage(InputMessageClosure& input_msg,
+                                int* num_bthread_created, bool last_msg) {
+    _tcp_transport->QueueMessage(input_msg, num_bthread_created, last_msg);
+}
+
+void ShmTransport::Debug(std::ostream& os) {
+    if (_shm_state == SHM_ON && _shm_ep) {
+        _shm_ep->DebugInfo(os);
+    }
+}
+
+int ShmTransport::ContextInitOrDie(bool serverOrNot, const void* _options) {
+    if (serverOrNot) {
+        if (!OptionsAvailableOverShm(static_cast<const ServerOptions*>(_options))) {
+            return -1;
+        }
+    } else {
+        if (!OptionsAvailableForShm(static_cast<const ChannelOptions*>(_options))) {
+            return -1;
+        }
+    }
+    shm::GlobalShmInitialize();
+    return 0;
+}
+
+bool ShmTransport::OptionsAvailableForShm(const ChannelOptions* opt) {
+    if (opt->has_ssl_options()) {
+        LOG(WARNING) << "Cannot use SSL and shared memory at the same time";
+        return false;
+    }
+    return true;
+}
+
+bool ShmTransport::OptionsAvailableOverShm(const ServerOptions* opt) {
+    if (opt->has_ssl_options()) {
+        LOG(WARNING) << "SSL is not supported by shared memory";
+        return false;
+    }
+    // Parsers of following protocols are tried before the handshake and
+    // may take the hello as the beginning of their own messages.
+    if (opt->rtmp_service) {
+        LOG(WARNING) << "RTMP is not supported by shared memory";
+        return false;
+    }
+    if (opt->mongo_service_adaptor) {
+        LOG(WARNING) << "MONGO is not supported by shared memory";
+        return false;
+    }
+    return true;
+}
+
+} // namespace brpc
+#endif // OS_LINUX
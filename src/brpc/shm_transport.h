@@ -0,0 +1,66 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BRPC_SHM_TRANSPORT_H
+#define BRPC_SHM_TRANSPORT_H
+
+#include "butil/build_config.h"
+
+#if defined(OS_LINUX)
+#include "brpc/socket.h"
+#include "brpc/channel.h"
+#include "brpc/transport.h"
+
+namespace brpc {
+// Passes messages through memory shared with a peer on the same host,
+// negotiated by a handshake over the TCP connection which falls back to
+// TCP when the peer is remote or does not support shared memory.
+class ShmTransport : public Transport {
+friend class TransportFactory;
+friend class shm::ShmEndpoint;
+friend class shm::ShmConnect;
+public:
+    void Init(Socket* socket, const SocketOptions& options) override;
+    void Release() override;
+    int Reset(int32_t expected_nref) override;
+    std::shared_ptr<AppConnect> Connect() override;
+    int CutFromIOBuf(butil::IOBuf* buf) override;
+    ssize_t CutFromIOBufList(butil::IOBuf** buf, size_t ndata) override;
+    int WaitEpollOut(butil::atomic<int>* _epollout_butex, bool pollin, const timespec duetime) override;
+    void ProcessEvent(bthread_attr_t attr) override;
+    void QueueMessage(InputMessageClosure& inputMsg, int* num_bthread_created, bool last_msg) override;
+    void Debug(std::ostream &os) override;
+    // Read from the shared memory if negotiated, otherwise from the fd.
+    ssize_t DoRead(butil::IOPortal* buf, size_t size_hint) override;
+    static int ContextInitOrDie(bool serverOrNot, const void* _options);
+private:
+    static bool OptionsAvailableForShm(const ChannelOptions* opt);
+    static bool OptionsAvailableOverShm(const ServerOptions* opt);
+
+    // The on/off state of shared memory
+    enum ShmState {
+        SHM_ON,
+        SHM_OFF,
+        SHM_UNKNOWN
+    };
+    shm::ShmEndpoint* _shm_ep = nullptr;
+    ShmState _shm_state = SHM_UNKNOWN;
+    std::shared_ptr<TcpTransport> _tcp_transport;
+};
+} // namespace brpc
+#endif // OS_LINUX
+#endif // BRPC_SHM_TRANSPORT_H
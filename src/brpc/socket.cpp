@@ -26,6 +26,7 @@
 #include <mesalink/openssl/x509.h>
 #endif
 #include <netinet/tcp.h>                         // getsockopt
+#include <limits>                                // numeric_limits
 #include <gflags/gflags.h>
 #include "bthread/unstable.h"                    // bthread_timer_del
 #include "butil/fd_utility.h"                     // make_non_blocking
@@ -54,6 +55,9 @@
 #if defined(OS_MACOSX)
 #include <sys/event.h>
 #endif
+#if defined(OS_LINUX)
+#include <linux/errqueue.h>                      // sock_extended_err
+#endif
 
 namespace bthread {
 size_t BAIDU_WEAK get_sizes(const bthread_id_list_t* list, size_t* cnt, size_t n);
@@ -113,8 +117,28 @@ static bool validate_connect_timeout_as_unreachable(const char*, int32_t v) {
 BRPC_VALIDATE_GFLAG(connect_timeout_as_unreachable,
                          validate_connect_timeout_as_unreachable);
 
+DEFINE_bool(socket_zerocopy, false,
+            "Send large data over TCP connections with MSG_ZEROCOPY to save "
+            "copying into the kernel. Only affects connections created "
+            "after this flag is set");
+
+DEFINE_int32(socket_zerocopy_min_bytes, 32 * 1024,
+             "Write with MSG_ZEROCOPY only when size of the data to write "
+             "is not less than this value");
+BRPC_VALIDATE_GFLAG(socket_zerocopy_min_bytes, PassValidate);
+
+DEFINE_int32(socket_zerocopy_linger_s, 60,
+             "Max seconds to keep a closed connection until all its "
+             "MSG_ZEROCOPY sends are notified as completed, the connection "
+             "is reset after that");
+BRPC_VALIDATE_GFLAG(socket_zerocopy_linger_s, PassValidate);
+
 const int WAIT_EPOLLOUT_TIMEOUT_MS = 50;
 
+// Max number of blocks written by one MSG_ZEROCOPY send, same with
+// IOBUF_IOV_MAX in iobuf.cpp
+static const size_t ZEROCOPY_IOV_MAX = 256;
+
 class BAIDU_CACHELINE_ALIGNMENT SocketPool {
 friend class Socket;
 public:
@@ -467,6 +491,7 @@ Socket::Socket(Forbidden f)
     , _hc_count(0)
     , _last_msg_size(0)
     , _avg_msg_size(0)
+    , _avg_read_size(0)
     , _last_readtime_us(0)
     , _parsing_context(nullptr)
     , _correlation_id(0)
@@ -490,6 +515,12 @@ Socket::Socket(Forbidden f)
     , _unwritten_bytes(0)
     , _epollout_butex(nullptr)
     , _write_head(nullptr)
+    , _zerocopy(nullptr)
+    , _write_coalesce_us(0)
+    , _write_coalesce_bytes(0)
+    , _coalescing_bytes(0)
+    , _coalesce_wake_bytes(std::numeric_limits<int64_t>::max())
+    , _coalesce_butex(nullptr)
     , _is_write_shutdown(false)
     , _stream_set(nullptr)
     , _total_streams_unconsumed_size(0)
@@ -499,11 +530,13 @@ Socket::Socket(Forbidden f)
     CreateVarsOnce();
     pthread_mutex_init(&_id_wait_list_mutex, nullptr);
     _epollout_butex = bthread::butex_create_checked<butil::atomic<int> >();
+    _coalesce_butex = bthread::butex_create_checked<butil::atomic<int> >();
 }
 
 Socket::~Socket() {
     pthread_mutex_destroy(&_id_wait_list_mutex);
     bthread::butex_destroy(_epollout_butex);
+    bthread::butex_destroy(_coalesce_butex);
 }
 
 void Socket::ReturnSuccessfulWriteRequest(Socket::WriteRequest* p) {
@@ -574,6 +607,7 @@ int Socket::ResetFileDescriptor(int fd) {
     // Reset message sizes when fd is changed.
     _last_msg_size = 0;
     _avg_msg_size = 0;
+    _avg_read_size = 0;
     // MUST store `_fd' before adding itself into epoll device to avoid
     // race conditions with the callback function inside epoll
     static butil::atomic<uint64_t> BAIDU_CACHELINE_ALIGNMENT fd_version(0);
@@ -608,10 +642,14 @@ int Socket::ResetFileDescriptor(int fd) {
 
     SetSocketOptions(fd);
 
+    if (_transport->HasOnEdgeTrigger() && _socket_mode == SOCKET_MODE_TCP) {
+        // Notifications of MSG_ZEROCOPY are delivered with EPOLLERR.
+        EnableZeroCopy(fd);
+    }
+
     if (_transport->HasOnEdgeTrigger()) {
-        if (_io_event.AddConsumer(fd) != 0) {
-            PLOG(ERROR) << "Fail to add SocketId=" << id() 
-                        << " into EventDispatcher";
+        if (_transport->StartRecv(fd) != 0) {
+            PLOG(ERROR) << "Fail to start receiving from SocketId=" << id();
             _fd.store(-1, butil::memory_order_release);
             return -1;
         }
@@ -619,6 +657,240 @@ int Socket::ResetFileDescriptor(int fd) {
     return 0;
 }
 
+void Socket::RemoveConsumer(int fd) {
+    _transport->StopRecv(fd);
+}
+
+// Data of a MSG_ZEROCOPY send, released after the kernel notifies that
+// the send is done.
+struct ZeroCopySend {
+    uint32_t seq;
+    bool done;
+    butil::IOBuf data;
+};
+
+struct Socket::ZeroCopyState {
+    ZeroCopyState() : enabled(false), next_seq(0), fd(-1) {}
+
+    // True if MSG_ZEROCOPY is on for the current fd. The state of a socket
+    // lives until the socket is recycled, so input events racing with
+    // CloseFileDescriptor() can still read it safely.
+    butil::atomic<bool> enabled;
+    // Id of next MSG_ZEROCOPY send. The kernel numbers successful sends on
+    // a socket from 0 in order. Only accessed by the writing thread.
+    uint32_t next_seq;
+    // Set when the fd is lingering after closed.
+    int fd;
+    butil::Mutex mutex;
+    std::deque<ZeroCopySend> pending;
+};
+
+bool Socket::ZeroCopyEnabled() const {
+    return _zerocopy != nullptr &&
+        _zerocopy->enabled.load(butil::memory_order_relaxed);
+}
+
+void Socket::EnableZeroCopy(int fd) {
+    if (!FLAGS_socket_zerocopy) {
+        return;
+    }
+#if defined(OS_LINUX) && defined(SO_ZEROCOPY)
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) != 0) {
+        // Not supported by the kernel or the socket (e.g. unix domain socket).
+        RPC_VLOG << "Fail to set SO_ZEROCOPY of fd=" << fd << ": " << berror();
+        return;
+    }
+    // Set before `fd' is added into epoll, and freed in BeforeRecycled().
+    if (_zerocopy == nullptr) {
+        _zerocopy = new ZeroCopyState;
+    }
+    _zerocopy->next_seq = 0;
+    _zerocopy->enabled.store(true, butil::memory_order_relaxed);
+#endif
+}
+
+void Socket::CloseFileDescriptor(int fd) {
+    ZeroCopyState* zc = _zerocopy;
+    if (zc != nullptr &&
+        zc->enabled.exchange(false, butil::memory_order_relaxed)) {
+        HandleZeroCopyNotifications(zc, fd);
+        ZeroCopyState* lingering = nullptr;
+        {
+            BAIDU_SCOPED_LOCK(zc->mutex);
+            if (!zc->pending.empty()) {
+                lingering = new ZeroCopyState;
+                lingering->pending.swap(zc->pending);
+            }
+        }
+        if (lingering != nullptr) {
+            // The kernel may still be sending the blocks which must not be
+            // reused until the notifications. Shutdown the connection (which
+            // sends FIN after the pending data like close) and close the fd
+            // after all notifications are received.
+            lingering->fd = fd;
+            shutdown(fd, SHUT_RDWR);
+            bthread_t th;
+            if (bthread_start_background(
+                    &th, nullptr, LingerZeroCopyFileDescriptor, lingering) == 0) {
+                return;
+            }
+            PLOG(ERROR) << "Fail to start bthread, wait in-place";
+            LingerZeroCopyFileDescriptor(lingering);
+            return;
+        }
+    }
+    close(fd);
+}
+
+void* Socket::LingerZeroCopyFileDescriptor(void* arg) {
+    ZeroCopyState* zc = static_cast<ZeroCopyState*>(arg);
+    g_vars->nzerocopy_lingering << 1;
+    const int64_t deadline_us = butil::gettimeofday_us() +
+        FLAGS_socket_zerocopy_linger_s * 1000000L;
+    int sleep_us = 1000;
+    while (true) {
+        HandleZeroCopyNotifications(zc, zc->fd);
+        {
+            BAIDU_SCOPED_LOCK(zc->mutex);
+            if (zc->pending.empty()) {
+                break;
+            }
+        }
+        if (butil::gettimeofday_us() >= deadline_us) {
+            // Reset the connection to drop the data queued in the kernel,
+            // after which the kernel does not reference the blocks anymore.
+            LOG(WARNING) << "Reset fd=" << zc->fd << " whose zerocopy sends "
+                         << "are not completed in "
+                         << FLAGS_socket_zerocopy_linger_s << " seconds";
+            struct linger lg = { 1, 0 };
+            setsockopt(zc->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            break;
+        }
+        bthread_usleep(sleep_us);
+        sleep_us = std::min(sleep_us * 2, 100000);
+    }
+    close(zc->fd);
+    delete zc;
+    g_vars->nzerocopy_lingering << -1;
+    return nullptr;
+}
+
+bool Socket::HandleZeroCopyNotifications(ZeroCopyState* zc, int fd) {
+#if defined(OS_LINUX) && defined(SO_EE_ORIGIN_ZEROCOPY)
+    // An EPOLLERR may carry a pending SO_ERROR with nothing in the error
+    // queue, which must not be taken as a zerocopy-only event.
+    bool only_zerocopy = true;
+    bool got_zerocopy = false;
+    std::vector<ZeroCopySend> completed;
+    while (true) {
+        char control[128];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr;
+             cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                only_zerocopy = false;
+                continue;
+            }
+            const sock_extended_err* serr = (const sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+                only_zerocopy = false;
+                continue;
+            }
+            got_zerocopy = true;
+            // Sends in [lo, hi] are done.
+            const uint32_t lo = serr->ee_info;
+            const uint32_t hi = serr->ee_data;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                // The kernel copied the data anyway, e.g. over loopback.
+                g_vars->nzerocopy_copied << (hi - lo + 1);
+            }
+            BAIDU_SCOPED_LOCK(zc->mutex);
+            for (size_t i = 0; i < zc->pending.size(); ++i) {
+                ZeroCopySend& s = zc->pending[i];
+                if ((uint32_t)(s.seq - lo) <= hi - lo) {
+                    s.done = true;
+                }
+            }
+            // Notifications are ordered in most cases, release sends from
+            // the front.
+            while (!zc->pending.empty() && zc->pending.front().done) {
+                completed.emplace_back();
+                completed.back().data.swap(zc->pending.front().data);
+                zc->pending.pop_front();
+            }
+        }
+    }
+    // Blocks are released here, outside the lock.
+    completed.clear();
+    return only_zerocopy && got_zerocopy;
+#else
+    return false;
+#endif
+}
+
+ssize_t Socket::ZeroCopyWrite(butil::IOBuf** data_list, size_t ndata) {
+#if defined(OS_LINUX) && defined(MSG_ZEROCOPY)
+    size_t total = 0;
+    for (size_t i = 0; i < ndata; ++i) {
+        total += data_list[i]->size();
+    }
+    if (total < (size_t)FLAGS_socket_zerocopy_min_bytes) {
+        return _transport->CutFromIOBufList(data_list, ndata);
+    }
+    const int fd = this->fd();
+    iovec vec[ZEROCOPY_IOV_MAX];
+    size_t nvec = 0;
+    for (size_t i = 0; i < ndata && nvec < ZEROCOPY_IOV_MAX; ++i) {
+        const butil::IOBuf* p = data_list[i];
+        const size_t nblock = p->backing_block_num();
+        for (size_t j = 0; j < nblock && nvec < ZEROCOPY_IOV_MAX; ++j, ++nvec) {
+            butil::StringPiece blk = p->backing_block(j);
+            vec[nvec].iov_base = (void*)blk.data();
+            vec[nvec].iov_len = blk.size();
+        }
+    }
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = nvec;
+    const ssize_t nw = sendmsg(fd, &msg, MSG_ZEROCOPY);
+    if (nw < 0) {
+        if (errno == ENOBUFS) {
+            // Exceeded the optmem limit for pinned pages, copy instead.
+            return _transport->CutFromIOBufList(data_list, ndata);
+        }
+        return nw;
+    }
+    if (nw == 0) {
+        return nw;
+    }
+    g_vars->nzerocopy_bytes << nw;
+    BAIDU_SCOPED_LOCK(_zerocopy->mutex);
+    _zerocopy->pending.emplace_back();
+    ZeroCopySend& zs = _zerocopy->pending.back();
+    zs.seq = _zerocopy->next_seq++;
+    zs.done = false;
+    size_t left = nw;
+    for (size_t i = 0; i < ndata && left > 0; ++i) {
+        left -= data_list[i]->cutn(&zs.data, left);
+    }
+    return nw;
+#else
+    return _transport->CutFromIOBufList(data_list, ndata);
+#endif
+}
+
 void Socket::SetSocketOptions(int fd) {
     if (_tos > 0 &&
         setsockopt(fd, IPPROTO_IP, IP_TOS, &_tos, sizeof(_tos)) != 0) {
@@ -732,6 +1004,9 @@ int Socket::OnCreated(const SocketOptions& options) {
     });
     // start build the transport
     _socket_mode = options.socket_mode;
+    _write_coalesce_us = options.write_coalesce_us;
+    _write_coalesce_bytes = options.write_coalesce_bytes;
+    _coalescing_bytes.store(0, butil::memory_order_relaxed);
     _transport = TransportFactory::CreateTransport(options.socket_mode);
     CHECK(nullptr != _transport);
     _transport->Init(this, options);
@@ -852,13 +1127,16 @@ void Socket::BeforeRecycled() {
     const int prev_fd = _fd.exchange(-1, butil::memory_order_relaxed);
     if (ValidFileDescriptor(prev_fd)) {
         if (_transport->HasOnEdgeTrigger()) {
-            _io_event.RemoveConsumer(prev_fd);
+            RemoveConsumer(prev_fd);
         }
-        close(prev_fd);
+        CloseFileDescriptor(prev_fd);
         if (create_by_connect) {
             g_vars->channel_conn << -1;
         }
     }
+    // Nobody references the socket now.
+    delete _zerocopy;
+    _zerocopy = nullptr;
     _transport->Release();
     reset_parsing_context(nullptr);
     _read_buf.clear();
@@ -1004,9 +1282,9 @@ int Socket::WaitAndReset(int32_t expected_nref) {
     const int prev_fd = _fd.exchange(-1, butil::memory_order_relaxed);
     if (ValidFileDescriptor(prev_fd)) {
         if (_transport->HasOnEdgeTrigger()) {
-            _io_event.RemoveConsumer(prev_fd);
+            RemoveConsumer(prev_fd);
         }
-        close(prev_fd);
+        CloseFileDescriptor(prev_fd);
         if (CreatedByConnect()) {
             g_vars->channel_conn << -1;
         }
@@ -1202,11 +1480,15 @@ bool Socket::IsWriteComplete(Socket::WriteRequest* old_head,
     // Reverse the list until old_head.
     WriteRequest* tail = nullptr;
     WriteRequest* p = new_head;
+    int64_t linked_bytes = 0;
     do {
         while (p->next == WriteRequest::UNCONNECTED) {
             // TODO(gejun): elaborate this
             sched_yield();
         }
+        // Same as the size counted by StartWrite() since Setup() is not
+        // called yet.
+        linked_bytes += (int64_t)p->data.size();
         WriteRequest* const saved_next = p->next;
         p->next = tail;
         tail = p;
@@ -1214,6 +1496,12 @@ bool Socket::IsWriteComplete(Socket::WriteRequest* old_head,
         CHECK(p != nullptr);
     } while (p != old_head);
 
+    if (_write_coalesce_bytes > 0) {
+        // The linked requests are taken by the current writer, they don't
+        // count for the next coalescing.
+        _coalescing_bytes.fetch_sub(linked_bytes, butil::memory_order_relaxed);
+    }
+
     // Link old list with new list.
     old_head->next = tail;
     // Call Setup() from oldest to newest, notice that the calling sequence
@@ -1699,12 +1987,20 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
     WriteRequest* const prev_head =
         _write_head.exchange(req, butil::memory_order_release);
     if (prev_head != nullptr) {
+        // `req' may be written and returned once it's linked.
+        const int64_t size = (_write_coalesce_bytes > 0 ? req->data.size() : 0);
         // Someone is writing to the fd. The KeepWrite thread may spin
         // until req->next to be non-UNCONNECTED. This process is not
         // lock-free, but the duration is so short(1~2 instructions,
         // depending on compiler) that the spin rarely occurs in practice
         // (I've not seen any spin in highly contended tests).
         req->next = prev_head;
+        if (size > 0 &&
+            _coalescing_bytes.fetch_add(size) + size >= _coalesce_wake_bytes.load()) {
+            // Wake up KeepWrite waiting in WaitForWriteCoalescing().
+            _coalesce_butex->fetch_add(1, butil::memory_order_release);
+            bthread::butex_wake(_coalesce_butex);
+        }
         return 0;
     }
 
@@ -1747,12 +2043,21 @@ int Socket::StartWrite(WriteRequest* req, const WriteOptions& opt) {
         // in the background.
         goto KEEPWRITE_IN_BACKGROUND;
     }
+    if (_write_coalesce_us > 0 &&
+        (_write_coalesce_bytes <= 0 ||
+         req->data.size() < (size_t)_write_coalesce_bytes)) {
+        // Let KeepWrite wait for following requests.
+        goto KEEPWRITE_IN_BACKGROUND;
+    }
     
     // Write once in the calling thread. If the write is not complete,
     // continue it in KeepWrite thread.
     if (_conn) {
         butil::IOBuf* data_arr[1] = { &req->data };
         nw = _conn->CutMessageIntoFileDescriptor(fd(), data_arr, 1);
+    } else if (ZeroCopyEnabled()) {
+        butil::IOBuf* data_arr[1] = { &req->data };
+        nw = ZeroCopyWrite(data_arr, 1);
     } else {
         nw = _transport->CutFromIOBuf(&req->data);
     }
@@ -1804,6 +2109,11 @@ void* Socket::KeepWrite(void* void_arg) {
     // returning directly otherwise _write_head is permantly non-nullptr which
     // makes later Write() abnormal.
     WriteRequest* cur_tail = nullptr;
+    if (s->_write_coalesce_us > 0 && !req->data.empty()) {
+        s->WaitForWriteCoalescing(req);
+        // Link requests queued meanwhile to write them together.
+        s->IsWriteComplete(req, false, &cur_tail);
+    }
     do {
         // req was written, skip it.
         bool need_shutdown = false;
@@ -1880,24 +2190,60 @@ void* Socket::KeepWrite(void* void_arg) {
     return nullptr;
 }
 
+void Socket::WaitForWriteCoalescing(WriteRequest* req) {
+    // Requests are linked after `req' lazily in IsWriteComplete(), their
+    // bytes are counted by StartWrite() until they're linked.
+    int64_t wake_bytes = std::numeric_limits<int64_t>::max();
+    if (_write_coalesce_bytes > 0) {
+        wake_bytes = _write_coalesce_bytes - (int64_t)req->data.size();
+        if (wake_bytes <= 0) {
+            return;
+        }
+    }
+    // Pair with fetch_add in StartWrite(), either we see the bytes or the
+    // writer sees `wake_bytes' and wakes us up.
+    _coalesce_wake_bytes.store(wake_bytes);
+    const timespec duetime = butil::microseconds_from_now(_write_coalesce_us);
+    while (!Failed()) {
+        const int expected_val = _coalesce_butex->load(butil::memory_order_acquire);
+        if (_coalescing_bytes.load() >= wake_bytes) {
+            break;
+        }
+        if (bthread::butex_wait(_coalesce_butex, expected_val, &duetime) < 0 &&
+            errno == ETIMEDOUT) {
+            break;
+        }
+    }
+    _coalesce_wake_bytes.store(std::numeric_limits<int64_t>::max(),
+                               butil::memory_order_relaxed);
+}
+
 ssize_t Socket::DoWrite(WriteRequest* req) {
     // Group butil::IOBuf in the list into a batch array.
     butil::IOBuf* data_list[DATA_LIST_MAX];
     size_t ndata = 0;
+    size_t nbytes = 0;
     for (WriteRequest* p = req; p != nullptr && ndata < DATA_LIST_MAX;
          p = p->next) {
         data_list[ndata++] = &p->data;
+        nbytes += p->data.size();
         if (p->need_shutdown_write()) {
             // Write WriteRequest until shutdown write.
             _is_write_shutdown = true;
             break;
         }
     }
+    if (_write_coalesce_us > 0) {
+        g_vars->coalesced_write_requests << ndata;
+        g_vars->coalesced_write_bytes << nbytes;
+    }
 
     if (ssl_state() == SSL_OFF) {
         // Write IOBuf in the batch array into the fd.
         if (_conn) {
             return _conn->CutMessageIntoFileDescriptor(fd(), data_list, ndata);
+        } else if (ZeroCopyEnabled()) {
+            return ZeroCopyWrite(data_list, ndata);
         } else {
             return _transport->CutFromIOBufList(data_list, ndata);
         }
@@ -2114,7 +2460,7 @@ ssize_t Socket::DoRead(size_t size_hint) {
             errno = ESSL;
             return -1;
         }
-        return _read_buf.append_from_file_descriptor(fd(), size_hint);
+        return _transport->DoRead(&_read_buf, size_hint);
     }
 
     CHECK_EQ(SSL_CONNECTED, ssl_state());
@@ -2237,6 +2583,17 @@ int Socket::OnInputEvent(void* user_data, uint32_t events,
         return -1;
     }
 
+#if defined(OS_LINUX)
+    if ((events & EPOLLERR) && s->ZeroCopyEnabled()) {
+        // Release data of completed zerocopy sends in the dispatcher
+        // directly, reading the fd is unnecessary if nothing else happened.
+        if (HandleZeroCopyNotifications(s->_zerocopy, s->fd()) &&
+            events == EPOLLERR) {
+            return 0;
+        }
+    }
+#endif
+
     // if (events & has_epollrdhup) {
     //     s->_eof = 1;
     // }
@@ -2377,12 +2734,21 @@ void Socket::DebugSocket(std::ostream& os, SocketId id) {
     const int64_t cpuwide_now = butil::cpuwide_time_us();
     os << "\nhc_count=" << ptr->_hc_count
        << "\navg_input_msg_size=" << ptr->_avg_msg_size
+       << "\navg_read_size=" << ptr->_avg_read_size
         // NOTE: We're assuming that butil::IOBuf.size() is thread-safe, it is now
         // however it's not guaranteed.
        << "\nread_buf=" << ptr->_read_buf.size()
        << "\nlast_read_to_now=" << cpuwide_now - ptr->_last_readtime_us << "us"
        << "\nlast_write_to_now=" << cpuwide_now - ptr->_last_writetime_us << "us"
        << "\novercrowded=" << ptr->_overcrowded;
+    if (ptr->_zerocopy != nullptr) {
+        BAIDU_SCOPED_LOCK(ptr->_zerocopy->mutex);
+        os << "\nzerocopy_pending_sends=" << ptr->_zerocopy->pending.size();
+    }
+    if (ptr->_write_coalesce_us > 0) {
+        os << "\nwrite_coalesce_us=" << ptr->_write_coalesce_us
+           << "\nwrite_coalesce_bytes=" << ptr->_write_coalesce_bytes;
+    }
     os << "\nid_wait_list={";
     for (size_t i = 0; i < nidsize; ++i) {
         if (i) {
@@ -2791,6 +3157,8 @@ int Socket::GetPooledSocket(SocketUniquePtr* pooled_socket) {
         opt.keytable_pool = _keytable_pool;
         opt.app_connect = _app_connect;
         opt.socket_mode = _socket_mode;
+        opt.write_coalesce_us = _write_coalesce_us;
+        opt.write_coalesce_bytes = _write_coalesce_bytes;
         socket_pool = new SocketPool(opt);
         SocketPool* expected = nullptr;
         if (!main_sp->socket_pool.compare_exchange_strong(
@@ -2894,6 +3262,8 @@ int Socket::GetShortSocket(SocketUniquePtr* short_socket) {
     opt.keytable_pool = _keytable_pool;
     opt.app_connect = _app_connect;
     opt.socket_mode = _socket_mode;
+    opt.write_coalesce_us = _write_coalesce_us;
+    opt.write_coalesce_bytes = _write_coalesce_bytes;
     if (get_client_side_messenger()->Create(opt, &id) != 0 ||
         Address(id, short_socket) != 0) {
         return -1;
@@ -46,7 +46,7 @@
 
 namespace brpc {
 namespace policy {
-class ConsistentHashingLoadBalancer;
+template <typename DataPolicy> class BasicConsistentHashingLoadBalancer;
 class RtmpContext;
 class H2GlobalStreamCreator;
 }  // namespace policy
@@ -65,6 +65,10 @@ namespace ubring {
     class UBShmEndpoint;
     class UBConnect;
 }
+namespace shm {
+class ShmEndpoint;
+class ShmConnect;
+}
 class Socket;
 class AuthContext;
 class EventDispatcher;
@@ -156,6 +160,16 @@ struct SocketVarsCollector {
         , nkeepwrite_second("rpc_keepwrite_second", &nkeepwrite)
         , nwaitepollout("rpc_waitepollout_count")
         , nwaitepollout_second("rpc_waitepollout_second", &nwaitepollout)
+        , nzerocopy_bytes("rpc_zerocopy_bytes")
+        , nzerocopy_copied("rpc_zerocopy_copied_count")
+        , nzerocopy_lingering("rpc_zerocopy_lingering_fd_count")
+        , coalesced_write_requests_window(
+            "rpc_coalesced_write_requests", &coalesced_write_requests, -1)
+        , coalesced_write_bytes_window(
+            "rpc_coalesced_write_bytes", &coalesced_write_bytes, -1)
+        , read_bytes_per_event_window(
+            "rpc_read_bytes_per_event", &read_bytes_per_event, -1)
+        , read_bytes_per_event_histogram("rpc_read_bytes_per_event_histogram")
     {}
 
     bvar::Adder<int64_t> nsocket;
@@ -167,6 +181,23 @@ struct SocketVarsCollector {
     bvar::PerSecond<bvar::Adder<int64_t> > nkeepwrite_second;
     bvar::Adder<int64_t> nwaitepollout;
     bvar::PerSecond<bvar::Adder<int64_t> > nwaitepollout_second;
+    // Bytes written with MSG_ZEROCOPY
+    bvar::Adder<int64_t> nzerocopy_bytes;
+    // MSG_ZEROCOPY sends which were copied by the kernel anyway
+    bvar::Adder<int64_t> nzerocopy_copied;
+    // Closed fds waiting for completions of MSG_ZEROCOPY sends
+    bvar::Adder<int64_t> nzerocopy_lingering;
+    // WriteRequests and bytes of each write of sockets with write
+    // coalescing enabled.
+    bvar::IntRecorder coalesced_write_requests;
+    bvar::IntRecorder coalesced_write_bytes;
+    bvar::Window<bvar::IntRecorder> coalesced_write_requests_window;
+    bvar::Window<bvar::IntRecorder> coalesced_write_bytes_window;
+    // Bytes read from each input event until EAGAIN. The recorder gives
+    // the average, the histogram gives the distribution.
+    bvar::IntRecorder read_bytes_per_event;
+    bvar::Window<bvar::IntRecorder> read_bytes_per_event_window;
+    bvar::LogLinearHistogram read_bytes_per_event_histogram;
 };
 
 struct PipelinedInfo {
@@ -294,6 +325,12 @@ struct SocketOptions {
     bool force_ssl{false};
     std::shared_ptr<SocketSSLContext> initial_ssl_ctx;
     SocketMode socket_mode{SOCKET_MODE_TCP};
+    // If positive, KeepWrite waits up to so many microseconds to merge
+    // WriteRequests queued in the meantime into fewer writes.
+    int32_t write_coalesce_us{0};
+    // Stop waiting once so many bytes are queued. Non-positive means
+    // waiting for `write_coalesce_us' always.
+    int32_t write_coalesce_bytes{0};
     bthread_keytable_pool_t* keytable_pool{nullptr};
     SocketConnection* conn{nullptr};
     std::shared_ptr<AppConnect> app_connect;
@@ -322,7 +359,8 @@ friend class ConnectionsService;
 friend class SocketUser;
 friend class Stream;
 friend class Controller;
-friend class policy::ConsistentHashingLoadBalancer;
+template <typename DataPolicy>
+friend class policy::BasicConsistentHashingLoadBalancer;
 friend class policy::RtmpContext;
 friend class schan::ChannelBalancer;
 friend class rdma::RdmaEndpoint;
@@ -344,6 +382,10 @@ friend void DereferenceSocket(Socket*);
 friend class Transport;
 friend class TcpTransport;
 friend class RdmaTransport;
+friend class IoUringTransport;
+friend class ShmTransport;
+friend class shm::ShmEndpoint;
+friend class shm::ShmConnect;
 friend class TransportFactory;
     class SharedPart;
     struct WriteRequest;
@@ -758,14 +800,41 @@ private:
 
     int ResetFileDescriptor(int fd);
 
+    // Stop receiving events of `fd' which is about to be closed.
+    void RemoveConsumer(int fd);
+
+    // Close `fd'. If some MSG_ZEROCOPY sends on `fd' are not notified as
+    // completed, `fd' is closed in background after they are.
+    void CloseFileDescriptor(int fd);
+
     void SetSocketOptions(int fd);
 
+    // Enable MSG_ZEROCOPY on `fd' if -socket_zerocopy is on.
+    void EnableZeroCopy(int fd);
+    bool ZeroCopyEnabled() const;
+
+    // Write `data_list' with MSG_ZEROCOPY if they're large enough, through
+    // the transport otherwise. Written blocks are referenced until the
+    // kernel notifies that the sending is done.
+    ssize_t ZeroCopyWrite(butil::IOBuf** data_list, size_t ndata);
+
+    struct ZeroCopyState;
+    // Release data of the sends notified as completed in the error queue of
+    // `fd'. Returns true if at least one message was read from the queue
+    // and all of them were notifications of MSG_ZEROCOPY.
+    static bool HandleZeroCopyNotifications(ZeroCopyState* zc, int fd);
+    static void* LingerZeroCopyFileDescriptor(void* arg);
+
     // Wait until nref hits `expected_nref' and reset some internal resources.
     int WaitAndReset(int32_t expected_nref);
 
 
     static void* KeepWrite(void*);
 
+    // Wait until `write_coalesce_bytes' are queued after `req' or
+    // `write_coalesce_us' elapses.
+    void WaitForWriteCoalescing(WriteRequest* req);
+
     bool IsWriteComplete(WriteRequest* old_head, bool singular_node,
                          WriteRequest** new_tail);
 
@@ -898,6 +967,9 @@ private:
     uint32_t _last_msg_size;
     // Average message size of last #MSG_SIZE_WINDOW messages (roughly)
     uint32_t _avg_msg_size;
+    // Exponentially decayed bytes read from each input event, which sizes
+    // the reads of next events.
+    uint32_t _avg_read_size;
 
     // Storing data read from `_fd' but cut-off yet.
     butil::IOPortal _read_buf;
@@ -993,6 +1065,21 @@ private:
     // Storing data that are not flushed into `fd' yet.
     butil::atomic<WriteRequest*> _write_head;
 
+    // MSG_ZEROCOPY states, nullptr if zerocopy was never enabled on fds of
+    // this socket. Kept until the socket is recycled.
+    ZeroCopyState* _zerocopy;
+
+    // Options of write coalescing, see SocketOptions.
+    int32_t _write_coalesce_us;
+    int32_t _write_coalesce_bytes;
+    // Bytes of WriteRequests queued while a write is in progress and not
+    // linked into the write list by IsWriteComplete() yet.
+    butil::atomic<int64_t> _coalescing_bytes;
+    // KeepWrite waiting for coalescing is woken through _coalesce_butex
+    // when _coalescing_bytes reaches _coalesce_wake_bytes.
+    butil::atomic<int64_t> _coalesce_wake_bytes;
+    butil::atomic<int>* _coalesce_butex;
+
     bool _is_write_shutdown;
 
     butil::Mutex _stream_mutex;
@@ -21,7 +21,9 @@ namespace brpc {
 enum SocketMode {
     SOCKET_MODE_TCP = 0,
     SOCKET_MODE_RDMA = 1,
-    SOCKET_MODE_UBRING = 2
+    SOCKET_MODE_UBRING = 2,
+    SOCKET_MODE_IO_URING = 3,
+    SOCKET_MODE_SHM = 4
 };
 } // namespace brpc
 #endif //BRPC_SOCKET_MODE_H
\ No newline at end of file
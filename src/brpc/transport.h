@@ -39,6 +39,22 @@ public:
         msg->_process(msg);
         return nullptr;
     }
+
+    // Start a bthread running ProcessInputMessage(msg). The bthread inherits
+    // the deadline of `msg' from the calling bthread, so that it's queued
+    // before messages with later deadlines by -bthread_deadline_scheduling.
+    static int StartProcessInputMessage(bthread_t* th, const bthread_attr_t* attr,
+                                        InputMessageBase* msg) {
+        const int64_t deadline_us = msg->process_deadline_us();
+        int64_t saved_deadline_us = 0;
+        if (deadline_us == 0 || bthread_get_deadline(&saved_deadline_us) != 0) {
+            return bthread_start_background(th, attr, ProcessInputMessage, msg);
+        }
+        bthread_set_deadline(deadline_us);
+        const int rc = bthread_start_background(th, attr, ProcessInputMessage, msg);
+        bthread_set_deadline(saved_deadline_us);
+        return rc;
+    }
     virtual ~Transport() = default;
     virtual void Init(Socket* socket, const SocketOptions& options) = 0;
     virtual void Release() = 0;
@@ -51,6 +67,23 @@ public:
     virtual void QueueMessage(InputMessageClosure& input_msg, int* num_bthread_created, bool last_msg) = 0;
     virtual void Debug(std::ostream &os) = 0;
 
+    // Start receiving data from `fd' which is just set to the socket.
+    // By default `fd' is watched by EventDispatcher.
+    // Returns 0 on success, -1 otherwise.
+    virtual int StartRecv(int fd) {
+        return _socket->_io_event.AddConsumer(fd);
+    }
+    // Stop receiving data from `fd'. MUST be called before `fd' is closed.
+    virtual void StopRecv(int fd) {
+        _socket->_io_event.RemoveConsumer(fd);
+    }
+    // Read data into `buf', `size_hint' is the suggested number of bytes to
+    // read. Called by Socket::DoRead() when SSL is off. Semantics of the
+    // return value are same with read().
+    virtual ssize_t DoRead(butil::IOPortal* buf, size_t size_hint) {
+        return buf->append_from_file_descriptor(_socket->fd(), size_hint);
+    }
+
     bool HasOnEdgeTrigger() {
         return _on_edge_trigger != nullptr;
     }
@@ -19,6 +19,8 @@
 #include "brpc/tcp_transport.h"
 #include "brpc/rdma_transport.h"
 #include "brpc/ubshm_transport.h"
+#include "brpc/io_uring_transport.h"
+#include "brpc/shm_transport.h"
 
 namespace brpc {
 int TransportFactory::ContextInitOrDie(SocketMode mode, bool serverOrNot, const void* _options) {
@@ -34,6 +36,16 @@ int TransportFactory::ContextInitOrDie(SocketMode mode, bool serverOrNot, const
     else if (mode == SOCKET_MODE_UBRING) {
         return UBShmTransport::ContextInitOrDie(serverOrNot, _options);
     }
+#endif
+#if BRPC_WITH_IO_URING
+    else if (mode == SOCKET_MODE_IO_URING) {
+        return IoUringTransport::ContextInitOrDie(serverOrNot, _options);
+    }
+#endif
+#if defined(OS_LINUX)
+    else if (mode == SOCKET_MODE_SHM) {
+        return ShmTransport::ContextInitOrDie(serverOrNot, _options);
+    }
 #endif
     else {
         LOG(ERROR) << "unknown transport type  " << mode;
@@ -54,6 +66,16 @@ std::unique_ptr<Transport> TransportFactory::CreateTransport(SocketMode mode) {
     else if (mode == SOCKET_MODE_UBRING) {
         return std::unique_ptr<UBShmTransport>(new UBShmTransport());
     }
+#endif
+#if BRPC_WITH_IO_URING
+    else if (mode == SOCKET_MODE_IO_URING) {
+        return std::unique_ptr<IoUringTransport>(new IoUringTransport());
+    }
+#endif
+#if defined(OS_LINUX)
+    else if (mode == SOCKET_MODE_SHM) {
+        return std::unique_ptr<ShmTransport>(new ShmTransport());
+    }
 #endif
     else {
         LOG(ERROR) << "socket_mode set error";
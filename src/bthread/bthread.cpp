@@ -261,20 +261,10 @@ static bool validate_bthread_concurrency_by_tag(const char*, int32_t val) {
 
 BAIDU_VOLATILE_THREAD_LOCAL(TaskGroup*, tls_task_group_nosignal, nullptr);
 
-BUTIL_FORCE_INLINE int
-start_from_non_worker(bthread_t* __restrict tid,
-                      const bthread_attr_t* __restrict attr,
-                      void* (*fn)(void*),
-                      void* __restrict arg) {
-    TaskControl* c = get_or_new_task_control();
-    if (nullptr == c) {
-        return ENOMEM;
-    }
-    bthread_tag_t tag = BTHREAD_TAG_DEFAULT;
-    if (attr != nullptr && attr->tag != BTHREAD_TAG_INVALID) {
-        tag = attr->tag;
-    }
-    if (attr != nullptr && (attr->flags & BTHREAD_NOSIGNAL)) {
+// Choose the TaskGroup to insert bthreads created by non-worker.
+BUTIL_FORCE_INLINE TaskGroup*
+choose_group_from_non_worker(TaskControl* c, bthread_tag_t tag, bool nosignal) {
+    if (nosignal) {
         // Remember the TaskGroup to insert NOSIGNAL tasks for 2 reasons:
         // 1. NOSIGNAL is often for creating many bthreads in batch,
         //    inserting into the same TaskGroup maximizes the batch.
@@ -292,19 +282,87 @@ start_from_non_worker(bthread_t* __restrict tid,
                 "BTHREAD_NOSIGNAL on the same thread is not supported, "
                 "expected tag=" << g->tag() << " but got tag=" << tag;
         }
-        return g->start_background<true>(tid, attr, fn, arg);
+        return g;
+    }
+    return c->choose_one_group(tag);
+}
+
+BUTIL_FORCE_INLINE int
+start_from_non_worker(bthread_t* __restrict tid,
+                      const bthread_attr_t* __restrict attr,
+                      void* (*fn)(void*),
+                      void* __restrict arg) {
+    TaskControl* c = get_or_new_task_control();
+    if (nullptr == c) {
+        return ENOMEM;
+    }
+    const bool nosignal = (attr != nullptr && (attr->flags & BTHREAD_NOSIGNAL));
+    TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (g != nullptr && (attr == nullptr || attr->tag == BTHREAD_TAG_INVALID)) {
+        // Created by a task borrowed from another tag by the worker, see
+        // FLAGS_bthread_tag_weights. bthread_flush() in the worker does not
+        // flush groups of other tags, signal NOSIGNAL tasks now.
+        TaskGroup* home = c->choose_one_group(g->current_tag());
+        const int rc = home->start_background<true>(tid, attr, fn, arg);
+        if (nosignal) {
+            home->flush_nosignal_tasks_remote();
+        }
+        return rc;
+    }
+    bthread_tag_t tag = BTHREAD_TAG_DEFAULT;
+    if (attr != nullptr && attr->tag != BTHREAD_TAG_INVALID) {
+        tag = attr->tag;
     }
-    return c->choose_one_group(tag)->start_background<true>(tid, attr, fn, arg);
+    return choose_group_from_non_worker(c, tag, nosignal)->
+        start_background<true>(tid, attr, fn, arg);
+}
+
+// `attrs' are checked to have the same tag.
+static int start_batch_from_non_worker(bthread_t* __restrict tids,
+                                       const bthread_attr_t* __restrict attrs,
+                                       void* (**fns)(void*),
+                                       void** args,
+                                       size_t n) {
+    TaskControl* c = get_or_new_task_control();
+    if (nullptr == c) {
+        return ENOMEM;
+    }
+    bthread_tag_t tag = BTHREAD_TAG_DEFAULT;
+    bool nosignal = false;
+    if (attrs != nullptr) {
+        if (attrs[0].tag != BTHREAD_TAG_INVALID) {
+            tag = attrs[0].tag;
+        }
+        for (size_t i = 0; i < n && !nosignal; ++i) {
+            nosignal = (attrs[i].flags & BTHREAD_NOSIGNAL);
+        }
+    }
+    TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (g != nullptr && (attrs == nullptr || attrs[0].tag == BTHREAD_TAG_INVALID)) {
+        // Same as start_from_non_worker().
+        TaskGroup* home = c->choose_one_group(g->current_tag());
+        const int rc = home->start_background_batch<true>(tids, attrs, fns, args, n);
+        if (nosignal) {
+            home->flush_nosignal_tasks_remote();
+        }
+        return rc;
+    }
+    return choose_group_from_non_worker(c, tag, nosignal)->
+        start_background_batch<true>(tids, attrs, fns, args, n);
 }
 
 // Meet one of the three conditions, can run in thread local
 // attr is nullptr
 // tag equal to thread local
 // tag equal to BTHREAD_TAG_INVALID
+// unless the current task is borrowed from another tag, whose children
+// belong to the tag of the task, see FLAGS_bthread_tag_weights.
 BUTIL_FORCE_INLINE bool can_run_thread_local(const bthread_attr_t* __restrict attr) {
-    return attr == nullptr ||
-           attr->tag == BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group)->tag() ||
-           attr->tag == BTHREAD_TAG_INVALID;
+    TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (attr == nullptr || attr->tag == BTHREAD_TAG_INVALID) {
+        return g->current_tag() == g->tag();
+    }
+    return attr->tag == g->tag();
 }
 
 struct TidTraits {
@@ -360,6 +418,34 @@ int bthread_start_background(bthread_t* __restrict tid,
     return bthread::start_from_non_worker(tid, attr, fn, arg);
 }
 
+int bthread_start_batch(bthread_t* __restrict tids,
+                        const bthread_attr_t* __restrict attrs,
+                        void * (**fns)(void*),
+                        void** args,
+                        size_t n) {
+    if (n == 0) {
+        return 0;
+    }
+    if (tids == nullptr || fns == nullptr) {
+        return EINVAL;
+    }
+    if (attrs != nullptr) {
+        for (size_t i = 1; i < n; ++i) {
+            if (attrs[i].tag != attrs[0].tag) {
+                return EINVAL;
+            }
+        }
+    }
+    bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (g) {
+        // if attribute is null use thread local task group
+        if (bthread::can_run_thread_local(attrs)) {
+            return g->start_background_batch<false>(tids, attrs, fns, args, n);
+        }
+    }
+    return bthread::start_batch_from_non_worker(tids, attrs, fns, args, n);
+}
+
 void bthread_flush() {
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
     if (g) {
@@ -427,6 +513,24 @@ int bthread_getattr(bthread_t tid, bthread_attr_t* attr) {
     return bthread::TaskGroup::get_attr(tid, attr);
 }
 
+int bthread_set_deadline(int64_t deadline_us) {
+    bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (g == nullptr || g->is_current_main_task()) {
+        return EINVAL;
+    }
+    g->current_task()->deadline_us = deadline_us;
+    return 0;
+}
+
+int bthread_get_deadline(int64_t* deadline_us) {
+    bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (deadline_us == nullptr || g == nullptr || g->is_current_main_task()) {
+        return EINVAL;
+    }
+    *deadline_us = g->current_task()->deadline_us;
+    return 0;
+}
+
 int bthread_getconcurrency(void) {
     return bthread::FLAGS_bthread_concurrency;
 }
@@ -562,6 +666,9 @@ int bthread_timer_del(bthread_timer_t id) {
 
 int bthread_usleep(uint64_t microseconds) {
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (nullptr != g && microseconds != 0) {
+        g->promote_stackless_task();
+    }
     if (nullptr != g && !g->is_current_pthread_task()) {
         return bthread::TaskGroup::usleep(&g, microseconds);
     }
@@ -570,6 +677,9 @@ int bthread_usleep(uint64_t microseconds) {
 
 int bthread_yield(void) {
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (nullptr != g) {
+        g->promote_stackless_task();
+    }
     if (nullptr != g && !g->is_current_pthread_task()) {
         bthread::TaskGroup::yield(&g);
         return 0;
@@ -643,7 +753,7 @@ int bthread_list_join(bthread_list_t* list) {
 
 bthread_tag_t bthread_self_tag(void) {
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
-    return g != nullptr ? g->tag() : BTHREAD_TAG_DEFAULT;
+    return g != nullptr ? g->current_tag() : BTHREAD_TAG_DEFAULT;
 }
 
 uint64_t bthread_cpu_clock_ns(void) {
@@ -69,6 +69,20 @@ extern int bthread_start_background(bthread_t* __restrict tid,
                                     void * (*fn)(void*),
                                     void* __restrict args);
 
+// Create `n' bthreads `fns[i](args[i])' with attributes `attrs[i]' and put
+// the identifiers into `tids[i]', as if bthread_start_background() is called
+// `n' times. Instead of touching the runqueue and waking up workers for each
+// bthread, all bthreads are pushed into the runqueue in one pass and workers
+// are woken up once. `attrs' or `args' can be NULL, in which case bthreads are
+// created with default attributes or NULL arguments. All attributes must have
+// the same tag.
+// Returns 0 on success, errno otherwise, in which case no bthread is created.
+extern int bthread_start_batch(bthread_t* __restrict tids,
+                               const bthread_attr_t* __restrict attrs,
+                               void * (**fns)(void*),
+                               void** args,
+                               size_t n);
+
 // Wake up operations blocking the thread. Different functions may behave
 // differently:
 //   bthread_usleep(): returns -1 and sets errno to ESTOP if bthread_stop()
@@ -147,6 +161,18 @@ extern int bthread_attr_destroy(bthread_attr_t* attr);
 // and destroyed with bthread_attr_destroy when no longer needed.
 extern int bthread_getattr(bthread_t bt, bthread_attr_t* attr);
 
+// Set deadline (absolute time in microseconds, see butil::gettimeofday_us())
+// of the calling bthread, 0 to clear. It takes effect when the bthread is
+// queued again, namely after it yields or is woken up, see
+// -bthread_deadline_scheduling. bthreads created by the calling bthread
+// inherit the deadline.
+// Returns 0 on success, EINVAL if the caller is not a bthread.
+extern int bthread_set_deadline(int64_t deadline_us);
+
+// Get deadline of the calling bthread into `deadline_us', 0 means no deadline.
+// Returns 0 on success, EINVAL if the caller is not a bthread.
+extern int bthread_get_deadline(int64_t* deadline_us);
+
 // ---------------------------------------------
 // Functions for scheduling control.
 // ---------------------------------------------
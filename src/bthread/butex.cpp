@@ -121,6 +121,17 @@ struct BAIDU_CACHELINE_ALIGNMENT Butex {
 BAIDU_CASSERT(offsetof(Butex, value) == 0, offsetof_value_must_0);
 BAIDU_CASSERT(sizeof(Butex) == BAIDU_CACHELINE_SIZE, butex_fits_in_one_cacheline);
 
+// A butex followed by data of its user, see butex_create_with_extra().
+struct ButexWithExtra {
+    Butex butex;
+    char extra[BUTEX_EXTRA_SIZE];
+};
+
+BAIDU_CASSERT(offsetof(ButexWithExtra, butex) == 0, offsetof_butex_must_0);
+// butex_extra() relies on this.
+BAIDU_CASSERT(offsetof(ButexWithExtra, extra) == BAIDU_CACHELINE_SIZE,
+              extra_must_follow_cacheline_of_butex);
+
 } // namespace bthread
 
 namespace butil {
@@ -128,6 +139,8 @@ namespace butil {
 // so ObjectPool<Butex> can not poison the memory region of Butex.
 template <>
 struct ObjectPoolWithASanPoison<bthread::Butex> : false_type {};
+template <>
+struct ObjectPoolWithASanPoison<bthread::ButexWithExtra> : false_type {};
 } // namespace butil
 
 namespace bthread {
@@ -278,6 +291,23 @@ void butex_destroy(void* butex) {
     butil::return_object(b);
 }
 
+void* butex_create_with_extra() {
+    ButexWithExtra* b = butil::get_object<ButexWithExtra>();
+    if (b) {
+        return &b->butex.value;
+    }
+    return nullptr;
+}
+
+void butex_destroy_with_extra(void* butex) {
+    if (!butex) {
+        return;
+    }
+    Butex* b = static_cast<Butex*>(
+        container_of(static_cast<butil::atomic<int>*>(butex), Butex, value));
+    butil::return_object(reinterpret_cast<ButexWithExtra*>(b));
+}
+
 // if TaskGroup tls_task_group is belong to tag
 inline bool is_same_tag(bthread_tag_t tag) {
     auto g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
@@ -682,6 +712,9 @@ int butex_wait(void* arg, int expected_value, const timespec* abstime, bool prep
         return -1;
     }
     TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (nullptr != g) {
+        g->promote_stackless_task();
+    }
     if (nullptr == g || g->is_current_pthread_task()) {
         return butex_wait_from_pthread(g, b, expected_value, abstime, prepend);
     }
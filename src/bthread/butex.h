@@ -49,6 +49,23 @@ template <typename T> T* butex_create_checked() {
 // Destroy the butex.
 void butex_destroy(void* butex);
 
+// Max size of the data that can be attached to a butex.
+static const size_t BUTEX_EXTRA_SIZE = 64;
+
+// Same as butex_create(), but the butex is followed by BUTEX_EXTRA_SIZE bytes
+// for the user, which are returned by butex_extra() and, like the butex
+// itself, never freed. The data is not initialized.
+void* butex_create_with_extra();
+
+// Destroy a butex created by butex_create_with_extra().
+void butex_destroy_with_extra(void* butex);
+
+// Data attached to a butex created by butex_create_with_extra(), which
+// follows the cacheline of the butex.
+inline void* butex_extra(void* butex) {
+    return static_cast<char*>(butex) + BAIDU_CACHELINE_SIZE;
+}
+
 // Wake up at most 1 thread waiting on |butex|.
 // Returns # of threads woken up.
 int butex_wake(void* butex, bool nosignal = false);
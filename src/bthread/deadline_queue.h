@@ -0,0 +1,142 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - An M:N threading library to make applications more concurrent.
+
+#ifndef BTHREAD_DEADLINE_QUEUE_H
+#define BTHREAD_DEADLINE_QUEUE_H
+
+#include <stdint.h>
+#include <algorithm>                       // std::push_heap
+#include <limits>
+#include <vector>
+#include "butil/atomicops.h"
+#include "butil/macros.h"
+#include "butil/scoped_lock.h"
+#include "butil/synchronization/lock.h"    // butil::Mutex
+#include "bthread/types.h"                  // bthread_t
+
+namespace bthread {
+
+// Ready bthreads with deadlines, popped in the order of deadlines (earliest
+// first). Shared by all workers of a tag: unlike runqueues, the order must
+// be global. A single heap would be locked by every worker, so the queue is
+// split into shards, each pushed by a subset of workers. pop() takes the
+// shard whose earliest deadline is the smallest, which is exact unless the
+// shards are changed meanwhile. Empty shards are never locked.
+class DeadlineQueue {
+public:
+    struct Entry {
+        int64_t deadline_us;
+        bthread_t tid;
+        // std::push_heap() makes a max-heap.
+        bool operator<(const Entry& rhs) const {
+            return deadline_us > rhs.deadline_us;
+        }
+    };
+
+    static const size_t NSHARD = 8;
+
+    DeadlineQueue() {}
+
+    // Push into the shard selected by `hint', e.g. a hash of the worker.
+    void push(bthread_t tid, int64_t deadline_us, size_t hint) {
+        const Entry e = { deadline_us, tid };
+        push_batch(&e, 1, hint);
+    }
+
+    // Push `entries' with one locking.
+    void push_batch(const Entry* entries, size_t n, size_t hint) {
+        Shard& sh = _shards[hint % NSHARD];
+        BAIDU_SCOPED_LOCK(sh.mutex);
+        for (size_t i = 0; i < n; ++i) {
+            sh.heap.push_back(entries[i]);
+            std::push_heap(sh.heap.begin(), sh.heap.end());
+        }
+        sh.update_locked();
+    }
+
+    // Returns true and the task with the earliest deadline in `tid' and its
+    // deadline in `deadline_us' if the queue is not empty.
+    bool pop(bthread_t* tid, int64_t* deadline_us) {
+        // Retry when the chosen shard was emptied by others.
+        for (size_t ntry = 0; ntry < NSHARD; ++ntry) {
+            Shard* best = nullptr;
+            int64_t best_deadline_us = EMPTY_DEADLINE;
+            for (size_t i = 0; i < NSHARD; ++i) {
+                const int64_t d = _shards[i].earliest_us.load(
+                    butil::memory_order_acquire);
+                if (d < best_deadline_us) {
+                    best_deadline_us = d;
+                    best = &_shards[i];
+                }
+            }
+            if (best == nullptr) {
+                return false;
+            }
+            BAIDU_SCOPED_LOCK(best->mutex);
+            if (best->heap.empty()) {
+                continue;
+            }
+            std::pop_heap(best->heap.begin(), best->heap.end());
+            *tid = best->heap.back().tid;
+            *deadline_us = best->heap.back().deadline_us;
+            best->heap.pop_back();
+            best->update_locked();
+            return true;
+        }
+        return false;
+    }
+
+    size_t volatile_size() const {
+        size_t n = 0;
+        for (size_t i = 0; i < NSHARD; ++i) {
+            n += _shards[i].size.load(butil::memory_order_relaxed);
+        }
+        return n;
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(DeadlineQueue);
+
+    static const int64_t EMPTY_DEADLINE = std::numeric_limits<int64_t>::max();
+
+    struct BAIDU_CACHELINE_ALIGNMENT Shard {
+        Shard() : earliest_us(EMPTY_DEADLINE), size(0) {}
+
+        void update_locked() {
+            size.store(heap.size(), butil::memory_order_relaxed);
+            int64_t d = EMPTY_DEADLINE;
+            if (!heap.empty()) {
+                d = heap.front().deadline_us;
+            }
+            earliest_us.store(d, butil::memory_order_release);
+        }
+
+        // Earliest deadline in the shard, EMPTY_DEADLINE if it's empty.
+        butil::atomic<int64_t> earliest_us;
+        butil::atomic<size_t> size;
+        butil::Mutex mutex;
+        std::vector<Entry> heap;
+    };
+
+    Shard _shards[NSHARD];
+};
+
+}  // namespace bthread
+
+#endif  // BTHREAD_DEADLINE_QUEUE_H
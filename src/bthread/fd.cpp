@@ -439,6 +439,9 @@ int bthread_fd_wait(int fd, unsigned events) {
         return -1;
     }
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (nullptr != g) {
+        g->promote_stackless_task();
+    }
     if (nullptr != g && !g->is_current_pthread_task()) {
         return bthread::get_epoll_thread(fd).fd_wait(
             fd, events, nullptr);
@@ -456,6 +459,9 @@ int bthread_fd_timedwait(int fd, unsigned events,
         return -1;
     }
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (nullptr != g) {
+        g->promote_stackless_task();
+    }
     if (nullptr != g && !g->is_current_pthread_task()) {
         return bthread::get_epoll_thread(fd).fd_wait(
             fd, events, abstime);
@@ -466,6 +472,9 @@ int bthread_fd_timedwait(int fd, unsigned events,
 int bthread_connect(int sockfd, const sockaddr* serv_addr,
                     socklen_t addrlen) {
     bthread::TaskGroup* g = bthread::BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (nullptr != g) {
+        g->promote_stackless_task();
+    }
     if (nullptr == g || g->is_current_pthread_task()) {
         return ::connect(sockfd, serv_addr, addrlen);
     }
@@ -21,8 +21,10 @@
 
 #include <sys/cdefs.h>
 #include <pthread.h>
+#include <algorithm>                             // std::min
 #include <dlfcn.h>                               // dlsym
 #include <fcntl.h>                               // O_RDONLY
+#include <gflags/gflags.h>
 #include "butil/atomicops.h"
 #include "bvar/bvar.h"
 #include "bvar/collector.h"
@@ -35,6 +37,7 @@
 #include "butil/file_util.h"
 #include "butil/unique_ptr.h"
 #include "butil/memory/scope_guard.h"
+#include "butil/memory/singleton_on_pthread_once.h"
 #include "butil/third_party/murmurhash3/murmurhash3.h"
 #include "butil/third_party/symbolize/symbolize.h"
 #include "butil/logging.h"
@@ -54,6 +57,15 @@ __END_DECLS
 
 namespace bthread {
 
+DEFINE_int32(bthread_mutex_max_spin_ns, 0,
+             "Max nanoseconds to spin for a contended bthread_mutex_t while "
+             "its owner is running on another worker, before waiting on the "
+             "butex. <= 0 (default) disables the adaptive spinning");
+DEFINE_int32(bthread_mutex_max_pthread_owner_spin_ns, 1000,
+             "Max nanoseconds to spin for a contended bthread_mutex_t locked "
+             "by a pthread, whose running state is unknown. Capped by "
+             "-bthread_mutex_max_spin_ns");
+
 EXTERN_BAIDU_VOLATILE_THREAD_LOCAL(TaskGroup*, tls_task_group);
 
 // Warm up backtrace before main().
@@ -71,7 +83,11 @@ struct SampledContention : public bvar::Collected {
     int64_t duration_ns;
     // number of samples, normalized according to to sampling_range
     double count;
-    void* stack[26];      // backtrace.
+    // part of duration_ns and count of which the lock was acquired by
+    // spinning.
+    int64_t spin_duration_ns;
+    double spin_count;
+    void* stack[24];      // backtrace.
     int nframes;          // #elements in stack
 
     // Implement bvar::Collected
@@ -93,7 +109,8 @@ struct SampledContention : public bvar::Collected {
 private:
 friend butil::ObjectPool<SampledContention>;
     SampledContention()
-        : duration_ns(0), count(0), stack{nullptr}, nframes(0), _hash_code(0) {}
+        : duration_ns(0), count(0), spin_duration_ns(0), spin_count(0)
+        , stack{nullptr}, nframes(0), _hash_code(0) {}
     ~SampledContention() override = default;
 
     mutable uint32_t _hash_code; // For combining samples with hashmap.
@@ -178,6 +195,8 @@ void ContentionProfiler::dump_and_destroy(SampledContention* c) {
         SampledContention* c2 = *p_c2;
         c2->duration_ns += c->duration_ns;
         c2->count += c->count;
+        c2->spin_duration_ns += c->spin_duration_ns;
+        c2->spin_count += c->spin_count;
         c->destroy();
     } else {
         _dedup_map.insert(c, c);
@@ -187,6 +206,13 @@ void ContentionProfiler::dump_and_destroy(SampledContention* c) {
     }
 }
 
+// Never called. The address is put at the top of stacks of sampled
+// contentions in which the lock was acquired by spinning, so that pprof shows
+// them as a separate callee of the locking site.
+NOINLINE void contention_acquired_by_spinning() {
+    asm volatile("" ::: "memory");
+}
+
 void ContentionProfiler::flush_to_disk(bool ending) {
     BT_VLOG << "flush_to_disk(ending=" << ending << ")";
     
@@ -197,11 +223,26 @@ void ContentionProfiler::flush_to_disk(bool ending) {
         for (ContentionMap::const_iterator
                  it = _dedup_map.begin(); it != _dedup_map.end(); ++it) {
             SampledContention* c = it->second;
-            os << c->duration_ns << ' ' << (size_t)ceil(c->count) << " @";
-            for (int i = SKIPPED_STACK_FRAMES; i < c->nframes; ++i) {
-                os << ' ' << (void*)c->stack[i];
+            const double wait_count = c->count - c->spin_count;
+            if (wait_count > 0) {
+                os << c->duration_ns - c->spin_duration_ns << ' '
+                   << (size_t)ceil(wait_count) << " @";
+                for (int i = SKIPPED_STACK_FRAMES; i < c->nframes; ++i) {
+                    os << ' ' << (void*)c->stack[i];
+                }
+                os << '\n';
+            }
+            if (c->spin_count > 0) {
+                // Locks acquired by spinning are shown as calling
+                // contention_acquired_by_spinning().
+                os << c->spin_duration_ns << ' '
+                   << (size_t)ceil(c->spin_count) << " @ "
+                   << (void*)contention_acquired_by_spinning;
+                for (int i = SKIPPED_STACK_FRAMES; i < c->nframes; ++i) {
+                    os << ' ' << (void*)c->stack[i];
+                }
+                os << '\n';
             }
-            os << '\n';
             c->destroy();
         }
         _dedup_map.clear();
@@ -630,8 +671,10 @@ inline bool remove_pthread_contention_site(const Mutex* mutex,
     return true;
 }
 
-// Submit the contention along with the callsite('s stacktrace)
-void submit_contention(const bthread_contention_site_t& csite, int64_t now_ns) {
+// Submit the contention along with the callsite('s stacktrace).
+// `spin_acquired' is true if the lock was acquired by spinning.
+static void submit_contention(const bthread_contention_site_t& csite,
+                              int64_t now_ns, bool spin_acquired) {
     BAIDU_SET_VOLATILE_THREAD_LOCAL(tls_inside_lock, true);
     BRPC_SCOPE_EXIT {
         BAIDU_SET_VOLATILE_THREAD_LOCAL(tls_inside_lock, false);
@@ -661,12 +704,20 @@ void submit_contention(const bthread_contention_site_t& csite, int64_t now_ns) {
     sc->duration_ns = csite.duration_ns * bvar::COLLECTOR_SAMPLING_BASE
         / csite.sampling_range;
     sc->count = bvar::COLLECTOR_SAMPLING_BASE / (double)csite.sampling_range;
+    if (spin_acquired) {
+        sc->spin_duration_ns = sc->duration_ns;
+        sc->spin_count = sc->count;
+    }
     sc->nframes = stack.CopyAddressTo(sc->stack, arraysize(sc->stack));
     sc->submit(now_ns / 1000);  // may lock
     // Once submit a contention, complete warn up.
     BAIDU_SET_VOLATILE_THREAD_LOCAL(tls_warn_up, true);
 }
 
+void submit_contention(const bthread_contention_site_t& csite, int64_t now_ns) {
+    submit_contention(csite, now_ns, false);
+}
+
 #if BRPC_DEBUG_LOCK
 #define MUTEX_RESET_OWNER_COMMON(owner)                                              \
     ((butil::atomic<bool>*)&(owner).hold)                                            \
@@ -944,7 +995,7 @@ BUTIL_FORCE_INLINE int pthread_mutex_unlock_impl(Mutex* mutex) {
     }
     int64_t unlock_start_ns = 0;
     bool miss_in_tls = true;
-    bthread_contention_site_t saved_csite = {0,0};
+    bthread_contention_site_t saved_csite = {0, 0};
 #ifndef DONT_SPEEDUP_PTHREAD_CONTENTION_PROFILER_WITH_TLS
     TLSPthreadContentionSites& fast_alt =
         *BAIDU_GET_PTR_VOLATILE_THREAD_LOCAL(tls_csites);
@@ -1048,10 +1099,103 @@ BAIDU_CASSERT(sizeof(unsigned) == sizeof(MutexInternal),
 #define BTHREAD_MUTEX_CHECK_OWNER ((void)0)
 #endif // BRPC_DEBUG_LOCK
 
+// Number of contended locks acquired by spinning, and number of spinnings
+// ended up with waiting on the butex.
+struct MutexSpinCount {
+    MutexSpinCount()
+        : acquired("bthread_mutex_spin_acquired_count")
+        , failed("bthread_mutex_spin_failed_count") {}
+    bvar::Adder<int64_t> acquired;
+    bvar::Adder<int64_t> failed;
+};
+inline MutexSpinCount& mutex_spin_count() {
+    return *butil::get_leaky_singleton<MutexSpinCount>();
+}
+
+// Attached to the butex of each bthread_mutex_t, so that the layout of
+// bthread_mutex_t is unchanged.
+struct MutexSpinOwner {
+    // Worker and bthread which locked the mutex last, for spinning only
+    // while the owner is running. Written by every lock when
+    // -bthread_mutex_max_spin_ns is positive.
+    butil::atomic<TaskGroup*> group;
+    butil::atomic<bthread_t> tid;
+    // True if the sampled contention in csite was acquired by spinning.
+    // Accessed with the mutex locked.
+    bool spin_acquired;
+};
+BAIDU_CASSERT(sizeof(MutexSpinOwner) <= BUTEX_EXTRA_SIZE,
+              MutexSpinOwner_fits_in_extra_of_butex);
+
+inline MutexSpinOwner* mutex_spin_owner(bthread_mutex_t* m) {
+    return static_cast<MutexSpinOwner*>(butex_extra(m->butex));
+}
+
+// Record the worker and the bthread locking `m', which are read by
+// mutex_spin_on_owner() in other threads.
+inline void mutex_set_spin_owner(bthread_mutex_t* m) {
+    if (FLAGS_bthread_mutex_max_spin_ns <= 0) {
+        return;
+    }
+    TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    MutexSpinOwner* owner = mutex_spin_owner(m);
+    owner->group.store(g, butil::memory_order_relaxed);
+    owner->tid.store(g ? g->current_tid() : 0, butil::memory_order_relaxed);
+}
+
+// Spin while `m' is locked by a bthread running on another worker, which is
+// likely to unlock soon. Give up when the owner is switched out or after
+// -bthread_mutex_max_spin_ns. Pthread owners can't be checked, spinning on
+// them is capped by the smaller -bthread_mutex_max_pthread_owner_spin_ns.
+// Returns true if the mutex is acquired.
+inline bool mutex_spin_on_owner(bthread_mutex_t* m, TaskGroup* g) {
+    MutexInternal* split = (MutexInternal*)m->butex;
+    const MutexSpinOwner* owner = mutex_spin_owner(m);
+    const int64_t max_spin_ns = FLAGS_bthread_mutex_max_spin_ns;
+    const int64_t max_pthread_owner_spin_ns = std::min<int64_t>(
+        max_spin_ns, FLAGS_bthread_mutex_max_pthread_owner_spin_ns);
+    int64_t start_ns = 0;
+    int i = 0;
+    for (; ; ++i) {
+        if (!split->locked.load(butil::memory_order_relaxed) &&
+            !split->locked.exchange(1, butil::memory_order_acquire)) {
+            if (i != 0) {
+                mutex_spin_count().acquired << 1;
+            }
+            return true;
+        }
+        // TaskGroups and TaskMetas are never freed while bthreads are
+        // running, reading a stale owner is harmless.
+        const TaskGroup* owner_group = owner->group.load(butil::memory_order_relaxed);
+        if (owner_group != nullptr) {
+            const bthread_t owner_tid = owner->tid.load(butil::memory_order_relaxed);
+            // The owner is not running if it was on the worker of the caller.
+            if (owner_group == g || owner_group->running_tid() != owner_tid) {
+                break;
+            }
+        }
+        if ((i & 15) == 0) {
+            const int64_t now_ns = butil::cpuwide_time_ns();
+            if (start_ns == 0) {
+                start_ns = now_ns;
+            } else if (now_ns - start_ns >= (owner_group != nullptr ?
+                       max_spin_ns : max_pthread_owner_spin_ns)) {
+                break;
+            }
+        }
+        cpu_relax();
+    }
+    if (i != 0) {
+        mutex_spin_count().failed << 1;
+    }
+    return false;
+}
+
 inline int mutex_trylock_impl(bthread_mutex_t* m) {
     MutexInternal* split = (MutexInternal*)m->butex;
     if (!split->locked.exchange(1, butil::memory_order_acquire)) {
         BTHREAD_MUTEX_SET_OWNER;
+        mutex_set_spin_owner(m);
         return 0;
     }
     return EBUSY;
@@ -1059,13 +1203,28 @@ inline int mutex_trylock_impl(bthread_mutex_t* m) {
 
 const int MAX_SPIN_ITER = 4;
 
+// Spin on the owner before waiting if `spin_acquired' is not nullptr, and
+// set it to true if the mutex is acquired by spinning. Spinning acquires the
+// mutex without setting the contended flag, which is not allowed in
+// bthread_mutex_lock_contended(): waiters requeued onto the butex by
+// bthread_cond_broadcast() are woken only if the flag is set.
 inline int mutex_lock_contended_impl(bthread_mutex_t* __restrict m,
-                                     const struct timespec* __restrict abstime) {
+                                     const struct timespec* __restrict abstime,
+                                     bool* spin_acquired) {
     BTHREAD_MUTEX_CHECK_OWNER;
-    // When a bthread first contends for a lock, active spinning makes sense.
-    // Spin only few times and only if local `rq' is empty.
     TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
-    if (BAIDU_UNLIKELY(nullptr == g || g->rq_size() == 0)) {
+    if (spin_acquired != nullptr && FLAGS_bthread_mutex_max_spin_ns > 0) {
+        // Spinning pays off when the owner is running and the critical
+        // section is short, which costs less than a context switch.
+        if (mutex_spin_on_owner(m, g)) {
+            BTHREAD_MUTEX_SET_OWNER;
+            mutex_set_spin_owner(m);
+            *spin_acquired = true;
+            return 0;
+        }
+    } else if (BAIDU_UNLIKELY(nullptr == g || g->rq_size() == 0)) {
+        // When a bthread first contends for a lock, active spinning makes
+        // sense. Spin only few times and only if local `rq' is empty.
         for (int i = 0; i < MAX_SPIN_ITER; ++i) {
             cpu_relax();
         }
@@ -1095,6 +1254,7 @@ inline int mutex_lock_contended_impl(bthread_mutex_t* __restrict m,
         }
     }
     BTHREAD_MUTEX_SET_OWNER;
+    mutex_set_spin_owner(m);
     return 0;
 }
 
@@ -1198,17 +1358,21 @@ int bthread_mutex_init(bthread_mutex_t* __restrict m,
                        const bthread_mutexattr_t* __restrict attr) {
     bthread::make_contention_site_invalid(&m->csite);
     MUTEX_RESET_OWNER_COMMON(m->owner);
-    m->butex = bthread::butex_create_checked<unsigned>();
+    m->butex = static_cast<unsigned*>(bthread::butex_create_with_extra());
     if (!m->butex) {
         return ENOMEM;
     }
     *m->butex = 0;
+    bthread::MutexSpinOwner* owner = bthread::mutex_spin_owner(m);
+    owner->group.store(nullptr, butil::memory_order_relaxed);
+    owner->tid.store(0, butil::memory_order_relaxed);
+    owner->spin_acquired = false;
     m->enable_csite = nullptr == attr ? true : attr->enable_csite;
     return 0;
 }
 
 int bthread_mutex_destroy(bthread_mutex_t* m) {
-    bthread::butex_destroy(m->butex);
+    bthread::butex_destroy_with_extra(m->butex);
     return 0;
 }
 
@@ -1217,7 +1381,7 @@ int bthread_mutex_trylock(bthread_mutex_t* m) {
 }
 
 int bthread_mutex_lock_contended(bthread_mutex_t* m) {
-    return bthread::mutex_lock_contended_impl(m, nullptr);
+    return bthread::mutex_lock_contended_impl(m, nullptr, nullptr);
 }
 
 static int bthread_mutex_lock_impl(bthread_mutex_t* __restrict m,
@@ -1226,23 +1390,25 @@ static int bthread_mutex_lock_impl(bthread_mutex_t* __restrict m,
         return 0;
     }
     // Don't sample when contention profiler is off.
+    bool spin_acquired = false;
     if (!bthread::g_cp) {
-        return bthread::mutex_lock_contended_impl(m, abstime);
+        return bthread::mutex_lock_contended_impl(m, abstime, &spin_acquired);
     }
     // Ask Collector if this (contended) locking should be sampled.
     const size_t sampling_range =
         m->enable_csite ? bvar::is_collectable(&bthread::g_cp_sl) : bvar::INVALID_SAMPLING_RANGE;
     if (!bvar::is_sampling_range_valid(sampling_range)) { // Don't sample
-        return bthread::mutex_lock_contended_impl(m, abstime);
+        return bthread::mutex_lock_contended_impl(m, abstime, &spin_acquired);
     }
     // Start sampling.
     const int64_t start_ns = butil::cpuwide_time_ns();
     // NOTE: Don't modify m->csite outside lock since multiple threads are
     // still contending with each other.
-    const int rc = bthread::mutex_lock_contended_impl(m, abstime);
+    const int rc = bthread::mutex_lock_contended_impl(m, abstime, &spin_acquired);
     if (!rc) { // Inside lock
         m->csite.duration_ns = butil::cpuwide_time_ns() - start_ns;
         m->csite.sampling_range = sampling_range;
+        bthread::mutex_spin_owner(m)->spin_acquired = spin_acquired;
     } else if (rc == ETIMEDOUT) {
         // Failed to lock due to ETIMEDOUT, submit the elapse directly.
         const int64_t end_ns = butil::cpuwide_time_ns();
@@ -1264,10 +1430,14 @@ int bthread_mutex_timedlock(bthread_mutex_t* __restrict m,
 int bthread_mutex_unlock(bthread_mutex_t* m) {
     auto whole = (butil::atomic<unsigned>*)m->butex;
     bthread_contention_site_t saved_csite = {0, 0};
+    bool saved_spin_acquired = false;
     bool is_valid = bthread::is_contention_site_valid(m->csite);
     if (is_valid) {
         saved_csite = m->csite;
         bthread::make_contention_site_invalid(&m->csite);
+        bthread::MutexSpinOwner* owner = bthread::mutex_spin_owner(m);
+        saved_spin_acquired = owner->spin_acquired;
+        owner->spin_acquired = false;
     }
     MUTEX_RESET_OWNER_COMMON(m->owner);
     const unsigned prev = whole->exchange(0, butil::memory_order_release);
@@ -1284,7 +1454,7 @@ int bthread_mutex_unlock(bthread_mutex_t* m) {
     bthread::butex_wake(whole);
     const int64_t unlock_end_ns = butil::cpuwide_time_ns();
     saved_csite.duration_ns += unlock_end_ns - unlock_start_ns;
-    bthread::submit_contention(saved_csite, unlock_end_ns);
+    bthread::submit_contention(saved_csite, unlock_end_ns, saved_spin_acquired);
     return 0;
 }
 
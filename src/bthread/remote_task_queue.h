@@ -22,60 +22,163 @@
 #ifndef BTHREAD_REMOTE_TASK_QUEUE_H
 #define BTHREAD_REMOTE_TASK_QUEUE_H
 
-#include "butil/containers/bounded_queue.h"
+#include <stdlib.h>                        // posix_memalign
+#include <new>                             // placement new
+#include "butil/atomicops.h"
 #include "butil/macros.h"
+#include "bthread/types.h"                  // bthread_t
 
 namespace bthread {
 
 class TaskGroup;
 
-// A queue for storing bthreads created by non-workers. Since non-workers
-// randomly choose a TaskGroup to push which distributes the contentions,
-// this queue is simply implemented as a queue protected with a lock.
+// A queue for storing bthreads created by non-workers. It's pushed by all
+// non-worker pthreads choosing the TaskGroup, and popped by the owner and
+// all workers stealing tasks, so it's a bounded MPMC ring without locks:
+// each cell has a sequence number telling whether it's ready for the
+// producer or the consumer of the position, positions are claimed with CAS.
 // The function names should be self-explanatory.
 class RemoteTaskQueue {
 public:
-    RemoteTaskQueue() {}
+    RemoteTaskQueue() : _cells(nullptr), _mask(0), _head(0), _tail(0) {}
 
+    ~RemoteTaskQueue() { free(_cells); }
+
+    // `cap' is rounded up to power of 2.
     int init(size_t cap) {
-        const size_t memsize = sizeof(bthread_t) * cap;
-        void* q_mem = malloc(memsize);
-        if (q_mem == nullptr) {
+        if (_cells != nullptr || cap == 0) {
+            return -1;
+        }
+        size_t n = 1;
+        while (n < cap) {
+            n <<= 1;
+        }
+        void* mem = nullptr;
+        if (posix_memalign(&mem, BAIDU_CACHELINE_SIZE, sizeof(Cell) * n) != 0) {
             return -1;
         }
-        butil::BoundedQueue<bthread_t> q(q_mem, memsize, butil::OWNS_STORAGE);
-        _tasks.swap(q);
+        _cells = static_cast<Cell*>(mem);
+        for (size_t i = 0; i < n; ++i) {
+            new (&_cells[i].seq) butil::atomic<size_t>(i);
+        }
+        _mask = n - 1;
         return 0;
     }
 
     bool pop(bthread_t* task) {
-        if (_tasks.empty()) {
-            return false;
+        size_t pos = _head.load(butil::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            const size_t seq = cell->seq.load(butil::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1,
+                                                butil::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Empty, or the producer of the cell has not finished.
+                return false;
+            } else {
+                pos = _head.load(butil::memory_order_relaxed);
+            }
         }
-        _mutex.lock();
-        const bool result = _tasks.pop(task);
-        _mutex.unlock();
-        return result;
+        *task = cell->task;
+        cell->seq.store(pos + _mask + 1, butil::memory_order_release);
+        return true;
     }
 
     bool push(bthread_t task) {
-        _mutex.lock();
-        const bool res = push_locked(task);
-        _mutex.unlock();
-        return res;
+        size_t pos = _tail.load(butil::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &_cells[pos & _mask];
+            const size_t seq = cell->seq.load(butil::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1,
+                                                butil::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // Full.
+                return false;
+            } else {
+                pos = _tail.load(butil::memory_order_relaxed);
+            }
+        }
+        cell->task = task;
+        cell->seq.store(pos + 1, butil::memory_order_release);
+        return true;
+    }
+
+    // Push at most `n' tasks, positions are claimed with one CAS.
+    // Returns number of tasks pushed, 0 if the queue is full.
+    size_t push_batch(const bthread_t* tasks, size_t n) {
+        if (n == 0) {
+            return 0;
+        }
+        size_t pos = _tail.load(butil::memory_order_relaxed);
+        size_t k = 0;
+        while (true) {
+            // Cells ready for producers of [pos, pos + k) can't be touched by
+            // others until _tail is moved beyond pos.
+            k = 0;
+            while (k < n) {
+                const size_t seq =
+                    _cells[(pos + k) & _mask].seq.load(butil::memory_order_acquire);
+                if (seq != pos + k) {
+                    break;
+                }
+                ++k;
+            }
+            if (k == 0) {
+                const size_t seq =
+                    _cells[pos & _mask].seq.load(butil::memory_order_relaxed);
+                if ((intptr_t)seq - (intptr_t)pos < 0) {
+                    // Full.
+                    return 0;
+                }
+                pos = _tail.load(butil::memory_order_relaxed);
+                continue;
+            }
+            if (_tail.compare_exchange_weak(pos, pos + k,
+                                            butil::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < k; ++i) {
+            Cell* cell = &_cells[(pos + i) & _mask];
+            cell->task = tasks[i];
+            cell->seq.store(pos + i + 1, butil::memory_order_release);
+        }
+        return k;
     }
 
-    bool push_locked(bthread_t task) {
-        return _tasks.push(task);
+    // Number of claimed cells, including ones being filled or taken.
+    size_t volatile_size() const {
+        const size_t h = _head.load(butil::memory_order_relaxed);
+        const size_t t = _tail.load(butil::memory_order_relaxed);
+        return (t <= h ? 0 : (t - h));
     }
 
-    size_t capacity() const { return _tasks.capacity(); }
-    
+    size_t capacity() const { return _mask + 1; }
+
 private:
-friend class TaskGroup;
     DISALLOW_COPY_AND_ASSIGN(RemoteTaskQueue);
-    butil::BoundedQueue<bthread_t> _tasks;
-    butil::Mutex _mutex;
+
+    struct Cell {
+        // == position: ready to be pushed at the position.
+        // == position + 1: ready to be popped at the position.
+        butil::atomic<size_t> seq;
+        bthread_t task;
+    };
+
+    Cell* _cells;
+    size_t _mask;
+    BAIDU_CACHELINE_ALIGNMENT butil::atomic<size_t> _head;
+    BAIDU_CACHELINE_ALIGNMENT butil::atomic<size_t> _tail;
 };
 
 }  // namespace bthread
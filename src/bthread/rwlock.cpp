@@ -15,8 +15,11 @@
 // specific language governing permissions and limitations
 // under the License.
 
+#include <unistd.h>
+#include <algorithm>
 #include <memory>
 #include "bvar/collector.h"
+#include "butil/thread_local.h"
 #include "butil/memory/scope_guard.h"
 #include "bthread/rwlock.h"
 #include "bthread/mutex.h"
@@ -480,6 +483,189 @@ static int rwlock_destroy(bthread_rwlock_t* rwlock) {
     return rc;
 }
 
+
+// Index of the BiasedRWLock slot used by the calling pthread. Pthreads get
+// consecutive indexes so that workers don't share slots as long as there
+// are enough slots.
+static butil::atomic<size_t> g_biased_rwlock_next_slot(0);
+static BAIDU_THREAD_LOCAL size_t tls_biased_rwlock_slot = (size_t)-1;
+
+static BUTIL_FORCE_INLINE size_t biased_rwlock_slot() {
+    if (BAIDU_UNLIKELY(tls_biased_rwlock_slot == (size_t)-1)) {
+        tls_biased_rwlock_slot = g_biased_rwlock_next_slot.fetch_add(
+            1, butil::memory_order_relaxed);
+    }
+    return tls_biased_rwlock_slot;
+}
+
+BiasedRWLock::BiasedRWLock(int nslot)
+    : _slots(nullptr)
+    , _slot_mask(0)
+    , _writer(nullptr)
+    , _reader_exit(nullptr)
+    , _wrlocked(false) {
+    if (nslot <= 0) {
+        nslot = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    }
+    size_t n = 1;
+    while (n < (size_t)nslot) {
+        n <<= 1;
+    }
+    std::unique_ptr<unsigned, ButexDeleter> writer(
+        butex_create_checked<unsigned>());
+    std::unique_ptr<unsigned, ButexDeleter> reader_exit(
+        butex_create_checked<unsigned>());
+    if (writer == nullptr || reader_exit == nullptr) {
+        throw std::system_error(std::error_code(ENOMEM, std::system_category()),
+                                "BiasedRWLock constructor failed");
+    }
+    *writer = 0;
+    *reader_exit = 0;
+    bthread_mutexattr_t attr;
+    bthread_mutexattr_init(&attr);
+    BRPC_SCOPE_EXIT { bthread_mutexattr_destroy(&attr); };
+    // Same as bthread_rwlock_t, contentions are reported by the rwlock.
+    bthread_mutexattr_disable_csite(&attr);
+    const int rc = bthread_mutex_init(&_writer_mutex, &attr);
+    if (rc != 0) {
+        throw std::system_error(std::error_code(rc, std::system_category()),
+                                "BiasedRWLock constructor failed");
+    }
+    _slots = new Slot[n];
+    for (size_t i = 0; i < n; ++i) {
+        _slots[i].nreader.store(0, butil::memory_order_relaxed);
+    }
+    _slot_mask = n - 1;
+    _writer = writer.release();
+    _reader_exit = reader_exit.release();
+}
+
+BiasedRWLock::~BiasedRWLock() {
+    bthread_mutex_destroy(&_writer_mutex);
+    butex_destroy(_writer);
+    butex_destroy(_reader_exit);
+    delete [] _slots;
+}
+
+int64_t BiasedRWLock::nreader() const {
+    int64_t n = 0;
+    for (size_t i = 0; i <= _slot_mask; ++i) {
+        // Acquire pairs with the release in leave() so that the writer sees
+        // everything done by the leaving readers.
+        n += _slots[i].nreader.load(butil::memory_order_acquire);
+    }
+    return n;
+}
+
+void BiasedRWLock::leave(Slot* slot) {
+    slot->nreader.fetch_sub(1, butil::memory_order_release);
+    // Pairs with the fence in wrlock_impl(): either the writer sees the
+    // decrement when summing the slots, or we see _writer and wake it up.
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    auto writer = (butil::atomic<unsigned>*)_writer;
+    if (BAIDU_UNLIKELY(writer->load(butil::memory_order_relaxed) != 0)) {
+        auto reader_exit = (butil::atomic<unsigned>*)_reader_exit;
+        reader_exit->fetch_add(1, butil::memory_order_release);
+        // Writers are serialized by _writer_mutex, at most one is waiting.
+        butex_wake(reader_exit);
+    }
+}
+
+int BiasedRWLock::rdlock_impl(bool try_lock, const struct timespec* abstime) {
+    auto writer = (butil::atomic<unsigned>*)_writer;
+    Slot* slot = &_slots[biased_rwlock_slot() & _slot_mask];
+    size_t sampling_range = bvar::INVALID_SAMPLING_RANGE;
+    int64_t start_ns = 0;
+    int rc = 0;
+    while (true) {
+        if (writer->load(butil::memory_order_relaxed) == 0) {
+            slot->nreader.fetch_add(1, butil::memory_order_relaxed);
+            // Pairs with the fence in wrlock_impl(): either we see the
+            // writer revoking the bias, or the writer sees our increment.
+            butil::atomic_thread_fence(butil::memory_order_seq_cst);
+            // Acquire pairs with the release in unwrlock().
+            if (writer->load(butil::memory_order_acquire) == 0) {
+                break;
+            }
+            // A writer revoked the bias meanwhile, back off.
+            leave(slot);
+        }
+        if (try_lock) {
+            return EBUSY;
+        }
+        BTHREAD_RWLOCK_MAYBE_START_SAMPLING;
+        if (butex_wait(writer, 1, abstime) < 0 &&
+            errno != EWOULDBLOCK && errno != EINTR) {
+            rc = errno;
+            break;
+        }
+    }
+    submit_contention_if_sampled(start_ns, sampling_range);
+    return rc;
+}
+
+void BiasedRWLock::unrdlock() {
+    leave(&_slots[biased_rwlock_slot() & _slot_mask]);
+}
+
+int BiasedRWLock::wrlock_impl(bool try_lock, const struct timespec* abstime) {
+    size_t sampling_range = bvar::INVALID_SAMPLING_RANGE;
+    int64_t start_ns = 0;
+    int rc = bthread_mutex_trylock(&_writer_mutex);
+    if (rc != 0) {
+        if (try_lock) {
+            return rc;
+        }
+        BTHREAD_RWLOCK_MAYBE_START_SAMPLING;
+        rc = bthread_mutex_timedlock(&_writer_mutex, abstime);
+        if (rc != 0) {
+            submit_contention_if_sampled(start_ns, sampling_range);
+            return rc;
+        }
+    }
+    // Revoke the bias: new readers wait on _writer from now on.
+    auto writer = (butil::atomic<unsigned>*)_writer;
+    auto reader_exit = (butil::atomic<unsigned>*)_reader_exit;
+    writer->store(1, butil::memory_order_relaxed);
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    while (true) {
+        // Load the sequence before summing the slots, a reader leaving after
+        // the sum bumps the sequence and makes butex_wait() return.
+        const unsigned seq = reader_exit->load(butil::memory_order_acquire);
+        if (nreader() == 0) {
+            _wrlocked.store(true, butil::memory_order_relaxed);
+            submit_contention_if_sampled(start_ns, sampling_range);
+            return 0;
+        }
+        if (try_lock) {
+            rc = EBUSY;
+            break;
+        }
+        BTHREAD_RWLOCK_MAYBE_START_SAMPLING;
+        if (butex_wait(reader_exit, seq, abstime) < 0 &&
+            errno != EWOULDBLOCK && errno != EINTR) {
+            rc = errno;
+            break;
+        }
+    }
+    // Give up, let the readers in.
+    writer->store(0, butil::memory_order_relaxed);
+    butex_wake_all(writer);
+    bthread_mutex_unlock(&_writer_mutex);
+    submit_contention_if_sampled(start_ns, sampling_range);
+    return rc;
+}
+
+void BiasedRWLock::unwrlock() {
+    _wrlocked.store(false, butil::memory_order_relaxed);
+    auto writer = (butil::atomic<unsigned>*)_writer;
+    // Release pairs with the acquire in rdlock_impl() to publish writes
+    // done under the write lock.
+    writer->store(0, butil::memory_order_release);
+    butex_wake_all(writer);
+    bthread_mutex_unlock(&_writer_mutex);
+}
+
 } // namespace bthread
 
 __BEGIN_DECLS
@@ -20,6 +20,7 @@
 
 #include "bthread/types.h"
 #include "bthread/bthread.h"
+#include "butil/atomicops.h"
 #include "butil/scoped_lock.h"
 
 namespace bthread {
@@ -86,6 +87,86 @@ private:
     bthread_rwlock_t _rwlock{};
 };
 
+// A reader-biased rwlock for data that is read by all workers and rarely
+// written, e.g. configs and routing tables. Readers count themselves in
+// cacheline-aligned slots chosen by the calling pthread instead of a shared
+// word, so that concurrent rdlock()/unlock() on different workers don't
+// bounce the same cacheline. A writer revokes the bias by raising a flag
+// which makes new readers wait, then waits for the sum of all slots to drop
+// to zero. Writers are therefore much slower than RWLock's (O(number of
+// slots)) and readers may starve for as long as writers keep coming.
+// Both sides block with butex, so the lock works in bthreads and pthreads.
+// A bthread may unlock in a different pthread than it locked in.
+class BiasedRWLock {
+public:
+    // `nslot' is rounded up to power of 2. 0 means the number of cpu cores.
+    explicit BiasedRWLock(int nslot = 0);
+    ~BiasedRWLock();
+
+    DISALLOW_COPY_AND_ASSIGN(BiasedRWLock);
+
+    void rdlock() {
+        int rc = rdlock_impl(false, nullptr);
+        if (rc) {
+            throw std::system_error(std::error_code(rc, std::system_category()),
+                                    "BiasedRWLock rdlock failed");
+        }
+    }
+
+    bool try_rdlock() { return 0 == rdlock_impl(true, nullptr); }
+
+    bool timed_rdlock(const struct timespec* abstime) {
+        return 0 == rdlock_impl(false, abstime);
+    }
+
+    void wrlock() {
+        int rc = wrlock_impl(false, nullptr);
+        if (rc) {
+            throw std::system_error(std::error_code(rc, std::system_category()),
+                                    "BiasedRWLock wrlock failed");
+        }
+    }
+
+    bool try_wrlock() { return 0 == wrlock_impl(true, nullptr); }
+
+    bool timed_wrlock(const struct timespec* abstime) {
+        return 0 == wrlock_impl(false, abstime);
+    }
+
+    // Release the read lock or the write lock held by the caller.
+    void unlock() {
+        if (_wrlocked.load(butil::memory_order_relaxed)) {
+            unwrlock();
+        } else {
+            unrdlock();
+        }
+    }
+
+private:
+    struct BAIDU_CACHELINE_ALIGNMENT Slot {
+        // May be negative since readers may unlock in other slots.
+        butil::atomic<int64_t> nreader;
+    };
+
+    int rdlock_impl(bool try_lock, const struct timespec* abstime);
+    int wrlock_impl(bool try_lock, const struct timespec* abstime);
+    void unrdlock();
+    void unwrlock();
+    // Leave slot `slot' and notify the writer revoking the bias, if any.
+    void leave(Slot* slot);
+    int64_t nreader() const;
+
+    Slot* _slots;
+    size_t _slot_mask;
+    // 1 when a writer revokes the bias or holds the lock (used as a butex).
+    unsigned* _writer;
+    // Bumped by readers leaving while _writer is 1 (used as a butex).
+    unsigned* _reader_exit;
+    // Serializes writers.
+    bthread_mutex_t _writer_mutex;
+    butil::atomic<bool> _wrlocked;
+};
+
 // Read lock guard of rwlock.
 class RWLockRdGuard {
 public:
@@ -214,6 +295,26 @@ private:
     std::lock_guard<bthread_rwlock_t> _rwlock_guard;
 };
 
+template <>
+class lock_guard<bthread::BiasedRWLock> {
+public:
+    lock_guard(bthread::BiasedRWLock& rwlock, bool read)
+        : _rwlock(&rwlock) {
+        if (read) {
+            _rwlock->rdlock();
+        } else {
+            _rwlock->wrlock();
+        }
+    }
+
+    ~lock_guard() { _rwlock->unlock(); }
+
+    DISALLOW_COPY_AND_ASSIGN(lock_guard);
+
+private:
+    bthread::BiasedRWLock* _rwlock;
+};
+
 } // namespace std
 
 #endif  //BTHREAD_RWLOCK_H
@@ -30,6 +30,7 @@
 #include "bvar/passive_status.h"
 #include "bthread/types.h"                        // BTHREAD_STACKTYPE_*
 #include "bthread/stack.h"
+#include "bthread/stack_arena.h"
 
 DEFINE_int32(stack_size_small, 32768, "size of small stacks");
 DEFINE_int32(stack_size_normal, 1048576, "size of normal stacks");
@@ -44,6 +45,7 @@ BAIDU_CASSERT(BTHREAD_STACKTYPE_PTHREAD == STACK_TYPE_PTHREAD, must_match);
 BAIDU_CASSERT(BTHREAD_STACKTYPE_SMALL == STACK_TYPE_SMALL, must_match);
 BAIDU_CASSERT(BTHREAD_STACKTYPE_NORMAL == STACK_TYPE_NORMAL, must_match);
 BAIDU_CASSERT(BTHREAD_STACKTYPE_LARGE == STACK_TYPE_LARGE, must_match);
+BAIDU_CASSERT(BTHREAD_STACKTYPE_STACKLESS == STACK_TYPE_STACKLESS, must_match);
 BAIDU_CASSERT(STACK_TYPE_MAIN == 0, must_be_0);
 
 static butil::static_atomic<int64_t> s_stack_count = BUTIL_STATIC_ATOMIC_INIT(0);
@@ -88,6 +90,17 @@ int allocate_stack_storage(StackStorage* s, int stacksize_in, int guardsize_in)
             (std::max(guardsize_in, MIN_GUARDSIZE) + PAGESIZE_M1) &
             ~PAGESIZE_M1;
 
+        if (arena_allocate_stack(s, stacksize, guardsize) == 0) {
+            s_stack_count.fetch_add(1, butil::memory_order_relaxed);
+            if (RunningOnValgrind()) {
+                s->valgrind_stack_id = VALGRIND_STACK_REGISTER(
+                    s->bottom, (char*)s->bottom - stacksize);
+            } else {
+                s->valgrind_stack_id = 0;
+            }
+            return 0;
+        }
+
         const int memsize = stacksize + guardsize;
         void* const mem = mmap(nullptr, memsize, (PROT_READ | PROT_WRITE),
                                (MAP_PRIVATE | MAP_ANONYMOUS), -1, 0);
@@ -139,7 +152,9 @@ void deallocate_stack_storage(StackStorage* s) {
         return;
     }
     s_stack_count.fetch_sub(1, butil::memory_order_relaxed);
-    if (s->guardsize == 0) {
+    if (is_arena_stack(s->bottom)) {
+        arena_deallocate_stack(s);
+    } else if (s->guardsize == 0) {
         free((char*)s->bottom - memsize);
     } else {
         munmap((char*)s->bottom - memsize, memsize);
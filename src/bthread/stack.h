@@ -58,7 +58,8 @@ enum StackType {
     STACK_TYPE_PTHREAD = BTHREAD_STACKTYPE_PTHREAD,
     STACK_TYPE_SMALL = BTHREAD_STACKTYPE_SMALL,
     STACK_TYPE_NORMAL = BTHREAD_STACKTYPE_NORMAL,
-    STACK_TYPE_LARGE = BTHREAD_STACKTYPE_LARGE
+    STACK_TYPE_LARGE = BTHREAD_STACKTYPE_LARGE,
+    STACK_TYPE_STACKLESS = BTHREAD_STACKTYPE_STACKLESS
 };
 
 struct ContextualStack {
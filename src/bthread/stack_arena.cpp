@@ -0,0 +1,505 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - An M:N threading library to make applications more concurrent.
+
+#include <sched.h>                                // sched_yield
+#include <stdio.h>                                // fopen
+#include <sys/mman.h>                             // mmap, mprotect, madvise
+#include <sys/syscall.h>                          // syscall
+#include <unistd.h>                               // getpagesize
+#include <stddef.h>                               // offsetof
+#include <pthread.h>
+#include <algorithm>                              // std::min
+#include <mutex>                                  // std::unique_lock
+#include <new>                                    // std::nothrow
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/logging.h"
+#include "butil/macros.h"
+#include "butil/scoped_lock.h"
+#include "butil/synchronization/lock.h"
+#include "bvar/passive_status.h"
+#include "bthread/stack.h"
+#include "bthread/stack_arena.h"
+
+DEFINE_int32(bthread_stack_arena_mb, 0,
+             "MB of address space reserved for stacks of each size on each "
+             "NUMA node, 0 disables stack arenas. Read when the first stack "
+             "is allocated after it's positive");
+DEFINE_bool(bthread_stack_arena_hugepage, false,
+            "Back stacks in the arenas with transparent huge pages");
+DEFINE_int32(bthread_stack_arena_idle_max, 256,
+             "Max number of idle stacks of each size keeping their pages in "
+             "each arena, pages of idle stacks beyond that are released");
+
+namespace bthread {
+
+char* g_stack_arenas_begin = nullptr;
+char* g_stack_arenas_end = nullptr;
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+static const int MAX_NUMA_NODES = 64;
+// Different sizes of stacks served by an arena, enough for small, normal
+// and large stacks plus a change of one of the sizes at runtime.
+static const int MAX_POOLS_PER_NODE = 4;
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+enum SlotState {
+    SLOT_FREE = 0,
+    SLOT_USED,
+    SLOT_IDLE,
+    SLOT_TRIMMING,
+    SLOT_TRIMMED,
+};
+
+struct Slot {
+    butil::atomic<int> state;
+    // Saved context of the idle stack, set before state becomes SLOT_IDLE.
+    void* sp;
+};
+
+// Stacks of the same size in an arena.
+struct BAIDU_CACHELINE_ALIGNMENT StackPool {
+    int node;
+    char* begin;
+    // Zero if the pool is not used yet. Other fields below are set before
+    // slot_size is published and not changed since then.
+    butil::atomic<size_t> slot_size;
+    size_t stacksize;
+    size_t guardsize;
+    size_t capacity;
+    Slot* slots;
+
+    butil::Mutex mutex;
+    // Fields below are protected by mutex.
+    size_t ncarved;
+    std::vector<uint32_t> free_slots;
+
+    butil::Mutex trim_mutex;
+    // Where the next trimming starts, protected by trim_mutex.
+    size_t trim_cursor;
+
+    // Stats.
+    butil::atomic<size_t> carved;
+    butil::atomic<size_t> used;
+    butil::atomic<size_t> idle;
+    butil::atomic<size_t> trimmed;
+};
+
+static pthread_once_t g_arenas_once = PTHREAD_ONCE_INIT;
+static StackPool* g_pools = nullptr;
+static int g_nnode = 0;
+// Address space of each pool.
+static size_t g_pool_span = 0;
+static butil::Mutex* g_init_pool_mutex = nullptr;
+static butil::static_atomic<size_t> g_nfallback = BUTIL_STATIC_ATOMIC_INIT(0);
+
+static int get_numa_node_num() {
+    // Content is like "0" or "0-3".
+    FILE* fp = fopen("/sys/devices/system/node/possible", "r");
+    if (fp == nullptr) {
+        return 1;
+    }
+    int max_node = 0;
+    int n = 0;
+    int c;
+    while ((c = fgetc(fp)) != EOF) {
+        if (c >= '0' && c <= '9') {
+            n = n * 10 + (c - '0');
+            max_node = std::max(max_node, n);
+        } else {
+            n = 0;
+        }
+    }
+    fclose(fp);
+    return std::min(max_node + 1, MAX_NUMA_NODES);
+}
+
+static int get_current_node() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (g_nnode <= 1 || syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return 0;
+    }
+    return (int)(node % g_nnode);
+}
+
+static void create_arenas() {
+    if (FLAGS_bthread_stack_arena_mb <= 0) {
+        return;
+    }
+    const size_t pool_span = ((size_t)FLAGS_bthread_stack_arena_mb * 1024 * 1024
+                              + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    const int nnode = get_numa_node_num();
+    const size_t node_span = pool_span * MAX_POOLS_PER_NODE;
+    const size_t total = node_span * nnode;
+    // Reserve address space only, stacks are made accessible when they're
+    // carved and everything else is a guard.
+    void* mem = mmap(nullptr, total + HUGE_PAGE_SIZE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        PLOG(ERROR) << "Fail to reserve " << total << " bytes for stack arenas";
+        return;
+    }
+    char* begin = (char*)(((uintptr_t)mem + HUGE_PAGE_SIZE - 1)
+                          & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (nnode > 1) {
+        for (int i = 0; i < nnode; ++i) {
+            // Pages are not touched yet, the policy is inherited by all
+            // mappings split from the reservation.
+            unsigned long nodemask = 1UL << i;
+            if (syscall(SYS_mbind, begin + node_span * i, node_span,
+                        MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+                PLOG_FIRST_N(WARNING, 1) << "Fail to bind stack arena to node "
+                                         << i;
+            }
+        }
+    }
+    StackPool* pools = new StackPool[nnode * MAX_POOLS_PER_NODE];
+    for (int i = 0; i < nnode * MAX_POOLS_PER_NODE; ++i) {
+        StackPool& p = pools[i];
+        p.node = i / MAX_POOLS_PER_NODE;
+        p.begin = begin + pool_span * i;
+        p.slot_size.store(0, butil::memory_order_relaxed);
+        p.stacksize = 0;
+        p.guardsize = 0;
+        p.capacity = 0;
+        p.slots = nullptr;
+        p.ncarved = 0;
+        p.trim_cursor = 0;
+        p.carved.store(0, butil::memory_order_relaxed);
+        p.used.store(0, butil::memory_order_relaxed);
+        p.idle.store(0, butil::memory_order_relaxed);
+        p.trimmed.store(0, butil::memory_order_relaxed);
+    }
+    g_init_pool_mutex = new butil::Mutex;
+    g_pools = pools;
+    g_nnode = nnode;
+    g_pool_span = pool_span;
+    g_stack_arenas_begin = begin;
+    g_stack_arenas_end = begin + total;
+    LOG(INFO) << "Created " << nnode << " stack arena(s) of "
+              << node_span << " bytes";
+}
+
+// Find or set up the pool of `slot_size' in the arena of `node'.
+static StackPool* get_pool(int node, size_t slot_size,
+                           size_t stacksize, size_t guardsize) {
+    StackPool* const pools = g_pools + node * MAX_POOLS_PER_NODE;
+    for (int i = 0; i < MAX_POOLS_PER_NODE; ++i) {
+        const size_t sz = pools[i].slot_size.load(butil::memory_order_acquire);
+        if (sz == slot_size) {
+            return &pools[i];
+        }
+        if (sz == 0) {
+            break;
+        }
+    }
+    BAIDU_SCOPED_LOCK(*g_init_pool_mutex);
+    for (int i = 0; i < MAX_POOLS_PER_NODE; ++i) {
+        StackPool& p = pools[i];
+        const size_t sz = p.slot_size.load(butil::memory_order_relaxed);
+        if (sz == slot_size) {
+            return &p;
+        }
+        if (sz == 0) {
+            const size_t capacity = g_pool_span / slot_size;
+            if (capacity == 0) {
+                return nullptr;
+            }
+            p.slots = new (std::nothrow) Slot[capacity];
+            if (p.slots == nullptr) {
+                return nullptr;
+            }
+            for (size_t j = 0; j < capacity; ++j) {
+                p.slots[j].state.store(SLOT_FREE, butil::memory_order_relaxed);
+                p.slots[j].sp = nullptr;
+            }
+            p.stacksize = stacksize;
+            p.guardsize = guardsize;
+            p.capacity = capacity;
+            p.slot_size.store(slot_size, butil::memory_order_release);
+            return &p;
+        }
+    }
+    return nullptr;
+}
+
+// Make `n' slots from `first' accessible. Called with p->mutex held.
+static bool carve_slots(StackPool* p, size_t first, size_t n) {
+    const size_t slot_size = p->slot_size.load(butil::memory_order_relaxed);
+    for (size_t i = first; i < first + n; ++i) {
+        // Guard of the slot is left PROT_NONE as reserved.
+        char* const stack = p->begin + slot_size * i + p->guardsize;
+        if (mprotect(stack, p->stacksize, PROT_READ | PROT_WRITE) != 0) {
+            PLOG_EVERY_SECOND(ERROR) << "Fail to mprotect stack arena";
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        if (FLAGS_bthread_stack_arena_hugepage) {
+            madvise(stack, p->stacksize, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    return true;
+}
+
+// Take a free slot of `p'. Returns the slot index or -1.
+static int64_t take_slot(StackPool* p) {
+    BAIDU_SCOPED_LOCK(p->mutex);
+    if (!p->free_slots.empty()) {
+        const uint32_t i = p->free_slots.back();
+        p->free_slots.pop_back();
+        return i;
+    }
+    if (p->ncarved >= p->capacity) {
+        return -1;
+    }
+    // Carve a batch of slots at once so that mostly one thread holding the
+    // mutex does syscalls.
+    const size_t slot_size = p->slot_size.load(butil::memory_order_relaxed);
+    const size_t batch = std::min(p->capacity - p->ncarved,
+                                  std::max(HUGE_PAGE_SIZE / slot_size, (size_t)1));
+    if (!carve_slots(p, p->ncarved, batch)) {
+        return -1;
+    }
+    const size_t first = p->ncarved;
+    p->ncarved += batch;
+    p->carved.store(p->ncarved, butil::memory_order_relaxed);
+    for (size_t i = first + batch - 1; i > first; --i) {
+        p->free_slots.push_back(i);
+    }
+    return first;
+}
+
+int arena_allocate_stack(StackStorage* s, size_t stacksize, size_t guardsize) {
+    if (FLAGS_bthread_stack_arena_mb <= 0 && g_pools == nullptr) {
+        return -1;
+    }
+    // Synchronizes with creation of the arenas.
+    pthread_once(&g_arenas_once, create_arenas);
+    if (g_pools == nullptr) {
+        return -1;
+    }
+    const size_t slot_size = stacksize + guardsize;
+    StackPool* p = get_pool(get_current_node(), slot_size, stacksize, guardsize);
+    if (p == nullptr) {
+        g_nfallback.fetch_add(1, butil::memory_order_relaxed);
+        return -1;
+    }
+    const int64_t i = take_slot(p);
+    if (i < 0) {
+        g_nfallback.fetch_add(1, butil::memory_order_relaxed);
+        return -1;
+    }
+    p->slots[i].state.store(SLOT_USED, butil::memory_order_relaxed);
+    p->used.fetch_add(1, butil::memory_order_relaxed);
+    s->bottom = p->begin + slot_size * (i + 1);
+    s->stacksize = stacksize;
+    s->guardsize = guardsize;
+    return 0;
+}
+
+static StackPool* find_pool(const void* bottom, size_t* index) {
+    const size_t off = (const char*)bottom - g_stack_arenas_begin - 1;
+    StackPool* p = &g_pools[off / g_pool_span];
+    *index = (off - (p->begin - g_stack_arenas_begin)) /
+        p->slot_size.load(butil::memory_order_relaxed);
+    return p;
+}
+
+void arena_deallocate_stack(StackStorage* s) {
+    // Wait for trimming and fix stats if the stack was pooled.
+    arena_stack_reused(*s);
+    size_t i = 0;
+    StackPool* p = find_pool(s->bottom, &i);
+    p->slots[i].state.store(SLOT_FREE, butil::memory_order_relaxed);
+    p->used.fetch_sub(1, butil::memory_order_relaxed);
+    // Rarely happens, release the pages right away.
+    madvise((char*)s->bottom - p->stacksize, p->stacksize, MADV_DONTNEED);
+    BAIDU_SCOPED_LOCK(p->mutex);
+    p->free_slots.push_back(i);
+}
+
+// Release pages of idle stacks in `p' until at most `nkeep' are left.
+// Returns 0 without waiting if another thread is trimming and `wait' is
+// false.
+static size_t trim_pool(StackPool* p, size_t nkeep, bool wait) {
+    static const uintptr_t PAGESIZE = getpagesize();
+    const size_t slot_size = p->slot_size.load(butil::memory_order_acquire);
+    if (slot_size == 0) {
+        return 0;
+    }
+    std::unique_lock<butil::Mutex> mu(p->trim_mutex, std::defer_lock);
+    if (wait) {
+        mu.lock();
+    } else if (!mu.try_lock()) {
+        return 0;
+    }
+    const size_t ncarved = p->carved.load(butil::memory_order_relaxed);
+    size_t ntrimmed = 0;
+    for (size_t n = 0; n < ncarved &&
+             p->idle.load(butil::memory_order_relaxed) > nkeep; ++n) {
+        const size_t i = p->trim_cursor;
+        p->trim_cursor = (i + 1 < ncarved ? i + 1 : 0);
+        Slot& slot = p->slots[i];
+        int expected = SLOT_IDLE;
+        if (!slot.state.compare_exchange_strong(expected, SLOT_TRIMMING,
+                                                butil::memory_order_acquire)) {
+            continue;
+        }
+        char* const low = p->begin + slot_size * i + p->guardsize;
+        char* const bottom = p->begin + slot_size * (i + 1);
+        // Keep the page of the saved context and the page below it.
+        char* const high = (char*)(((uintptr_t)slot.sp & ~(PAGESIZE - 1))
+                                   - PAGESIZE);
+        if ((char*)slot.sp > low && (char*)slot.sp <= bottom && high > low) {
+            madvise(low, high - low, MADV_DONTNEED);
+        }
+        slot.state.store(SLOT_TRIMMED, butil::memory_order_release);
+        p->idle.fetch_sub(1, butil::memory_order_relaxed);
+        p->trimmed.fetch_add(1, butil::memory_order_relaxed);
+        ++ntrimmed;
+    }
+    return ntrimmed;
+}
+
+void arena_stack_returned(const StackStorage& s, void* context) {
+    size_t i = 0;
+    StackPool* p = find_pool(s.bottom, &i);
+    Slot& slot = p->slots[i];
+    slot.sp = context;
+    slot.state.store(SLOT_IDLE, butil::memory_order_release);
+    p->used.fetch_sub(1, butil::memory_order_relaxed);
+    const size_t nidle = p->idle.fetch_add(1, butil::memory_order_relaxed) + 1;
+    const int idle_max = FLAGS_bthread_stack_arena_idle_max;
+    if (idle_max >= 0 && nidle > (size_t)idle_max) {
+        trim_pool(p, idle_max / 2, false);
+    }
+}
+
+void arena_stack_reused(const StackStorage& s) {
+    size_t i = 0;
+    StackPool* p = find_pool(s.bottom, &i);
+    Slot& slot = p->slots[i];
+    int state = slot.state.load(butil::memory_order_relaxed);
+    while (true) {
+        if (state == SLOT_USED) {
+            // Just allocated.
+            return;
+        }
+        if (state == SLOT_TRIMMING) {
+            sched_yield();
+            state = slot.state.load(butil::memory_order_relaxed);
+            continue;
+        }
+        if (slot.state.compare_exchange_weak(state, SLOT_USED,
+                                             butil::memory_order_acquire)) {
+            break;
+        }
+    }
+    if (state == SLOT_IDLE) {
+        p->idle.fetch_sub(1, butil::memory_order_relaxed);
+    } else {
+        p->trimmed.fetch_sub(1, butil::memory_order_relaxed);
+    }
+    p->used.fetch_add(1, butil::memory_order_relaxed);
+}
+
+size_t trim_stack_arenas() {
+    if (g_stack_arenas_end == nullptr) {
+        return 0;
+    }
+    size_t n = 0;
+    for (int i = 0; i < g_nnode * MAX_POOLS_PER_NODE; ++i) {
+        n += trim_pool(&g_pools[i], 0, true);
+    }
+    return n;
+}
+
+void get_stack_arena_stats(std::vector<StackArenaStat>* stats) {
+    stats->clear();
+    if (g_stack_arenas_end == nullptr) {
+        return;
+    }
+    for (int i = 0; i < g_nnode * MAX_POOLS_PER_NODE; ++i) {
+        const StackPool& p = g_pools[i];
+        if (p.slot_size.load(butil::memory_order_acquire) == 0) {
+            continue;
+        }
+        StackArenaStat s;
+        s.node = p.node;
+        s.stacksize = p.stacksize;
+        s.guardsize = p.guardsize;
+        s.capacity = p.capacity;
+        s.carved = p.carved.load(butil::memory_order_relaxed);
+        s.used = p.used.load(butil::memory_order_relaxed);
+        s.idle = p.idle.load(butil::memory_order_relaxed);
+        s.trimmed = p.trimmed.load(butil::memory_order_relaxed);
+        stats->push_back(s);
+    }
+}
+
+void describe_stack_arenas(std::ostream& os) {
+    std::vector<StackArenaStat> stats;
+    get_stack_arena_stats(&stats);
+    if (g_stack_arenas_end == nullptr) {
+        os << "stack_arena: disabled\n";
+        return;
+    }
+    os << "stack_arena: reserved="
+       << (g_stack_arenas_end - g_stack_arenas_begin)
+       << " hugepage=" << FLAGS_bthread_stack_arena_hugepage
+       << " fallback_allocations="
+       << g_nfallback.load(butil::memory_order_relaxed) << '\n';
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const StackArenaStat& s = stats[i];
+        os << "stack_arena[node=" << s.node
+           << " stacksize=" << s.stacksize
+           << "]: capacity=" << s.capacity
+           << " carved=" << s.carved
+           << " used=" << s.used
+           << " idle=" << s.idle
+           << " trimmed=" << s.trimmed << '\n';
+    }
+}
+
+static size_t get_arena_stat(void* arg) {
+    const size_t offset = (size_t)arg;
+    std::vector<StackArenaStat> stats;
+    get_stack_arena_stats(&stats);
+    size_t n = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        n += *(const size_t*)((const char*)&stats[i] + offset);
+    }
+    return n;
+}
+
+static bvar::PassiveStatus<size_t> bvar_arena_idle(
+    "bthread_stack_arena_idle", get_arena_stat,
+    (void*)offsetof(StackArenaStat, idle));
+static bvar::PassiveStatus<size_t> bvar_arena_trimmed(
+    "bthread_stack_arena_trimmed", get_arena_stat,
+    (void*)offsetof(StackArenaStat, trimmed));
+static bvar::PassiveStatus<size_t> bvar_arena_carved(
+    "bthread_stack_arena_carved", get_arena_stat,
+    (void*)offsetof(StackArenaStat, carved));
+
+}  // namespace bthread
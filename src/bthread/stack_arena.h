@@ -0,0 +1,104 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// bthread - An M:N threading library to make applications more concurrent.
+
+#ifndef BTHREAD_STACK_ARENA_H
+#define BTHREAD_STACK_ARENA_H
+
+#include <stddef.h>
+#include <ostream>
+#include <vector>
+
+// Stack arenas, enabled by -bthread_stack_arena_mb > 0.
+//
+// Without arenas, each stack is mmap-ed separately and a guard page is
+// mprotect-ed, stacks are never unmapped once pooled and keep all pages
+// they ever touched. With arenas:
+//  - Address space of stacks is reserved contiguously for each NUMA node and
+//    bound to the node, stacks are carved out of the arena of the node that
+//    the allocating thread runs on.
+//  - The reservation is PROT_NONE, carving a stack only makes the stack part
+//    of its slot writable, so guard pages cost no syscalls.
+//  - Stacks may be backed by transparent huge pages
+//    (-bthread_stack_arena_hugepage), which only pays off for stacks spanning
+//    2MB-aligned ranges, i.e. normal and large stacks.
+//  - When more than -bthread_stack_arena_idle_max stacks of a size are idle
+//    (pooled but not used by any bthread) in an arena, the thread returning
+//    the stack releases pages of idle stacks with madvise(MADV_DONTNEED) in
+//    a batch until half of them are left. Pages holding the saved context of
+//    an idle stack are kept.
+// Stacks that can't be served by arenas (arenas are full or there're too
+// many different stack sizes) are mmap-ed as usual.
+
+namespace bthread {
+
+struct StackStorage;
+
+// Range of all arenas, empty before the arenas are created.
+extern char* g_stack_arenas_begin;
+extern char* g_stack_arenas_end;
+
+// Return true if the stack whose highest address is `bottom' was carved out
+// of the arenas.
+inline bool is_arena_stack(const void* bottom) {
+    return (const char*)bottom > g_stack_arenas_begin &&
+        (const char*)bottom <= g_stack_arenas_end;
+}
+
+// Carve a stack of `stacksize' bytes with a guard of `guardsize' bytes, both
+// aligned by page size, out of the arena of current NUMA node.
+// Returns 0 on success, -1 if the arenas are disabled or full.
+int arena_allocate_stack(StackStorage* s, size_t stacksize, size_t guardsize);
+
+// Give a stack carved by arena_allocate_stack() back to its arena.
+void arena_deallocate_stack(StackStorage* s);
+
+// Called when an arena stack is pooled or taken from the pool. `context' is
+// the saved context (stack pointer) of the pooled stack.
+void arena_stack_returned(const StackStorage& s, void* context);
+void arena_stack_reused(const StackStorage& s);
+
+// Release pages of all idle stacks in the arenas.
+// Returns number of stacks trimmed.
+size_t trim_stack_arenas();
+
+struct StackArenaStat {
+    int node;
+    size_t stacksize;
+    size_t guardsize;
+    // Max number of stacks of the size in the arena.
+    size_t capacity;
+    // Number of stacks carved out of the arena so far.
+    size_t carved;
+    // Number of stacks running bthreads.
+    size_t used;
+    // Number of pooled stacks with resident pages.
+    size_t idle;
+    // Number of pooled stacks whose pages were released.
+    size_t trimmed;
+};
+
+// Get stats of stacks in the arenas. Empty if the arenas are not created.
+void get_stack_arena_stats(std::vector<StackArenaStat>* stats);
+
+// Print stats of the arenas in plain text.
+void describe_stack_arenas(std::ostream& os);
+
+}  // namespace bthread
+
+#endif  // BTHREAD_STACK_ARENA_H
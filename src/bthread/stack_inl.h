@@ -22,6 +22,8 @@
 #ifndef BTHREAD_ALLOCATE_STACK_INL_H
 #define BTHREAD_ALLOCATE_STACK_INL_H
 
+#include "bthread/stack_arena.h"
+
 DECLARE_int32(guard_page_size);
 DECLARE_int32(tc_stack_small);
 DECLARE_int32(tc_stack_normal);
@@ -148,12 +150,19 @@ template <typename StackClass> struct StackFactory {
     
     static ContextualStack* get_stack(void (*entry)(intptr_t)) {
         ContextualStack* cs = butil::get_object<Wrapper>(entry);
+        if (cs && is_arena_stack(cs->storage.bottom)) {
+            arena_stack_reused(cs->storage);
+        }
         // Marks stack as addressable.
         BTHREAD_ASAN_UNPOISON_MEMORY_REGION(cs->storage);
         return cs;
     }
     
     static void return_stack(ContextualStack* cs) {
+        if (is_arena_stack(cs->storage.bottom)) {
+            // Pages below the saved context may be released while pooled.
+            arena_stack_returned(cs->storage, cs->context);
+        }
         // Marks stack as unaddressable.
         BTHREAD_ASAN_POISON_MEMORY_REGION(cs->storage);
         butil::return_object(static_cast<Wrapper*>(cs));
@@ -181,6 +190,8 @@ inline ContextualStack* get_stack(StackType type, void (*entry)(intptr_t)) {
     case STACK_TYPE_SMALL:
         return StackFactory<SmallStackClass>::get_stack(entry);
     case STACK_TYPE_NORMAL:
+    case STACK_TYPE_STACKLESS:
+        // Stackless tasks that can't borrow a stack get a normal one.
         return StackFactory<NormalStackClass>::get_stack(entry);
     case STACK_TYPE_LARGE:
         return StackFactory<LargeStackClass>::get_stack(entry);
@@ -196,6 +207,7 @@ inline void return_stack(ContextualStack* s) {
     }
     switch (s->stacktype) {
     case STACK_TYPE_PTHREAD:
+    case STACK_TYPE_STACKLESS:
         assert(false);
         return;
     case STACK_TYPE_SMALL:
@@ -20,6 +20,9 @@
 // Date: Tue Jul 10 17:40:58 CST 2012
 
 #include <pthread.h>
+#include <dirent.h>                        // opendir
+#include <sched.h>                         // sched_getcpu
+#include <mutex>                           // std::unique_lock
 #include <set>
 #include <regex>
 #include <sys/syscall.h>                   // SYS_gettid
@@ -64,6 +67,40 @@ DEFINE_bool(parking_lot_no_signal_when_no_waiter, false,
             "ParkingLot doesn't signal when there is no waiter. "
             "In busy worker scenarios, signal overhead can be reduced.");
 DEFINE_bool(enable_bthread_priority_queue, false, "Whether to enable priority queue");
+DEFINE_bool(bthread_numa_aware, false,
+            "Workers steal tasks from workers sharing the last level cache, "
+            "then from workers on the same NUMA node before going to other "
+            "nodes, and tasks created by non-worker threads are queued into "
+            "workers on the node of the creator. Workers should be bound to "
+            "cpus by -cpu_set, otherwise the node of a worker is where it "
+            "ran on when it started.");
+DEFINE_int32(bthread_steal_batch, 1,
+             "Max number of tasks taken from the runqueue of another worker "
+             "in one steal, no more than half of the runqueue is taken. "
+             "Tasks other than the one to run are moved into the runqueue of "
+             "the stealing worker, so that a flooded worker is drained by "
+             "idle workers in fewer steals. 1 (default) to take one task "
+             "each time.");
+DEFINE_bool(bthread_deadline_scheduling, false,
+            "Ready bthreads with deadlines (bthread_set_deadline()) are "
+            "run before other bthreads of the same tag, earliest deadline "
+            "first, so that tasks close to their deadlines are not queued "
+            "behind fresh ones when workers are overloaded.");
+DEFINE_int32(bthread_deadline_max_consecutive, 16,
+             "Max number of tasks a worker takes from the deadline queue in a "
+             "row before taking one from runqueues, so that bthreads without "
+             "deadlines, e.g. the ones reading and parsing new requests, are "
+             "not starved by -bthread_deadline_scheduling");
+DEFINE_string(bthread_tag_weights, "",
+              "Share workers and cpu between tags by weights, e.g. \"0:4;1:1\" "
+              "where the number before ':' is the bthread_tag and the number "
+              "after ':' is its weight, tags not mentioned get weight 1. "
+              "Workers of all tags form one pool: idle workers run bthreads "
+              "of other tags, and workers of a tag using more than its "
+              "weighted share of cpu run bthreads of tags owed cpu first. "
+              "Default: disable.");
+DEFINE_int32(bthread_tag_share_period_us, 10000,
+             "Period of sampling cpu time of tags for -bthread_tag_weights");
 
 DECLARE_int32(bthread_concurrency);
 DECLARE_int32(bthread_min_concurrency);
@@ -105,22 +142,24 @@ void* TaskControl::worker_thread(void* arg) {
     delete dummy;
     run_tagged_worker_startfn(tag);
 
-    TaskGroup* g = c->create_group(tag);
-    TaskStatistics stat;
-    if (nullptr == g) {
-        LOG(ERROR) << "Fail to create TaskGroup in pthread=" << pthread_self();
-        return nullptr;
-    }
-
-    g->_tid = pthread_self();
     // tag_wid is a per-tag monotonic counter: same-tag workers get 0,1,2,...
     // Used both for CPU round-robin affinity and the thread name suffix.
+    // Bind before creating the group which records the NUMA node of the cpu.
     int tag_wid = c->_tag_next_worker_id[tag].fetch_add(
                       1, butil::memory_order_relaxed);
     if (!c->_tag_cpus[tag].empty()) {
         const auto& cpus = c->_tag_cpus[tag];
         bind_thread_to_cpu(pthread_self(), cpus[tag_wid % cpus.size()]);
     }
+
+    TaskGroup* g = c->create_group(tag);
+    TaskStatistics stat;
+    if (nullptr == g) {
+        LOG(ERROR) << "Fail to create TaskGroup in pthread=" << pthread_self();
+        return nullptr;
+    }
+
+    g->_tid = pthread_self();
     if (FLAGS_task_group_set_worker_name) {
         std::string worker_thread_name = butil::string_printf(
             "brpc_wkr:%d-%d", g->tag(), tag_wid);
@@ -208,6 +247,10 @@ TaskControl::TaskControl()
     , _signal_per_second(&_cumulated_signal_count)
     , _status(print_rq_sizes_in_the_tc, this)
     , _nbthreads("bthread_count")
+    , _nstackless_promoted("bthread_stackless_promoted_count")
+    , _nsteal_moved("bthread_steal_moved_count")
+    , _deadline_scheduling(FLAGS_bthread_deadline_scheduling)
+    , _deadline_queues(_deadline_scheduling ? FLAGS_task_group_ntags : 0)
     , _enable_priority_queue(FLAGS_enable_bthread_priority_queue)
     , _ed_priority_queue_num_of_each_tag(FLAGS_event_dispatcher_num)
     , _ed_priority_queues(
@@ -216,6 +259,10 @@ TaskControl::TaskControl()
     , _tagged_pl(FLAGS_task_group_ntags)
     , _tag_cpus(FLAGS_task_group_ntags)
     , _tag_next_worker_id(FLAGS_task_group_ntags)
+    , _numa_aware(FLAGS_bthread_numa_aware)
+    , _numa_nnode(1)
+    , _tag_share_next_ns(0)
+    , _tag_owed(-1)
 {}
 
 int TaskControl::init_ed_priority_queues() {
@@ -236,6 +283,91 @@ int TaskControl::init_ed_priority_queues() {
     return 0;
 }
 
+// Returns the node of `cpu' according to <cpu_dir>/cpuN/nodeM, 0 if unknown.
+static int read_cpu_numa_node(const std::string& cpu_dir, int cpu) {
+    const std::string path = cpu_dir + "/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return 0;
+    }
+    int node = 0;
+    while (struct dirent* e = readdir(dir)) {
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit(e->d_name[4])) {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// Returns id of the last level cache of `cpu', -1 if unknown.
+static int read_cpu_llc_id(const std::string& cpu_dir, int cpu) {
+    for (int index = 3; index >= 2; --index) {
+        const std::string path = cpu_dir + "/cpu" + std::to_string(cpu) +
+            "/cache/index" + std::to_string(index) + "/id";
+        FILE* fp = fopen(path.c_str(), "r");
+        if (fp == nullptr) {
+            continue;
+        }
+        int id = -1;
+        if (fscanf(fp, "%d", &id) != 1) {
+            id = -1;
+        }
+        fclose(fp);
+        if (id >= 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+void TaskControl::init_numa_topology() {
+    init_numa_topology("/sys/devices/system/cpu",
+                       sysconf(_SC_NPROCESSORS_CONF));
+}
+
+void TaskControl::init_numa_topology(const std::string& cpu_dir, long ncpu) {
+    int max_node = 0;
+    for (long cpu = 0; cpu < ncpu; ++cpu) {
+        const int node = read_cpu_numa_node(cpu_dir, cpu);
+        // Nodes are expected to be numbered compactly, cap sparse numbers.
+        _cpu_numa_node.push_back(std::min(node, BTHREAD_MAX_CONCURRENCY - 1));
+        _cpu_llc_id.push_back(read_cpu_llc_id(cpu_dir, cpu));
+        max_node = std::max(max_node, _cpu_numa_node.back());
+    }
+    _numa_nnode = max_node + 1;
+    _tagged_node_groups.resize(FLAGS_task_group_ntags * _numa_nnode);
+    std::vector<butil::atomic<size_t>> ngroup(FLAGS_task_group_ntags * _numa_nnode);
+    for (auto& n : ngroup) {
+        n.store(0, butil::memory_order_relaxed);
+    }
+    _tagged_node_ngroup.swap(ngroup);
+    for (int i = 0; i < _numa_nnode; ++i) {
+        const std::string node_str = "node" + std::to_string(i);
+        _numa_nsteal.push_back(
+            new bvar::Adder<int64_t>("bthread_numa_steal", node_str));
+        _numa_nmigration.push_back(
+            new bvar::Adder<int64_t>("bthread_numa_migration", node_str));
+    }
+    LOG(INFO) << "bthread workers are NUMA-aware over " << _numa_nnode
+              << " node(s) of " << ncpu << " cpus";
+}
+
+int TaskControl::cpu_numa_node(int cpu) const {
+    if (cpu < 0 || (size_t)cpu >= _cpu_numa_node.size()) {
+        return 0;
+    }
+    return _cpu_numa_node[cpu];
+}
+
+int TaskControl::cpu_llc_id(int cpu) const {
+    if (cpu < 0 || (size_t)cpu >= _cpu_llc_id.size()) {
+        return -1;
+    }
+    return _cpu_llc_id[cpu];
+}
+
 int TaskControl::init(int concurrency) {
     if (_concurrency != 0) {
         LOG(ERROR) << "Already initialized";
@@ -254,6 +386,14 @@ int TaskControl::init(int concurrency) {
         }
     }
 
+    if (!FLAGS_bthread_tag_weights.empty()) {
+        if (parse_tag_weights(FLAGS_bthread_tag_weights) == -1) {
+            LOG(ERROR) << "invalid bthread_tag_weights="
+                       << FLAGS_bthread_tag_weights;
+            return -1;
+        }
+    }
+
     // task group group by tags
     for (int i = 0; i < FLAGS_task_group_ntags; ++i) {
         _tagged_ngroup[i].store(0, std::memory_order_relaxed);
@@ -270,6 +410,10 @@ int TaskControl::init(int concurrency) {
         return -1;
     }
 
+    if (_numa_aware) {
+        init_numa_topology();
+    }
+
     // Make sure TimerThread is ready.
     if (get_or_create_global_timer_thread() == nullptr) {
         LOG(ERROR) << "Fail to get global_timer_thread";
@@ -345,6 +489,13 @@ int TaskControl::add_workers(int num, bthread_tag_t tag) {
 
 TaskGroup* TaskControl::choose_one_group(bthread_tag_t tag) {
     CHECK(tag >= BTHREAD_TAG_DEFAULT && tag < FLAGS_task_group_ntags) << tag;
+    if (_numa_aware) {
+        const int node = cpu_numa_node(sched_getcpu());
+        const size_t nlocal = node_ngroup(tag, node).load(butil::memory_order_acquire);
+        if (nlocal != 0) {
+            return node_group(tag, node)[butil::fast_rand_less_than(nlocal)];
+        }
+    }
     auto& groups = tag_group(tag);
     const auto ngroup = tag_ngroup(tag).load(butil::memory_order_acquire);
     if (ngroup != 0) {
@@ -453,6 +604,194 @@ int TaskControl::parse_cpuset(const std::string& value) {
     return 0;
 }
 
+int TaskControl::parse_tag_weights(const std::string& value) {
+    const int ntags = FLAGS_task_group_ntags;
+    std::vector<int> weights(ntags, 1);
+    for (butil::StringSplitter seg_split(value.data(), ';'); seg_split; ++seg_split) {
+        std::string segment(seg_split.field(), seg_split.length());
+        auto s = segment.find_first_not_of(' ');
+        auto e = segment.find_last_not_of(' ');
+        if (s == std::string::npos) { continue; }  // blank segment
+        segment = segment.substr(s, e - s + 1);
+
+        auto colon = segment.find(':');
+        if (colon == std::string::npos) {
+            LOG(ERROR) << "bthread_tag_weights segment missing ':': " << segment;
+            return -1;
+        }
+        unsigned tag_id = 0;
+        unsigned weight = 0;
+        const std::string tag_str = segment.substr(0, colon);
+        const std::string weight_str = segment.substr(colon + 1);
+        if (butil::StringSplitter(tag_str.c_str(), '\t').to_uint(&tag_id) != 0 ||
+            (int)tag_id >= ntags) {
+            LOG(ERROR) << "bthread_tag_weights invalid tag '" << tag_str << "'";
+            return -1;
+        }
+        if (butil::StringSplitter(weight_str.c_str(), '\t').to_uint(&weight) != 0 ||
+            weight == 0 || weight > 10000) {
+            LOG(ERROR) << "bthread_tag_weights invalid weight '" << weight_str
+                       << "' for tag " << tag_id;
+            return -1;
+        }
+        weights[tag_id] = weight;
+    }
+
+    std::vector<butil::atomic<bool>> overdrawn(ntags);
+    std::vector<bvar::Adder<int64_t>*> nborrow;
+    for (int i = 0; i < ntags; ++i) {
+        overdrawn[i].store(false, butil::memory_order_relaxed);
+        nborrow.push_back(new bvar::Adder<int64_t>(
+            "bthread_tag_borrow_count", std::to_string(i)));
+    }
+    _tag_overdrawn.swap(overdrawn);
+    _tagged_nborrow.swap(nborrow);
+    _tag_cputime_ns.assign(ntags, 0);
+    _tag_deficit_ns.assign(ntags, 0);
+    _tag_weights.swap(weights);
+    return 0;
+}
+
+// A deficit scheduler over tags: in each period, cpu time used by all tags
+// is split among active tags (used cpu or having queued tasks) by weights,
+// the difference between the split and the cpu time actually used by a tag
+// is accumulated in its deficit. Deficits are bounded so that a tag never
+// banks credit or debt for long, and reset when the tag becomes inactive.
+// Cpu time of a tag is the running time of its bthreads, accounted by the
+// workers running them in sched_to() like cumulated_cputime_ns(), no matter
+// which tag the workers belong to. The tag with queued tasks and the largest
+// positive deficit is owed cpu: workers of overdrawn tags run its tasks
+// before their own ones, see steal_task_of_other_tags().
+void TaskControl::refresh_tag_shares() {
+    std::unique_lock<butil::Mutex> mu(_tag_share_mutex, std::try_to_lock);
+    if (!mu.owns_lock()) {
+        // Being refreshed by another worker.
+        return;
+    }
+    const int64_t now_ns = butil::cpuwide_time_ns();
+    if (now_ns < _tag_share_next_ns.load(butil::memory_order_relaxed)) {
+        // Just refreshed by another worker.
+        return;
+    }
+    const int64_t period_ns =
+        std::max(FLAGS_bthread_tag_share_period_us, 1) * 1000L;
+    _tag_share_next_ns.store(now_ns + period_ns, butil::memory_order_relaxed);
+
+    const int ntags = (int)_tag_weights.size();
+    DEFINE_SMALL_ARRAY(int64_t, cputime_ns, ntags, 64);
+    DEFINE_SMALL_ARRAY(size_t, nqueued, ntags, 64);
+    for (int tag = 0; tag < ntags; ++tag) {
+        cputime_ns[tag] = 0;
+        nqueued[tag] = 0;
+    }
+    for (int tag = 0; tag < ntags; ++tag) {
+        const size_t ngroup = tag_ngroup(tag).load(butil::memory_order_acquire);
+        auto& groups = tag_group(tag);
+        for (size_t i = 0; i < ngroup; ++i) {
+            TaskGroup* g = groups[i];
+            if (g == nullptr) {
+                continue;
+            }
+            for (int t = 0; t < ntags; ++t) {
+                cputime_ns[t] +=
+                    g->_tagged_cputime_ns[t].load(butil::memory_order_relaxed);
+            }
+            // Tasks of other tags are never queued in the runqueues.
+            nqueued[tag] += g->_rq.volatile_size() + g->_remote_rq.volatile_size();
+        }
+    }
+
+    DEFINE_SMALL_ARRAY(int64_t, used_ns, ntags, 64);
+    DEFINE_SMALL_ARRAY(bool, active, ntags, 64);
+    int64_t total_ns = 0;
+    int64_t active_weight = 0;
+    for (int tag = 0; tag < ntags; ++tag) {
+        // Cpu time of destroyed groups is gone with them.
+        used_ns[tag] = std::max(cputime_ns[tag] - _tag_cputime_ns[tag], (int64_t)0);
+        _tag_cputime_ns[tag] = cputime_ns[tag];
+        active[tag] = used_ns[tag] > 0 || nqueued[tag] > 0;
+        if (active[tag]) {
+            total_ns += used_ns[tag];
+            active_weight += _tag_weights[tag];
+        }
+    }
+
+    const int64_t bound_ns = std::max(total_ns, period_ns);
+    int owed = -1;
+    for (int tag = 0; tag < ntags; ++tag) {
+        int64_t& deficit = _tag_deficit_ns[tag];
+        if (!active[tag]) {
+            deficit = 0;
+        } else {
+            deficit += total_ns * _tag_weights[tag] / active_weight - used_ns[tag];
+            deficit = std::min(std::max(deficit, -bound_ns), bound_ns);
+        }
+        _tag_overdrawn[tag].store(deficit < 0, butil::memory_order_relaxed);
+        if (nqueued[tag] > 0 && deficit > 0 &&
+            (owed < 0 || deficit > _tag_deficit_ns[owed])) {
+            owed = tag;
+        }
+    }
+    _tag_owed.store(owed, butil::memory_order_relaxed);
+}
+
+bool TaskControl::steal_task_of_other_tags(TaskGroup* self, bthread_t* tid,
+                                           bool owed_only, int64_t now_ns) {
+    if (now_ns >= _tag_share_next_ns.load(butil::memory_order_relaxed)) {
+        refresh_tag_shares();
+    }
+    const bthread_tag_t home = self->tag();
+    const int owed = _tag_owed.load(butil::memory_order_relaxed);
+    if (owed_only &&
+        (owed < 0 || owed == home ||
+         !_tag_overdrawn[home].load(butil::memory_order_relaxed))) {
+        return false;
+    }
+    bthread_tag_t stolen_tag = BTHREAD_TAG_INVALID;
+    if (owed >= 0 && owed != home &&
+        steal_from_tag(owed, tid, &self->_steal_seed, self->_steal_offset)) {
+        stolen_tag = owed;
+    } else if (!owed_only) {
+        // Idle, run tasks of any tag.
+        const int ntags = (int)_tag_weights.size();
+        for (int i = 1; i < ntags; ++i) {
+            const bthread_tag_t tag = (home + i) % ntags;
+            if (tag != owed &&
+                steal_from_tag(tag, tid, &self->_steal_seed, self->_steal_offset)) {
+                stolen_tag = tag;
+                break;
+            }
+        }
+    }
+    if (stolen_tag == BTHREAD_TAG_INVALID) {
+        return false;
+    }
+    *_tagged_nborrow[stolen_tag] << 1;
+    return true;
+}
+
+bool TaskControl::steal_from_tag(bthread_tag_t tag, bthread_t* tid,
+                                 size_t* seed, size_t offset) {
+    const size_t ngroup = tag_ngroup(tag).load(butil::memory_order_acquire);
+    if (0 == ngroup) {
+        return false;
+    }
+    auto& groups = tag_group(tag);
+    bool stolen = false;
+    size_t s = *seed;
+    for (size_t i = 0; i < ngroup; ++i, s += offset) {
+        TaskGroup* g = groups[s % ngroup];
+        // Take one task each time, tasks of other tags are not queued into
+        // the runqueue of the stealing worker.
+        if (g && (g->_rq.steal(tid) || g->_remote_rq.pop(tid))) {
+            stolen = true;
+            break;
+        }
+    }
+    *seed = s;
+    return stolen;
+}
+
 void TaskControl::bind_thread_to_cpu(pthread_t pthread, unsigned cpu_id) {
 #if defined(OS_LINUX)
         cpu_set_t cs;
@@ -505,6 +844,9 @@ void TaskControl::stop_and_join() {
         std::for_each(
             _tagged_ngroup.begin(), _tagged_ngroup.end(),
             [](butil::atomic<size_t>& index) { index.store(0, butil::memory_order_relaxed); });
+        std::for_each(
+            _tagged_node_ngroup.begin(), _tagged_node_ngroup.end(),
+            [](butil::atomic<size_t>& index) { index.store(0, butil::memory_order_relaxed); });
     }
     for (int i = 0; i < FLAGS_task_group_ntags; ++i) {
         for (auto& pl : _tagged_pl[i]) {
@@ -547,12 +889,25 @@ int TaskControl::_add_group(TaskGroup* g, bthread_tag_t tag) {
         return -1;
     }
     g->set_tag(tag);
-    g->set_pl(&_tagged_pl[tag][butil::fmix64(pthread_numeric_id()) % _pl_num_of_each_tag]);
+    g->set_pl(&tag_pl(tag)[butil::fmix64(pthread_numeric_id()) % _pl_num_of_each_tag]);
     size_t ngroup = _tagged_ngroup[tag].load(butil::memory_order_relaxed);
     if (ngroup < (size_t)BTHREAD_MAX_CONCURRENCY) {
         _tagged_groups[tag][ngroup] = g;
         _tagged_ngroup[tag].store(ngroup + 1, butil::memory_order_release);
     }
+    if (_numa_aware) {
+        // Called in the worker thread of `g'.
+        const int cpu = sched_getcpu();
+        g->_numa_node = cpu_numa_node(cpu);
+        g->_llc_id = cpu_llc_id(cpu);
+        const size_t nlocal =
+            node_ngroup(tag, g->_numa_node).load(butil::memory_order_relaxed);
+        if (nlocal < (size_t)BTHREAD_MAX_CONCURRENCY) {
+            node_group(tag, g->_numa_node)[nlocal] = g;
+            node_ngroup(tag, g->_numa_node).store(
+                nlocal + 1, butil::memory_order_release);
+        }
+    }
     mu.unlock();
     // See the comments in _destroy_group
     // TODO: Not needed anymore since non-worker pthread cannot have TaskGroup
@@ -599,6 +954,20 @@ int TaskControl::_destroy_group(TaskGroup* g) {
                 break;
             }
         }
+        if (erased && _numa_aware) {
+            // Same as above.
+            auto& local_groups = node_group(tag, g->_numa_node);
+            const size_t nlocal =
+                node_ngroup(tag, g->_numa_node).load(butil::memory_order_relaxed);
+            for (size_t i = 0; i < nlocal; ++i) {
+                if (local_groups[i] == g) {
+                    local_groups[i] = local_groups[nlocal - 1];
+                    node_ngroup(tag, g->_numa_node).store(
+                        nlocal - 1, butil::memory_order_release);
+                    break;
+                }
+            }
+        }
     }
 
     // Can't delete g immediately because for performance consideration,
@@ -615,7 +984,8 @@ int TaskControl::_destroy_group(TaskGroup* g) {
 }
 
 bool TaskControl::steal_task(bthread_t* tid, size_t* seed, size_t offset) {
-    auto tag = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group)->tag();
+    TaskGroup* const self = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    auto tag = self->tag();
 
     if (_enable_priority_queue) {
         for (int i = 0;
@@ -626,22 +996,57 @@ bool TaskControl::steal_task(bthread_t* tid, size_t* seed, size_t offset) {
         }
     }
 
+    if (_deadline_scheduling && self->pop_deadline_rq(tid, false)) {
+        return true;
+    }
+
+    // NOTE: Don't return inside `for' iteration since we need to update |seed|
+    bool stolen = false;
+    size_t s = *seed;
+    const int node = self->_numa_node;
+    if (_numa_aware && node >= 0) {
+        // Groups sharing the last level cache with the caller first, then
+        // other groups on the same node.
+        const size_t nlocal = node_ngroup(tag, node).load(butil::memory_order_acquire);
+        auto& local_groups = node_group(tag, node);
+        for (int pass = 0; pass < 2 && !stolen; ++pass) {
+            for (size_t i = 0; i < nlocal; ++i, s += offset) {
+                TaskGroup* g = local_groups[s % nlocal];
+                if (g == nullptr || (g->_llc_id == self->_llc_id) != (pass == 0)) {
+                    continue;
+                }
+                if (steal_from_rq(self, g, tid) || g->_remote_rq.pop(tid)) {
+                    stolen = true;
+                    break;
+                }
+            }
+        }
+        if (stolen) {
+            *seed = s;
+            *_numa_nsteal[node] << 1;
+            self->_ndeadline_popped = 0;
+            return true;
+        }
+    }
+
     // 1: Acquiring fence is paired with releasing fence in _add_group to
     // avoid accessing uninitialized slot of _groups.
     const size_t ngroup = tag_ngroup(tag).load(butil::memory_order_acquire/*1*/);
     if (0 == ngroup) {
+        *seed = s;
         return false;
     }
 
-    // NOTE: Don't return inside `for' iteration since we need to update |seed|
-    bool stolen = false;
-    size_t s = *seed;
     auto& groups = tag_group(tag);
     for (size_t i = 0; i < ngroup; ++i, s += offset) {
         TaskGroup* g = groups[s % ngroup];
         // g is possibly nullptr because of concurrent _destroy_group
         if (g) {
-            if (g->_rq.steal(tid)) {
+            if (_numa_aware && node >= 0 && g->_numa_node == node) {
+                // Searched above.
+                continue;
+            }
+            if (steal_from_rq(self, g, tid)) {
                 stolen = true;
                 break;
             }
@@ -652,9 +1057,44 @@ bool TaskControl::steal_task(bthread_t* tid, size_t* seed, size_t offset) {
         }
     }
     *seed = s;
+    if (stolen && _numa_aware && node >= 0) {
+        *_numa_nmigration[node] << 1;
+    }
+    if (stolen) {
+        self->_ndeadline_popped = 0;
+    } else if (_deadline_scheduling && self->pop_deadline_rq(tid, true)) {
+        // Skipped above to give runqueues a chance, but they're empty.
+        return true;
+    }
     return stolen;
 }
 
+bool TaskControl::steal_from_rq(TaskGroup* self, TaskGroup* victim,
+                                bthread_t* tid) {
+    const int max_steal = FLAGS_bthread_steal_batch;
+    if (max_steal <= 1 || victim == self) {
+        return victim->_rq.steal(tid);
+    }
+    DEFINE_SMALL_ARRAY(bthread_t, tids, max_steal, 64);
+    const size_t n = victim->_rq.steal_batch(tids, max_steal);
+    if (n == 0) {
+        return false;
+    }
+    *tid = tids[0];
+    if (n > 1) {
+        // steal_task() is called by the worker of `self' which owns the
+        // runqueue, and the runqueue is empty otherwise the worker would not
+        // steal. No signal is needed: the tasks were signalled when they were
+        // queued into `victim', idle workers may steal them from `self'.
+        size_t pushed = self->_rq.push_batch(tids + 1, n - 1);
+        for (; pushed < n - 1; ++pushed) {
+            self->push_rq(tids[pushed + 1]);
+        }
+        _nsteal_moved << (int64_t)(n - 1);
+    }
+    return true;
+}
+
 void TaskControl::signal_task(int num_task, bthread_tag_t tag) {
     if (num_task <= 0) {
         return;
@@ -685,6 +1125,33 @@ void TaskControl::signal_task(int num_task, bthread_tag_t tag) {
     }
 }
 
+void TaskControl::signal_task_batch(int num_task, bthread_tag_t tag) {
+    if (num_task <= 2) {
+        return signal_task(num_task, tag);
+    }
+    // Waking up more workers than the tag has is useless.
+    const int ngroup = (int)_tagged_ngroup[tag].load(butil::memory_order_relaxed);
+    if (num_task > ngroup) {
+        num_task = ngroup;
+    }
+    auto& pl = tag_pl(tag);
+    size_t start_index = butil::fmix64(pthread_numeric_id()) % _pl_num_of_each_tag;
+    for (size_t i = 0; i < _pl_num_of_each_tag && num_task > 0; ++i) {
+        num_task -= pl[start_index].signal(num_task);
+        if (++start_index >= _pl_num_of_each_tag) {
+            start_index = 0;
+        }
+    }
+    if (num_task > 0 &&
+        FLAGS_bthread_min_concurrency > 0 &&    // test min_concurrency for performance
+        _concurrency.load(butil::memory_order_relaxed) < FLAGS_bthread_concurrency) {
+        BAIDU_SCOPED_LOCK(g_task_control_mutex);
+        if (_concurrency.load(butil::memory_order_acquire) < FLAGS_bthread_concurrency) {
+            add_workers(1, tag);
+        }
+    }
+}
+
 void TaskControl::print_rq_sizes(std::ostream& os) {
     size_t ngroup = 0;
     std::for_each(_tagged_ngroup.begin(), _tagged_ngroup.end(), [&](butil::atomic<size_t>& index) {
@@ -742,7 +1209,8 @@ int64_t TaskControl::get_cumulated_signal_count() {
     BAIDU_SCOPED_LOCK(_modify_group_mutex);
     for_each_task_group([&](TaskGroup* g) {
         if (g) {
-            c += g->_nsignaled + g->_remote_nsignaled;
+            c += g->_nsignaled +
+                 g->_remote_nsignaled.load(butil::memory_order_relaxed);
         }
     });
     return c;
@@ -31,10 +31,12 @@
 #include <array>
 #include <memory>
 #include "butil/atomicops.h"                     // butil::atomic
+#include "butil/time.h"                          // butil::cpuwide_time_ns
 #include "bvar/bvar.h"                          // bvar::PassiveStatus
 #include "bthread/task_tracer.h"
 #include "bthread/task_meta.h"                  // TaskMeta
 #include "bthread/work_stealing_queue.h"        // WorkStealingQueue
+#include "bthread/deadline_queue.h"             // DeadlineQueue
 #include "bthread/parking_lot.h"
 
 DECLARE_int32(task_group_ntags);
@@ -65,6 +67,10 @@ public:
 
     // Tell other groups that `n' tasks was just added to caller's runqueue
     void signal_task(int num_task, bthread_tag_t tag);
+    // Same as signal_task() but for tasks added in a batch: wake up as many
+    // workers as the tasks (at most all workers of the tag) with at most one
+    // wakeup on each parking lot.
+    void signal_task_batch(int num_task, bthread_tag_t tag);
 
     // Stop and join worker threads in TaskControl.
     void stop_and_join();
@@ -87,7 +93,8 @@ public:
     // Return the number of workers actually added, which may be less than |num|
     int add_workers(int num, bthread_tag_t tag);
 
-    // Choose one TaskGroup (randomly right now).
+    // Choose one TaskGroup randomly, from groups on the NUMA node of the
+    // calling thread if FLAGS_bthread_numa_aware is on.
     // If this method is called after init(), it never returns nullptr.
     TaskGroup* choose_one_group(bthread_tag_t tag);
 
@@ -100,6 +107,24 @@ public:
 
     static void bind_thread_to_cpu(pthread_t pthread, unsigned cpu_id);
 
+    // Parse FLAGS_bthread_tag_weights into _tag_weights, e.g. "0:4;1:1".
+    // Tags not mentioned get weight 1.
+    // Returns -1 on parse error.
+    int parse_tag_weights(const std::string& value);
+
+    // True if workers of all tags form one pool, see FLAGS_bthread_tag_weights.
+    bool share_tags() const { return !_tag_weights.empty(); }
+
+    // Steal a task of another tag than the one of `self', tags owed more cpu
+    // by their weights are tried first. If `owed_only' is true, steal only
+    // when the tag of `self' used more than its share and another tag with
+    // queued tasks is owed cpu. Called only when share_tags() is true.
+    // `now_ns' is a recent butil::cpuwide_time_ns() of the caller, e.g. the
+    // time of its last context switch, so that checking it in every sched()
+    // does not read the clock again.
+    bool steal_task_of_other_tags(TaskGroup* self, bthread_t* tid,
+                                  bool owed_only, int64_t now_ns);
+
 #ifdef BRPC_BTHREAD_TRACER
     // A stacktrace of bthread can be helpful in debugging.
     void stack_trace(std::ostream& os, bthread_t tid);
@@ -113,6 +138,15 @@ public:
 
     std::vector<bthread_t> get_living_bthreads();
 
+    // True if FLAGS_bthread_deadline_scheduling is on.
+    bool deadline_scheduling() const { return _deadline_scheduling; }
+
+    // Queue ready bthreads with deadlines of a tag, see
+    // FLAGS_bthread_deadline_scheduling.
+    DeadlineQueue& deadline_queue(bthread_tag_t tag) {
+        return _deadline_queues[tag];
+    }
+
 private:
     typedef std::array<TaskGroup*, BTHREAD_MAX_CONCURRENCY> TaggedGroups;
     typedef std::array<ParkingLot, BTHREAD_MAX_PARKINGLOT> TaggedParkingLot;
@@ -127,8 +161,10 @@ private:
     // Tag ngroup
     butil::atomic<size_t>& tag_ngroup(int tag) { return _tagged_ngroup[tag]; }
 
-    // Tag parking slot
-    TaggedParkingLot& tag_pl(bthread_tag_t tag) { return _tagged_pl[tag]; }
+    // Tag parking slot. Workers of all tags park on the slots of tag 0 when
+    // tags share workers, so that any idle worker is woken for new tasks.
+    TaggedParkingLot& tag_pl(bthread_tag_t tag)
+    { return _tagged_pl[share_tags() ? 0 : tag]; }
 
     // Priority queue for a specific ED within a tag
     WorkStealingQueue<bthread_t>& ed_priority_queue(
@@ -139,6 +175,33 @@ private:
 
     int init_ed_priority_queues();
 
+    // Steal tasks from the runqueue of `victim': the first one is returned
+    // in `tid', others are moved into the runqueue of `self'.
+    bool steal_from_rq(TaskGroup* self, TaskGroup* victim, bthread_t* tid);
+
+    // Read NUMA nodes and last level caches of cpus from sysfs.
+    void init_numa_topology();
+    // Same as above, reading cpu0 ~ cpu<ncpu-1> in `cpu_dir' instead of
+    // /sys/devices/system/cpu, for testing.
+    void init_numa_topology(const std::string& cpu_dir, long ncpu);
+    int cpu_numa_node(int cpu) const;
+    int cpu_llc_id(int cpu) const;
+
+    // Groups of `tag' on NUMA `node'.
+    TaggedGroups& node_group(bthread_tag_t tag, int node)
+    { return _tagged_node_groups[tag * _numa_nnode + node]; }
+    butil::atomic<size_t>& node_ngroup(bthread_tag_t tag, int node)
+    { return _tagged_node_ngroup[tag * _numa_nnode + node]; }
+
+    // Sample cpu time and runqueues of tags, update the deficits and decide
+    // which tag is owed cpu in the next period. The clock is read again
+    // inside since the time passed to steal_task_of_other_tags() may be stale.
+    void refresh_tag_shares();
+
+    // Steal a task from the runqueues of groups of `tag'.
+    bool steal_from_tag(bthread_tag_t tag, bthread_t* tid,
+                        size_t* seed, size_t offset);
+
     static void delete_task_group(void* arg);
 
     static void* worker_thread(void* task_control);
@@ -170,12 +233,19 @@ private:
     bvar::PerSecond<bvar::PassiveStatus<int64_t> > _signal_per_second;
     bvar::PassiveStatus<std::string> _status;
     bvar::Adder<int64_t> _nbthreads;
+    // Number of stackless bthreads promoted to ordinary ones.
+    bvar::Adder<int64_t> _nstackless_promoted;
+    // Number of stolen tasks moved into runqueues of stealing workers.
+    bvar::Adder<int64_t> _nsteal_moved;
 
     std::vector<bvar::Adder<int64_t>*> _tagged_nworkers;
     std::vector<bvar::PassiveStatus<double>*> _tagged_cumulated_worker_time;
     std::vector<bvar::PerSecond<bvar::PassiveStatus<double>>*> _tagged_worker_usage_second;
     std::vector<bvar::Adder<int64_t>*> _tagged_nbthreads;
 
+    bool _deadline_scheduling;
+    std::vector<DeadlineQueue> _deadline_queues;
+
     bool _enable_priority_queue;
     int _ed_priority_queue_num_of_each_tag;
     std::vector<WorkStealingQueue<bthread_t>> _ed_priority_queues;
@@ -189,6 +259,34 @@ private:
     // Incremented once per worker created for that tag (in worker_thread).
     std::vector<butil::atomic<int>> _tag_next_worker_id;
 
+    // Topology-aware placement and stealing, see FLAGS_bthread_numa_aware.
+    bool _numa_aware;
+    int _numa_nnode;
+    std::vector<int> _cpu_numa_node;
+    std::vector<int> _cpu_llc_id;
+    // Same as _tagged_groups/_tagged_ngroup, indexed by tag * _numa_nnode + node.
+    std::vector<TaggedGroups> _tagged_node_groups;
+    std::vector<butil::atomic<size_t>> _tagged_node_ngroup;
+    // Tasks stolen by workers of each node from the same node / other nodes.
+    std::vector<bvar::Adder<int64_t>*> _numa_nsteal;
+    std::vector<bvar::Adder<int64_t>*> _numa_nmigration;
+
+    // Weighted fair sharing of cpu between tags, see FLAGS_bthread_tag_weights.
+    // Empty if disabled.
+    std::vector<int> _tag_weights;
+    butil::atomic<int64_t> _tag_share_next_ns;
+    // The tag with queued tasks which is owed the most cpu, -1 if none.
+    butil::atomic<int> _tag_owed;
+    // True if the tag used more than its share.
+    std::vector<butil::atomic<bool>> _tag_overdrawn;
+    // Protects fields below, held by the worker refreshing the shares.
+    butil::Mutex _tag_share_mutex;
+    std::vector<int64_t> _tag_cputime_ns;
+    // Cpu time a tag is owed (positive) or overdrawn (negative).
+    std::vector<int64_t> _tag_deficit_ns;
+    // Tasks of each tag run by workers of other tags.
+    std::vector<bvar::Adder<int64_t>*> _tagged_nborrow;
+
 #ifdef BRPC_BTHREAD_TRACER
     TaskTracer _task_tracer;
 #endif // BRPC_BTHREAD_TRACER
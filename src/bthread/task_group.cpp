@@ -57,6 +57,8 @@ void (*g_end_bthread_span)() = nullptr;
 static const bthread_attr_t BTHREAD_ATTR_TASKGROUP = {
     BTHREAD_STACKTYPE_UNKNOWN, 0, nullptr, BTHREAD_TAG_INVALID, {0} };
 
+DECLARE_int32(bthread_deadline_max_consecutive);
+
 DEFINE_bool(show_bthread_creation_in_vars, false, "When this flags is on, The time "
             "from bthread creation to first run will be recorded and shown in /vars");
 BUTIL_VALIDATE_GFLAG(show_bthread_creation_in_vars, butil::PassValidate);
@@ -350,6 +352,13 @@ int TaskGroup::init(size_t runqueue_capacity) {
         LOG(FATAL) << "Fail to init _remote_rq";
         return -1;
     }
+    if (_control->share_tags()) {
+        const size_t ntags = _control->_tag_weights.size();
+        _tagged_cputime_ns.reset(new butil::atomic<int64_t>[ntags]);
+        for (size_t i = 0; i < ntags; ++i) {
+            _tagged_cputime_ns[i].store(0, butil::memory_order_relaxed);
+        }
+    }
 
 #ifdef BUTIL_USE_ASAN
     void* stack_addr = nullptr;
@@ -379,6 +388,7 @@ int TaskGroup::init(size_t runqueue_capacity) {
     m->local_storage = LOCAL_STORAGE_INIT;
     m->cpuwide_start_ns = butil::cpuwide_time_ns();
     m->stat = EMPTY_STAT;
+    m->deadline_us = 0;
     m->attr = BTHREAD_ATTR_TASKGROUP;
     m->tid = make_tid(*m->version_butex, slot);
     m->set_stack(stk);
@@ -390,8 +400,10 @@ int TaskGroup::init(size_t runqueue_capacity) {
 #endif // BUTIL_USE_ASAN
 
     _cur_meta = m;
+    _running_tid.store(m->tid, butil::memory_order_relaxed);
     _main_tid = m->tid;
     _main_stack = stk;
+    _pthread_stack = stk;
 
     CPUTimeStat cpu_time_stat;
     cpu_time_stat.set_last_run_ns(m->cpuwide_start_ns, true);
@@ -535,7 +547,7 @@ void TaskGroup::task_runner(intptr_t skip_remained) {
 #endif // BRPC_BTHREAD_TRACER
 
         g->_control->_nbthreads << -1;
-        g->_control->tag_nbthreads(g->tag()) << -1;
+        g->_control->tag_nbthreads(m->attr.tag) << -1;
         g->set_remained(_release_last_context, m);
         ending_sched(&g);
 
@@ -547,15 +559,134 @@ void TaskGroup::task_runner(intptr_t skip_remained) {
 
 void TaskGroup::_release_last_context(void* arg) {
     TaskMeta* m = static_cast<TaskMeta*>(arg);
-    if (m->stack_type() != STACK_TYPE_PTHREAD) {
-        return_stack(m->release_stack()/*may be nullptr*/);
-    } else {
+    if (m->stack_type() == STACK_TYPE_PTHREAD) {
         // it's _main_stack, don't return.
         m->set_stack(nullptr);
+    } else if (m->stack_type() == STACK_TYPE_STACKLESS &&
+               m->pthread_stack_group != nullptr) {
+        // The promoted task held the pthread stack of the group, give it
+        // back. Its context was saved before this callback.
+        TaskGroup* home = m->pthread_stack_group;
+        m->pthread_stack_group = nullptr;
+        m->set_stack(nullptr);
+        home->_pthread_stack_returned.store(true, butil::memory_order_release);
+    } else if (m->stack_type() == STACK_TYPE_STACKLESS &&
+               m->stack ==
+               BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group)->_main_stack) {
+        // Ran on _main_stack without blocking, don't return.
+        m->set_stack(nullptr);
+    } else {
+        return_stack(m->release_stack()/*may be nullptr*/);
     }
     return_resource(get_slot(m->tid));
 }
 
+void TaskGroup::_release_promoted_main_stack(void* arg) {
+    ContextualStack* stk = static_cast<ContextualStack*>(arg);
+    // The stack is left in the middle of run_promoted_main_task(), restart
+    // it from the entry of ordinary tasks.
+#ifdef BUTIL_USE_ASAN
+    stk->context = bthread_make_fcontext(
+        stk->storage.bottom, stk->storage.stacksize, asan_task_runner);
+#else
+    stk->context = bthread_make_fcontext(
+        stk->storage.bottom, stk->storage.stacksize, task_runner);
+#endif // BUTIL_USE_ASAN
+    return_stack(stk);
+}
+
+void TaskGroup::promote_current_task() {
+    ContextualStack* stk = get_stack(STACK_TYPE_NORMAL, main_task_runner);
+    if (stk == nullptr) {
+        LOG_EVERY_SECOND(ERROR) << "Fail to get stack to promote bthread="
+                                << _cur_meta->tid << ", block the worker";
+        return;
+    }
+    // A pooled stack resumes where it was left, start it from the entry.
+    stk->context = bthread_make_fcontext(
+        stk->storage.bottom, stk->storage.stacksize, main_task_runner);
+    if (_main_stack == _pthread_stack) {
+        _cur_meta->pthread_stack_group = this;
+    }
+    // Current task keeps the old _main_stack (set as its stack already),
+    // frames of the main task below frames of the task are resumed after the
+    // task ends if it's the pthread stack, see return_to_pthread_stack(), or
+    // abandoned otherwise.
+    _main_stack = stk;
+    address_meta(_main_tid)->set_stack(stk);
+    _control->_nstackless_promoted << 1;
+}
+
+void TaskGroup::main_task_runner(intptr_t) {
+#ifdef BUTIL_USE_ASAN
+    internal::FinishSwitchFiber(nullptr);
+#endif // BUTIL_USE_ASAN
+    // Entered from sched_to() of the promoted task.
+    TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+#ifdef BRPC_BTHREAD_TRACER
+    TaskTracer::set_running_status(g->tid(), g->_cur_meta);
+#endif // BRPC_BTHREAD_TRACER
+    while (g->_last_context_remained) {
+        RemainedFn fn = g->_last_context_remained;
+        g->_last_context_remained = nullptr;
+        fn(g->_last_context_remained_arg);
+        g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    }
+#ifndef NDEBUG
+    --g->_sched_recursive_guard;
+#endif
+    g->run_promoted_main_task();
+    // Never returns.
+    LOG(FATAL) << "Promoted main task of group=" << g << " returned";
+}
+
+void TaskGroup::run_promoted_main_task() {
+    // Same as run_main_task(), except that the task quits the loop by
+    // jumping back to the pthread stack.
+    TaskGroup* dummy = this;
+    bthread_t tid;
+    while (!_pthread_stack_returned.load(butil::memory_order_acquire)) {
+        if (!wait_task(&tid)) {
+            // The worker is stopped, but quitting it must be done on the
+            // pthread stack. Keep running tasks in queues of this group
+            // without waiting for signals until the promoted task ends,
+            // other groups are not visible to stealing anymore.
+            tid = find_next_task();
+            if (tid == _main_tid) {
+                LOG_EVERY_SECOND(WARNING) << "Worker of group=" << this
+                                          << " is waiting for the promoted"
+                                          " bthread holding its pthread stack"
+                                          " to end";
+                ::usleep(1000);
+                continue;
+            }
+        }
+        sched_to(&dummy, tid);
+        DCHECK_EQ(this, dummy);
+        DCHECK_EQ(_cur_meta->stack, _main_stack);
+        if (_cur_meta->tid != _main_tid) {
+            task_runner(1/*skip remained*/);
+        }
+    }
+    return_to_pthread_stack();
+}
+
+void TaskGroup::return_to_pthread_stack() {
+    _pthread_stack_returned.store(false, butil::memory_order_relaxed);
+    ContextualStack* stk = _main_stack;
+    _main_stack = _pthread_stack;
+    address_meta(_main_tid)->set_stack(_pthread_stack);
+    set_remained(_release_promoted_main_stack, stk);
+#ifndef NDEBUG
+    // Decreased by sched_to() of the ended task which resumes.
+    ++_sched_recursive_guard;
+#endif
+    // Resume in sched_to() of the task which ended on the pthread stack,
+    // then go back to run_main_task() since current task is the main task.
+    BTHREAD_SCOPED_ASAN_FIBER_SWITCHER(_pthread_stack->storage);
+    jump_stack(stk, _pthread_stack);
+}
+
 int TaskGroup::start_foreground(TaskGroup** pg,
                                 bthread_t* __restrict th,
                                 const bthread_attr_t* __restrict attr,
@@ -594,6 +725,7 @@ int TaskGroup::start_foreground(TaskGroup** pg,
 
     TaskGroup* g = *pg;
     m->priority_index = g->_cur_meta->priority_index;
+    m->deadline_us = g->_cur_meta->deadline_us;
     m->attr.tag = g->tag();
     *th = m->tid;
     if (using_attr.flags & BTHREAD_LOG_START_AND_FINISH) {
@@ -605,6 +737,8 @@ int TaskGroup::start_foreground(TaskGroup** pg,
 #ifdef BRPC_BTHREAD_TRACER
     g->_control->_task_tracer.set_status(TASK_STATUS_CREATED, m);
 #endif // BRPC_BTHREAD_TRACER
+    // Current task is suspended to run the new task.
+    g->promote_stackless_task();
     if (g->is_current_pthread_task()) {
         // never create foreground task in pthread.
         g->ready_to_run(m, using_attr.flags & BTHREAD_NOSIGNAL);
@@ -620,7 +754,8 @@ int TaskGroup::start_foreground(TaskGroup** pg,
             fn = ready_to_run_in_worker;
         }
         ReadyToRunArgs args = {
-            g->tag(), g->_cur_meta, (bool)(using_attr.flags & BTHREAD_NOSIGNAL)
+            g->current_tag(), g->_cur_meta,
+            (bool)(using_attr.flags & BTHREAD_NOSIGNAL)
         };
         g->set_remained(fn, &args);
         sched_to(pg, m->tid);
@@ -628,21 +763,12 @@ int TaskGroup::start_foreground(TaskGroup** pg,
     return 0;
 }
 
-template <bool REMOTE>
-int TaskGroup::start_background(bthread_t* __restrict th,
-                                const bthread_attr_t* __restrict attr,
-                                void * (*fn)(void*),
-                                void* __restrict arg) {
-    if (__builtin_expect(!fn, 0)) {
-        return EINVAL;
-    }
-    const int64_t start_ns = butil::cpuwide_time_ns();
-    const bthread_attr_t using_attr = (attr ? *attr : BTHREAD_ATTR_NORMAL);
-    butil::ResourceId<TaskMeta> slot;
-    TaskMeta* m = butil::get_resource(&slot);
-    if (BAIDU_UNLIKELY(nullptr == m)) {
-        return ENOMEM;
-    }
+void TaskGroup::init_background_meta(TaskMeta* m,
+                                     butil::ResourceId<TaskMeta> slot,
+                                     const bthread_attr_t& using_attr,
+                                     void * (*fn)(void*),
+                                     void* arg,
+                                     int64_t start_ns) {
     CHECK(m->current_waiter.load(butil::memory_order_relaxed) == nullptr);
     m->sleep_failed = false;
     m->stop = false;
@@ -664,16 +790,42 @@ int TaskGroup::start_background(bthread_t* __restrict th,
     m->stat = EMPTY_STAT;
     m->tid = make_tid(*m->version_butex, slot);
     m->priority_index = _cur_meta->priority_index;
-    *th = m->tid;
+    // Inherit the deadline of the creating bthread, if there's one.
+    m->deadline_us = 0;
+    if (_control->deadline_scheduling()) {
+        TaskGroup* cur_g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+        if (cur_g != nullptr) {
+            m->deadline_us = cur_g->_cur_meta->deadline_us;
+        }
+    }
     if (using_attr.flags & BTHREAD_LOG_START_AND_FINISH) {
         LOG(INFO) << "Started bthread " << m->tid;
     }
     m->attr.tag = tag();
-    _control->_nbthreads << 1;
-    _control->tag_nbthreads(tag()) << 1;
 #ifdef BRPC_BTHREAD_TRACER
     _control->_task_tracer.set_status(TASK_STATUS_CREATED, m);
 #endif // BRPC_BTHREAD_TRACER
+}
+
+template <bool REMOTE>
+int TaskGroup::start_background(bthread_t* __restrict th,
+                                const bthread_attr_t* __restrict attr,
+                                void * (*fn)(void*),
+                                void* __restrict arg) {
+    if (__builtin_expect(!fn, 0)) {
+        return EINVAL;
+    }
+    const int64_t start_ns = butil::cpuwide_time_ns();
+    const bthread_attr_t using_attr = (attr ? *attr : BTHREAD_ATTR_NORMAL);
+    butil::ResourceId<TaskMeta> slot;
+    TaskMeta* m = butil::get_resource(&slot);
+    if (BAIDU_UNLIKELY(nullptr == m)) {
+        return ENOMEM;
+    }
+    init_background_meta(m, slot, using_attr, fn, arg, start_ns);
+    *th = m->tid;
+    _control->_nbthreads << 1;
+    _control->tag_nbthreads(tag()) << 1;
     if (REMOTE) {
         ready_to_run_remote(m, (using_attr.flags & BTHREAD_NOSIGNAL));
     } else {
@@ -682,6 +834,53 @@ int TaskGroup::start_background(bthread_t* __restrict th,
     return 0;
 }
 
+template <bool REMOTE>
+int TaskGroup::start_background_batch(bthread_t* __restrict tids,
+                                      const bthread_attr_t* __restrict attrs,
+                                      void * (**fns)(void*),
+                                      void** args,
+                                      size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        if (__builtin_expect(!fns[i], 0)) {
+            return EINVAL;
+        }
+    }
+    // Get all metas before initializing any of them, so that nothing needs
+    // to be undone on failure.
+    for (size_t i = 0; i < n; ++i) {
+        butil::ResourceId<TaskMeta> slot;
+        if (BAIDU_UNLIKELY(nullptr == butil::get_resource(&slot))) {
+            for (size_t j = 0; j < i; ++j) {
+                butil::ResourceId<TaskMeta> id = { tids[j] };
+                return_resource(id);
+            }
+            return ENOMEM;
+        }
+        tids[i] = slot.value;
+    }
+    const int64_t start_ns = butil::cpuwide_time_ns();
+    size_t nnosignal = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const bthread_attr_t using_attr = (attrs ? attrs[i] : BTHREAD_ATTR_NORMAL);
+        butil::ResourceId<TaskMeta> slot = { tids[i] };
+        TaskMeta* m = butil::address_resource(slot);
+        init_background_meta(m, slot, using_attr, fns[i],
+                             (args ? args[i] : nullptr), start_ns);
+        tids[i] = m->tid;
+        if (using_attr.flags & BTHREAD_NOSIGNAL) {
+            ++nnosignal;
+        }
+    }
+    _control->_nbthreads << (int64_t)n;
+    _control->tag_nbthreads(tag()) << (int64_t)n;
+    if (REMOTE) {
+        ready_to_run_remote_batch(tids, n, nnosignal);
+    } else {
+        ready_to_run_batch(tids, n, nnosignal);
+    }
+    return 0;
+}
+
 // Explicit instantiations.
 template int
 TaskGroup::start_background<true>(bthread_t* __restrict th,
@@ -693,6 +892,18 @@ TaskGroup::start_background<false>(bthread_t* __restrict th,
                                    const bthread_attr_t* __restrict attr,
                                    void * (*fn)(void*),
                                    void* __restrict arg);
+template int
+TaskGroup::start_background_batch<true>(bthread_t* __restrict tids,
+                                        const bthread_attr_t* __restrict attrs,
+                                        void * (**fns)(void*),
+                                        void** args,
+                                        size_t n);
+template int
+TaskGroup::start_background_batch<false>(bthread_t* __restrict tids,
+                                         const bthread_attr_t* __restrict attrs,
+                                         void * (**fns)(void*),
+                                         void** args,
+                                         size_t n);
 
 int TaskGroup::join(bthread_t tid, void** return_value) {
     if (__builtin_expect(!tid, 0)) {  // tid of bthread is never 0.
@@ -740,28 +951,89 @@ TaskStatistics TaskGroup::main_stat() const {
     return m ? m->stat : EMPTY_STAT;
 }
 
-void TaskGroup::ending_sched(TaskGroup** pg) {
-    TaskGroup* g = *pg;
+bthread_t TaskGroup::find_next_task() {
+    // The time of the last switch is recent enough, sched_to() reads the
+    // clock right after this function.
     bthread_t next_tid = 0;
-    // Find next task to run, if none, switch to idle thread of the group.
-
+    if (BAIDU_UNLIKELY(_control->share_tags()) &&
+        _control->steal_task_of_other_tags(
+            this, &next_tid, true, _cpu_time_stat.load_unsafe().last_run_ns())) {
+        // The tag of this group used more than its share, run a task of the
+        // tag owed cpu first.
+        return next_tid;
+    }
+    if (_control->deadline_scheduling() && pop_deadline_rq(&next_tid, false)) {
+        return next_tid;
+    }
 #ifndef BTHREAD_FAIR_WSQ
     // When BTHREAD_FAIR_WSQ is defined, profiling shows that cpu cost of
     // WSQ::steal() in example/multi_threaded_echo_c++ changes from 1.9%
     // to 2.9%
-    const bool popped = g->_rq.pop(&next_tid);
+    const bool popped = _rq.pop(&next_tid);
 #else
-    const bool popped = g->_rq.steal(&next_tid);
+    const bool popped = _rq.steal(&next_tid);
 #endif
-    if (!popped && !g->steal_task(&next_tid)) {
+    if (popped) {
+        _ndeadline_popped = 0;
+    } else if (!steal_task(&next_tid)) {
         // Jump to main task if there's no task to run.
-        next_tid = g->_main_tid;
+        next_tid = _main_tid;
     }
+    return next_tid;
+}
+
+// Max number of expired tasks moved into _rq in one pop_deadline_rq().
+static const int DEADLINE_MAX_DEMOTED = 64;
+
+bool TaskGroup::pop_deadline_rq(bthread_t* tid, bool force) {
+    if (!force && _ndeadline_popped >= FLAGS_bthread_deadline_max_consecutive) {
+        // Give tasks in runqueues a chance.
+        return false;
+    }
+    DeadlineQueue& dq = _control->deadline_queue(_tag);
+    int64_t now_us = 0;
+    int64_t deadline_us = 0;
+    for (int ndemoted = 0; dq.pop(tid, &deadline_us); ++ndemoted) {
+        if (now_us == 0) {
+            now_us = butil::gettimeofday_us();
+        }
+        if (deadline_us >= now_us || ndemoted >= DEADLINE_MAX_DEMOTED) {
+            ++_ndeadline_popped;
+            return true;
+        }
+        // Running the task first does not help meeting its deadline, which
+        // has passed. Queue it with tasks without deadlines instead of
+        // delaying the ones which can still make it.
+        address_meta(*tid)->deadline_us = 0;
+        if (!_rq.push(*tid)) {
+            // _rq is full, just run it.
+            ++_ndeadline_popped;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskGroup::ending_sched(TaskGroup** pg) {
+    TaskGroup* g = *pg;
+    // Find next task to run, if none, switch to idle thread of the group.
+    const bthread_t next_tid = g->find_next_task();
 
     TaskMeta* const cur_meta = g->_cur_meta;
     TaskMeta* next_meta = address_meta(next_tid);
     if (next_meta->stack == nullptr) {
-        if (next_meta->stack_type() == cur_meta->stack_type()) {
+        ContextualStack* const cur_stack = cur_meta->stack;
+        if (next_meta->stack_type() == STACK_TYPE_STACKLESS &&
+            cur_stack != nullptr && cur_meta->pthread_stack_group == nullptr &&
+            (cur_stack == g->_main_stack ||
+             cur_stack->stacktype == STACK_TYPE_NORMAL ||
+             cur_stack->stacktype == STACK_TYPE_LARGE)) {
+            // A stackless task borrows the stack of the current ending task
+            // unless the stack is smaller than a normal one or it's the
+            // pthread stack of another group.
+            next_meta->set_stack(cur_meta->release_stack());
+        } else if (next_meta->stack_type() == cur_meta->stack_type() &&
+                   next_meta->stack_type() != STACK_TYPE_STACKLESS) {
             // Reuse the stack of the current ending task.
             //
             // also works with pthread_task scheduling to pthread_task, the
@@ -791,18 +1063,8 @@ void TaskGroup::ending_sched(TaskGroup** pg) {
 
 void TaskGroup::sched(TaskGroup** pg) {
     TaskGroup* g = *pg;
-    bthread_t next_tid = 0;
     // Find next task to run, if none, switch to idle thread of the group.
-#ifndef BTHREAD_FAIR_WSQ
-    const bool popped = g->_rq.pop(&next_tid);
-#else
-    const bool popped = g->_rq.steal(&next_tid);
-#endif
-    if (!popped && !g->steal_task(&next_tid)) {
-        // Jump to main task if there's no task to run.
-        next_tid = g->_main_tid;
-    }
-    sched_to(pg, next_tid);
+    sched_to(pg, g->find_next_task());
 }
 
 extern void CheckBthreadScheSafety();
@@ -828,6 +1090,12 @@ void TaskGroup::sched_to(TaskGroup** pg, TaskMeta* next_meta) {
     cpu_time_stat.set_last_run_ns(now, is_main_task(g, next_meta->tid));
     cpu_time_stat.add_cumulated_cputime_ns(elp_ns, is_main_task(g, cur_meta->tid));
     g->_cpu_time_stat.store(cpu_time_stat);
+    if (g->_tagged_cputime_ns && !is_main_task(g, cur_meta->tid)) {
+        // Charged to the tag of the task rather than the one of the group.
+        butil::atomic<int64_t>& tag_ns = g->_tagged_cputime_ns[cur_meta->attr.tag];
+        tag_ns.store(tag_ns.load(butil::memory_order_relaxed) + elp_ns,
+                     butil::memory_order_relaxed);
+    }
 
     if (FLAGS_bthread_enable_cpu_clock_stat) {
         const int64_t cpu_thread_time = butil::cputhread_time_ns();
@@ -844,6 +1112,7 @@ void TaskGroup::sched_to(TaskGroup** pg, TaskMeta* next_meta) {
     // Switch to the task
     if (__builtin_expect(next_meta != cur_meta, 1)) {
         g->_cur_meta = next_meta;
+        g->_running_tid.store(next_meta->tid, butil::memory_order_relaxed);
         // Switch tls_bls
         cur_meta->local_storage = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_bls);
         BAIDU_SET_VOLATILE_THREAD_LOCAL(tls_bls, next_meta->local_storage);
@@ -919,7 +1188,20 @@ void TaskGroup::destroy_self() {
 }
 
 
+bool TaskGroup::ready_to_run_home(TaskMeta* meta) {
+    if (BAIDU_LIKELY(meta->attr.tag == _tag)) {
+        return false;
+    }
+    // Always signalled: NOSIGNAL tasks are flushed by groups of their tags
+    // only.
+    _control->choose_one_group(meta->attr.tag)->ready_to_run_remote(meta);
+    return true;
+}
+
 void TaskGroup::ready_to_run(TaskMeta* meta, bool nosignal) {
+    if (ready_to_run_home(meta)) {
+        return;
+    }
 #ifdef BRPC_BTHREAD_TRACER
     _control->_task_tracer.set_status(TASK_STATUS_READY, meta);
 #endif // BRPC_BTHREAD_TRACER
@@ -947,36 +1229,118 @@ void TaskGroup::ready_to_run_remote(TaskMeta* meta, bool nosignal) {
 #ifdef BRPC_BTHREAD_TRACER
     _control->_task_tracer.set_status(TASK_STATUS_READY, meta);
 #endif // BRPC_BTHREAD_TRACER
-    _remote_rq._mutex.lock();
-    while (!_remote_rq.push_locked(meta->tid)) {
-        flush_nosignal_tasks_remote_locked(_remote_rq._mutex);
+    while (!push_deadline_rq(meta->tid) && !_remote_rq.push(meta->tid)) {
+        flush_nosignal_tasks_remote();
         LOG_EVERY_SECOND(ERROR) << "_remote_rq is full, capacity="
                                 << _remote_rq.capacity();
         ::usleep(1000);
-        _remote_rq._mutex.lock();
     }
     if (nosignal) {
-        ++_remote_num_nosignal;
-        _remote_rq._mutex.unlock();
+        _remote_num_nosignal.fetch_add(1, butil::memory_order_relaxed);
     } else {
-        const int additional_signal = _remote_num_nosignal;
-        _remote_num_nosignal = 0;
-        _remote_nsignaled += 1 + additional_signal;
-        _remote_rq._mutex.unlock();
+        const int additional_signal =
+            _remote_num_nosignal.exchange(0, butil::memory_order_relaxed);
+        _remote_nsignaled.fetch_add(1 + additional_signal,
+                                    butil::memory_order_relaxed);
         _control->signal_task(1 + additional_signal, _tag);
     }
 }
 
-void TaskGroup::flush_nosignal_tasks_remote_locked(butil::Mutex& locked_mutex) {
-    const int val = _remote_num_nosignal;
-    if (!val) {
-        locked_mutex.unlock();
-        return;
+size_t TaskGroup::push_deadline_rq_batch(const bthread_t* tids, size_t n,
+                                         bthread_t* rest) {
+    DEFINE_SMALL_ARRAY(DeadlineQueue::Entry, entries, n, 64);
+    size_t nentry = 0;
+    size_t nrest = 0;
+    for (size_t i = 0; i < n; ++i) {
+        const int64_t deadline_us = address_meta(tids[i])->deadline_us;
+        if (deadline_us == 0) {
+            rest[nrest++] = tids[i];
+        } else {
+            entries[nentry].deadline_us = deadline_us;
+            entries[nentry].tid = tids[i];
+            ++nentry;
+        }
+    }
+    if (nentry != 0) {
+        _control->deadline_queue(_tag).push_batch(
+            entries, nentry, deadline_shard_hint());
+    }
+    return nrest;
+}
+
+void TaskGroup::push_rq_batch(const bthread_t* tids, size_t n) {
+    size_t pushed = _rq.push_batch(tids, n);
+    _num_nosignal += (int)pushed;
+    for (; pushed < n; ++pushed) {
+        push_rq(tids[pushed]);
+        ++_num_nosignal;
+    }
+}
+
+void TaskGroup::push_remote_rq_batch(const bthread_t* tids, size_t n) {
+    size_t pushed = 0;
+    while (pushed < n) {
+        const size_t k = _remote_rq.push_batch(tids + pushed, n - pushed);
+        _remote_num_nosignal.fetch_add((int)k, butil::memory_order_relaxed);
+        pushed += k;
+        if (k == 0) {
+            flush_nosignal_tasks_remote();
+            LOG_EVERY_SECOND(ERROR) << "_remote_rq is full, capacity="
+                                    << _remote_rq.capacity();
+            ::usleep(1000);
+        }
+    }
+}
+
+void TaskGroup::ready_to_run_batch(const bthread_t* tids, size_t n,
+                                   size_t nnosignal) {
+#ifdef BRPC_BTHREAD_TRACER
+    for (size_t i = 0; i < n; ++i) {
+        _control->_task_tracer.set_status(TASK_STATUS_READY, address_meta(tids[i]));
+    }
+#endif // BRPC_BTHREAD_TRACER
+    // Tasks are counted as nosignal ones until all of them are pushed, so
+    // that they're signalled by push_rq() when _rq is full.
+    if (_control->deadline_scheduling()) {
+        DEFINE_SMALL_ARRAY(bthread_t, rest, n, 64);
+        const size_t nrest = push_deadline_rq_batch(tids, n, rest);
+        _num_nosignal += (int)(n - nrest);
+        push_rq_batch(rest, nrest);
+    } else {
+        push_rq_batch(tids, n);
+    }
+    if (nnosignal < n) {
+        const int val = _num_nosignal;
+        _num_nosignal = 0;
+        _nsignaled += val;
+        _control->signal_task_batch(val, _tag);
+    }
+}
+
+void TaskGroup::ready_to_run_remote_batch(const bthread_t* tids, size_t n,
+                                          size_t nnosignal) {
+#ifdef BRPC_BTHREAD_TRACER
+    for (size_t i = 0; i < n; ++i) {
+        _control->_task_tracer.set_status(TASK_STATUS_READY, address_meta(tids[i]));
+    }
+#endif // BRPC_BTHREAD_TRACER
+    // Same as ready_to_run_batch().
+    if (_control->deadline_scheduling()) {
+        DEFINE_SMALL_ARRAY(bthread_t, rest, n, 64);
+        const size_t nrest = push_deadline_rq_batch(tids, n, rest);
+        _remote_num_nosignal.fetch_add((int)(n - nrest), butil::memory_order_relaxed);
+        push_remote_rq_batch(rest, nrest);
+    } else {
+        push_remote_rq_batch(tids, n);
+    }
+    if (nnosignal < n) {
+        const int val =
+            _remote_num_nosignal.exchange(0, butil::memory_order_relaxed);
+        if (val) {
+            _remote_nsignaled.fetch_add(val, butil::memory_order_relaxed);
+            _control->signal_task_batch(val, _tag);
+        }
     }
-    _remote_num_nosignal = 0;
-    _remote_nsignaled += val;
-    locked_mutex.unlock();
-    _control->signal_task(val, _tag);
 }
 
 void TaskGroup::ready_to_run_general(TaskMeta* meta, bool nosignal) {
@@ -1002,6 +1366,9 @@ void TaskGroup::ready_to_run_in_worker(void* args_in) {
 void TaskGroup::ready_to_run_in_worker_ignoresignal(void* args_in) {
     ReadyToRunArgs* args = static_cast<ReadyToRunArgs*>(args_in);
     TaskGroup* g = BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group);
+    if (g->ready_to_run_home(args->meta)) {
+        return;
+    }
 
 #ifdef BRPC_BTHREAD_TRACER
     g->_control->_task_tracer.set_status(TASK_STATUS_READY, args->meta);
@@ -1016,6 +1383,9 @@ void TaskGroup::priority_to_run(void* args_in) {
     g->_control->_task_tracer.set_status(TASK_STATUS_READY, args->meta);
 #endif // BRPC_BTHREAD_TRACER
     if (args->meta->priority_index < 0) {
+        if (g->ready_to_run_home(args->meta)) {
+            return;
+        }
         return g->push_rq(args->meta->tid);
     }
     g->control()->push_ed_priority_queue(
@@ -1036,7 +1406,7 @@ static void ready_to_run_from_timer_thread(void* arg) {
     CHECK(BAIDU_GET_VOLATILE_THREAD_LOCAL(tls_task_group) == nullptr);
     const SleepArgs* e = static_cast<const SleepArgs*>(arg);
     TaskGroup* g = e->group;
-    bthread_tag_t tag = g->tag();
+    bthread_tag_t tag = e->meta->attr.tag;
     g->control()->choose_one_group(tag)->ready_to_run_remote(e->meta);
 }
 
@@ -1200,7 +1570,7 @@ int TaskGroup::interrupt(bthread_t tid, TaskControl* c) {
 
 void TaskGroup::yield(TaskGroup** pg) {
     TaskGroup* g = *pg;
-    ReadyToRunArgs args = { g->tag(), g->_cur_meta, false };
+    ReadyToRunArgs args = { g->current_tag(), g->_cur_meta, false };
     g->set_remained(ready_to_run_in_worker, &args);
     sched(pg);
 }
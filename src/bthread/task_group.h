@@ -28,6 +28,7 @@
 #include "bthread/work_stealing_queue.h"           // WorkStealingQueue
 #include "bthread/remote_task_queue.h"             // RemoteTaskQueue
 #include "butil/resource_pool.h"                    // ResourceId
+#include "butil/third_party/murmurhash3/murmurhash3.h" // fmix64
 #include "bthread/parking_lot.h"
 #include "bthread/prime_offset.h"
 
@@ -106,6 +107,18 @@ public:
                          void * (*fn)(void*),
                          void* __restrict arg);
 
+    // Create `n' tasks `fns[i](args[i])' with attributes `attrs[i]' in this
+    // TaskGroup, put the identifiers into `tids'. All tasks are pushed into
+    // the runqueue in one pass and workers are signalled once.
+    // `attrs' and `args' can be nullptr.
+    // Return 0 on success, errno otherwise, in which case no task is created.
+    template <bool REMOTE>
+    int start_background_batch(bthread_t* __restrict tids,
+                               const bthread_attr_t* __restrict attrs,
+                               void * (**fns)(void*),
+                               void** args,
+                               size_t n);
+
     // Suspend caller and run next bthread in TaskGroup *pg.
     static void sched(TaskGroup** pg);
     static void ending_sched(TaskGroup** pg);
@@ -169,6 +182,9 @@ public:
     // Meta/Identifier of current task in this group.
     TaskMeta* current_task() const { return _cur_meta; }
     bthread_t current_tid() const { return _cur_meta->tid; }
+    // Same as current_tid(), but can be read from other threads.
+    bthread_t running_tid() const
+    { return _running_tid.load(butil::memory_order_relaxed); }
     // Uptime of current task in nanoseconds.
     int64_t current_uptime_ns() const
     { return butil::cpuwide_time_ns() - _cur_meta->cpuwide_start_ns; }
@@ -179,6 +195,17 @@ public:
     bool is_current_pthread_task() const
     { return _cur_meta->stack == _main_stack; }
 
+    // If current task is a stackless one running on the stack of the main
+    // task, hand the stack over to the task and move the main task to a new
+    // stack, so that the task can be suspended like an ordinary bthread.
+    // Called before blocking, yielding or switching to another task.
+    void promote_stackless_task() {
+        if (_cur_meta->stack == _main_stack &&
+            _cur_meta->stack_type() == STACK_TYPE_STACKLESS) {
+            promote_current_task();
+        }
+    }
+
     // Active time in nanoseconds spent by this TaskGroup.
     int64_t cumulated_cputime_ns() const;
 
@@ -189,9 +216,14 @@ public:
 
     // Push a bthread into the runqueue from another non-worker thread.
     void ready_to_run_remote(TaskMeta* meta, bool nosignal = false);
-    void flush_nosignal_tasks_remote_locked(butil::Mutex& locked_mutex);
     void flush_nosignal_tasks_remote();
 
+    // Push `n' bthreads into the runqueue, `nnosignal' of which are not
+    // signalled.
+    void ready_to_run_batch(const bthread_t* tids, size_t n, size_t nnosignal);
+    void ready_to_run_remote_batch(const bthread_t* tids, size_t n,
+                                   size_t nnosignal);
+
     // Automatically decide the caller is remote or local, and call
     // the corresponding function.
     void ready_to_run_general(TaskMeta* meta, bool nosignal = false);
@@ -221,6 +253,12 @@ public:
 
     bthread_tag_t tag() const { return _tag; }
 
+    // Tag of the current task, different from tag() if the task is borrowed
+    // from another tag, see FLAGS_bthread_tag_weights.
+    bthread_tag_t current_tag() const {
+        return is_current_main_task() ? _tag : _cur_meta->attr.tag;
+    }
+
     pthread_t tid() const { return _tid; }
 
     int64_t current_task_cpu_clock_ns() {
@@ -304,6 +342,13 @@ friend class TaskControl;
 
     int init(size_t runqueue_capacity);
 
+    // Initialize `m' got from `slot' as task `fn(arg)' of this group, which
+    // is created at `start_ns'. Shared by start_background*().
+    void init_background_meta(TaskMeta* m, butil::ResourceId<TaskMeta> slot,
+                              const bthread_attr_t& using_attr,
+                              void * (*fn)(void*), void* arg,
+                              int64_t start_ns);
+
     // You shall call destroy_selfm() instead of destructor because deletion
     // of groups are postponed to avoid race.
     ~TaskGroup();
@@ -313,8 +358,18 @@ friend class TaskControl;
 #endif // BUTIL_USE_ASAN
     static void task_runner(intptr_t skip_remained);
 
+    // Routines of the main task after a stackless task running on the stack
+    // of the main task is promoted, see promote_stackless_task().
+    void promote_current_task();
+    static void main_task_runner(intptr_t);
+    void run_promoted_main_task();
+    // Switch the main task back to the pthread stack after the promoted task
+    // holding it ends.
+    void return_to_pthread_stack();
+
     // Callbacks for set_remained()
     static void _release_last_context(void*);
+    static void _release_promoted_main_stack(void*);
     static void _add_sleep_event(void*);
     struct ReadyToRunArgs {
         bthread_tag_t tag;
@@ -330,6 +385,35 @@ friend class TaskControl;
     // loop calling this function should end.
     bool wait_task(bthread_t* tid);
 
+    // Find next task to run in sched() and ending_sched(), the main task if
+    // there's none.
+    bthread_t find_next_task();
+
+    // Queue `tid' into the deadline queue of the tag if it has a deadline and
+    // FLAGS_bthread_deadline_scheduling is on. Returns true on queued.
+    bool push_deadline_rq(bthread_t tid);
+
+    // Pop the task with the earliest deadline from the deadline queue of the
+    // tag. Tasks past their deadlines are moved into _rq as ones without
+    // deadlines. Returns false without popping if FLAGS_bthread_deadline_
+    // max_consecutive tasks were popped since the last one from runqueues,
+    // unless `force' is true.
+    bool pop_deadline_rq(bthread_t* tid, bool force);
+    // Queue tasks with deadlines in `tids' into the deadline queue of the tag
+    // with one locking, copy the others into `rest'. Returns number of tasks
+    // copied into `rest'. Called only when FLAGS_bthread_deadline_scheduling
+    // is on.
+    size_t push_deadline_rq_batch(const bthread_t* tids, size_t n,
+                                  bthread_t* rest);
+    // Shard of the deadline queue pushed by this group.
+    size_t deadline_shard_hint() const {
+        return butil::fmix64((uint64_t)(uintptr_t)this);
+    }
+    // Push `tids' into _rq, counted as nosignal tasks.
+    void push_rq_batch(const bthread_t* tids, size_t n);
+    // Push `tids' into _remote_rq, counted as nosignal tasks.
+    void push_remote_rq_batch(const bthread_t* tids, size_t n);
+
     bool steal_task(bthread_t* tid) {
         if (_remote_rq.pop(tid)) {
             return true;
@@ -337,9 +421,20 @@ friend class TaskControl;
 #ifndef BTHREAD_DONT_SAVE_PARKING_STATE
         _last_pl_state = _pl->get_state();
 #endif
-        return _control->steal_task(tid, &_steal_seed, _steal_offset);
+        if (_control->steal_task(tid, &_steal_seed, _steal_offset)) {
+            return true;
+        }
+        // Run tasks of other tags if workers are shared between tags.
+        return _control->share_tags() &&
+            _control->steal_task_of_other_tags(
+                this, tid, false, butil::cpuwide_time_ns());
     }
 
+    // Queue `meta' into a group of its tag and return true if the task was
+    // borrowed from another tag, so that runqueues of a group only contain
+    // tasks of its tag.
+    bool ready_to_run_home(TaskMeta* meta);
+
     void set_tag(bthread_tag_t tag) { _tag = tag; }
 
     void set_pl(ParkingLot* pl) { _pl = pl; }
@@ -349,6 +444,8 @@ friend class TaskControl;
     }
 
     TaskMeta* _cur_meta{nullptr};
+    // tid of _cur_meta, published for running_tid().
+    butil::atomic<bthread_t> _running_tid{0};
     
     // the control that this group belongs to
     TaskControl* _control{nullptr};
@@ -368,19 +465,35 @@ friend class TaskControl;
 #endif
     size_t _steal_seed{butil::fast_rand()};
     size_t _steal_offset{prime_offset(_steal_seed)};
+    // Tasks popped from the deadline queue since the last one from runqueues.
+    int _ndeadline_popped{0};
     ContextualStack* _main_stack{nullptr};
     bthread_t _main_tid{INVALID_BTHREAD};
+    // Stack of the worker pthread, which is not _main_stack when it's held by
+    // a promoted stackless task.
+    ContextualStack* _pthread_stack{nullptr};
+    // Set when the promoted task holding _pthread_stack ends.
+    butil::atomic<bool> _pthread_stack_returned{false};
     WorkStealingQueue<bthread_t> _rq;
     RemoteTaskQueue _remote_rq;
-    int _remote_num_nosignal{0};
-    int _remote_nsignaled{0};
+    // Modified by all non-worker pthreads pushing into _remote_rq.
+    butil::atomic<int> _remote_num_nosignal{0};
+    butil::atomic<int> _remote_nsignaled{0};
 
     int _sched_recursive_guard{0};
     // tag of this taskgroup
     bthread_tag_t _tag{BTHREAD_TAG_DEFAULT};
+    // NUMA node and last level cache of the cpu that the worker ran on when
+    // the group was added, set only when FLAGS_bthread_numa_aware is on.
+    int _numa_node{-1};
+    int _llc_id{-1};
 
     // Worker thread id.
     pthread_t _tid{};
+
+    // Running time of bthreads of each tag run by this group, written by
+    // the worker only. Allocated only when workers are shared between tags.
+    std::unique_ptr<butil::atomic<int64_t>[]> _tagged_cputime_ns;
 };
 
 }  // namespace bthread
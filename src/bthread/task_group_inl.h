@@ -48,10 +48,11 @@ inline TaskMeta* TaskGroup::address_meta(bthread_t tid) {
 
 inline void TaskGroup::exchange(TaskGroup** pg, TaskMeta* next_meta) {
     TaskGroup* g = *pg;
+    g->promote_stackless_task();
     if (g->is_current_pthread_task()) {
         return g->ready_to_run(next_meta);
     }
-    ReadyToRunArgs args = { g->tag(), g->_cur_meta, false };
+    ReadyToRunArgs args = { g->current_tag(), g->_cur_meta, false };
     g->set_remained((g->current_task()->about_to_quit
                      ? ready_to_run_in_worker_ignoresignal
                      : ready_to_run_in_worker),
@@ -61,6 +62,12 @@ inline void TaskGroup::exchange(TaskGroup** pg, TaskMeta* next_meta) {
 
 inline void TaskGroup::sched_to(TaskGroup** pg, bthread_t next_tid) {
     TaskMeta* next_meta = address_meta(next_tid);
+    if (next_meta->stack == nullptr &&
+        next_meta->stack_type() == STACK_TYPE_STACKLESS &&
+        (*pg)->is_current_main_task()) {
+        // Run the stackless task on the stack of the main task directly.
+        next_meta->set_stack((*pg)->_main_stack);
+    }
     if (next_meta->stack == nullptr) {
 #ifdef BUTIL_USE_ASAN
         ContextualStack* stk = get_stack(next_meta->stack_type(), asan_task_runner);
@@ -82,7 +89,22 @@ inline void TaskGroup::sched_to(TaskGroup** pg, bthread_t next_tid) {
     sched_to(pg, next_meta);
 }
 
+inline bool TaskGroup::push_deadline_rq(bthread_t tid) {
+    if (!_control->deadline_scheduling()) {
+        return false;
+    }
+    const int64_t deadline_us = address_meta(tid)->deadline_us;
+    if (deadline_us == 0) {
+        return false;
+    }
+    _control->deadline_queue(_tag).push(tid, deadline_us, deadline_shard_hint());
+    return true;
+}
+
 inline void TaskGroup::push_rq(bthread_t tid) {
+    if (push_deadline_rq(tid)) {
+        return;
+    }
     while (!_rq.push(tid)) {
         // Created too many bthreads: a promising approach is to insert the
         // task into another TaskGroup, but we don't use it because:
@@ -102,9 +124,13 @@ inline void TaskGroup::push_rq(bthread_t tid) {
 }
 
 inline void TaskGroup::flush_nosignal_tasks_remote() {
-    if (_remote_num_nosignal) {
-        _remote_rq._mutex.lock();
-        flush_nosignal_tasks_remote_locked(_remote_rq._mutex);
+    if (_remote_num_nosignal.load(butil::memory_order_relaxed) == 0) {
+        return;
+    }
+    const int val = _remote_num_nosignal.exchange(0, butil::memory_order_relaxed);
+    if (val) {
+        _remote_nsignaled.fetch_add(val, butil::memory_order_relaxed);
+        _control->signal_task(val, _tag);
     }
 }
 
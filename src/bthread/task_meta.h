@@ -40,6 +40,7 @@ struct TaskStatistics {
 
 class KeyTable;
 struct ButexWaiter;
+class TaskGroup;
 
 struct LocalStorage {
     KeyTable* keytable;
@@ -97,6 +98,12 @@ struct TaskMeta {
 
     int priority_index{-1};
 
+    // Absolute deadline in microseconds since epoch (as
+    // butil::gettimeofday_us()), 0 means no deadline. Set by
+    // bthread_set_deadline() and inherited by bthreads created by this one,
+    // see -bthread_deadline_scheduling.
+    int64_t deadline_us{0};
+
     // User function and argument
     void* (*fn)(void*){nullptr};
     void* arg{nullptr};
@@ -104,6 +111,10 @@ struct TaskMeta {
     // Stack of this task.
     ContextualStack* stack{nullptr};
 
+    // [Not Reset] The group whose pthread stack is held by this promoted
+    // stackless task, which is given back to the group when the task ends.
+    TaskGroup* pthread_stack_group{nullptr};
+
     // Attributes creating this task
     bthread_attr_t attr{BTHREAD_ATTR_NORMAL};
     
@@ -18,6 +18,7 @@
 // bthread - An M:N threading library to make applications more concurrent.
 
 
+#include <string.h>                        // memset
 #include <queue>                           // heap functions
 #include <gflags/gflags.h>
 #include "butil/scoped_lock.h"
@@ -59,13 +60,21 @@ DEFINE_uint32(brpc_timer_max_wakeup_interval_ms, 0,
               "to reclaim unscheduled tasks even when all pending tasks are far "
               "in the future; 0 means no periodic wakeup");
 
+DEFINE_uint32(brpc_timer_wheel_shards, 0,
+              "Run the global timer with hierarchical timing wheels sharded "
+              "into so many threads; 0 means using the min-heap");
+DEFINE_int64(brpc_timer_wheel_tick_us, 1000,
+             "Resolution of the timing wheels of the global timer");
+
 // Defined in task_control.cpp
 void run_worker_startfn();
 
 const TimerThread::TaskId TimerThread::INVALID_TASK_ID = 0;
 
 TimerThreadOptions::TimerThreadOptions()
-    : num_buckets(13) {
+    : num_buckets(13)
+    , num_wheel_shards(0)
+    , wheel_tick_us(1000) {
 }
 
 // A task contains the necessary information for running fn(arg).
@@ -125,6 +134,100 @@ private:
     Task* _task_head;
 };
 
+// Timer tasks are put into hierarchical timing wheels (similar to the
+// classic timers of linux kernel) when options.num_wheel_shards is positive.
+// The root wheel has 256 slots of one tick each, every upper wheel has 64
+// slots each of which covers a whole lower wheel. A task is put into the
+// lowest wheel covering its expiration and moved down (cascaded) whenever
+// the lower wheel wraps around, so that adding a task is O(1) and the thread
+// only touches the slots that expire. Unscheduled tasks stay in the slots
+// and are deleted when they're cascaded, expired or swept.
+static const int WHEEL_ROOT_BITS = 8;
+static const int WHEEL_LEVEL_BITS = 6;
+static const int WHEEL_NUPPER = 4;
+static const int64_t WHEEL_ROOT_SIZE = 1 << WHEEL_ROOT_BITS;
+static const int64_t WHEEL_ROOT_MASK = WHEEL_ROOT_SIZE - 1;
+static const int64_t WHEEL_LEVEL_SIZE = 1 << WHEEL_LEVEL_BITS;
+static const int64_t WHEEL_LEVEL_MASK = WHEEL_LEVEL_SIZE - 1;
+// Tasks farther than this are put into the last wheel and re-inserted when
+// the slot expires.
+static const int64_t WHEEL_MAX_TICKS =
+    (1LL << (WHEEL_ROOT_BITS + WHEEL_NUPPER * WHEEL_LEVEL_BITS)) - 1;
+
+// A shard of timing wheels with its own thread. Tasks scheduled by other
+// threads are pushed into an inbox which is moved into the wheels by the
+// thread of the shard.
+class BAIDU_CACHELINE_ALIGNMENT TimerThread::WheelShard {
+public:
+    WheelShard();
+
+    int start(TimerThread* owner, int64_t tick_us);
+    void stop_and_join();
+
+    TaskId schedule(void (*fn)(void*), void* arg, const timespec& abstime);
+
+    pthread_t thread_id() const { return _thread; }
+
+    // Stats written by the shard thread only.
+    size_t nscheduled;
+    size_t ntriggered;
+    double busy_seconds;
+
+private:
+    static void* run_this(void* arg);
+    void run();
+
+    // Put `task' into the slot covering its expiration.
+    void add_task(Task* task);
+    // Move tasks in slot `index' of upper wheel `level' into lower wheels.
+    void cascade(int level, int64_t index);
+    // Delete unscheduled tasks in `*slot'.
+    void sweep(Task** slot);
+    // Run tasks expired before `now_tick'.
+    void run_ticks(int64_t now_tick);
+    // The tick at which the thread must wake up to run tasks or cascade.
+    int64_t next_wakeup_tick() const;
+
+    // Accessed by schedule() in different threads.
+    FastPthreadMutex _mutex;
+    Task* _task_head;
+    int64_t _nearest_run_time;
+    int _nsignals;
+
+    // Accessed by the shard thread.
+    BAIDU_CACHELINE_ALIGNMENT TimerThread* _owner;
+    pthread_t _thread;
+    int64_t _tick_us;
+    int64_t _base;            // the next tick to run
+    int64_t _ntasks;          // number of tasks in the wheels
+    int64_t _npublished;      // _ntasks added to _owner->_npending
+    int64_t _sweep_cursor;    // the next upper slot to sweep
+    Task* _root[WHEEL_ROOT_SIZE];
+    Task* _upper[WHEEL_NUPPER][WHEEL_LEVEL_SIZE];
+};
+
+// Sum of stats of all shards.
+struct TimerThread::WheelVars {
+    explicit WheelVars(TimerThread* timer);
+
+    template <typename T, T WheelShard::*field>
+    static T sum_shards(void* arg) {
+        const TimerThread* timer = static_cast<TimerThread*>(arg);
+        T sum = T();
+        for (size_t i = 0; i < timer->_options.num_wheel_shards; ++i) {
+            sum += timer->_shards[i].*field;
+        }
+        return sum;
+    }
+
+    bvar::PassiveStatus<size_t> nscheduled_var;
+    bvar::PerSecond<bvar::PassiveStatus<size_t> > nscheduled_second;
+    bvar::PassiveStatus<size_t> ntriggered_var;
+    bvar::PerSecond<bvar::PassiveStatus<size_t> > ntriggered_second;
+    bvar::PassiveStatus<double> busy_seconds_var;
+    bvar::PerSecond<bvar::PassiveStatus<double> > busy_seconds_second;
+};
+
 // Utilies for making and extracting TaskId.
 inline TimerThread::TaskId make_task_id(
     butil::ResourceId<TimerThread::Task> slot, uint32_t version) {
@@ -158,13 +261,19 @@ TimerThread::TimerThread()
     , _nearest_run_time(std::numeric_limits<int64_t>::max())
     , _nsignals(0)
     , _npending(0)
-    , _thread(0) {
+    , _thread(0)
+    , _shards(nullptr)
+    , _wheel_vars(nullptr) {
 }
 
 TimerThread::~TimerThread() {
     stop_and_join();
     delete [] _buckets;
     _buckets = nullptr;
+    delete _wheel_vars;
+    _wheel_vars = nullptr;
+    delete [] _shards;
+    _shards = nullptr;
 }
 
 int TimerThread::start(const TimerThreadOptions* options_in) {
@@ -174,6 +283,9 @@ int TimerThread::start(const TimerThreadOptions* options_in) {
     if (options_in) {
         _options = *options_in;
     }
+    if (_options.num_wheel_shards > 0) {
+        return start_wheels();
+    }
     if (_options.num_buckets == 0) {
         LOG(ERROR) << "num_buckets can't be 0";
         return EINVAL;
@@ -191,6 +303,36 @@ int TimerThread::start(const TimerThreadOptions* options_in) {
     return 0;
 }
 
+int TimerThread::start_wheels() {
+    if (_options.num_wheel_shards > 1024) {
+        LOG(ERROR) << "num_wheel_shards=" << _options.num_wheel_shards
+                   << " is too big";
+        return EINVAL;
+    }
+    if (_options.wheel_tick_us <= 0) {
+        LOG(ERROR) << "wheel_tick_us=" << _options.wheel_tick_us
+                   << " must be positive";
+        return EINVAL;
+    }
+    _shards = new WheelShard[_options.num_wheel_shards];
+    for (size_t i = 0; i < _options.num_wheel_shards; ++i) {
+        const int ret = _shards[i].start(this, _options.wheel_tick_us);
+        if (ret) {
+            _stop.store(true, butil::memory_order_relaxed);
+            for (size_t j = 0; j < i; ++j) {
+                _shards[j].stop_and_join();
+            }
+            return ret;
+        }
+    }
+    if (!_options.bvar_prefix.empty()) {
+        _wheel_vars = new WheelVars(this);
+    }
+    _thread = _shards[0].thread_id();
+    _started = true;
+    return 0;
+}
+
 TimerThread::Task* TimerThread::Bucket::consume_tasks() {
     Task* head = nullptr;
     if (_task_head) { // NOTE: schedule() and consume_tasks() are sequenced
@@ -207,14 +349,13 @@ TimerThread::Task* TimerThread::Bucket::consume_tasks() {
     return head;
 }
 
-TimerThread::Bucket::ScheduleResult
-TimerThread::Bucket::schedule(void (*fn)(void*), void* arg,
-                              const timespec& abstime) {
-    butil::ResourceId<Task> slot_id;
-    Task* task = butil::get_resource<Task>(&slot_id);
+// Get a Task from the pool and fill it. Returns nullptr on error.
+static TimerThread::Task* new_task(void (*fn)(void*), void* arg,
+                                   const timespec& abstime) {
+    butil::ResourceId<TimerThread::Task> slot_id;
+    TimerThread::Task* task = butil::get_resource<TimerThread::Task>(&slot_id);
     if (task == nullptr) {
-        ScheduleResult result = { INVALID_TASK_ID, false };
-        return result;
+        return nullptr;
     }
     task->next = nullptr;
     task->fn = fn;
@@ -225,8 +366,19 @@ TimerThread::Bucket::schedule(void (*fn)(void*), void* arg,
         task->version.fetch_add(2, butil::memory_order_relaxed);
         version = 2;
     }
-    const TaskId id = make_task_id(slot_id, version);
-    task->task_id = id;
+    task->task_id = make_task_id(slot_id, version);
+    return task;
+}
+
+TimerThread::Bucket::ScheduleResult
+TimerThread::Bucket::schedule(void (*fn)(void*), void* arg,
+                              const timespec& abstime) {
+    Task* task = new_task(fn, arg, abstime);
+    if (task == nullptr) {
+        ScheduleResult result = { INVALID_TASK_ID, false };
+        return result;
+    }
+    const TaskId id = task->task_id;
     bool earlier = false;
     {
         BAIDU_SCOPED_LOCK(_mutex);
@@ -247,6 +399,10 @@ TimerThread::TaskId TimerThread::schedule(
         // Not add tasks when TimerThread is about to stop.
         return INVALID_TASK_ID;
     }
+    if (_shards) {
+        return _shards[butil::fmix64(pthread_numeric_id()) %
+                       _options.num_wheel_shards].schedule(fn, arg, abstime);
+    }
     // Hashing by pthread id is better for cache locality.
     const Bucket::ScheduleResult result = 
         _buckets[butil::fmix64(pthread_numeric_id()) % _options.num_buckets]
@@ -513,11 +669,273 @@ void TimerThread::run() {
     BT_VLOG << "Ended TimerThread=" << pthread_self();
 }
 
+TimerThread::WheelVars::WheelVars(TimerThread* timer)
+    : nscheduled_var(sum_shards<size_t, &WheelShard::nscheduled>, timer)
+    , nscheduled_second(&nscheduled_var)
+    , ntriggered_var(sum_shards<size_t, &WheelShard::ntriggered>, timer)
+    , ntriggered_second(&ntriggered_var)
+    , busy_seconds_var(sum_shards<double, &WheelShard::busy_seconds>, timer)
+    , busy_seconds_second(&busy_seconds_var) {
+    const std::string& prefix = timer->_options.bvar_prefix;
+    nscheduled_second.expose_as(prefix, "scheduled_second");
+    ntriggered_second.expose_as(prefix, "triggered_second");
+    busy_seconds_second.expose_as(prefix, "usage");
+}
+
+TimerThread::WheelShard::WheelShard()
+    : nscheduled(0)
+    , ntriggered(0)
+    , busy_seconds(0)
+    , _task_head(nullptr)
+    , _nearest_run_time(std::numeric_limits<int64_t>::max())
+    , _nsignals(0)
+    , _owner(nullptr)
+    , _thread(0)
+    , _tick_us(1000)
+    , _base(0)
+    , _ntasks(0)
+    , _npublished(0)
+    , _sweep_cursor(0) {
+    memset(_root, 0, sizeof(_root));
+    memset(_upper, 0, sizeof(_upper));
+}
+
+int TimerThread::WheelShard::start(TimerThread* owner, int64_t tick_us) {
+    _owner = owner;
+    _tick_us = tick_us;
+    _base = butil::gettimeofday_us() / _tick_us;
+    return pthread_create(&_thread, nullptr, WheelShard::run_this, this);
+}
+
+void TimerThread::WheelShard::stop_and_join() {
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        _nearest_run_time = 0;
+        ++_nsignals;
+    }
+    if (pthread_self() != _thread) {
+        futex_wake_private(&_nsignals, 1);
+        pthread_join(_thread, nullptr);
+    }
+}
+
+TimerThread::TaskId TimerThread::WheelShard::schedule(
+    void (*fn)(void*), void* arg, const timespec& abstime) {
+    Task* task = new_task(fn, arg, abstime);
+    if (task == nullptr) {
+        return INVALID_TASK_ID;
+    }
+    const TaskId id = task->task_id;
+    bool earlier = false;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        task->next = _task_head;
+        _task_head = task;
+        if (task->run_time < _nearest_run_time) {
+            _nearest_run_time = task->run_time;
+            ++_nsignals;
+            earlier = true;
+        }
+    }
+    if (earlier) {
+        futex_wake_private(&_nsignals, 1);
+    }
+    return id;
+}
+
+void* TimerThread::WheelShard::run_this(void* arg) {
+    butil::PlatformThread::SetNameSimple("brpc_timer");
+    static_cast<WheelShard*>(arg)->run();
+    return nullptr;
+}
+
+void TimerThread::WheelShard::add_task(Task* task) {
+    // Round up so that tasks never run earlier than run_time.
+    int64_t expires = task->run_time / _tick_us +
+        (task->run_time % _tick_us != 0);
+    int64_t delta = expires - _base;
+    Task** slot = nullptr;
+    if (delta < WHEEL_ROOT_SIZE) {
+        // Expired tasks are put into the slot to run right now.
+        slot = &_root[(delta < 0 ? _base : expires) & WHEEL_ROOT_MASK];
+    } else {
+        if (delta > WHEEL_MAX_TICKS) {
+            delta = WHEEL_MAX_TICKS;
+            expires = _base + delta;
+        }
+        int level = 0;
+        while (delta >> (WHEEL_ROOT_BITS + (level + 1) * WHEEL_LEVEL_BITS)) {
+            ++level;
+        }
+        slot = &_upper[level][(expires >> (WHEEL_ROOT_BITS +
+                                           level * WHEEL_LEVEL_BITS))
+                              & WHEEL_LEVEL_MASK];
+    }
+    task->next = *slot;
+    *slot = task;
+    ++_ntasks;
+}
+
+void TimerThread::WheelShard::cascade(int level, int64_t index) {
+    Task* p = _upper[level][index];
+    _upper[level][index] = nullptr;
+    while (p != nullptr) {
+        Task* next_task = p->next;
+        --_ntasks;
+        if (!p->try_delete()) {
+            add_task(p);
+        }
+        p = next_task;
+    }
+}
+
+void TimerThread::WheelShard::sweep(Task** slot) {
+    Task** pp = slot;
+    while (*pp != nullptr) {
+        Task* p = *pp;
+        Task* next_task = p->next;
+        if (p->try_delete()) {
+            *pp = next_task;
+            --_ntasks;
+        } else {
+            pp = &p->next;
+        }
+    }
+}
+
+void TimerThread::WheelShard::run_ticks(int64_t now_tick) {
+    while (_base <= now_tick) {
+        if (_ntasks == 0) {
+            // Nothing to run, skip the idle ticks.
+            _base = now_tick + 1;
+            break;
+        }
+        const int64_t index = _base & WHEEL_ROOT_MASK;
+        if (index == 0) {
+            for (int level = 0; level < WHEEL_NUPPER; ++level) {
+                const int64_t i = (_base >> (WHEEL_ROOT_BITS +
+                                             level * WHEEL_LEVEL_BITS))
+                    & WHEEL_LEVEL_MASK;
+                cascade(level, i);
+                if (i != 0) {
+                    break;
+                }
+            }
+        }
+        // Sweep one upper slot per tick so that unscheduled tasks in upper
+        // wheels are deleted within 256 ticks rather than their run_time.
+        sweep(&_upper[0][0] + _sweep_cursor);
+        _sweep_cursor = (_sweep_cursor + 1) % (WHEEL_NUPPER * WHEEL_LEVEL_SIZE);
+
+        Task* p = _root[index];
+        _root[index] = nullptr;
+        ++_base;
+        while (p != nullptr) {
+            Task* next_task = p->next;
+            --_ntasks;
+            if (p->run_and_delete()) {
+                ++ntriggered;
+            }
+            p = next_task;
+        }
+    }
+}
+
+int64_t TimerThread::WheelShard::next_wakeup_tick() const {
+    if (_ntasks == 0) {
+        return std::numeric_limits<int64_t>::max();
+    }
+    const int64_t start = _base & WHEEL_ROOT_MASK;
+    if (start == 0) {
+        // Upper wheels are cascaded at this tick.
+        return _base;
+    }
+    for (int64_t i = start; i < WHEEL_ROOT_SIZE; ++i) {
+        if (_root[i] != nullptr) {
+            return _base + i - start;
+        }
+    }
+    return _base + WHEEL_ROOT_SIZE - start;
+}
+
+void TimerThread::WheelShard::run() {
+    run_worker_startfn();
+#ifdef BAIDU_INTERNAL
+    logging::ComlogInitializer comlog_initializer;
+#endif
+
+    int64_t last_sleep_time = butil::gettimeofday_us();
+    BT_VLOG << "Started TimerThread shard=" << pthread_self();
+
+    while (!_owner->_stop.load(butil::memory_order_relaxed)) {
+        // Same as TimerThread::run(), clear _nearest_run_time before
+        // consuming the inbox to be aware of earlier tasks scheduled later.
+        Task* head = nullptr;
+        {
+            BAIDU_SCOPED_LOCK(_mutex);
+            if (BAIDU_UNLIKELY(_owner->_stop.load(butil::memory_order_relaxed))) {
+                break;
+            }
+            _nearest_run_time = std::numeric_limits<int64_t>::max();
+            head = _task_head;
+            _task_head = nullptr;
+        }
+        for (Task* p = head; p != nullptr; ++nscheduled) {
+            Task* next_task = p->next;
+            if (!p->try_delete()) {
+                add_task(p);
+            }
+            p = next_task;
+        }
+
+        run_ticks(butil::gettimeofday_us() / _tick_us);
+        if (_ntasks != _npublished) {
+            _owner->_npending.fetch_add(_ntasks - _npublished,
+                                        butil::memory_order_relaxed);
+            _npublished = _ntasks;
+        }
+
+        const int64_t next_tick = next_wakeup_tick();
+        int64_t next_run_time = std::numeric_limits<int64_t>::max();
+        if (next_tick != std::numeric_limits<int64_t>::max()) {
+            next_run_time = next_tick * _tick_us;
+        }
+        int expected_nsignals = 0;
+        {
+            BAIDU_SCOPED_LOCK(_mutex);
+            if (next_run_time > _nearest_run_time) {
+                // a task earlier than what we would wait for was scheduled.
+                continue;
+            }
+            _nearest_run_time = next_run_time;
+            expected_nsignals = _nsignals;
+        }
+        timespec* ptimeout = nullptr;
+        timespec next_timeout = { 0, 0 };
+        const int64_t now = butil::gettimeofday_us();
+        if (next_run_time != std::numeric_limits<int64_t>::max()) {
+            if (next_run_time <= now) {
+                continue;
+            }
+            next_timeout = butil::microseconds_to_timespec(next_run_time - now);
+            ptimeout = &next_timeout;
+        }
+        busy_seconds += (now - last_sleep_time) / 1000000.0;
+        futex_wait_private(&_nsignals, expected_nsignals, ptimeout);
+        last_sleep_time = butil::gettimeofday_us();
+    }
+    BT_VLOG << "Ended TimerThread shard=" << pthread_self();
+}
+
 void TimerThread::stop_and_join() {
     if (_stop.exchange(true, butil::memory_order_relaxed)) {
         return;
     }
-    if (_started) {
+    if (_started && _shards) {
+        for (size_t i = 0; i < _options.num_wheel_shards; ++i) {
+            _shards[i].stop_and_join();
+        }
+    } else if (_started) {
         {
             BAIDU_SCOPED_LOCK(_mutex);
              // trigger pull_again and wakeup TimerThread
@@ -540,6 +958,8 @@ static void init_global_timer_thread() {
     TimerThreadOptions options;
     options.bvar_prefix = "bthread_timer";
     options.num_buckets = FLAGS_brpc_timer_num_buckets;
+    options.num_wheel_shards = FLAGS_brpc_timer_wheel_shards;
+    options.wheel_tick_us = FLAGS_brpc_timer_wheel_tick_us;
     const int rc = g_timer_thread->start(&options);
     if (rc != 0) {
         LOG(FATAL) << "Fail to start timer_thread, " << berror(rc);
@@ -43,6 +43,19 @@ struct TimerThreadOptions {
     // Default: ""
     std::string bvar_prefix;
 
+    // If this field is positive, tasks are kept in hierarchical timing wheels
+    // instead of the min-heap. The wheels are sharded into so many shards,
+    // each of which has its own mutex and thread to run tasks. schedule() and
+    // unschedule() are O(1) and don't contend on a global mutex, while tasks
+    // run at a resolution of `wheel_tick_us'. num_buckets is not used then.
+    // Default: 0 (the min-heap)
+    size_t num_wheel_shards;
+
+    // Length of a slot of the timing wheels in microseconds. Tasks run at most
+    // one tick (plus scheduling latency) later than their abstime.
+    // Default: 1000
+    int64_t wheel_tick_us;
+
     // Constructed with default options.
     TimerThreadOptions();
 };
@@ -54,6 +67,8 @@ class TimerThread {
 public:
     struct Task;
     class Bucket;
+    class WheelShard;
+    struct WheelVars;
 
     typedef uint64_t TaskId;
     const static TaskId INVALID_TASK_ID;
@@ -81,7 +96,8 @@ public:
     //   1   -  The task is just running.
     int unschedule(TaskId task_id);
 
-    // Get identifier of internal pthread.
+    // Get identifier of internal pthread. If timing wheels are used, this is
+    // the thread of the first shard.
     // Returns (pthread_t)0 if start() is not called yet.
     pthread_t thread_id() const { return _thread; }
 
@@ -89,6 +105,7 @@ private:
     // the timer thread will run this method.
     void run();
     static void* run_this(void* arg);
+    int start_wheels();
 
     bool _started;            // whether the timer thread was started successfully.
     butil::atomic<bool> _stop;
@@ -100,11 +117,15 @@ private:
     // the futex for wake up timer thread. can't use _nearest_run_time because
     // it's 64-bit.
     int _nsignals;
-    // Number of tasks buffered in the internal min-heap, published by the
-    // timer thread each iteration. Not part of the public API; read by unit
-    // tests through the -fno-access-control build flag.
+    // Number of tasks buffered in the internal min-heap (or the timing
+    // wheels of all shards), published by the timer thread each iteration.
+    // Not part of the public API; read by unit tests through the
+    // -fno-access-control build flag.
     butil::atomic<int64_t> _npending;
     pthread_t _thread;       // all scheduled task will be run on this thread
+    // Non-null when options.num_wheel_shards is positive.
+    WheelShard* _shards;
+    WheelVars* _wheel_vars;
 };
 
 // Get the global TimerThread which never quits.
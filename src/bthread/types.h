@@ -46,6 +46,7 @@ static const bthread_stacktype_t BTHREAD_STACKTYPE_PTHREAD = 1;
 static const bthread_stacktype_t BTHREAD_STACKTYPE_SMALL = 2;
 static const bthread_stacktype_t BTHREAD_STACKTYPE_NORMAL = 3;
 static const bthread_stacktype_t BTHREAD_STACKTYPE_LARGE = 4;
+static const bthread_stacktype_t BTHREAD_STACKTYPE_STACKLESS = 5;
 
 typedef unsigned bthread_attrflags_t;
 static const bthread_attrflags_t BTHREAD_LOG_START_AND_FINISH = 8;
@@ -133,6 +134,20 @@ void bthread_attr_set_name(bthread_attr_t* attr, const char* name);
 static const bthread_attr_t BTHREAD_ATTR_PTHREAD =
 { BTHREAD_STACKTYPE_PTHREAD, 0, nullptr, BTHREAD_TAG_INVALID, {0} };
 
+// bthreads started with this attribute do not have stacks of their own. They
+// run on the stack that the worker already holds when they're scheduled: the
+// stack of the worker pthread if the worker was idle, or the stack of the
+// bthread that just ended. Neither a stack is allocated nor a context is
+// switched for such bthreads if they do not block, which suits short tasks
+// that seldom block. If one blocks on a butex (bthread_join, bthread::Mutex,
+// bthread_usleep, bthread_fd_wait...) while running on the worker's stack,
+// the stack is handed over to the bthread and the worker goes on with a new
+// stack, namely the bthread is promoted to an ordinary one with a normal-sized
+// stack. Stackless bthreads must not assume size of the stack they run on to
+// be larger than BTHREAD_ATTR_NORMAL.
+static const bthread_attr_t BTHREAD_ATTR_STACKLESS =
+{ BTHREAD_STACKTYPE_STACKLESS, 0, nullptr, BTHREAD_TAG_INVALID, {0} };
+
 // bthreads created with following attributes will have different size of
 // stacks. Default is BTHREAD_ATTR_NORMAL.
 static const bthread_attr_t BTHREAD_ATTR_SMALL = {BTHREAD_STACKTYPE_SMALL, 0, nullptr,
@@ -22,6 +22,7 @@
 #ifndef BTHREAD_WORK_STEALING_QUEUE_H
 #define BTHREAD_WORK_STEALING_QUEUE_H
 
+#include <algorithm>
 #include "butil/macros.h"
 #include "butil/atomicops.h"
 #include "butil/logging.h"
@@ -77,6 +78,25 @@ public:
         return true;
     }
 
+    // Push at most `n' items into the queue in one pass, stop when the queue
+    // is full.
+    // Returns number of items pushed.
+    // Same concurrency requirements as push().
+    size_t push_batch(const T* items, size_t n) {
+        const size_t b = _bottom.load(butil::memory_order_relaxed);
+        const size_t t = _top.load(butil::memory_order_acquire);
+        const size_t room = t + _capacity - b;
+        if (n > room) {
+            n = room;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            _buffer[(b + i) & (_capacity - 1)] = items[i];
+        }
+        // Stealers see all items after this release.
+        _bottom.store(b + n, butil::memory_order_release);
+        return n;
+    }
+
     // Pop an item from the queue.
     // Returns true on popped and the item is written to `val'.
     // May run in parallel with steal().
@@ -131,6 +151,39 @@ public:
         return true;
     }
 
+    // Steal at most `max' items, and no more than half of the queue (rounded
+    // up), in one pass. Stolen items are written to `out' in FIFO order.
+    // Returns number of items stolen.
+    // Every item is still claimed by a CAS on _top as in steal(): pop() takes
+    // the bottom item without CAS unless it's the last one, claiming a range
+    // of items with one CAS may race with consecutive pop()s.
+    // May run in parallel with push() pop() or another steal().
+    size_t steal_batch(T* out, size_t max) {
+        size_t t = _top.load(butil::memory_order_acquire);
+        size_t b = _bottom.load(butil::memory_order_acquire);
+        if (t >= b || max == 0) {
+            return 0;
+        }
+        const size_t n = std::min((b - t + 1) / 2, max);
+        size_t nstolen = 0;
+        while (nstolen < n) {
+            butil::atomic_thread_fence(butil::memory_order_seq_cst);
+            b = _bottom.load(butil::memory_order_acquire);
+            if (t >= b) {
+                break;
+            }
+            const T val = _buffer[t & (_capacity - 1)];
+            // `t' is reloaded on failure.
+            if (_top.compare_exchange_weak(t, t + 1,
+                                           butil::memory_order_seq_cst,
+                                           butil::memory_order_relaxed)) {
+                out[nstolen++] = val;
+                ++t;
+            }
+        }
+        return nstolen;
+    }
+
     size_t volatile_size() const {
         const size_t b = _bottom.load(butil::memory_order_relaxed);
         const size_t t = _top.load(butil::memory_order_relaxed);
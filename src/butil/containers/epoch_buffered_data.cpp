@@ -0,0 +1,105 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <sched.h>
+#include <unistd.h>
+#include <new>
+#include "butil/containers/epoch_buffered_data.h"
+
+namespace butil {
+namespace detail {
+
+// Starts from 1 since 0 means "not reading".
+butil::atomic<uint64_t> g_epoch(1);
+BAIDU_THREAD_LOCAL EpochReader* tls_epoch_reader = nullptr;
+
+// Readers are never freed, readers of exited threads are reused by new
+// threads, so the list is as long as the max number of threads ever read.
+static butil::atomic<EpochReader*> g_readers(nullptr);
+
+static void release_epoch_reader(void* arg) {
+    EpochReader* r = static_cast<EpochReader*>(arg);
+    r->depth = 0;
+    r->epoch.store(0, butil::memory_order_release);
+    r->in_use.store(false, butil::memory_order_release);
+    tls_epoch_reader = nullptr;
+}
+
+EpochReader* create_epoch_reader() {
+    EpochReader* r = nullptr;
+    for (EpochReader* p = g_readers.load(butil::memory_order_acquire);
+         p != nullptr; p = p->next) {
+        bool expected = false;
+        if (!p->in_use.load(butil::memory_order_relaxed) &&
+            p->in_use.compare_exchange_strong(expected, true,
+                                              butil::memory_order_acquire)) {
+            r = p;
+            break;
+        }
+    }
+    if (r == nullptr) {
+        r = new (std::nothrow) EpochReader;
+        if (r == nullptr) {
+            return nullptr;
+        }
+        r->epoch.store(0, butil::memory_order_relaxed);
+        r->depth = 0;
+        r->in_use.store(true, butil::memory_order_relaxed);
+        r->next = g_readers.load(butil::memory_order_relaxed);
+        while (!g_readers.compare_exchange_weak(r->next, r,
+                                                butil::memory_order_release,
+                                                butil::memory_order_relaxed)) {
+        }
+    }
+    if (thread_atexit(release_epoch_reader, r) != 0) {
+        release_epoch_reader(r);
+        return nullptr;
+    }
+    tls_epoch_reader = r;
+    return r;
+}
+
+void synchronize_epoch() {
+    // Readers seeing the new epoch see all changes before this call.
+    const uint64_t epoch = g_epoch.fetch_add(1, butil::memory_order_seq_cst) + 1;
+    // Pairs with the fence in begin_epoch_read().
+    butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    EpochReader* const self = tls_epoch_reader;
+    for (EpochReader* p = g_readers.load(butil::memory_order_acquire);
+         p != nullptr; p = p->next) {
+        if (p == self) {
+            // Reads of the calling thread can't be waited.
+            continue;
+        }
+        for (int i = 0; ; ++i) {
+            // Acquire pairs with the release in end_epoch_read() so that the
+            // finished reads happen before the following modification.
+            const uint64_t e = p->epoch.load(butil::memory_order_acquire);
+            if (e == 0 || e >= epoch) {
+                break;
+            }
+            if (i < 64) {
+                sched_yield();
+            } else {
+                usleep(100);
+            }
+        }
+    }
+}
+
+}  // namespace detail
+}  // namespace butil
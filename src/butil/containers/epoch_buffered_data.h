@@ -0,0 +1,276 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BUTIL_EPOCH_BUFFERED_DATA_H
+#define BUTIL_EPOCH_BUFFERED_DATA_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "butil/atomicops.h"
+#include "butil/containers/doubly_buffered_data.h"
+#include "butil/macros.h"
+#include "butil/scoped_lock.h"
+#include "butil/thread_key.h"
+#include "butil/thread_local.h"
+#include "butil/type_traits.h"
+
+namespace butil {
+
+namespace detail {
+
+// Read-side state of a thread in the global epoch domain shared by all
+// EpochBufferedData.
+struct BAIDU_CACHELINE_ALIGNMENT EpochReader {
+    // The global epoch seen by the ongoing read, 0 if the thread is not
+    // reading.
+    butil::atomic<uint64_t> epoch;
+    // Depth of nested reads. Only accessed by the owner thread.
+    int depth;
+    // Whether the reader is owned by a thread.
+    butil::atomic<bool> in_use;
+    // Next reader in the global list which never shrinks.
+    EpochReader* next;
+};
+
+extern butil::atomic<uint64_t> g_epoch;
+extern BAIDU_THREAD_LOCAL EpochReader* tls_epoch_reader;
+
+// Get or create reader of the calling thread. Returns nullptr on error.
+EpochReader* create_epoch_reader();
+
+// Wait until all reads which began before this function in other threads
+// finish. Reads beginning later see everything done before the call.
+void synchronize_epoch();
+
+inline EpochReader* begin_epoch_read() {
+    EpochReader* r = tls_epoch_reader;
+    if (BAIDU_UNLIKELY(r == nullptr)) {
+        r = create_epoch_reader();
+        if (r == nullptr) {
+            return nullptr;
+        }
+    }
+    if (r->depth++ == 0) {
+        // Acquire pairs with the increment in synchronize_epoch(): seeing the
+        // new epoch means seeing the data published before it.
+        r->epoch.store(g_epoch.load(butil::memory_order_acquire),
+                       butil::memory_order_relaxed);
+        // Pairs with the fence in synchronize_epoch(): either the writer sees
+        // this read, or this read sees the new data.
+        butil::atomic_thread_fence(butil::memory_order_seq_cst);
+    }
+    return r;
+}
+
+inline void end_epoch_read(EpochReader* r) {
+    if (--r->depth == 0) {
+        r->epoch.store(0, butil::memory_order_release);
+    }
+}
+
+template <typename TLS>
+struct EpochBufferedDataTLS {
+    TLS* get() { return _tls.get(); }
+    ThreadLocal<TLS> _tls;
+};
+
+template <>
+struct EpochBufferedDataTLS<Void> {
+    Void* get() { return nullptr; }
+};
+
+}  // namespace detail
+
+// A sibling of DoublyBufferedData with the same Read()/Modify() API, using
+// epoch-based reclamation instead of thread-local mutexes.
+//
+// Read(): Publish the global epoch in the thread-local reader (one store and
+// one fence) then read the foreground instance. No mutex is locked, reads
+// are wait-free.
+//
+// Modify(): Modify background instance, flip foreground and background,
+// advance the global epoch and wait until every thread is either not reading
+// or reading with the new epoch, then modify background (foreground before
+// flip) again. Scanning readers does not block Read() in other threads.
+//
+// All instances share the epoch domain: Modify() also waits for reads of
+// other instances which are assumed to be short. Similar to
+// DoublyBufferedData with `AllowBthreadSuspended=false', bthread must not
+// be suspended while reading, and Modify() must not be called while reading
+// the same instance in the same thread.
+template <typename T, typename TLS = Void>
+class EpochBufferedData {
+public:
+    class ScopedPtr {
+    friend class EpochBufferedData;
+    public:
+        ScopedPtr() : _data(nullptr), _reader(nullptr), _tls(nullptr) {}
+        ~ScopedPtr() {
+            if (_reader) {
+                detail::end_epoch_read(_reader);
+            }
+        }
+        const T* get() const { return _data; }
+        const T& operator*() const { return *_data; }
+        const T* operator->() const { return _data; }
+        TLS& tls() { return *_tls; }
+
+    private:
+        DISALLOW_COPY_AND_ASSIGN(ScopedPtr);
+        const T* _data;
+        detail::EpochReader* _reader;
+        TLS* _tls;
+    };
+
+    EpochBufferedData();
+    ~EpochBufferedData();
+
+    // Put foreground instance into ptr. The instance will not be changed until
+    // ptr is destructed.
+    // This function is not blocked by Read() and Modify() in other threads.
+    // Returns 0 on success, -1 otherwise.
+    int Read(ScopedPtr* ptr);
+
+    // `fn(const T&)' will be called with foreground instance.
+    // This function is not blocked by Read() and Modify() in other threads.
+    // Returns 0 on success, otherwise on error.
+    template <typename Fn>
+    int Read(Fn&& fn);
+
+    // Modify background and foreground instances. fn(T&, ...) will be called
+    // twice. Modify() from different threads are exclusive from each other.
+    // NOTE: Call same series of fn to different equivalent instances should
+    // result in equivalent instances, otherwise foreground and background
+    // instance will be inconsistent.
+    template <typename Fn, typename... Args>
+    size_t Modify(Fn&& fn, Args&&... args);
+
+    // fn(T& background, const T& foreground, ...) will be called to background
+    // and foreground instances respectively.
+    template <typename Fn, typename... Args>
+    size_t ModifyWithForeground(Fn&& fn, Args&&... args);
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(EpochBufferedData);
+
+    // Foreground and background void.
+    T _data[2];
+
+    // Index of foreground instance.
+    butil::atomic<int> _index;
+
+    // Sequence modifications.
+    pthread_mutex_t _modify_mutex;
+
+    detail::EpochBufferedDataTLS<TLS> _tls;
+};
+
+// Selectors of the container protecting data which is read by many threads
+// and modified occasionally, for classes parameterized by the container,
+// e.g. load balancers.
+struct DoublyBufferedPolicy {
+    template <typename T, typename TLS = Void>
+    using Data = DoublyBufferedData<T, TLS>;
+};
+
+struct EpochBufferedPolicy {
+    template <typename T, typename TLS = Void>
+    using Data = EpochBufferedData<T, TLS>;
+};
+
+template <typename T, typename TLS>
+EpochBufferedData<T, TLS>::EpochBufferedData() : _index(0) {
+    pthread_mutex_init(&_modify_mutex, nullptr);
+    // Initialize _data for some POD types. This is essential for pointer
+    // types because they should be Read() as nullptr before any Modify().
+    if (is_integral<T>::value || is_floating_point<T>::value ||
+        is_pointer<T>::value || is_member_function_pointer<T>::value) {
+        _data[0] = T();
+        _data[1] = T();
+    }
+}
+
+template <typename T, typename TLS>
+EpochBufferedData<T, TLS>::~EpochBufferedData() {
+    // User is responsible for synchronizations between Read()/Modify() and
+    // this function.
+    pthread_mutex_destroy(&_modify_mutex);
+}
+
+template <typename T, typename TLS>
+int EpochBufferedData<T, TLS>::Read(ScopedPtr* ptr) {
+    detail::EpochReader* r = detail::begin_epoch_read();
+    if (BAIDU_UNLIKELY(r == nullptr)) {
+        return -1;
+    }
+    if (ptr->_reader) {
+        detail::end_epoch_read(ptr->_reader);
+    }
+    ptr->_reader = r;
+    ptr->_data = _data + _index.load(butil::memory_order_acquire);
+    ptr->_tls = _tls.get();
+    return 0;
+}
+
+template <typename T, typename TLS>
+template <typename Fn>
+int EpochBufferedData<T, TLS>::Read(Fn&& fn) {
+    BAIDU_CASSERT((is_result_void<Fn, const T&>::value),
+                  "Fn must accept `const T&' and return void");
+    ScopedPtr ptr;
+    if (Read(&ptr) != 0) {
+        return -1;
+    }
+    fn(*ptr);
+    return 0;
+}
+
+template <typename T, typename TLS>
+template <typename Fn, typename... Args>
+size_t EpochBufferedData<T, TLS>::Modify(Fn&& fn, Args&&... args) {
+    BAIDU_SCOPED_LOCK(_modify_mutex);
+    int bg_index = !_index.load(butil::memory_order_relaxed);
+    // background instance is not accessed by other threads, being safe to
+    // modify.
+    const size_t ret = fn(_data[bg_index], std::forward<Args>(args)...);
+    if (!ret) {
+        return 0;
+    }
+
+    // Publish, flip background and foreground.
+    _index.store(bg_index, butil::memory_order_release);
+    bg_index = !bg_index;
+
+    // Wait until all threads finish reading the old foreground instance.
+    detail::synchronize_epoch();
+
+    const size_t ret2 = fn(_data[bg_index], std::forward<Args>(args)...);
+    CHECK_EQ(ret2, ret) << "index=" << _index.load(butil::memory_order_relaxed);
+    return ret2;
+}
+
+template <typename T, typename TLS>
+template <typename Fn, typename... Args>
+size_t EpochBufferedData<T, TLS>::ModifyWithForeground(Fn&& fn, Args&&... args) {
+    return Modify([this, &fn](T& bg, Args&&... args) {
+        return fn(bg, (const T&)_data[&bg == _data], std::forward<Args>(args)...);
+    }, std::forward<Args>(args)...);
+}
+
+}  // namespace butil
+
+#endif  // BUTIL_EPOCH_BUFFERED_DATA_H
@@ -0,0 +1,711 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// An open addressing hash-map in the style of Swiss tables. Slots are
+// divided into groups of 16, each slot has a control byte telling whether
+// the slot is empty, deleted, or full with 7 bits of the hash code. A lookup
+// compares the 16 control bytes of a group with SSE2 (or NEON) at once and
+// only compares keys of the matched slots, a miss usually stops at the first
+// group without touching any key. Elements are stored inline, inserting
+// never allocates except for resizing.
+//
+// Compared with FlatMap, SwissFlatMap:
+//  * does not allocate or chase overflow nodes on collisions. Hash codes
+//    are mixed before use, being much faster when lower bits of hash codes
+//    are poorly distributed (e.g. aligned addresses as keys).
+//  * moves elements when resizing, references to values are invalidated.
+//  * leaves tombstones after erasing, which are cleaned by resizing.
+// Run FlatMapTest.swiss_perf in test/flat_map_unittest.cpp for comparisons.
+
+#ifndef BUTIL_SWISS_FLAT_MAP_H
+#define BUTIL_SWISS_FLAT_MAP_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <tuple>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "butil/logging.h"
+#include "butil/macros.h"
+#include "butil/containers/flat_map.h"        // DefaultHasher, find_power2
+
+namespace butil {
+
+namespace swiss {
+
+typedef int8_t ctrl_t;
+
+// Values of control bytes. A full slot has the lower 7 bits of the hash
+// code, which is non-negative.
+static const ctrl_t CTRL_EMPTY = -128;
+static const ctrl_t CTRL_DELETED = -2;
+
+static const size_t GROUP_WIDTH = 16;
+
+// Positions of matched slots in a group, one bit for each slot.
+class BitMask {
+public:
+    explicit BitMask(uint32_t mask) : _mask(mask) {}
+    explicit operator bool() const { return _mask != 0; }
+    // Index of the lowest matched slot. Must be non-empty.
+    size_t lowest() const { return __builtin_ctz(_mask); }
+    void remove_lowest() { _mask &= (_mask - 1); }
+private:
+    uint32_t _mask;
+};
+
+// Control bytes of a group, loaded into a register.
+class Group {
+public:
+#if defined(__SSE2__)
+    explicit Group(const ctrl_t* pos)
+        : _ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+
+    BitMask match(ctrl_t h2) const {
+        return BitMask(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_set1_epi8(h2), _ctrl)));
+    }
+    BitMask match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+    // Empty and deleted are the only negative values except -1.
+    BitMask match_empty_or_deleted() const {
+        return BitMask(_mm_movemask_epi8(
+            _mm_cmpgt_epi8(_mm_set1_epi8(-1), _ctrl)));
+    }
+
+private:
+    __m128i _ctrl;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    explicit Group(const ctrl_t* pos) : _ctrl(vld1q_s8(pos)) {}
+
+    BitMask match(ctrl_t h2) const {
+        return BitMask(to_mask(vceqq_s8(vdupq_n_s8(h2), _ctrl)));
+    }
+    BitMask match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+    BitMask match_empty_or_deleted() const {
+        return BitMask(to_mask(vcltq_s8(_ctrl, vdupq_n_s8(-1))));
+    }
+
+private:
+    // Gather the highest bit of each byte, like _mm_movemask_epi8.
+    static uint32_t to_mask(uint8x16_t v) {
+        static const uint8_t BITS[16] = {
+            1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+        const uint8x16_t masked = vandq_u8(v, vld1q_u8(BITS));
+        return vaddv_u8(vget_low_u8(masked)) |
+            ((uint32_t)vaddv_u8(vget_high_u8(masked)) << 8);
+    }
+    int8x16_t _ctrl;
+#else
+    explicit Group(const ctrl_t* pos) {
+        memcpy(_ctrl, pos, sizeof(_ctrl));
+    }
+
+    BitMask match(ctrl_t h2) const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            mask |= (uint32_t)(_ctrl[i] == h2) << i;
+        }
+        return BitMask(mask);
+    }
+    BitMask match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+    BitMask match_empty_or_deleted() const {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+            mask |= (uint32_t)(_ctrl[i] < -1) << i;
+        }
+        return BitMask(mask);
+    }
+
+private:
+    ctrl_t _ctrl[GROUP_WIDTH];
+#endif
+};
+
+// Scatter bits of the hash code, hashers of integers (e.g. DefaultHasher)
+// are often the identity function whose lower bits are poorly distributed.
+inline size_t mix_hash(size_t h) {
+    uint64_t x = h;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+}  // namespace swiss
+
+template <typename Map, typename Value> class SwissFlatMapIterator;
+
+// NOTE: Objects stored in SwissFlatMap MUST be copyable.
+template <typename _K, typename _T,
+          // Compute hash code from key.
+          typename _Hash = DefaultHasher<_K>,
+          // Test equivalence between stored-key and passed-key.
+          // stored-key is always on LHS, passed-key is always on RHS.
+          typename _Equal = DefaultEqualTo<_K> >
+class SwissFlatMap {
+public:
+    typedef _K key_type;
+    typedef _T mapped_type;
+    typedef std::pair<const _K, _T> value_type;
+    typedef SwissFlatMapIterator<SwissFlatMap, value_type> iterator;
+    typedef SwissFlatMapIterator<SwissFlatMap, const value_type>
+    const_iterator;
+    typedef _Hash hasher;
+    typedef _Equal key_equal;
+    static constexpr size_t GROUP_WIDTH = swiss::GROUP_WIDTH;
+    static constexpr u_int DEFAULT_LOAD_FACTOR = 87;
+
+    explicit SwissFlatMap(const hasher& hashfn = hasher(),
+                          const key_equal& eql = key_equal());
+    SwissFlatMap(const SwissFlatMap& rhs);
+    ~SwissFlatMap();
+
+    SwissFlatMap& operator=(const SwissFlatMap& rhs);
+    void swap(SwissFlatMap& rhs);
+
+    // SwissFlatMap allocates slots at the first insertion, so this function
+    // only needs to be called when a large initial number of slots or
+    // non-default `load_factor' is required.
+    // `nbucket' is the initial number of slots which is rounded up to power
+    // of 2. `load_factor' is the maximum value of (size()+#tombstones)*100
+    // /bucket_count(), clamped to [10, 95]. If the value is reached, slots
+    // are doubled (or tombstones are dropped) and all items are rehashed.
+    // Returns 0 on success, -1 on error.
+    int init(size_t nbucket, u_int load_factor = DEFAULT_LOAD_FACTOR);
+
+    // Insert a pair of |key| and |value|, overwriting the existing value.
+    // Returns address of the inserted value, nullptr on error.
+    mapped_type* insert(const key_type& key, const mapped_type& value);
+    mapped_type* insert(const std::pair<key_type, mapped_type>& kv);
+
+    // Remove |key| and the associated value.
+    // Returns 1 on erased, 0 otherwise.
+    template <typename K2>
+    size_t erase(const K2& key, mapped_type* old_value = nullptr);
+
+    // Remove all items. Allocated slots are NOT returned to system.
+    void clear();
+
+    // Remove all items and return all allocated slots to system.
+    void clear_and_reset_pool();
+
+    // Search for the value associated with |key|.
+    // Returns: address of the value, nullptr if |key| does not exist.
+    template <typename K2> mapped_type* seek(const K2& key) const;
+
+    // Get the value associated with |key|. If |key| does not exist,
+    // insert with a default-constructed value.
+    // Returns reference of the value.
+    mapped_type& operator[](const key_type& key);
+
+    // Rehash all items into at least `nbucket' slots. This is optional
+    // because resizing will be triggered by insert() or operator[] if
+    // there're too many items.
+    // Returns successful or not.
+    bool resize(size_t nbucket);
+
+    // Iterators are invalidated by insertions which resize the map. Erasing
+    // the element of an iterator does not invalidate other iterators.
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Always returns true.
+    bool initialized() const { return true; }
+
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+    size_t bucket_count() const { return _capacity; }
+    u_int load_factor() const { return _load_factor; }
+
+private:
+template <typename Map, typename Value> friend class SwissFlatMapIterator;
+
+    typedef swiss::ctrl_t ctrl_t;
+
+    // Storage of an element, constructed only when the slot is full.
+    union Slot {
+        Slot() {}
+        ~Slot() {}
+        value_type value;
+    };
+
+    static bool is_full(ctrl_t c) { return c >= 0; }
+    static size_t h1(size_t hash) { return hash >> 7; }
+    static ctrl_t h2(size_t hash) { return (ctrl_t)(hash & 0x7F); }
+
+    template <typename K2> size_t hash(const K2& key) const {
+        return swiss::mix_hash(_hashfn(key));
+    }
+
+    // Number of items (including tombstones) that `capacity' slots can hold.
+    size_t max_load(size_t capacity) const {
+        const size_t n = capacity * _load_factor / 100;
+        return n < capacity ? n : capacity - 1;
+    }
+
+    // Round `nbucket' up to a valid number of slots holding current items.
+    size_t fit_capacity(size_t nbucket) const {
+        size_t capacity = find_power2(std::max(nbucket, swiss::GROUP_WIDTH));
+        while (max_load(capacity) < _size) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    // Index of the slot holding |key|, _capacity if not found.
+    template <typename K2> size_t find(const K2& key, size_t hash) const;
+
+    // Index of the first empty or deleted slot in the probe sequence.
+    size_t find_non_full(size_t hash) const;
+
+    // Slots are stored group by group: GROUP_WIDTH control bytes followed
+    // by GROUP_WIDTH slots, so that seeking touches nearby memory (and
+    // fewer pages) rather than two separated arrays.
+    static constexpr size_t SLOTS_OFFSET =
+        (GROUP_WIDTH + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+    static constexpr size_t GROUP_SIZE =
+        SLOTS_OFFSET + GROUP_WIDTH * sizeof(Slot);
+
+    static ctrl_t* group_ctrl(char* groups, size_t g) {
+        return reinterpret_cast<ctrl_t*>(groups + g * GROUP_SIZE);
+    }
+    static ctrl_t& ctrl(char* groups, size_t i) {
+        return group_ctrl(groups, i / GROUP_WIDTH)[i % GROUP_WIDTH];
+    }
+    static value_type& slot(char* groups, size_t i) {
+        Slot* slots = reinterpret_cast<Slot*>(
+            groups + i / GROUP_WIDTH * GROUP_SIZE + SLOTS_OFFSET);
+        return slots[i % GROUP_WIDTH].value;
+    }
+    ctrl_t* group_ctrl(size_t g) const { return group_ctrl(_groups, g); }
+    ctrl_t& ctrl(size_t i) const { return ctrl(_groups, i); }
+    value_type& slot(size_t i) const { return slot(_groups, i); }
+
+    // Index of the slot holding |key|, inserting a default-constructed value
+    // if |key| does not exist. Returns _capacity on error.
+    size_t find_or_prepare_insert(const key_type& key);
+
+    // Rehash into `new_capacity' slots, being a power of 2 which is
+    // not less than GROUP_WIDTH.
+    bool rehash(size_t new_capacity);
+
+    void destroy_slots();
+    void free_slots();
+
+    char* _groups;
+    // Number of slots, 0 or power of 2 not less than GROUP_WIDTH.
+    size_t _capacity;
+    size_t _size;
+    // Number of items can be inserted before resizing.
+    size_t _growth_left;
+    u_int _load_factor;
+    hasher _hashfn;
+    key_equal _eql;
+};
+
+template <typename Map, typename Value> class SwissFlatMapIterator {
+public:
+    typedef Value value_type;
+    typedef Value& reference;
+    typedef Value* pointer;
+    typedef typename add_const<Value>::type ConstValue;
+    typedef ConstValue& const_reference;
+    typedef ConstValue* const_pointer;
+    typedef std::forward_iterator_tag iterator_category;
+    typedef ptrdiff_t difference_type;
+    typedef typename remove_const<Value>::type NonConstValue;
+
+    SwissFlatMapIterator() : _map(nullptr), _index(0) {}
+    SwissFlatMapIterator(const Map* map, size_t index)
+        : _map(map), _index(index) { skip_non_full(); }
+    // Converting from iterator to const_iterator.
+    SwissFlatMapIterator(const SwissFlatMapIterator<Map, NonConstValue>& rhs)
+        : _map(rhs._map), _index(rhs._index) {}
+
+    bool operator==(const SwissFlatMapIterator& rhs) const
+    { return _index == rhs._index; }
+    bool operator!=(const SwissFlatMapIterator& rhs) const
+    { return _index != rhs._index; }
+
+    SwissFlatMapIterator& operator++() {
+        ++_index;
+        skip_non_full();
+        return *this;
+    }
+    SwissFlatMapIterator operator++(int) {
+        SwissFlatMapIterator tmp = *this;
+        this->operator++();
+        return tmp;
+    }
+
+    reference operator*() { return _map->slot(_index); }
+    pointer operator->() { return &_map->slot(_index); }
+    const_reference operator*() const { return _map->slot(_index); }
+    const_pointer operator->() const { return &_map->slot(_index); }
+
+private:
+friend class SwissFlatMapIterator<Map, ConstValue>;
+friend Map;
+
+    void skip_non_full() {
+        while (_index < _map->_capacity &&
+               !Map::is_full(_map->ctrl(_index))) {
+            ++_index;
+        }
+    }
+
+    const Map* _map;
+    size_t _index;
+};
+
+template <typename _K, typename _T, typename _H, typename _E>
+SwissFlatMap<_K, _T, _H, _E>::SwissFlatMap(const hasher& hashfn,
+                                           const key_equal& eql)
+    : _groups(nullptr)
+    , _capacity(0)
+    , _size(0)
+    , _growth_left(0)
+    , _load_factor(DEFAULT_LOAD_FACTOR)
+    , _hashfn(hashfn)
+    , _eql(eql) {}
+
+template <typename _K, typename _T, typename _H, typename _E>
+SwissFlatMap<_K, _T, _H, _E>::SwissFlatMap(const SwissFlatMap& rhs)
+    : SwissFlatMap(rhs._hashfn, rhs._eql) {
+    operator=(rhs);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+SwissFlatMap<_K, _T, _H, _E>::~SwissFlatMap() {
+    free_slots();
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+SwissFlatMap<_K, _T, _H, _E>&
+SwissFlatMap<_K, _T, _H, _E>::operator=(const SwissFlatMap& rhs) {
+    if (this == &rhs) {
+        return *this;
+    }
+    clear();
+    _load_factor = rhs._load_factor;
+    _hashfn = rhs._hashfn;
+    _eql = rhs._eql;
+    if (rhs._size == 0) {
+        return *this;
+    }
+    if (_capacity != rhs._capacity) {
+        free_slots();
+        if (!rehash(rhs._capacity)) {
+            LOG(ERROR) << "Fail to allocate " << rhs._capacity << " slots";
+            return *this;
+        }
+    }
+    // Copy slots one by one at the same positions, tombstones included.
+    for (size_t g = 0; g < _capacity / GROUP_WIDTH; ++g) {
+        memcpy(group_ctrl(g), rhs.group_ctrl(g), GROUP_WIDTH);
+    }
+    for (size_t i = 0; i < _capacity; ++i) {
+        if (is_full(ctrl(i))) {
+            new (&slot(i)) value_type(rhs.slot(i));
+        }
+    }
+    _size = rhs._size;
+    _growth_left = rhs._growth_left;
+    return *this;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+void SwissFlatMap<_K, _T, _H, _E>::swap(SwissFlatMap& rhs) {
+    std::swap(_groups, rhs._groups);
+    std::swap(_capacity, rhs._capacity);
+    std::swap(_size, rhs._size);
+    std::swap(_growth_left, rhs._growth_left);
+    std::swap(_load_factor, rhs._load_factor);
+    std::swap(_hashfn, rhs._hashfn);
+    std::swap(_eql, rhs._eql);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+int SwissFlatMap<_K, _T, _H, _E>::init(size_t nbucket, u_int load_factor) {
+    _load_factor = std::min(std::max(load_factor, 10u), 95u);
+    if (nbucket == 0 && _capacity == 0) {
+        return 0;
+    }
+    // Always rehash to apply the new load factor.
+    return rehash(fit_capacity(std::max(nbucket, _capacity))) ? 0 : -1;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+template <typename K2>
+size_t SwissFlatMap<_K, _T, _H, _E>::find(const K2& key, size_t hash) const {
+    const size_t mask = (_capacity / GROUP_WIDTH) - 1;
+    // Triangular probing visits all groups when the number of groups is
+    // power of 2.
+    size_t g = h1(hash) & mask;
+    for (size_t step = 1; ; ++step) {
+        const swiss::Group group(group_ctrl(g));
+        for (swiss::BitMask m = group.match(h2(hash)); m; m.remove_lowest()) {
+            const size_t i = g * GROUP_WIDTH + m.lowest();
+            if (_eql(slot(i).first, key)) {
+                return i;
+            }
+        }
+        if (group.match_empty()) {
+            return _capacity;
+        }
+        g = (g + step) & mask;
+    }
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+size_t SwissFlatMap<_K, _T, _H, _E>::find_non_full(size_t hash) const {
+    const size_t mask = (_capacity / GROUP_WIDTH) - 1;
+    size_t g = h1(hash) & mask;
+    for (size_t step = 1; ; ++step) {
+        const swiss::BitMask m =
+            swiss::Group(group_ctrl(g)).match_empty_or_deleted();
+        if (m) {
+            return g * GROUP_WIDTH + m.lowest();
+        }
+        g = (g + step) & mask;
+    }
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+template <typename K2>
+_T* SwissFlatMap<_K, _T, _H, _E>::seek(const K2& key) const {
+    if (_size == 0) {
+        return nullptr;
+    }
+    const size_t i = find(key, hash(key));
+    return i != _capacity ? &slot(i).second : nullptr;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+size_t SwissFlatMap<_K, _T, _H, _E>::find_or_prepare_insert(
+    const key_type& key) {
+    const size_t h = hash(key);
+    if (_size != 0) {
+        const size_t i = find(key, h);
+        if (i != _capacity) {
+            return i;
+        }
+    }
+    size_t target = _capacity;
+    if (_capacity != 0) {
+        target = find_non_full(h);
+    }
+    // Reusing a tombstone does not consume growth.
+    if (target == _capacity ||
+        (_growth_left == 0 && ctrl(target) != swiss::CTRL_DELETED)) {
+        // Drop tombstones if they take more than 1/8 of the load, otherwise
+        // double the slots. Either way, the map can hold at least 1/8 of the
+        // load more before the next resizing.
+        size_t new_capacity = _capacity * 2;
+        if (_capacity == 0) {
+            new_capacity = GROUP_WIDTH;
+        } else if (_size * 8 <= max_load(_capacity) * 7) {
+            new_capacity = _capacity;
+        }
+        if (!rehash(new_capacity)) {
+            return _capacity;
+        }
+        target = find_non_full(h);
+    }
+    if (ctrl(target) == swiss::CTRL_EMPTY) {
+        --_growth_left;
+    }
+    new (&slot(target)) value_type(
+        std::piecewise_construct, std::forward_as_tuple(key),
+        std::forward_as_tuple());
+    ctrl(target) = h2(h);
+    ++_size;
+    return target;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+_T& SwissFlatMap<_K, _T, _H, _E>::operator[](const key_type& key) {
+    const size_t i = find_or_prepare_insert(key);
+    CHECK(i != _capacity) << "Fail to allocate slots";
+    return slot(i).second;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+_T* SwissFlatMap<_K, _T, _H, _E>::insert(
+    const key_type& key, const mapped_type& value) {
+    const size_t i = find_or_prepare_insert(key);
+    if (i == _capacity) {
+        return nullptr;
+    }
+    mapped_type* p = &slot(i).second;
+    *p = value;
+    return p;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+_T* SwissFlatMap<_K, _T, _H, _E>::insert(
+    const std::pair<key_type, mapped_type>& kv) {
+    return insert(kv.first, kv.second);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+template <typename K2>
+size_t SwissFlatMap<_K, _T, _H, _E>::erase(const K2& key, _T* old_value) {
+    if (_size == 0) {
+        return 0;
+    }
+    const size_t i = find(key, hash(key));
+    if (i == _capacity) {
+        return 0;
+    }
+    if (old_value) {
+        *old_value = std::move(slot(i).second);
+    }
+    slot(i).~value_type();
+    --_size;
+    // Seeking stops at a group with an empty slot. If the group already has
+    // one, no seeking passes this group, so the slot can be empty again.
+    if (swiss::Group(group_ctrl(i / GROUP_WIDTH)).match_empty()) {
+        ctrl(i) = swiss::CTRL_EMPTY;
+        ++_growth_left;
+    } else {
+        ctrl(i) = swiss::CTRL_DELETED;
+    }
+    return 1;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+void SwissFlatMap<_K, _T, _H, _E>::destroy_slots() {
+    if (_size != 0) {
+        for (size_t i = 0; i < _capacity; ++i) {
+            if (is_full(ctrl(i))) {
+                slot(i).~value_type();
+            }
+        }
+    }
+    _size = 0;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+void SwissFlatMap<_K, _T, _H, _E>::clear() {
+    destroy_slots();
+    if (_capacity != 0) {
+        for (size_t g = 0; g < _capacity / GROUP_WIDTH; ++g) {
+            memset(group_ctrl(g), swiss::CTRL_EMPTY, GROUP_WIDTH);
+        }
+        _growth_left = max_load(_capacity);
+    }
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+void SwissFlatMap<_K, _T, _H, _E>::free_slots() {
+    destroy_slots();
+    if (_capacity != 0) {
+        free(_groups);
+    }
+    _groups = nullptr;
+    _capacity = 0;
+    _growth_left = 0;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+void SwissFlatMap<_K, _T, _H, _E>::clear_and_reset_pool() {
+    free_slots();
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+bool SwissFlatMap<_K, _T, _H, _E>::resize(size_t nbucket) {
+    const size_t new_capacity = fit_capacity(nbucket);
+    if (new_capacity == _capacity) {
+        return true;
+    }
+    return rehash(new_capacity);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+bool SwissFlatMap<_K, _T, _H, _E>::rehash(size_t new_capacity) {
+    const size_t ngroup = new_capacity / GROUP_WIDTH;
+    char* new_groups = (char*)malloc(ngroup * GROUP_SIZE);
+    if (new_groups == nullptr) {
+        return false;
+    }
+    for (size_t g = 0; g < ngroup; ++g) {
+        memset(group_ctrl(new_groups, g), swiss::CTRL_EMPTY, GROUP_WIDTH);
+    }
+
+    char* old_groups = _groups;
+    const size_t old_capacity = _capacity;
+    _groups = new_groups;
+    _capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (!is_full(ctrl(old_groups, i))) {
+            continue;
+        }
+        value_type& v = slot(old_groups, i);
+        const size_t h = hash(v.first);
+        const size_t target = find_non_full(h);
+        new (&slot(target)) value_type(std::move(v));
+        ctrl(target) = h2(h);
+        v.~value_type();
+    }
+    _growth_left = max_load(_capacity) - _size;
+    free(old_groups);
+    return true;
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+typename SwissFlatMap<_K, _T, _H, _E>::iterator
+SwissFlatMap<_K, _T, _H, _E>::begin() {
+    return iterator(this, 0);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+typename SwissFlatMap<_K, _T, _H, _E>::iterator
+SwissFlatMap<_K, _T, _H, _E>::end() {
+    return iterator(this, _capacity);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+typename SwissFlatMap<_K, _T, _H, _E>::const_iterator
+SwissFlatMap<_K, _T, _H, _E>::begin() const {
+    return const_iterator(this, 0);
+}
+
+template <typename _K, typename _T, typename _H, typename _E>
+typename SwissFlatMap<_K, _T, _H, _E>::const_iterator
+SwissFlatMap<_K, _T, _H, _E>::end() const {
+    return const_iterator(this, _capacity);
+}
+
+}  // namespace butil
+
+#endif  // BUTIL_SWISS_FLAT_MAP_H
@@ -0,0 +1,454 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <sys/mman.h>                      // mmap, mprotect, madvise
+#include <sys/syscall.h>                   // syscall
+#include <unistd.h>
+#include <stdio.h>                         // fopen
+#include <stdlib.h>                        // malloc, free
+#include <pthread.h>
+#include <algorithm>                       // std::max
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
+#include "butil/iobuf.h"
+#include "butil/logging.h"
+#include "butil/macros.h"
+#include "butil/scoped_lock.h"
+#include "butil/synchronization/lock.h"
+#include "butil/thread_local.h"            // thread_atexit
+#include "butil/iobuf_block_allocator.h"
+
+namespace butil {
+namespace iobuf {
+
+DEFINE_string(iobuf_block_allocator, "malloc",
+              "Allocator of IOBuf blocks: `malloc' or `hugepage'. Can't be "
+              "changed back to malloc after hugepage is set");
+DEFINE_int32(iobuf_hugepage_arena_mb, 1024,
+             "Max MB of huge pages used by IOBuf blocks on each NUMA node, "
+             "blocks beyond that are malloc-ed. Read when the first block is "
+             "allocated by -iobuf_block_allocator=hugepage");
+DEFINE_bool(iobuf_hugepage_explicit, false,
+            "Map hugetlbfs pages (which must be reserved by vm.nr_hugepages) "
+            "for IOBuf blocks instead of transparent huge pages");
+DEFINE_int32(iobuf_hugepage_thread_cache, 64,
+             "Max number of freed IOBuf blocks cached by each thread when "
+             "-iobuf_block_allocator=hugepage");
+
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+static const int MAX_NUMA_NODES = 64;
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct BAIDU_CACHELINE_ALIGNMENT Arena {
+    int node;
+    char* begin;
+    char* end;
+    butil::Mutex mutex;
+    // Fields below are protected by mutex.
+    // Blocks before carve_pos were given out at least once.
+    char* carve_pos;
+    // Memory in [begin, mapped_end) is readable and writable.
+    char* mapped_end;
+    FreeBlock* free_list;
+    size_t nfree;
+    // Copies of fields above for stats.
+    butil::atomic<size_t> mapped_bytes;
+    butil::atomic<size_t> carved_blocks;
+    butil::atomic<size_t> free_blocks;
+};
+
+static pthread_once_t g_arenas_once = PTHREAD_ONCE_INIT;
+static Arena* g_arenas = nullptr;
+static int g_narena = 0;
+static size_t g_arena_size = 0;
+// Range of all arenas, empty before the arenas are created.
+static char* g_arenas_begin = nullptr;
+static char* g_arenas_end = nullptr;
+// Size of blocks in the arenas.
+static size_t g_block_size = 0;
+static size_t g_thread_cache_max = 0;
+static butil::static_atomic<bool> g_explicit_failed = BUTIL_STATIC_ATOMIC_INIT(false);
+static butil::static_atomic<size_t> g_nfallback = BUTIL_STATIC_ATOMIC_INIT(0);
+static butil::static_atomic<bool> g_used = BUTIL_STATIC_ATOMIC_INIT(false);
+
+// Freed blocks of the arena of `node', only blocks of that arena are cached.
+struct ThreadCache {
+    FreeBlock* head;
+    size_t n;
+    int node;
+    bool registered;
+};
+static __thread ThreadCache tls_cache = { nullptr, 0, -1, false };
+
+static int get_numa_node_num() {
+    // Content is like "0" or "0-3".
+    FILE* fp = fopen("/sys/devices/system/node/possible", "r");
+    if (fp == nullptr) {
+        return 1;
+    }
+    int max_node = 0;
+    int n = 0;
+    int c;
+    while ((c = fgetc(fp)) != EOF) {
+        if (c >= '0' && c <= '9') {
+            n = n * 10 + (c - '0');
+            max_node = std::max(max_node, n);
+        } else {
+            n = 0;
+        }
+    }
+    fclose(fp);
+    return std::min(max_node + 1, MAX_NUMA_NODES);
+}
+
+static int get_current_node() {
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (g_narena <= 1 || syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return 0;
+    }
+    return (int)(node % g_narena);
+}
+
+static void create_arenas() {
+    g_block_size = GetDefaultBlockSize();
+    if (g_block_size > HUGE_PAGE_SIZE || g_block_size < sizeof(FreeBlock)) {
+        LOG(ERROR) << "Block size=" << g_block_size
+                   << " is not supported by huge page arenas";
+        return;
+    }
+    if (FLAGS_iobuf_hugepage_arena_mb <= 0) {
+        return;
+    }
+    const size_t arena_size = ((size_t)FLAGS_iobuf_hugepage_arena_mb * 1024 * 1024
+                               + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    const int nnode = get_numa_node_num();
+    // Reserve address space only, pages are mapped on demand.
+    const size_t total = arena_size * nnode;
+    void* mem = mmap(nullptr, total + HUGE_PAGE_SIZE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) {
+        PLOG(ERROR) << "Fail to reserve " << total << " bytes for huge page arenas";
+        return;
+    }
+    char* begin = (char*)(((uintptr_t)mem + HUGE_PAGE_SIZE - 1)
+                          & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    Arena* arenas = new Arena[nnode];
+    for (int i = 0; i < nnode; ++i) {
+        Arena& a = arenas[i];
+        a.node = i;
+        a.begin = begin + arena_size * i;
+        a.end = a.begin + arena_size;
+        a.carve_pos = a.begin;
+        a.mapped_end = a.begin;
+        a.free_list = nullptr;
+        a.nfree = 0;
+        a.mapped_bytes.store(0, butil::memory_order_relaxed);
+        a.carved_blocks.store(0, butil::memory_order_relaxed);
+        a.free_blocks.store(0, butil::memory_order_relaxed);
+    }
+    g_arenas = arenas;
+    g_narena = nnode;
+    g_arena_size = arena_size;
+    g_thread_cache_max = std::max(FLAGS_iobuf_hugepage_thread_cache, 0);
+    g_arenas_begin = begin;
+    g_arenas_end = begin + total;
+    LOG(INFO) << "Created " << nnode << " huge page arena(s) of "
+              << arena_size << " bytes for IOBuf blocks of "
+              << g_block_size << " bytes";
+}
+
+// Map one more huge page at the end of `a'. Called with a->mutex held.
+static bool map_huge_page(Arena* a) {
+    if (a->mapped_end >= a->end) {
+        return false;
+    }
+    char* const p = a->mapped_end;
+    bool mapped = false;
+    if (FLAGS_iobuf_hugepage_explicit &&
+        !g_explicit_failed.load(butil::memory_order_relaxed)) {
+        void* rc = mmap(p, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB,
+                        -1, 0);
+        if (rc != MAP_FAILED) {
+            mapped = true;
+        } else {
+            PLOG(WARNING) << "Fail to map hugetlbfs pages, use transparent "
+                "huge pages instead. Check vm.nr_hugepages";
+            g_explicit_failed.store(true, butil::memory_order_relaxed);
+        }
+    }
+    if (!mapped) {
+        if (mprotect(p, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE) != 0) {
+            PLOG(ERROR) << "Fail to mprotect huge page arena";
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(p, HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+#endif
+    }
+    if (g_narena > 1) {
+        // Pages are not touched yet, bind them before faulting them in.
+        unsigned long nodemask = 1UL << a->node;
+        if (syscall(SYS_mbind, p, HUGE_PAGE_SIZE, MPOL_PREFERRED,
+                    &nodemask, sizeof(nodemask) * 8, 0) != 0) {
+            PLOG_FIRST_N(WARNING, 1) << "Fail to bind huge page arena to node "
+                                     << a->node;
+        }
+    }
+    a->mapped_end += HUGE_PAGE_SIZE;
+    a->mapped_bytes.store(a->mapped_end - a->begin, butil::memory_order_relaxed);
+    return true;
+}
+
+// Take at most `n' blocks from `a' and link them before `*head'.
+// Called with a->mutex held. Returns number of blocks taken.
+static size_t take_blocks(Arena* a, size_t n, FreeBlock** head) {
+    size_t got = 0;
+    while (got < n && a->free_list != nullptr) {
+        FreeBlock* b = a->free_list;
+        a->free_list = b->next;
+        b->next = *head;
+        *head = b;
+        ++got;
+    }
+    a->nfree -= got;
+    a->free_blocks.store(a->nfree, butil::memory_order_relaxed);
+    size_t ncarved = 0;
+    while (got < n) {
+        if (a->carve_pos + g_block_size > a->mapped_end && !map_huge_page(a)) {
+            break;
+        }
+        FreeBlock* b = (FreeBlock*)a->carve_pos;
+        a->carve_pos += g_block_size;
+        b->next = *head;
+        *head = b;
+        ++got;
+        ++ncarved;
+    }
+    if (ncarved) {
+        a->carved_blocks.fetch_add(ncarved, butil::memory_order_relaxed);
+    }
+    return got;
+}
+
+// Give `n' blocks from `head' to `tail' back to `a'.
+static void give_back_blocks(Arena* a, FreeBlock* head, FreeBlock* tail, size_t n) {
+    BAIDU_SCOPED_LOCK(a->mutex);
+    tail->next = a->free_list;
+    a->free_list = head;
+    a->nfree += n;
+    a->free_blocks.store(a->nfree, butil::memory_order_relaxed);
+}
+
+static void flush_thread_cache() {
+    ThreadCache& tc = tls_cache;
+    if (tc.head == nullptr) {
+        return;
+    }
+    FreeBlock* tail = tc.head;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    give_back_blocks(&g_arenas[tc.node], tc.head, tail, tc.n);
+    tc.head = nullptr;
+    tc.n = 0;
+}
+
+static void init_thread_cache(ThreadCache& tc) {
+    tc.node = get_current_node();
+    if (!tc.registered) {
+        tc.registered = true;
+        butil::thread_atexit(flush_thread_cache);
+    }
+}
+
+static void* fallback_allocate(size_t size) {
+    g_nfallback.fetch_add(1, butil::memory_order_relaxed);
+    return malloc(size);
+}
+
+void* hugepage_block_allocate(size_t size) {
+    pthread_once(&g_arenas_once, create_arenas);
+    if (size > g_block_size || g_narena == 0) {
+        return fallback_allocate(size);
+    }
+    ThreadCache& tc = tls_cache;
+    if (tc.head == nullptr) {
+        if (tc.node < 0) {
+            init_thread_cache(tc);
+        }
+        Arena* a = &g_arenas[tc.node];
+        const size_t batch = std::max(g_thread_cache_max / 2, (size_t)1);
+        BAIDU_SCOPED_LOCK(a->mutex);
+        tc.n += take_blocks(a, batch, &tc.head);
+        if (tc.head == nullptr) {
+            return fallback_allocate(size);
+        }
+    }
+    FreeBlock* b = tc.head;
+    tc.head = b->next;
+    --tc.n;
+    return b;
+}
+
+bool is_hugepage_block(const void* mem) {
+    return (const char*)mem >= g_arenas_begin && (const char*)mem < g_arenas_end;
+}
+
+void hugepage_block_deallocate(void* mem) {
+    if (!is_hugepage_block(mem)) {
+        free(mem);
+        return;
+    }
+    FreeBlock* b = (FreeBlock*)mem;
+    ThreadCache& tc = tls_cache;
+    if (tc.node < 0) {
+        init_thread_cache(tc);
+    }
+    const int node = ((char*)mem - g_arenas_begin) / g_arena_size;
+    if (node != tc.node) {
+        // Blocks of other nodes go back to their arenas directly, so that
+        // they're reused by threads on the nodes.
+        b->next = nullptr;
+        give_back_blocks(&g_arenas[node], b, b, 1);
+        return;
+    }
+    if (tc.n >= g_thread_cache_max && tc.n > 0) {
+        // Keep the most recently freed half which is likely in cache.
+        const size_t nkeep = tc.n / 2;
+        FreeBlock* last_kept = tc.head;
+        for (size_t i = 1; i < nkeep; ++i) {
+            last_kept = last_kept->next;
+        }
+        FreeBlock* head = (nkeep ? last_kept->next : tc.head);
+        FreeBlock* tail = head;
+        while (tail->next) {
+            tail = tail->next;
+        }
+        give_back_blocks(&g_arenas[node], head, tail, tc.n - nkeep);
+        if (nkeep) {
+            last_kept->next = nullptr;
+        } else {
+            tc.head = nullptr;
+        }
+        tc.n = nkeep;
+    }
+    if (g_thread_cache_max == 0) {
+        b->next = nullptr;
+        give_back_blocks(&g_arenas[node], b, b, 1);
+        return;
+    }
+    b->next = tc.head;
+    tc.head = b;
+    ++tc.n;
+}
+
+int use_hugepage_block_allocator() {
+    static butil::Mutex s_mutex;
+    BAIDU_SCOPED_LOCK(s_mutex);
+    if (g_used.load(butil::memory_order_relaxed)) {
+        return 0;
+    }
+    if (blockmem_allocate != ::malloc) {
+        LOG(ERROR) << "Allocator of IOBuf blocks was replaced, "
+                      "can't use huge page arenas";
+        return -1;
+    }
+    // Blocks malloc-ed before are freed by hugepage_block_deallocate as well,
+    // switch deallocation first.
+    blockmem_deallocate = hugepage_block_deallocate;
+    blockmem_allocate = hugepage_block_allocate;
+    g_used.store(true, butil::memory_order_relaxed);
+    return 0;
+}
+
+bool is_hugepage_block_allocator_used() {
+    return g_used.load(butil::memory_order_relaxed);
+}
+
+void get_hugepage_arena_stats(std::vector<HugePageArenaStat>* stats) {
+    stats->clear();
+    if (g_arenas_end == nullptr) {
+        return;
+    }
+    for (int i = 0; i < g_narena; ++i) {
+        const Arena& a = g_arenas[i];
+        HugePageArenaStat s;
+        s.node = a.node;
+        s.reserved_bytes = a.end - a.begin;
+        s.mapped_bytes = a.mapped_bytes.load(butil::memory_order_relaxed);
+        s.carved_blocks = a.carved_blocks.load(butil::memory_order_relaxed);
+        s.free_blocks = a.free_blocks.load(butil::memory_order_relaxed);
+        stats->push_back(s);
+    }
+}
+
+void describe_block_allocator(std::ostream& os) {
+    os << "iobuf_block_allocator: "
+       << (is_hugepage_block_allocator_used() ? "hugepage" : "malloc")
+       << "\niobuf_block_count: " << IOBuf::block_count()
+       << "\niobuf_block_memory: " << IOBuf::block_memory() << '\n';
+    std::vector<HugePageArenaStat> stats;
+    get_hugepage_arena_stats(&stats);
+    if (stats.empty()) {
+        return;
+    }
+    os << "hugepage_type: "
+       << ((FLAGS_iobuf_hugepage_explicit &&
+            !g_explicit_failed.load(butil::memory_order_relaxed))
+           ? "explicit" : "transparent")
+       << "\nhugepage_block_size: " << g_block_size
+       << "\nhugepage_fallback_allocations: "
+       << g_nfallback.load(butil::memory_order_relaxed) << '\n';
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const HugePageArenaStat& s = stats[i];
+        os << "hugepage_arena[node=" << s.node
+           << "]: reserved=" << s.reserved_bytes
+           << " mapped=" << s.mapped_bytes
+           << " carved_blocks=" << s.carved_blocks
+           << " free_blocks=" << s.free_blocks << '\n';
+    }
+}
+
+static bool validate_iobuf_block_allocator(const char*, const std::string& value) {
+    if (value == "malloc") {
+        if (is_hugepage_block_allocator_used()) {
+            LOG(ERROR) << "Can't change -iobuf_block_allocator back to malloc";
+            return false;
+        }
+        return true;
+    }
+    if (value == "hugepage") {
+        return use_hugepage_block_allocator() == 0;
+    }
+    LOG(ERROR) << "Unknown iobuf_block_allocator=" << value;
+    return false;
+}
+
+const bool ALLOW_UNUSED validate_iobuf_block_allocator_dummy =
+    GFLAGS_NAMESPACE::RegisterFlagValidator(&FLAGS_iobuf_block_allocator,
+                                            &validate_iobuf_block_allocator);
+
+}  // namespace iobuf
+}  // namespace butil
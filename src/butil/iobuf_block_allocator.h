@@ -0,0 +1,83 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef BUTIL_IOBUF_BLOCK_ALLOCATOR_H
+#define BUTIL_IOBUF_BLOCK_ALLOCATOR_H
+
+#include <stddef.h>
+#include <ostream>
+#include <vector>
+
+// Allocators of memory of IOBuf::Block, selected by -iobuf_block_allocator:
+//
+//   malloc    (default) Blocks are malloc-ed one by one.
+//   hugepage  Blocks are carved out of 2MB huge pages, either transparent
+//             ones or hugetlbfs ones (-iobuf_hugepage_explicit). Walking
+//             chains of blocks (writing to fds, parsing messages) touches
+//             much fewer TLB entries. Each NUMA node has its own arena which
+//             is bound to the node, threads allocate from the arena of the
+//             node they run on. Freed blocks are cached by threads and shared
+//             through the arenas, memory is never given back to the system.
+//
+// The allocator can't be switched back to malloc after hugepage is chosen,
+// since blocks allocated by then may still be alive.
+
+namespace butil {
+namespace iobuf {
+
+// Allocate `size' bytes for a block from the huge page arenas. Blocks larger
+// than the default block size (GetDefaultBlockSize() when the arenas were
+// created) or beyond -iobuf_hugepage_arena_mb are malloc-ed.
+void* hugepage_block_allocate(size_t size);
+
+// Free memory returned by hugepage_block_allocate() or malloc().
+void hugepage_block_deallocate(void* mem);
+
+// Return true if `mem' is inside the huge page arenas.
+bool is_hugepage_block(const void* mem);
+
+// Make IOBuf allocate blocks with hugepage_block_allocate(), same as setting
+// -iobuf_block_allocator=hugepage. Fail if blockmem_allocate was replaced by
+// others (e.g. RDMA).
+// Returns 0 on success, -1 otherwise.
+int use_hugepage_block_allocator();
+
+bool is_hugepage_block_allocator_used();
+
+struct HugePageArenaStat {
+    int node;
+    // Virtual memory reserved for the arena.
+    size_t reserved_bytes;
+    // Huge pages mapped so far.
+    size_t mapped_bytes;
+    // Number of blocks carved out of mapped pages.
+    size_t carved_blocks;
+    // Number of freed blocks held by the arena, not including blocks
+    // cached by threads.
+    size_t free_blocks;
+};
+
+// Get stats of all arenas. Empty if the arenas are not created yet.
+void get_hugepage_arena_stats(std::vector<HugePageArenaStat>* stats);
+
+// Print the allocator and stats of arenas in plain text.
+void describe_block_allocator(std::ostream& os);
+
+}  // namespace iobuf
+}  // namespace butil
+
+#endif  // BUTIL_IOBUF_BLOCK_ALLOCATOR_H
@@ -28,7 +28,9 @@
 #include "butil/type_traits.h"           // butil::add_cr_non_integral
 #include "butil/synchronization/lock.h"  // butil::Lock
 #include "butil/containers/linked_list.h"// LinkNode
+#include "butil/memory/aligned_memory.h" // butil::AlignedAlloc
 #include "bvar/detail/agent_group.h"    // detail::AgentGroup
+#include "bvar/detail/percpu.h"         // percpu_agent_count
 #include "bvar/detail/is_atomical.h"
 #include "bvar/detail/call_op_returning_void.h"
 
@@ -228,10 +230,20 @@ friend class GlobalValue<self_type>;
         , _op(op)
         , _global_result(result_identity)
         , _result_identity(result_identity)
-        , _element_identity(element_identity) {
+        , _element_identity(element_identity)
+        , _percpu_agents(nullptr)
+        , _npercpu_agent(0) {
+        create_percpu_agents(is_atomical<ElementTp>());
     }
 
     ~AgentCombiner() {
+        if (_percpu_agents) {
+            for (uint32_t i = 0; i < _npercpu_agent; ++i) {
+                _percpu_agents[i].~PerCpuAgent();
+            }
+            butil::AlignedFree(_percpu_agents);
+            _percpu_agents = nullptr;
+        }
         if (_id >= 0) {
             // NOTE: We intentionally do NOT walk `_agents` here (e.g. via the
             // previously existed `clear_all_agents()`).
@@ -302,21 +314,26 @@ friend class GlobalValue<self_type>;
         return tmp;
     }
 
-    // Always called from the thread owning the agent.
+    // Called when a thread-local agent is destroyed. The element is taken
+    // with an atomic exchange under _lock, so writers still running CAS
+    // loops on the agent (e.g. on a per-cpu agent) lose no value: they
+    // retry against the identity.
     void commit_and_erase(Agent* agent) {
         if (nullptr == agent) {
             return;
         }
-        ElementTp local;
+        ElementTp prev;
         butil::AutoLock guard(_lock);
         // TODO: For non-atomic types, we can pass the reference to op directly.
         // But atomic types cannot. The code is a little troublesome to write.
-        agent->element.load(&local);
-        call_op_returning_void(_op, _global_result, local);
+        agent->element.exchange(&prev, _element_identity);
+        call_op_returning_void(_op, _global_result, prev);
         agent->RemoveFromList();
     }
 
-    // Always called from the thread owning the agent
+    // May be called from any thread writing the agent, including other
+    // threads sharing a per-cpu agent. The element is taken with an atomic
+    // exchange under _lock, which is safe with concurrent CAS writers.
     void commit_and_clear(Agent* agent) {
         if (nullptr == agent) {
             return;
@@ -328,7 +345,14 @@ friend class GlobalValue<self_type>;
     }
 
     // We need this function to be as fast as possible.
+    // Returns the agent of current cpu instead if per-cpu agents are used,
+    // which may be modified by other threads concurrently.
     Agent* get_or_create_tls_agent() {
+        if (_percpu_agents) {
+            const uint32_t cpu = current_cpu();
+            return &_percpu_agents[cpu < _npercpu_agent ?
+                                   cpu : cpu % _npercpu_agent].agent;
+        }
         Agent* agent = AgentGroup::get_tls_agent(_id);
         if (!agent) {
             // Create the agent
@@ -380,7 +404,39 @@ friend class GlobalValue<self_type>;
 
     bool valid() const { return _id >= 0; }
 
+    bool use_percpu_agents() const { return _percpu_agents != nullptr; }
+
 private:
+    // Every cpu has its own agent which lies in separate cachelines.
+    struct BAIDU_CACHELINE_ALIGNMENT PerCpuAgent {
+        Agent agent;
+    };
+
+    // Atomical elements can be modified by threads sharing a per-cpu agent,
+    // with memory bounded by the number of cpus rather than the number of
+    // threads ever modified the combiner. Per-cpu agents are never removed
+    // from _agents and don't belong to any thread.
+    void create_percpu_agents(butil::true_type) {
+        const int n = percpu_agent_count();
+        if (n <= 0) {
+            return;
+        }
+        void* mem = butil::AlignedAlloc(sizeof(PerCpuAgent) * n,
+                                        BAIDU_CACHELINE_SIZE);
+        if (mem == nullptr) {
+            return;
+        }
+        _percpu_agents = static_cast<PerCpuAgent*>(mem);
+        _npercpu_agent = n;
+        for (int i = 0; i < n; ++i) {
+            PerCpuAgent* a = new (&_percpu_agents[i]) PerCpuAgent;
+            a->agent.element.store(_element_identity);
+            _agents.Append(&a->agent);
+        }
+    }
+    void create_percpu_agents(butil::false_type) {}
+
+
     AgentId                                     _id;
     BinaryOp                                    _op;
     mutable butil::Lock                          _lock;
@@ -388,6 +444,8 @@ private:
     ResultTp                                    _result_identity;
     ElementTp                                   _element_identity;
     butil::LinkedList<Agent>                     _agents;
+    PerCpuAgent*                                _percpu_agents;
+    uint32_t                                    _npercpu_agent;
 };
 
 }  // namespace detail
@@ -0,0 +1,182 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef  BVAR_DETAIL_HISTOGRAM_H
+#define  BVAR_DETAIL_HISTOGRAM_H
+
+#include <stdint.h>                     // uint32_t
+#include <string.h>                     // memset
+#include <ostream>                      // std::ostream
+#include "butil/atomicops.h"            // butil::atomic
+#include "butil/macros.h"               // BAIDU_CASSERT
+#include "butil/strings/string_piece.h"
+#include "bvar/detail/combiner.h"       // ElementContainer
+
+namespace bvar {
+namespace detail {
+
+// Counters of values in log-linear buckets: values less than 2^SUB_BUCKET_BITS
+// have their own buckets, every [2^e, 2^(e+1)) above is split into
+// 2^SUB_BUCKET_BITS buckets of the same width. Thus the width of a bucket is
+// at most 1/32 of its lower bound. Values are clamped into [0, 2^32-1].
+// Layout of buckets is fixed, buckets of different histograms, windows or
+// processes can be merged exactly by adding the counters.
+struct HistogramBuckets {
+    static const int SUB_BUCKET_BITS = 5;
+    static const size_t SUB_BUCKET_COUNT = (1 << SUB_BUCKET_BITS);
+    static const size_t NBUCKET = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    HistogramBuckets() { memset(this, 0, sizeof(*this)); }
+
+    static size_t bucket_index(uint32_t value) {
+        if (value < SUB_BUCKET_COUNT) {
+            return value;
+        }
+        const int shift = 31 - __builtin_clz(value) - SUB_BUCKET_BITS;
+        return ((size_t)(shift + 1) << SUB_BUCKET_BITS) +
+            ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+    }
+    static uint32_t bucket_lower_bound(size_t index) {
+        if (index < SUB_BUCKET_COUNT) {
+            return index;
+        }
+        const int shift = (index >> SUB_BUCKET_BITS) - 1;
+        return (uint32_t)(SUB_BUCKET_COUNT + (index & (SUB_BUCKET_COUNT - 1)))
+            << shift;
+    }
+    // The largest value in the bucket.
+    static uint32_t bucket_upper_bound(size_t index) {
+        if (index < SUB_BUCKET_COUNT) {
+            return index;
+        }
+        const int shift = (index >> SUB_BUCKET_BITS) - 1;
+        return bucket_lower_bound(index) + (uint32_t)((1UL << shift) - 1);
+    }
+
+    // Get the `ratio'-ile value, e.g. 0.99 means 99%-ile value. The upper
+    // bound of the bucket holding the value is returned, which is at most
+    // 1/32 larger than the actual value.
+    uint32_t get_number(double ratio) const;
+
+    void operator+=(const HistogramBuckets& rhs) {
+        sum += rhs.sum;
+        count += rhs.count;
+        for (size_t i = 0; i < NBUCKET; ++i) {
+            counts[i] += rhs.counts[i];
+        }
+    }
+    void operator-=(const HistogramBuckets& rhs) {
+        sum -= rhs.sum;
+        count -= rhs.count;
+        for (size_t i = 0; i < NBUCKET; ++i) {
+            counts[i] -= rhs.counts[i];
+        }
+    }
+    bool operator==(const HistogramBuckets& rhs) const {
+        return memcmp(this, &rhs, sizeof(*this)) == 0;
+    }
+
+    // Print as {"count":N,"sum":S,"buckets":{"UPPER_BOUND":COUNT,...}} in
+    // which only non-empty buckets are listed.
+    void describe(std::ostream& os) const;
+
+    // Parse output of describe(). Returns 0 on success, -1 otherwise.
+    int parse(const butil::StringPiece& desc);
+
+    int64_t sum;
+    uint64_t count;
+    uint64_t counts[NBUCKET];
+};
+
+inline std::ostream& operator<<(std::ostream& os, const HistogramBuckets& b) {
+    b.describe(os);
+    return os;
+}
+
+struct AddHistogramBuckets {
+    void operator()(HistogramBuckets& b1, const HistogramBuckets& b2) const {
+        b1 += b2;
+    }
+};
+
+struct MinusHistogramBuckets {
+    void operator()(HistogramBuckets& b1, const HistogramBuckets& b2) const {
+        b1 -= b2;
+    }
+};
+
+// Thread-local buckets. Only the owning thread adds values, with relaxed
+// loads and stores rather than locks or atomic read-modify-writes, while
+// combining threads read the counters one by one. Exchanging (resetting)
+// the buckets concurrently with adding may lose values being added.
+template <>
+class ElementContainer<HistogramBuckets> {
+public:
+    ElementContainer() : _sum(0), _count(0) {
+        for (size_t i = 0; i < HistogramBuckets::NBUCKET; ++i) {
+            _counts[i].store(0, butil::memory_order_relaxed);
+        }
+    }
+
+    void load(HistogramBuckets* out) {
+        out->sum = _sum.load(butil::memory_order_relaxed);
+        out->count = _count.load(butil::memory_order_relaxed);
+        for (size_t i = 0; i < HistogramBuckets::NBUCKET; ++i) {
+            out->counts[i] = _counts[i].load(butil::memory_order_relaxed);
+        }
+    }
+
+    void store(const HistogramBuckets& b) {
+        _sum.store(b.sum, butil::memory_order_relaxed);
+        _count.store(b.count, butil::memory_order_relaxed);
+        for (size_t i = 0; i < HistogramBuckets::NBUCKET; ++i) {
+            _counts[i].store(b.counts[i], butil::memory_order_relaxed);
+        }
+    }
+
+    void exchange(HistogramBuckets* prev, const HistogramBuckets& b) {
+        prev->sum = _sum.exchange(b.sum, butil::memory_order_relaxed);
+        prev->count = _count.exchange(b.count, butil::memory_order_relaxed);
+        for (size_t i = 0; i < HistogramBuckets::NBUCKET; ++i) {
+            prev->counts[i] = _counts[i].exchange(
+                b.counts[i], butil::memory_order_relaxed);
+        }
+    }
+
+    // [Unique] Called from the owning thread only.
+    void add(uint32_t value) {
+        butil::atomic<uint64_t>& c = _counts[HistogramBuckets::bucket_index(value)];
+        c.store(c.load(butil::memory_order_relaxed) + 1,
+                butil::memory_order_relaxed);
+        _sum.store(_sum.load(butil::memory_order_relaxed) + value,
+                   butil::memory_order_relaxed);
+        _count.store(_count.load(butil::memory_order_relaxed) + 1,
+                     butil::memory_order_relaxed);
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(ElementContainer);
+
+    butil::atomic<int64_t> _sum;
+    butil::atomic<uint64_t> _count;
+    butil::atomic<uint64_t> _counts[HistogramBuckets::NBUCKET];
+};
+
+}  // namespace detail
+}  // namespace bvar
+
+#endif  // BVAR_DETAIL_HISTOGRAM_H
@@ -0,0 +1,56 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <unistd.h>                              // sysconf
+#include <gflags/gflags.h>
+#include "butil/logging.h"
+#include "bvar/detail/percpu.h"
+
+namespace bvar {
+
+DEFINE_bool(bvar_percpu_reducer, false, "Put values of Adder, Maxer, Miner "
+            "and IntRecorder created afterwards into per-cpu agents rather "
+            "than thread-local agents when rseq is available");
+
+namespace detail {
+
+static int get_percpu_agent_count() {
+#ifdef BVAR_HAS_RSEQ
+    // Registration of rseq is disabled, e.g. by
+    // GLIBC_TUNABLES=glibc.pthread.rseq=0, or failed.
+    if (__rseq_size == 0 || (int32_t)current_cpu() < 0) {
+        LOG(WARNING) << "rseq is not registered, bvar_percpu_reducer is ignored";
+        return 0;
+    }
+    const long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    return ncpu > 0 ? (int)ncpu : 0;
+#else
+    LOG(WARNING) << "rseq is not supported, bvar_percpu_reducer is ignored";
+    return 0;
+#endif
+}
+
+int percpu_agent_count() {
+    if (!FLAGS_bvar_percpu_reducer) {
+        return 0;
+    }
+    static const int n = get_percpu_agent_count();
+    return n;
+}
+
+}  // namespace detail
+}  // namespace bvar
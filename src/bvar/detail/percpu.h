@@ -0,0 +1,60 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef  BVAR_DETAIL_PERCPU_H
+#define  BVAR_DETAIL_PERCPU_H
+
+#include <stdint.h>                         // uint32_t
+#include "butil/build_config.h"             // OS_LINUX
+#if defined(OS_LINUX)
+#include <features.h>                       // __GLIBC_PREREQ
+#endif
+
+// glibc >= 2.35 registers a rseq (restartable sequences) area for every
+// thread, in which the kernel keeps the id of the cpu running the thread.
+#if defined(OS_LINUX) && defined(__GLIBC_PREREQ) && defined(__has_builtin)
+#if __GLIBC_PREREQ(2, 35) && __has_builtin(__builtin_thread_pointer)
+#define BVAR_HAS_RSEQ 1
+#include <sys/rseq.h>                       // __rseq_offset, __rseq_size
+#endif
+#endif
+
+namespace bvar {
+namespace detail {
+
+// Number of per-cpu agents of a reducer, which is the number of cpus if
+// -bvar_percpu_reducer is on and rseq is available, 0 otherwise, in which
+// case thread-local agents are used.
+int percpu_agent_count();
+
+// Id of the cpu running the calling thread. Only meaningful when
+// percpu_agent_count() > 0, and the thread may be moved to another cpu
+// right after, so the id is just a hint to spread contentions.
+inline uint32_t current_cpu() {
+#ifdef BVAR_HAS_RSEQ
+    const struct rseq* rs = (const struct rseq*)(
+        (char*)__builtin_thread_pointer() + __rseq_offset);
+    return __atomic_load_n(&rs->cpu_id, __ATOMIC_RELAXED);
+#else
+    return 0;
+#endif
+}
+
+}  // namespace detail
+}  // namespace bvar
+
+#endif  // BVAR_DETAIL_PERCPU_H
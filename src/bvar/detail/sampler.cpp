@@ -17,7 +17,10 @@
 
 // Date: Tue Jul 28 18:14:40 CST 2015
 
+#include <algorithm>                           // std::min
 #include <gflags/gflags.h>
+#include "butil/reloadable_flags.h"
+#include "butil/string_printf.h"
 #include "butil/threading/platform_thread.h"
 #include "butil/time.h"
 #include "butil/memory/singleton_on_pthread_once.h"
@@ -49,6 +52,23 @@ struct CombineSampler {
 // of child as well, no need to register in the child again.
 static bool registered_atfork = false;
 
+// Max value of -bvar_sampler_thread_num.
+static const int MAX_SAMPLER_COLLECTORS = 32;
+
+static bool validate_bvar_sampler_thread_num(const char*, int32_t v) {
+    if (v < 1 || v > MAX_SAMPLER_COLLECTORS) {
+        LOG(ERROR) << "Invalid bvar_sampler_thread_num=" << v
+                   << ", must be in [1, " << MAX_SAMPLER_COLLECTORS << "]";
+        return false;
+    }
+    return true;
+}
+DEFINE_int32(bvar_sampler_thread_num, 1, "Number of threads to call "
+             "take_sample() of samplers (used by Window, PerSecond, "
+             "LatencyRecorder etc). Samplers scheduled afterwards are "
+             "distributed to the threads in round-robin");
+BUTIL_VALIDATE_GFLAG(bvar_sampler_thread_num, validate_bvar_sampler_thread_num);
+
 // Call take_sample() of all scheduled samplers.
 // This can be done with regular timer thread, but it's way too slow(global
 // contention + log(N) heap manipulations). We need it to be super fast so that
@@ -60,12 +80,20 @@ static bool registered_atfork = false;
 // list of Samplers. Waking through the list and call take_sample().
 // If a Sampler needs to be deleted, we just mark it as unused and the
 // deletion is taken place in the thread as well.
+// Samplers are sharded into -bvar_sampler_thread_num SamplerCollectors (see
+// SamplerCollectorGroup), each of which has its own thread, so that hundreds
+// of thousands of samplers can still be sampled within one second.
 class SamplerCollector : public bvar::Reducer<Sampler*, CombineSampler> {
 public:
-    SamplerCollector()
-        : _created(false)
+    explicit SamplerCollector(int index)
+        : _index(index)
+        , _created(false)
         , _stop(false)
-        , _cumulated_time_us(0) {
+        , _cumulated_time_us(0)
+        , _lag_us(0)
+        , _duration_us(0)
+        , _lag_bvar(nullptr)
+        , _duration_bvar(nullptr) {
         create_sampling_thread();
     }
     ~SamplerCollector() {
@@ -76,17 +104,26 @@ public:
         }
     }
 
+    int64_t cumulated_time_us() const {
+        return _cumulated_time_us.load(butil::memory_order_relaxed);
+    }
+
+    void after_forked_as_child() {
+        _created = false;
+        create_sampling_thread();
+    }
+
 private:
+    DISALLOW_COPY_AND_ASSIGN(SamplerCollector);
+
     // Support for fork:
     // * The singleton can be null before forking, the child callback will not
     //   be registered.
     // * If the singleton is not null before forking, the child callback will
-    //   be registered and the sampling thread will be re-created.
+    //   be registered and the sampling threads will be re-created.
     // * A forked program can be forked again.
 
-    static void child_callback_atfork() {
-        butil::get_leaky_singleton<SamplerCollector>()->after_forked_as_child();
-    }
+    static void child_callback_atfork();
 
     void create_sampling_thread() {
         const int rc = pthread_create(&_tid, nullptr, sampling_thread, this);
@@ -101,11 +138,6 @@ private:
         }
     }
 
-    void after_forked_as_child() {
-        _created = false;
-        create_sampling_thread();
-    }
-
     void run();
 
     static void* sampling_thread(void* arg) {
@@ -114,18 +146,108 @@ private:
         return nullptr;
     }
 
-    static double get_cumulated_time(void* arg) {
-        return static_cast<SamplerCollector*>(arg)->_cumulated_time_us / 1000.0 / 1000.0;
+    static int64_t get_lag_us(void* arg) {
+        return static_cast<SamplerCollector*>(arg)->_lag_us.load(
+            butil::memory_order_relaxed);
+    }
+
+    static int64_t get_duration_us(void* arg) {
+        return static_cast<SamplerCollector*>(arg)->_duration_us.load(
+            butil::memory_order_relaxed);
     }
 
 private:
+    const int _index;
     bool _created;
     bool _stop;
-    int64_t _cumulated_time_us;
+    butil::atomic<int64_t> _cumulated_time_us;
+    // How late the last round started compared to one second after the
+    // start of the previous round.
+    butil::atomic<int64_t> _lag_us;
+    // Time spent by the last round.
+    butil::atomic<int64_t> _duration_us;
+    PassiveStatus<int64_t>* _lag_bvar;
+    PassiveStatus<int64_t>* _duration_bvar;
     pthread_t _tid;
 };
 
+// Create SamplerCollectors on demand and distribute samplers to them.
+class SamplerCollectorGroup {
+public:
+    SamplerCollectorGroup() : _next(0), _ncollector(0) {
+        for (int i = 0; i < MAX_SAMPLER_COLLECTORS; ++i) {
+            _collectors[i].store(nullptr, butil::memory_order_relaxed);
+        }
+    }
+
+    void schedule(Sampler* s) {
+        // The flag may be modified at runtime, read it every time.
+        const int n = std::max(1, std::min(
+            (int)FLAGS_bvar_sampler_thread_num, MAX_SAMPLER_COLLECTORS));
+        const uint32_t i =
+            _next.fetch_add(1, butil::memory_order_relaxed) % n;
+        *get_collector(i) << s;
+    }
+
+    double cumulated_time_s() {
+        int64_t total_us = 0;
+        const int n = _ncollector.load(butil::memory_order_acquire);
+        for (int i = 0; i < n; ++i) {
+            SamplerCollector* c = _collectors[i].load(butil::memory_order_acquire);
+            if (c) {
+                total_us += c->cumulated_time_us();
+            }
+        }
+        return total_us / 1000.0 / 1000.0;
+    }
+
+    void after_forked_as_child() {
+        const int n = _ncollector.load(butil::memory_order_acquire);
+        for (int i = 0; i < n; ++i) {
+            SamplerCollector* c = _collectors[i].load(butil::memory_order_acquire);
+            if (c) {
+                c->after_forked_as_child();
+            }
+        }
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(SamplerCollectorGroup);
+
+    SamplerCollector* get_collector(int i) {
+        SamplerCollector* c = _collectors[i].load(butil::memory_order_acquire);
+        if (BAIDU_LIKELY(c != nullptr)) {
+            return c;
+        }
+        BAIDU_SCOPED_LOCK(_mutex);
+        c = _collectors[i].load(butil::memory_order_relaxed);
+        if (c == nullptr) {
+            // Never deleted, as the singleton was.
+            c = new SamplerCollector(i);
+            _collectors[i].store(c, butil::memory_order_release);
+            if (i >= _ncollector.load(butil::memory_order_relaxed)) {
+                _ncollector.store(i + 1, butil::memory_order_release);
+            }
+        }
+        return c;
+    }
+
+    butil::atomic<uint32_t> _next;
+    // Collectors in [0, _ncollector) may be created.
+    butil::atomic<int> _ncollector;
+    butil::atomic<SamplerCollector*> _collectors[MAX_SAMPLER_COLLECTORS];
+    butil::Mutex _mutex;
+};
+
+void SamplerCollector::child_callback_atfork() {
+    butil::get_leaky_singleton<SamplerCollectorGroup>()->after_forked_as_child();
+}
+
 #ifndef UNIT_TEST
+static double get_cumulated_time(void*) {
+    return butil::get_leaky_singleton<SamplerCollectorGroup>()->cumulated_time_s();
+}
+
 static PassiveStatus<double>* s_cumulated_time_bvar = nullptr;
 static bvar::PerSecond<bvar::PassiveStatus<double> >* s_sampling_thread_usage_bvar = nullptr;
 #endif
@@ -141,21 +263,38 @@ void SamplerCollector::run() {
     //   may be abandoned at any time after forking.
     // * They can't created inside the constructor of SamplerCollector as well,
     //   which results in deadlock.
-    if (s_cumulated_time_bvar == nullptr) {
+    // * The first collector is always created, usage of all collectors is
+    //   exposed by its thread.
+    if (_index == 0 && s_cumulated_time_bvar == nullptr) {
         s_cumulated_time_bvar =
-            new PassiveStatus<double>(get_cumulated_time, this);
+            new PassiveStatus<double>(get_cumulated_time, nullptr);
     }
-    if (s_sampling_thread_usage_bvar == nullptr) {
+    if (_index == 0 && s_sampling_thread_usage_bvar == nullptr) {
         s_sampling_thread_usage_bvar =
             new bvar::PerSecond<bvar::PassiveStatus<double> >(
                     "bvar_sampler_collector_usage", s_cumulated_time_bvar, 10);
     }
+    if (_lag_bvar == nullptr) {
+        _lag_bvar = new PassiveStatus<int64_t>(
+            butil::string_printf("bvar_sampler_collector_%d_lag_us", _index),
+            get_lag_us, this);
+    }
+    if (_duration_bvar == nullptr) {
+        _duration_bvar = new PassiveStatus<int64_t>(
+            butil::string_printf("bvar_sampler_collector_%d_duration_us", _index),
+            get_duration_us, this);
+    }
 #endif
 
     butil::LinkNode<Sampler> root;
     int consecutive_nosleep = 0;
+    int64_t expected_start_us = 0;
     while (!_stop) {
         int64_t abstime = butil::cpuwide_time_us();
+        if (expected_start_us != 0) {
+            _lag_us.store(std::max(abstime - expected_start_us, (int64_t)0),
+                          butil::memory_order_relaxed);
+        }
         Sampler* s = this->reset();
         if (s) {
             s->InsertBeforeAsList(&root);
@@ -177,8 +316,10 @@ void SamplerCollector::run() {
         }
         bool slept = false;
         int64_t now = butil::cpuwide_time_us();
-        _cumulated_time_us += now - abstime;
+        _duration_us.store(now - abstime, butil::memory_order_relaxed);
+        _cumulated_time_us.fetch_add(now - abstime, butil::memory_order_relaxed);
         abstime += 1000000L;
+        expected_start_us = abstime;
         while (abstime > now) {
             ::usleep(abstime - now);
             slept = true;
@@ -206,7 +347,7 @@ void Sampler::schedule() {
     // since the SamplerCollector is initialized before the program starts
     // flags will not take effect if used in the SamplerCollector constructor
     if (FLAGS_bvar_enable_sampling) {
-        *butil::get_leaky_singleton<SamplerCollector>() << this;
+        butil::get_leaky_singleton<SamplerCollectorGroup>()->schedule(this);
     }
 }
 
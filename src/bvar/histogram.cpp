@@ -0,0 +1,178 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <math.h>                                // ceil
+#include <limits>                                // std::numeric_limits
+#include "butil/logging.h"
+#include "butil/strings/string_number_conversions.h"
+#include "bvar/histogram.h"
+
+namespace bvar {
+namespace detail {
+
+const int HistogramBuckets::SUB_BUCKET_BITS;
+const size_t HistogramBuckets::SUB_BUCKET_COUNT;
+const size_t HistogramBuckets::NBUCKET;
+
+uint32_t HistogramBuckets::get_number(double ratio) const {
+    uint64_t n = (uint64_t)ceil(ratio * count);
+    if (n > count) {
+        n = count;
+    } else if (n == 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < NBUCKET; ++i) {
+        if (n <= counts[i]) {
+            return bucket_upper_bound(i);
+        }
+        n -= counts[i];
+    }
+    // Counters are read one by one when combining thread-local buckets,
+    // `count' may be slightly larger than sum of the counters.
+    for (size_t i = NBUCKET; i > 0; --i) {
+        if (counts[i - 1]) {
+            return bucket_upper_bound(i - 1);
+        }
+    }
+    return 0;
+}
+
+void HistogramBuckets::describe(std::ostream& os) const {
+    os << "{\"count\":" << count << ",\"sum\":" << sum << ",\"buckets\":{";
+    bool first = true;
+    for (size_t i = 0; i < NBUCKET; ++i) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        if (!first) {
+            os << ',';
+        }
+        first = false;
+        os << '"' << bucket_upper_bound(i) << "\":" << counts[i];
+    }
+    os << "}}";
+}
+
+// Consume `prefix' at the beginning of `s'.
+static bool consume(butil::StringPiece* s, const butil::StringPiece& prefix) {
+    if (!s->starts_with(prefix)) {
+        return false;
+    }
+    s->remove_prefix(prefix.size());
+    return true;
+}
+
+// Consume digits (and the sign) at the beginning of `s'.
+static butil::StringPiece consume_number(butil::StringPiece* s) {
+    size_t n = 0;
+    if (n < s->size() && (*s)[n] == '-') {
+        ++n;
+    }
+    while (n < s->size() && (*s)[n] >= '0' && (*s)[n] <= '9') {
+        ++n;
+    }
+    const butil::StringPiece num = s->substr(0, n);
+    s->remove_prefix(n);
+    return num;
+}
+
+int HistogramBuckets::parse(const butil::StringPiece& desc) {
+    *this = HistogramBuckets();
+    butil::StringPiece s = desc;
+    if (!consume(&s, "{\"count\":") ||
+        !butil::StringToUint64(consume_number(&s), &count) ||
+        !consume(&s, ",\"sum\":") ||
+        !butil::StringToInt64(consume_number(&s), &sum) ||
+        !consume(&s, ",\"buckets\":{")) {
+        return -1;
+    }
+    bool first = true;
+    while (!consume(&s, "}}")) {
+        if (!first && !consume(&s, ",")) {
+            return -1;
+        }
+        first = false;
+        uint64_t upper = 0;
+        uint64_t n = 0;
+        if (!consume(&s, "\"") ||
+            !butil::StringToUint64(consume_number(&s), &upper) ||
+            upper > std::numeric_limits<uint32_t>::max() ||
+            !consume(&s, "\":") ||
+            !butil::StringToUint64(consume_number(&s), &n)) {
+            return -1;
+        }
+        const size_t index = bucket_index((uint32_t)upper);
+        if (bucket_upper_bound(index) != upper) {
+            return -1;
+        }
+        counts[index] += n;
+    }
+    return s.empty() ? 0 : -1;
+}
+
+}  // namespace detail
+
+LogLinearHistogram::LogLinearHistogram()
+    : _combiner(std::make_shared<combiner_type>())
+    , _sampler(nullptr) {}
+
+LogLinearHistogram::LogLinearHistogram(const butil::StringPiece& name)
+    : LogLinearHistogram() {
+    expose(name);
+}
+
+LogLinearHistogram::LogLinearHistogram(const butil::StringPiece& prefix,
+                                       const butil::StringPiece& name)
+    : LogLinearHistogram() {
+    expose_as(prefix, name);
+}
+
+LogLinearHistogram::~LogLinearHistogram() {
+    hide();
+    if (_sampler) {
+        _sampler->destroy();
+        _sampler = nullptr;
+    }
+}
+
+LogLinearHistogram& LogLinearHistogram::operator<<(int64_t value) {
+    if (BAIDU_UNLIKELY(value < 0)) {
+        if (!name().empty()) {
+            LOG_EVERY_SECOND(WARNING) << "Input=" << value << " to `" << name()
+                                      << "' is negative, drop";
+        } else if (!_debug_name.empty()) {
+            LOG_EVERY_SECOND(WARNING) << "Input=" << value << " to `" << _debug_name
+                                      << "' is negative, drop";
+        } else {
+            LOG_EVERY_SECOND(WARNING) << "Input=" << value << " to LogLinearHistogram("
+                                      << (void*)this << ") is negative, drop";
+        }
+        return *this;
+    }
+    if (value > std::numeric_limits<uint32_t>::max()) {
+        value = std::numeric_limits<uint32_t>::max();
+    }
+    agent_type* agent = _combiner->get_or_create_tls_agent();
+    if (BAIDU_UNLIKELY(!agent)) {
+        LOG(FATAL) << "Fail to create agent";
+        return *this;
+    }
+    agent->element.add((uint32_t)value);
+    return *this;
+}
+
+}  // namespace bvar
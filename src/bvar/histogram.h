@@ -0,0 +1,102 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#ifndef  BVAR_HISTOGRAM_H
+#define  BVAR_HISTOGRAM_H
+
+#include <stdint.h>                              // int64_t
+#include <string>
+#include "bvar/detail/combiner.h"                // detail::AgentCombiner
+#include "bvar/detail/histogram.h"               // detail::HistogramBuckets
+#include "bvar/detail/sampler.h"                 // detail::ReducerSampler
+#include "bvar/variable.h"
+#include "bvar/window.h"
+
+namespace bvar {
+
+// Count non-negative integers in fixed log-linear buckets (see
+// detail::HistogramBuckets), percentiles are accurate to 1/32 of the values
+// no matter how many values are added. Every thread adds values into its own
+// buckets without locking. Counters are cumulative, use Window<> to get
+// buckets within a time window, which are differences between two samples.
+// Example:
+//   LogLinearHistogram h("foo_size_histogram");
+//   Window<LogLinearHistogram> w(&h, 60);
+//   h << 10 << 1000;
+//   w.get_value().get_number(0.99);
+// Exposed histograms are described as
+//   {"count":N,"sum":S,"buckets":{"UPPER_BOUND":COUNT,...}}
+// which is recognized by the prometheus exporter of brpc.
+class LogLinearHistogram : public Variable {
+public:
+    typedef detail::HistogramBuckets value_type;
+    typedef detail::AddHistogramBuckets Op;
+    typedef detail::MinusHistogramBuckets InvOp;
+    typedef detail::ReducerSampler<LogLinearHistogram, value_type,
+                                   Op, InvOp> sampler_type;
+    typedef detail::AgentCombiner<value_type, value_type, Op> combiner_type;
+    typedef combiner_type::self_shared_type shared_combiner_type;
+    typedef combiner_type::Agent agent_type;
+
+    LogLinearHistogram();
+    explicit LogLinearHistogram(const butil::StringPiece& name);
+    LogLinearHistogram(const butil::StringPiece& prefix,
+                       const butil::StringPiece& name);
+    ~LogLinearHistogram() override;
+
+    // Negative values are dropped, values larger than 2^32-1 are counted
+    // as 2^32-1.
+    LogLinearHistogram& operator<<(int64_t value);
+
+    value_type get_value() const { return _combiner->combine_agents(); }
+
+    // Values being added concurrently may be lost.
+    value_type reset() { return _combiner->reset_all_agents(); }
+
+    Op op() const { return Op(); }
+    InvOp inv_op() const { return InvOp(); }
+
+    sampler_type* get_sampler() {
+        if (nullptr == _sampler) {
+            _sampler = new sampler_type(this);
+            _sampler->schedule();
+        }
+        return _sampler;
+    }
+
+    bool valid() const { return _combiner->valid(); }
+
+    void describe(std::ostream& os, bool /*quote_string*/) const override {
+        os << get_value();
+    }
+
+    // This name is useful for warning negative values in operator<<.
+    void set_debug_name(const butil::StringPiece& name) {
+        _debug_name.assign(name.data(), name.size());
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(LogLinearHistogram);
+
+    shared_combiner_type _combiner;
+    sampler_type* _sampler;
+    std::string _debug_name;
+};
+
+}  // namespace bvar
+
+#endif  // BVAR_HISTOGRAM_H
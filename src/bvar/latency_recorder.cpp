@@ -39,11 +39,16 @@ BUTIL_VALIDATE_GFLAG(bvar_latency_p2, valid_percentile);
 DEFINE_int32(bvar_latency_p3, 99, "Third latency percentile");
 BUTIL_VALIDATE_GFLAG(bvar_latency_p3, valid_percentile);
 
+DEFINE_bool(bvar_latency_histogram, false, "Compute percentiles of "
+            "LatencyRecorders created afterwards from log-linear histograms "
+            "rather than sampled latencies, and expose the histograms as "
+            "<prefix>_latency_histogram");
+
 namespace detail {
 
 typedef PercentileSamples<1022> CombinedPercentileSamples;
 
-CDF::CDF(PercentileWindow* w) : _w(w) {}
+CDF::CDF(PercentileWindow* w, HistogramWindow* hw) : _w(w), _hw(hw) {}
 
 CDF::~CDF() {
     hide();
@@ -61,22 +66,35 @@ int CDF::describe_series(
     if (options.test_only) {
         return 0;
     }
-    std::unique_ptr<CombinedPercentileSamples> cb(new CombinedPercentileSamples);
-    std::vector<GlobalPercentileSamples> buckets;
-    _w->get_samples(&buckets);
-    for (size_t i = 0; i < buckets.size(); ++i) {
-        cb->combine_of(buckets.begin(), buckets.end());
-    }
     std::pair<int, int> values[20];
     size_t n = 0;
-    for (int i = 1; i < 10; ++i) {
-        values[n++] = std::make_pair(i*10, cb->get_number(i * 0.1));
-    }
-    for (int i = 91; i < 100; ++i) {
-        values[n++] = std::make_pair(i, cb->get_number(i * 0.01));
+    if (_hw != nullptr) {
+        std::unique_ptr<HistogramBuckets> hb(
+            new HistogramBuckets(_hw->get_value()));
+        for (int i = 1; i < 10; ++i) {
+            values[n++] = std::make_pair(i*10, hb->get_number(i * 0.1));
+        }
+        for (int i = 91; i < 100; ++i) {
+            values[n++] = std::make_pair(i, hb->get_number(i * 0.01));
+        }
+        values[n++] = std::make_pair(100, hb->get_number(0.999));
+        values[n++] = std::make_pair(101, hb->get_number(0.9999));
+    } else {
+        std::unique_ptr<CombinedPercentileSamples> cb(new CombinedPercentileSamples);
+        std::vector<GlobalPercentileSamples> buckets;
+        _w->get_samples(&buckets);
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            cb->combine_of(buckets.begin(), buckets.end());
+        }
+        for (int i = 1; i < 10; ++i) {
+            values[n++] = std::make_pair(i*10, cb->get_number(i * 0.1));
+        }
+        for (int i = 91; i < 100; ++i) {
+            values[n++] = std::make_pair(i, cb->get_number(i * 0.01));
+        }
+        values[n++] = std::make_pair(100, cb->get_number(0.999));
+        values[n++] = std::make_pair(101, cb->get_number(0.9999));
     }
-    values[n++] = std::make_pair(100, cb->get_number(0.999));
-    values[n++] = std::make_pair(101, cb->get_number(0.9999));
     CHECK_EQ(n, arraysize(values));
     os << "{\"label\":\"cdf\",\"data\":[";
     for (size_t i = 0; i < n; ++i) {
@@ -141,21 +159,18 @@ static int64_t get_p3(void* arg) {
 }
 
 static Vector<int64_t, 4> get_latencies(void *arg) {
-    std::unique_ptr<CombinedPercentileSamples> cb(
-        combine((PercentileWindow*)arg));
-    // NOTE: We don't show 99.99% since it's often significantly larger than
-    // other values and make other curves on the plotted graph small and
-    // hard to read.
-    Vector<int64_t, 4> result;
-    result[0] = cb->get_number(FLAGS_bvar_latency_p1 / 100.0);
-    result[1] = cb->get_number(FLAGS_bvar_latency_p2 / 100.0);
-    result[2] = cb->get_number(FLAGS_bvar_latency_p3 / 100.0);
-    result[3] = cb->get_number(0.999);
-    return result;
+    // `arg' is the LatencyRecorderBase of a LatencyRecorder.
+    return static_cast<LatencyRecorder*>(
+        static_cast<LatencyRecorderBase*>(arg))->latency_percentiles();
 }
 
 LatencyRecorderBase::LatencyRecorderBase(time_t window_size)
     : _max_latency(0)
+    , _latency_histogram(FLAGS_bvar_latency_histogram ?
+                         new LogLinearHistogram : nullptr)
+    , _latency_histogram_window(_latency_histogram ?
+                                new HistogramWindow(_latency_histogram, window_size)
+                                : nullptr)
     , _latency_window(&_latency, window_size)
     , _max_latency_window(&_max_latency, window_size)
     , _count(get_recorder_count, &_latency)
@@ -166,16 +181,45 @@ LatencyRecorderBase::LatencyRecorderBase(time_t window_size)
     , _latency_p3(get_p3, this)
     , _latency_999(get_percetile<999, 1000>, this)
     , _latency_9999(get_percetile<9999, 10000>, this)
-    , _latency_cdf(&_latency_percentile_window)
-    , _latency_percentiles(get_latencies, &_latency_percentile_window)
+    , _latency_cdf(&_latency_percentile_window, _latency_histogram_window)
+    , _latency_percentiles(get_latencies, this)
 {}
 
+LatencyRecorderBase::~LatencyRecorderBase() {
+    // Hide the variables referencing the histogram before destroying it.
+    _latency_cdf.hide();
+    _latency_percentiles.hide();
+    delete _latency_histogram_window;
+    _latency_histogram_window = nullptr;
+    delete _latency_histogram;
+    _latency_histogram = nullptr;
+}
+
 }  // namespace detail
 
 Vector<int64_t, 4> LatencyRecorder::latency_percentiles() const {
+    // NOTE: We don't show 99.99% since it's often significantly larger than
+    // other values and make other curves on the plotted graph small and
+    // hard to read.
+    Vector<int64_t, 4> result;
+    if (_latency_histogram_window) {
+        std::unique_ptr<detail::HistogramBuckets> hb(
+            new detail::HistogramBuckets(_latency_histogram_window->get_value()));
+        result[0] = hb->get_number(FLAGS_bvar_latency_p1 / 100.0);
+        result[1] = hb->get_number(FLAGS_bvar_latency_p2 / 100.0);
+        result[2] = hb->get_number(FLAGS_bvar_latency_p3 / 100.0);
+        result[3] = hb->get_number(0.999);
+        return result;
+    }
     // const_cast here is just to adapt parameter type and safe.
-    return detail::get_latencies(
-        const_cast<detail::PercentileWindow*>(&_latency_percentile_window));
+    std::unique_ptr<detail::CombinedPercentileSamples> cb(
+        detail::combine(const_cast<detail::PercentileWindow*>(
+                            &_latency_percentile_window)));
+    result[0] = cb->get_number(FLAGS_bvar_latency_p1 / 100.0);
+    result[1] = cb->get_number(FLAGS_bvar_latency_p2 / 100.0);
+    result[2] = cb->get_number(FLAGS_bvar_latency_p3 / 100.0);
+    result[3] = cb->get_number(0.999);
+    return result;
 }
 
 int64_t LatencyRecorder::qps(time_t window_size) const {
@@ -215,6 +259,9 @@ int LatencyRecorder::expose(const butil::StringPiece& prefix1,
     // set debug names for printing helpful error log.
     _latency.set_debug_name(prefix);
     _latency_percentile.set_debug_name(prefix);
+    if (_latency_histogram) {
+        _latency_histogram->set_debug_name(prefix);
+    }
 
     if (_latency_window.expose_as(prefix, "latency") != 0) {
         return -1;
@@ -253,6 +300,11 @@ int LatencyRecorder::expose(const butil::StringPiece& prefix1,
     if (_latency_percentiles.expose_as(prefix, "latency_percentiles", DISPLAY_ON_HTML) != 0) {
         return -1;
     }
+    if (_latency_histogram &&
+        _latency_histogram->expose_as(prefix, "latency_histogram",
+                                      DISPLAY_ON_PLAIN_TEXT) != 0) {
+        return -1;
+    }
     if (FLAGS_save_series) {
         snprintf(namebuf, sizeof(namebuf), "%d%%,%d%%,%d%%,99.9%%",
                  (int)FLAGS_bvar_latency_p1, (int)FLAGS_bvar_latency_p2,
@@ -263,6 +315,11 @@ int LatencyRecorder::expose(const butil::StringPiece& prefix1,
 }
 
 int64_t LatencyRecorder::latency_percentile(double ratio) const {
+    if (_latency_histogram_window) {
+        std::unique_ptr<detail::HistogramBuckets> hb(
+            new detail::HistogramBuckets(_latency_histogram_window->get_value()));
+        return hb->get_number(ratio);
+    }
     std::unique_ptr<detail::CombinedPercentileSamples> cb(
         combine((detail::PercentileWindow*)&_latency_percentile_window));
     return cb->get_number(ratio);
@@ -280,6 +337,14 @@ void LatencyRecorder::hide() {
     _latency_9999.hide();
     _latency_cdf.hide();
     _latency_percentiles.hide();
+    if (_latency_histogram) {
+        _latency_histogram->hide();
+    }
+}
+
+const std::string& LatencyRecorder::latency_histogram_name() const {
+    static const std::string empty_name;
+    return _latency_histogram ? _latency_histogram->name() : empty_name;
 }
 
 DEFINE_uint64(latency_scale_factor, 1, "latency scale factor, used by method status, etc., latency_us = latency * latency_scale_factor");
@@ -288,7 +353,11 @@ LatencyRecorder& LatencyRecorder::operator<<(int64_t latency) {
     latency = latency / FLAGS_latency_scale_factor;
     _latency << latency;
     _max_latency << latency;
-    _latency_percentile << latency;
+    if (_latency_histogram) {
+        *_latency_histogram << latency;
+    } else {
+        _latency_percentile << latency;
+    }
     return *this;
 }
 
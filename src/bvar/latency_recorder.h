@@ -24,6 +24,7 @@
 #include "bvar/reducer.h"
 #include "bvar/passive_status.h"
 #include "bvar/detail/percentile.h"
+#include "bvar/histogram.h"
 
 namespace bvar {
 namespace detail {
@@ -32,28 +33,36 @@ class Percentile;
 typedef Window<IntRecorder, SERIES_IN_SECOND> RecorderWindow;
 typedef Window<Maxer<int64_t>, SERIES_IN_SECOND> MaxWindow;
 typedef Window<Percentile, SERIES_IN_SECOND> PercentileWindow;
+typedef Window<LogLinearHistogram, SERIES_IN_SECOND> HistogramWindow;
 
 // NOTE: Always use int64_t in the interfaces no matter what the impl. is.
 
 class CDF : public Variable {
 public:
-    explicit CDF(PercentileWindow* w);
+    // Values are from `hw' if it's not nullptr, otherwise from `w'.
+    explicit CDF(PercentileWindow* w, HistogramWindow* hw = nullptr);
     ~CDF() override;
     void describe(std::ostream& os, bool quote_string) const override;
     int describe_series(std::ostream& os, const SeriesOptions& options) const override;
 private:
     PercentileWindow* _w; 
+    HistogramWindow* _hw;
 };
 
 // For mimic constructor inheritance.
 class LatencyRecorderBase {
 public:
     explicit LatencyRecorderBase(time_t window_size);
+    ~LatencyRecorderBase();
     time_t window_size() const { return _latency_window.window_size(); }
 protected:
     IntRecorder _latency;
     Maxer<int64_t> _max_latency;
     Percentile _latency_percentile;
+    // Replace _latency_percentile when -bvar_latency_histogram is true at
+    // construction, nullptr otherwise.
+    LogLinearHistogram* _latency_histogram;
+    HistogramWindow* _latency_histogram_window;
 
     RecorderWindow _latency_window;
     MaxWindow _max_latency_window;
@@ -107,6 +116,8 @@ public:
     //                                    // foo_bar_write_max_latency
     //                                    // foo_bar_write_count
     //                                    // foo_bar_write_qps
+    //                                    // foo_bar_write_latency_histogram
+    //                                    // (-bvar_latency_histogram only)
     //   rec.expose("foo_bar", "read");   // foo_bar_read_latency
     //                                    // foo_bar_read_max_latency
     //                                    // foo_bar_read_count
@@ -155,6 +166,8 @@ public:
     { return _max_latency_window.name(); }
     const std::string& count_name() const { return _count.name(); }
     const std::string& qps_name() const { return _qps.name(); }
+    // Empty if -bvar_latency_histogram was false at construction.
+    const std::string& latency_histogram_name() const;
 };
 
 std::ostream& operator<<(std::ostream& os, const LatencyRecorder&);
@@ -189,11 +189,18 @@ private:
     typename std::enable_if<butil::is_same<LatencyRecorder, U>::value, size_t>::type
     dump_impl(Dumper* dumper, const DumpOptions* options);
 
-    void make_dump_key(std::ostream& os, const key_type& labels_value,
-                       const std::string& suffix = "",  int quantile = 0);
-
-    void make_labels_kvpair_string(
-        std::ostream& os, const key_type& labels_value, int quantile);
+    // Put `name<suffix>{<labels>,quantile="<quantile>"}' into `key'.
+    // quantile is omitted if it's not positive.
+    void make_dump_key(std::string* key, const std::string& labels,
+                       const butil::StringPiece& suffix = butil::StringPiece(),
+                       int quantile = 0);
+
+    // Append `k1="v1",k2="v2"' to `labels'.
+    void make_labels_kvpair_string(std::string* labels,
+                                   const key_type& labels_value);
+
+    static bool dump_int_value(Dumper* dumper, const std::string& key,
+                               int64_t value);
 
 
     template <typename K>
@@ -20,6 +20,8 @@
 #ifndef BVAR_MULTI_DIMENSION_INL_H
 #define BVAR_MULTI_DIMENSION_INL_H
 
+#include <inttypes.h>                        // PRId64
+#include <stdio.h>                           // snprintf
 #include <gflags/gflags_declare.h>
 #include "butil/compiler_specific.h"
 
@@ -232,16 +234,22 @@ MultiDimension<T, KeyType, Shared>::dump_impl(Dumper* dumper, const DumpOptions*
         return 0;
     }
     size_t n = 0;
+    // Buffers are reused by all stats to avoid allocations for each stats.
+    std::string labels;
+    std::string key;
+    CharArrayStreamBuf streambuf;
+    std::ostream os(&streambuf);
     for (auto &label_name : label_names) {
         value_ptr_type bvar = get_stats_impl(label_name);
         if (nullptr == bvar) {
             continue;
         }
-        std::ostringstream oss;
-        bvar->describe(oss, options->quote_string);
-        std::ostringstream oss_key;
-        make_dump_key(oss_key, label_name);
-        if (!dumper->dump_mvar(oss_key.str(), oss.str())) {
+        streambuf.reset();
+        bvar->describe(os, options->quote_string);
+        labels.clear();
+        make_labels_kvpair_string(&labels, label_name);
+        make_dump_key(&key, labels);
+        if (!dumper->dump_mvar(key, streambuf.data())) {
             continue;
         }
         n++;
@@ -258,85 +266,78 @@ MultiDimension<T, KeyType, Shared>::dump_impl(Dumper* dumper, const DumpOptions*
     if (label_names.empty()) {
         return 0;
     }
+    // Look up stats and format their labels only once, the formatted labels
+    // are shared by all series of the same stats.
+    std::vector<std::pair<value_ptr_type, std::string> > stats;
+    stats.reserve(label_names.size());
+    for (auto &label_name : label_names) {
+        value_ptr_type bvar = get_stats_impl(label_name);
+        if (nullptr == bvar) {
+            continue;
+        }
+        stats.emplace_back(bvar, std::string());
+        make_labels_kvpair_string(&stats.back().second, label_name);
+    }
     size_t n = 0;
+    std::string key;
     // To meet prometheus specification, we must guarantee no second TYPE line for one metric name
 
     // latency comment
     dumper->dump_comment(this->name() + "_latency", METRIC_TYPE_GAUGE);
-    for (auto &label_name : label_names) {
-        bvar::LatencyRecorder* bvar = get_stats_impl(label_name);
-        if (!bvar) {
-            continue;
-        }
-
+    const int latency_percentiles[3] {
+        FLAGS_bvar_latency_p1, FLAGS_bvar_latency_p2, FLAGS_bvar_latency_p3};
+    for (auto& stat : stats) {
+        const value_ptr_type& bvar = stat.first;
+        const std::string& labels = stat.second;
         // latency
-        std::ostringstream oss_latency_key;
-        make_dump_key(oss_latency_key, label_name, "_latency");
-        if (dumper->dump_mvar(oss_latency_key.str(), std::to_string(bvar->latency()))) {
+        make_dump_key(&key, labels, "_latency");
+        if (dump_int_value(dumper, key, bvar->latency())) {
             n++;
         }
         // latency_percentiles
-        // p1/p2/p3
-        int latency_percentiles[3] {FLAGS_bvar_latency_p1, FLAGS_bvar_latency_p2, FLAGS_bvar_latency_p3};
-        for (auto lp : latency_percentiles) {
-            std::ostringstream oss_lp_key;
-            make_dump_key(oss_lp_key, label_name, "_latency", lp);
-            if (dumper->dump_mvar(oss_lp_key.str(), std::to_string(bvar->latency_percentile(lp / 100.0)))) {
+        // p1/p2/p3/999, all of which are from one combination of samples.
+        const Vector<int64_t, 4> values = bvar->latency_percentiles();
+        for (size_t i = 0; i < arraysize(latency_percentiles); ++i) {
+            make_dump_key(&key, labels, "_latency", latency_percentiles[i]);
+            if (dump_int_value(dumper, key, values[i])) {
                 n++;
             }
         }
         // 999
-        std::ostringstream oss_p999_key;
-        make_dump_key(oss_p999_key, label_name, "_latency", 999);
-        if (dumper->dump_mvar(oss_p999_key.str(), std::to_string(bvar->latency_percentile(0.999)))) {
+        make_dump_key(&key, labels, "_latency", 999);
+        if (dump_int_value(dumper, key, values[3])) {
             n++;
         }
         // 9999
-        std::ostringstream oss_p9999_key;
-        make_dump_key(oss_p9999_key, label_name, "_latency", 9999);
-        if (dumper->dump_mvar(oss_p9999_key.str(), std::to_string(bvar->latency_percentile(0.9999)))) {
+        make_dump_key(&key, labels, "_latency", 9999);
+        if (dump_int_value(dumper, key, bvar->latency_percentile(0.9999))) {
             n++;
         }
     }
 
     // max_latency comment
     dumper->dump_comment(this->name() + "_max_latency", METRIC_TYPE_GAUGE);
-    for (auto &label_name : label_names) {
-        LatencyRecorder* bvar = get_stats_impl(label_name);
-        if (nullptr == bvar) {
-            continue;
-        }
-        std::ostringstream oss_max_latency_key;
-        make_dump_key(oss_max_latency_key, label_name, "_max_latency");
-        if (dumper->dump_mvar(oss_max_latency_key.str(), std::to_string(bvar->max_latency()))) {
+    for (auto& stat : stats) {
+        make_dump_key(&key, stat.second, "_max_latency");
+        if (dump_int_value(dumper, key, stat.first->max_latency())) {
             n++;
         }
     }
 
     // qps comment
     dumper->dump_comment(this->name() + "_qps", METRIC_TYPE_GAUGE);
-    for (auto &label_name : label_names) {
-        LatencyRecorder* bvar = get_stats_impl(label_name);
-        if (nullptr == bvar) {
-            continue;
-        }
-        std::ostringstream oss_qps_key;
-        make_dump_key(oss_qps_key, label_name, "_qps");
-        if (dumper->dump_mvar(oss_qps_key.str(), std::to_string(bvar->qps()))) {
+    for (auto& stat : stats) {
+        make_dump_key(&key, stat.second, "_qps");
+        if (dump_int_value(dumper, key, stat.first->qps())) {
             n++;
         }
     }
 
     // count comment
     dumper->dump_comment(this->name() + "_count", METRIC_TYPE_COUNTER);
-    for (auto &label_name : label_names) {
-        LatencyRecorder* bvar = get_stats_impl(label_name);
-        if (nullptr == bvar) {
-            continue;
-        }
-        std::ostringstream oss_count_key;
-        make_dump_key(oss_count_key, label_name, "_count");
-        if (dumper->dump_mvar(oss_count_key.str(), std::to_string(bvar->count()))) {
+    for (auto& stat : stats) {
+        make_dump_key(&key, stat.second, "_count");
+        if (dump_int_value(dumper, key, stat.first->count())) {
             n++;
         }
     }
@@ -344,31 +345,48 @@ MultiDimension<T, KeyType, Shared>::dump_impl(Dumper* dumper, const DumpOptions*
 }
 
 template <typename T, typename KeyType, bool Shared>
-void MultiDimension<T, KeyType, Shared>::make_dump_key(std::ostream& os, const key_type& labels_value,
-                                               const std::string& suffix, int quantile) {
-    os << this->name();
-    if (!suffix.empty()) {
-        os << suffix;
+bool MultiDimension<T, KeyType, Shared>::dump_int_value(
+    Dumper* dumper, const std::string& key, int64_t value) {
+    char buf[24];
+    const int len = snprintf(buf, sizeof(buf), "%" PRId64, value);
+    return dumper->dump_mvar(key, butil::StringPiece(buf, len));
+}
+
+template <typename T, typename KeyType, bool Shared>
+void MultiDimension<T, KeyType, Shared>::make_dump_key(
+    std::string* key, const std::string& labels,
+    const butil::StringPiece& suffix, int quantile) {
+    key->assign(this->name());
+    suffix.AppendToString(key);
+    key->push_back('{');
+    key->append(labels);
+    if (quantile > 0) {
+        if (!labels.empty()) {
+            key->push_back(',');
+        }
+        key->append("quantile=\"");
+        char buf[16];
+        key->append(buf, snprintf(buf, sizeof(buf), "%d", quantile));
+        key->push_back('"');
     }
-    make_labels_kvpair_string(os, labels_value, quantile);
+    key->push_back('}');
 }
 
 template <typename T, typename KeyType, bool Shared>
 void MultiDimension<T, KeyType, Shared>::make_labels_kvpair_string(
-    std::ostream& os, const key_type& labels_value, int quantile) {
-    os << "{";
+    std::string* labels, const key_type& labels_value) {
     auto label_key = this->_labels.cbegin();
     auto label_value = labels_value.cbegin();
-    char comma[2] = {'\0', '\0'};
     for (; label_key != this->_labels.cend() && label_value != labels_value.cend();
         label_key++, label_value++) {
-        os << comma << label_key->c_str() << "=\"" << label_value->c_str() << "\"";
-        comma[0] = ',';
-    }
-    if (quantile > 0) {
-        os << comma << "quantile=\"" << quantile << "\"";
+        if (!labels->empty()) {
+            labels->push_back(',');
+        }
+        labels->append(label_key->c_str());
+        labels->append("=\"");
+        labels->append(label_value->c_str());
+        labels->push_back('"');
     }
-    os << "}";
 }
 
 template <typename T, typename KeyType, bool Shared>
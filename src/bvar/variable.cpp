@@ -311,27 +311,6 @@ int Variable::get_exposed(const std::string& name, boost::any* value) {
 #endif
 
 // TODO(gejun): This is copied from otherwhere, common it if possible.
-
-// Underlying buffer to store logs. Comparing to using std::ostringstream
-// directly, this utility exposes more low-level methods so that we avoid
-// creation of std::string which allocates memory internally.
-class CharArrayStreamBuf : public std::streambuf {
-public:
-    explicit CharArrayStreamBuf() : _data(nullptr), _size(0) {}
-    ~CharArrayStreamBuf();
-
-    int overflow(int ch) override;
-    int sync() override;
-    void reset();
-    butil::StringPiece data() {
-        return butil::StringPiece(pbase(), pptr() - pbase());
-    }
-
-private:
-    char* _data;
-    size_t _size;
-};
-
 CharArrayStreamBuf::~CharArrayStreamBuf() {
     free(_data);
 }
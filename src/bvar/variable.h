@@ -21,6 +21,7 @@
 #define  BVAR_VARIABLE_H
 
 #include <ostream>                     // std::ostream
+#include <streambuf>                   // std::streambuf
 #include <string>                      // std::string
 #include <vector>                      // std::vector
 #include <gflags/gflags_declare.h>
@@ -56,6 +57,36 @@ enum DisplayFilter {
     DISPLAY_ON_ALL = 3,
 };
 
+// Underlying buffer to store descriptions. Comparing to using
+// std::ostringstream directly, this utility exposes more low-level methods
+// so that we avoid creation of std::string which allocates memory internally.
+// Example:
+//   CharArrayStreamBuf buf;
+//   std::ostream os(&buf);
+//   for (...) {
+//       buf.reset();
+//       var->describe(os, false);
+//       use(buf.data());
+//   }
+class CharArrayStreamBuf : public std::streambuf {
+public:
+    explicit CharArrayStreamBuf() : _data(nullptr), _size(0) {}
+    ~CharArrayStreamBuf() override;
+
+    int overflow(int ch) override;
+    int sync() override;
+    void reset();
+    butil::StringPiece data() {
+        return butil::StringPiece(pbase(), pptr() - pbase());
+    }
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(CharArrayStreamBuf);
+
+    char* _data;
+    size_t _size;
+};
+
 // Implement this class to write variables into different places.
 // If dump() returns false, Variable::dump_exposed() stops and returns -1.
 class Dumper {
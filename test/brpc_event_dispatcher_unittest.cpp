@@ -29,6 +29,7 @@
 #include "butil/fd_utility.h"
 #include "butil/memory/scope_guard.h"
 #include "bthread/bthread.h"
+#include "bvar/variable.h"
 #include "brpc/event_dispatcher.h"
 #include "brpc/socket.h"
 #include "brpc/details/has_epollrdhup.h"
@@ -532,3 +533,72 @@ TEST_F(EventDispatcherTest, customize_dispatch_task) {
     ASSERT_EQ(nullptr, ptr);
     ASSERT_NE(0, EventPipe::Address(id, &ptr));
 }
+
+TEST_F(EventDispatcherTest, batch_input_and_busy_poll) {
+    const bool saved_batch_input = brpc::FLAGS_event_dispatcher_batch_input;
+    const int32_t saved_busy_poll_us = brpc::FLAGS_event_dispatcher_busy_poll_us;
+    brpc::FLAGS_event_dispatcher_batch_input = true;
+    brpc::FLAGS_event_dispatcher_busy_poll_us = 1000;
+    BRPC_SCOPE_EXIT {
+        brpc::FLAGS_event_dispatcher_batch_input = saved_batch_input;
+        brpc::FLAGS_event_dispatcher_busy_poll_us = saved_busy_poll_us;
+    };
+
+    const size_t NCLIENT = 8;
+    int fds[2 * NCLIENT];
+    SocketExtra* sm[NCLIENT];
+    brpc::SocketId socket_ids[NCLIENT];
+    for (size_t i = 0; i < NCLIENT; ++i) {
+        ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds + 2 * i));
+        sm[i] = new SocketExtra;
+        butil::make_non_blocking(fds[i * 2]);
+        brpc::SocketOptions options;
+        options.fd = fds[i * 2];
+        options.user = sm[i];
+        options.on_edge_triggered_events = SocketExtra::OnEdgeTriggeredEvents;
+        ASSERT_EQ(0, brpc::Socket::Create(options, &socket_ids[i]));
+    }
+
+    // Make all sockets readable in each round so that one epoll_wait
+    // harvests events of several sockets.
+    const size_t NROUND = 200;
+    char buf[64];
+    memset(buf, 'a', sizeof(buf));
+    for (size_t r = 0; r < NROUND; ++r) {
+        for (size_t i = 0; i < NCLIENT; ++i) {
+            ASSERT_EQ((ssize_t)sizeof(buf), write(fds[i * 2 + 1], buf, sizeof(buf)));
+        }
+        usleep(100);
+    }
+    const int64_t deadline_us = butil::gettimeofday_us() + 5000000L;
+    size_t server_bytes = 0;
+    while (butil::gettimeofday_us() < deadline_us) {
+        server_bytes = 0;
+        for (size_t i = 0; i < NCLIENT; ++i) {
+            server_bytes += sm[i]->bytes;
+        }
+        if (server_bytes == NROUND * NCLIENT * sizeof(buf)) {
+            break;
+        }
+        usleep(1000);
+    }
+    ASSERT_EQ(NROUND * NCLIENT * sizeof(buf), server_bytes);
+
+    // Events arriving within the window turn busy polling on.
+    const std::string hit =
+        bvar::Variable::describe_exposed("event_dispatcher_busy_poll_hit");
+    const std::string miss =
+        bvar::Variable::describe_exposed("event_dispatcher_busy_poll_miss");
+    ASSERT_FALSE(hit.empty());
+    ASSERT_FALSE(miss.empty());
+    ASSERT_GT(strtoll(hit.c_str(), nullptr, 10) +
+              strtoll(miss.c_str(), nullptr, 10), 0);
+
+    for (size_t i = 0; i < NCLIENT; ++i) {
+        brpc::SocketUniquePtr s;
+        if (brpc::Socket::Address(socket_ids[i], &s) == 0) {
+            s->SetFailed();
+        }
+        close(fds[i * 2 + 1]);
+    }
+}
@@ -223,3 +223,33 @@ TEST_F(MessengerTest, dispatch_tasks) {
     }
     LOG(WARNING) << "begin to exit!!!!";
 }
+
+TEST_F(MessengerTest, read_size_follows_events) {
+    brpc::SocketOptions options;
+    brpc::SocketId id = brpc::INVALID_SOCKET_ID;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+
+    // Sized by messages before any event is read.
+    s->_avg_msg_size = 1024;
+    ASSERT_EQ(16 * 1024u, brpc::InputMessenger::OnceReadSize(s.get()));
+
+    // Connections streaming data read more at once.
+    for (int i = 0; i < 32; ++i) {
+        brpc::InputMessenger::UpdateReadSize(s.get(), 256 * 1024);
+    }
+    ASSERT_GE(brpc::InputMessenger::OnceReadSize(s.get()), 256 * 1024u);
+    // Capped.
+    for (int i = 0; i < 32; ++i) {
+        brpc::InputMessenger::UpdateReadSize(s.get(), 64 * 1024 * 1024);
+    }
+    ASSERT_EQ(524288u, brpc::InputMessenger::OnceReadSize(s.get()));
+
+    // Chatty connections don't prepare space for messages never coming.
+    for (int i = 0; i < 128; ++i) {
+        brpc::InputMessenger::UpdateReadSize(s.get(), 100);
+    }
+    ASSERT_EQ(4096u, brpc::InputMessenger::OnceReadSize(s.get()));
+    ASSERT_EQ(0, s->SetFailed());
+}
@@ -0,0 +1,208 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#if BRPC_WITH_IO_URING
+#include "butil/iobuf.h"
+#include "bthread/bthread.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/server.h"
+#include "brpc/socket.h"
+#include "brpc/io_uring/io_uring_context.h"
+#include "echo.pb.h"
+
+namespace brpc {
+namespace iouring {
+DECLARE_int32(io_uring_recv_buffer_count);
+DECLARE_int32(io_uring_recv_buffer_size);
+} // namespace iouring
+} // namespace brpc
+
+namespace {
+
+static const int PORT = 8733;
+
+class EchoServiceImpl : public test::EchoService {
+public:
+    EchoServiceImpl() : nio_uring_request(0) {}
+
+    void Echo(google::protobuf::RpcController* cntl_base,
+              const test::EchoRequest* request,
+              test::EchoResponse* response,
+              google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        response->set_message(request->message());
+        brpc::SocketUniquePtr s;
+        if (brpc::Socket::Address(cntl->_current_call.peer_id, &s) == 0 &&
+            s->socket_mode() == brpc::SOCKET_MODE_IO_URING) {
+            nio_uring_request.fetch_add(1, butil::memory_order_relaxed);
+        }
+        cntl->response_attachment().append(cntl->request_attachment());
+    }
+
+    // Number of requests received by io_uring sockets.
+    butil::atomic<int> nio_uring_request;
+};
+
+class IoUringTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        brpc::ServerOptions options;
+        options.socket_mode = brpc::SOCKET_MODE_IO_URING;
+        ASSERT_EQ(0, _server.AddService(&_svc, brpc::SERVER_DOESNT_OWN_SERVICE));
+        ASSERT_EQ(0, _server.Start(PORT, &options));
+    }
+
+    void TearDown() override {
+        _server.Stop(0);
+        _server.Join();
+    }
+
+    static void InitChannel(brpc::Channel* channel) {
+        brpc::ChannelOptions options;
+        options.socket_mode = brpc::SOCKET_MODE_IO_URING;
+        options.timeout_ms = 5000;
+        options.max_retry = 0;
+        ASSERT_EQ(0, channel->Init(butil::EndPoint(butil::my_ip(), PORT), &options));
+    }
+
+    EchoServiceImpl _svc;
+    brpc::Server _server;
+};
+
+TEST_F(IoUringTest, echo) {
+    brpc::Channel channel;
+    InitChannel(&channel);
+    test::EchoService_Stub stub(&channel);
+    for (int i = 0; i < 100; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("hello io_uring");
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ("hello io_uring", res.message());
+    }
+    // All requests were received by io_uring sockets.
+    ASSERT_EQ(100, _svc.nio_uring_request.load());
+}
+
+TEST_F(IoUringTest, large_attachment) {
+    brpc::Channel channel;
+    InitChannel(&channel);
+    test::EchoService_Stub stub(&channel);
+    // Much larger than all provided buffers, so that recv runs out of
+    // buffers and is re-armed after the buffers are recycled, and sends
+    // are split into multiple linked SENDMSG.
+    const size_t len = 16 * 1024 * 1024;
+    std::string data(len, 0);
+    for (size_t i = 0; i < len; ++i) {
+        data[i] = (char)(i * 7);
+    }
+    for (int i = 0; i < 3; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("large");
+        cntl.request_attachment().append(data);
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(len, cntl.response_attachment().size());
+        ASSERT_TRUE(cntl.response_attachment().equals(data));
+    }
+}
+
+struct CallArg {
+    brpc::Channel* channel;
+    int ncall;
+    int nfail;
+};
+
+static void* CallEcho(void* void_arg) {
+    CallArg* arg = static_cast<CallArg*>(void_arg);
+    test::EchoService_Stub stub(arg->channel);
+    for (int i = 0; i < arg->ncall; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("concurrent");
+        cntl.request_attachment().resize(1000 + i * 10, 'x');
+        stub.Echo(&cntl, &req, &res, nullptr);
+        if (cntl.Failed() ||
+            cntl.response_attachment().size() != 1000u + i * 10) {
+            ++arg->nfail;
+        }
+    }
+    return nullptr;
+}
+
+TEST_F(IoUringTest, concurrent_calls_share_connection) {
+    brpc::Channel channel;
+    InitChannel(&channel);
+    const int NTHREAD = 8;
+    bthread_t tids[NTHREAD];
+    CallArg args[NTHREAD];
+    for (int i = 0; i < NTHREAD; ++i) {
+        args[i] = { &channel, 200, 0 };
+        ASSERT_EQ(0, bthread_start_background(&tids[i], nullptr, CallEcho, &args[i]));
+    }
+    for (int i = 0; i < NTHREAD; ++i) {
+        bthread_join(tids[i], nullptr);
+        ASSERT_EQ(0, args[i].nfail);
+    }
+}
+
+TEST_F(IoUringTest, server_closes_connection) {
+    brpc::Channel channel;
+    InitChannel(&channel);
+    test::EchoService_Stub stub(&channel);
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("before");
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    }
+    _server.Stop(0);
+    _server.Join();
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("after");
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_TRUE(cntl.Failed());
+    }
+}
+
+} // namespace
+#endif // BRPC_WITH_IO_URING
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+#if BRPC_WITH_IO_URING
+    // Few buffers to cover the path of running out of provided buffers.
+    brpc::iouring::FLAGS_io_uring_recv_buffer_count = 64;
+    brpc::iouring::FLAGS_io_uring_recv_buffer_size = 4096;
+#endif // BRPC_WITH_IO_URING
+    return RUN_ALL_TESTS();
+}
@@ -26,6 +26,7 @@
 #include "gperftools_helper.h"
 #include "butil/compiler_specific.h"
 #include "butil/containers/doubly_buffered_data.h"
+#include "butil/containers/epoch_buffered_data.h"
 #include "brpc/describable.h"
 #include "brpc/socket.h"
 #include "brpc/socket_map.h"
@@ -142,6 +143,104 @@ TEST_F(LoadBalancerTest, doubly_buffered_data) {
     test_doubly_buffered_data<butil::DoublyBufferedData<Foo, butil::Void, true>>();
 }
 
+TEST_F(LoadBalancerTest, epoch_buffered_data) {
+    test_doubly_buffered_data<butil::EpochBufferedData<Foo>>();
+    test_doubly_buffered_data<butil::EpochBufferedData<Foo, UserTLS>>();
+
+    // Nested reads of the same or different instances.
+    butil::EpochBufferedData<Foo> d1;
+    butil::EpochBufferedData<Foo> d2;
+    d1.Modify(AddN, 1);
+    {
+        butil::EpochBufferedData<Foo>::ScopedPtr p1;
+        ASSERT_EQ(0, d1.Read(&p1));
+        {
+            butil::EpochBufferedData<Foo>::ScopedPtr p2;
+            ASSERT_EQ(0, d2.Read(&p2));
+            ASSERT_EQ(0, p2->x);
+            ASSERT_EQ(0, d1.Read([](const Foo& f) {
+                ASSERT_EQ(1, f.x);
+            }));
+            // Read again with the same ptr.
+            ASSERT_EQ(0, d2.Read(&p2));
+            ASSERT_EQ(0, p2->x);
+        }
+        ASSERT_EQ(1, p1->x);
+    }
+    ASSERT_EQ(1UL, d2.Modify(AddN, 2));
+    ASSERT_EQ(0, d2.Read([](const Foo& f) {
+        ASSERT_EQ(2, f.x);
+    }));
+}
+
+static butil::atomic<bool> g_ebd_stopped(false);
+
+struct EBDReadArgs {
+    butil::EpochBufferedData<Foo>* d;
+    int64_t nread;
+    int64_t nerror;
+};
+
+void* read_and_check_ebd(void* void_arg) {
+    EBDReadArgs* args = (EBDReadArgs*)void_arg;
+    while (!g_ebd_stopped.load(butil::memory_order_relaxed)) {
+        butil::EpochBufferedData<Foo>::ScopedPtr ptr;
+        if (args->d->Read(&ptr) != 0) {
+            ++args->nerror;
+            continue;
+        }
+        // The instance being read must not be modified until ptr is
+        // destructed.
+        const volatile int* px = &ptr->x;
+        const int x = *px;
+        for (int i = 0; i < 100; ++i) {
+            if (*px != x) {
+                ++args->nerror;
+                break;
+            }
+        }
+        ++args->nread;
+    }
+    return nullptr;
+}
+
+TEST_F(LoadBalancerTest, epoch_buffered_data_modify_during_reading) {
+    g_ebd_stopped.store(false);
+    butil::EpochBufferedData<Foo> d;
+    pthread_t th[4];
+    EBDReadArgs args[ARRAY_SIZE(th)];
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        args[i].d = &d;
+        args[i].nread = 0;
+        args[i].nerror = 0;
+        ASSERT_EQ(0, pthread_create(&th[i], nullptr, read_and_check_ebd, &args[i]));
+    }
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        while (((volatile EBDReadArgs*)&args[i])->nread == 0) {
+            usleep(1000);
+        }
+    }
+    const int N = 500;
+    butil::Timer tm;
+    tm.start();
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(1UL, d.Modify(AddN, 1));
+    }
+    tm.stop();
+    g_ebd_stopped.store(true);
+    int64_t nread = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(th); ++i) {
+        ASSERT_EQ(0, pthread_join(th[i], nullptr));
+        ASSERT_EQ(0, args[i].nerror);
+        nread += args[i].nread;
+    }
+    ASSERT_EQ(0, d.Read([N](const Foo& f) {
+        ASSERT_EQ(N, f.x);
+    }));
+    LOG(INFO) << "nread=" << nread
+              << " modify_latency=" << tm.n_elapsed() / N << "ns";
+}
+
 bool exitFlag = false;
 
 template <typename DBD>
@@ -329,8 +428,23 @@ TEST_F(LoadBalancerTest, dbd_performance) {
     PerfTest<butil::DoublyBufferedData<PerfMap, butil::Void, true>>(thread_num, true);
 }
 
+TEST_F(LoadBalancerTest, ebd_performance) {
+    int thread_num = 1;
+    PerfTest<butil::EpochBufferedData<PerfMap>>(thread_num, false);
+    PerfTest<butil::EpochBufferedData<PerfMap>>(thread_num, true);
+
+    thread_num = 4;
+    PerfTest<butil::EpochBufferedData<PerfMap>>(thread_num, false);
+    PerfTest<butil::EpochBufferedData<PerfMap>>(thread_num, true);
+
+    thread_num = 16;
+    PerfTest<butil::EpochBufferedData<PerfMap>>(thread_num, false);
+    PerfTest<butil::EpochBufferedData<PerfMap>>(thread_num, true);
+}
+
 
 typedef brpc::policy::LocalityAwareLoadBalancer LALB;
+typedef brpc::policy::EpochLocalityAwareLoadBalancer EpochLALB;
 
 static void ValidateWeightTree(
     std::vector<LALB::ServerInfo> & weight_tree) {
@@ -358,8 +472,9 @@ static void ValidateWeightTree(
     }
 }
 
-static void ValidateLALB(LALB& lalb, size_t N) {
-    LALB::Servers* d = lalb._db_servers._data;
+template <typename LB>
+static void ValidateLALB(LB& lalb, size_t N) {
+    typename LB::Servers* d = lalb._db_servers._data;
     for (size_t R = 0; R < 2; ++R) {
         ASSERT_EQ(d[R].weight_tree.size(), N);
         ASSERT_EQ(d[R].server_map.size(), N);
@@ -380,8 +495,9 @@ static void ValidateLALB(LALB& lalb, size_t N) {
     ASSERT_EQ(total, lalb._total.load());
 }
 
-TEST_F(LoadBalancerTest, la_sanity) {
-    LALB lalb;
+template <typename LB>
+void TestLALBSanity() {
+    LB lalb;
     ASSERT_EQ(0, lalb._total.load());
     std::vector<brpc::ServerId> ids;
     const size_t N = 256;
@@ -422,6 +538,11 @@ TEST_F(LoadBalancerTest, la_sanity) {
     }
 }
 
+TEST_F(LoadBalancerTest, la_sanity) {
+    TestLALBSanity<LALB>();
+    TestLALBSanity<EpochLALB>();
+}
+
 typedef std::map<brpc::SocketId, int> CountMap;
 volatile bool global_stop = false;
 
@@ -467,7 +588,7 @@ class SaveRecycle : public brpc::SocketUser {
 };
 
 TEST_F(LoadBalancerTest, update_while_selection) {
-    for (size_t round = 0; round < 5; ++round) {
+    for (size_t round = 0; round < 7; ++round) {
         brpc::LoadBalancer* lb = nullptr;
         SelectArg sa = { nullptr, nullptr};
         bool is_lalb = false;
@@ -480,9 +601,17 @@ TEST_F(LoadBalancerTest, update_while_selection) {
             is_lalb = true;
         } else if (round == 3) {
             lb = new brpc::policy::WeightedRoundRobinLoadBalancer;
-        } else {
+        } else if (round == 4) {
             lb = new brpc::policy::ConsistentHashingLoadBalancer(brpc::policy::CONS_HASH_LB_MURMUR3);
             sa.hash = ::brpc::policy::MurmurHash32;
+        } else if (round == 5) {
+            // EpochLocalityAwareLoadBalancer is not tested here since it
+            // modifies servers one by one in RemoveServersInBatch(), each
+            // waiting for all the busy selecting threads to be scheduled.
+            lb = new brpc::policy::EpochRoundRobinLoadBalancer;
+        } else {
+            lb = new brpc::policy::EpochConsistentHashingLoadBalancer(brpc::policy::CONS_HASH_LB_MURMUR3);
+            sa.hash = ::brpc::policy::MurmurHash32;
         }
         sa.lb = lb;
 
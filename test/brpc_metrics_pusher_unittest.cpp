@@ -0,0 +1,251 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+// brpc - A framework to host and access services throughout Baidu.
+
+#include <map>
+#include <vector>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include "butil/synchronization/lock.h"
+#include "brpc/server.h"
+#include "brpc/controller.h"
+#include "brpc/metrics_pusher.h"
+#include "brpc/prometheus_remote_write.pb.h"
+#include "brpc/policy/snappy_compress.h"
+#include "bvar/bvar.h"
+#include "bvar/multi_dimension.h"
+#include "echo.pb.h"
+
+namespace bvar {
+DECLARE_int32(bvar_max_dump_multi_dimension_metric_number);
+}
+
+namespace brpc {
+DECLARE_string(bvar_push_url);
+DECLARE_int32(bvar_push_interval);
+DECLARE_string(bvar_push_labels);
+}
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+// Stand-in of a server accepting prometheus remote write.
+class RemoteWriteServiceImpl : public ::test::UploadService {
+public:
+    RemoteWriteServiceImpl() : fail(false) {}
+
+    void Upload(::google::protobuf::RpcController* cntl_base,
+                const ::test::HttpRequest*,
+                ::test::HttpResponse*,
+                ::google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        if (fail) {
+            cntl->SetFailed("fail on purpose");
+            return;
+        }
+        const std::string* encoding =
+            cntl->http_request().GetHeader("Content-Encoding");
+        const std::string* version =
+            cntl->http_request().GetHeader("X-Prometheus-Remote-Write-Version");
+        if (encoding == nullptr || *encoding != "snappy" ||
+            version == nullptr || *version != "0.1.0" ||
+            cntl->http_request().content_type() != "application/x-protobuf" ||
+            cntl->http_request().method() != brpc::HTTP_METHOD_POST) {
+            cntl->http_response().set_status_code(brpc::HTTP_STATUS_BAD_REQUEST);
+            return;
+        }
+        brpc::prometheus::WriteRequest req;
+        if (!brpc::policy::SnappyDecompress(cntl->request_attachment(), &req)) {
+            cntl->http_response().set_status_code(brpc::HTTP_STATUS_BAD_REQUEST);
+            return;
+        }
+        BAIDU_SCOPED_LOCK(mutex);
+        requests.push_back(req);
+    }
+
+    // Series received, keyed by their labels except "job".
+    std::map<std::string, brpc::prometheus::TimeSeries> TakeSeries() {
+        std::map<std::string, brpc::prometheus::TimeSeries> m;
+        BAIDU_SCOPED_LOCK(mutex);
+        for (size_t i = 0; i < requests.size(); ++i) {
+            for (int j = 0; j < requests[i].timeseries_size(); ++j) {
+                const brpc::prometheus::TimeSeries& ts = requests[i].timeseries(j);
+                std::string key;
+                for (int k = 0; k < ts.labels_size(); ++k) {
+                    if (ts.labels(k).name() != "job") {
+                        key.append(ts.labels(k).name()).push_back('=');
+                        key.append(ts.labels(k).value()).push_back(' ');
+                    }
+                }
+                m[key] = ts;
+            }
+        }
+        requests.clear();
+        return m;
+    }
+
+    size_t TakeRequestCount() {
+        BAIDU_SCOPED_LOCK(mutex);
+        const size_t n = requests.size();
+        requests.clear();
+        return n;
+    }
+
+    bool fail;
+    butil::Mutex mutex;
+    std::vector<brpc::prometheus::WriteRequest> requests;
+};
+
+class MetricsPusherTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        bvar::FLAGS_bvar_max_dump_multi_dimension_metric_number = 100;
+        ASSERT_EQ(0, _server.AddService(&_svc, brpc::SERVER_DOESNT_OWN_SERVICE,
+                                        "/api/v1/write => Upload"));
+        ASSERT_EQ(0, _server.Start("127.0.0.1:8616", nullptr));
+    }
+
+    void TearDown() override {
+        _server.Stop(0);
+        _server.Join();
+        bvar::FLAGS_bvar_max_dump_multi_dimension_metric_number = 0;
+    }
+
+    brpc::Server _server;
+    RemoteWriteServiceImpl _svc;
+};
+
+const char* const URL = "http://127.0.0.1:8616/api/v1/write";
+
+TEST_F(MetricsPusherTest, push_changed_series) {
+    bvar::Adder<int> adder("pusher_test_adder");
+    bvar::Status<std::string> str("pusher_test_string", "not pushed");
+    bvar::MultiDimension<bvar::Adder<int> > madder(
+        "pusher_test_madder", {"method", "code"});
+    adder << 10;
+    *madder.get_stats({"Echo", "200"}) << 1;
+
+    brpc::MetricsPusherOptions options;
+    options.labels.push_back(std::make_pair("job", "pusher_test"));
+    options.labels.push_back(std::make_pair("code", "overridden"));
+    brpc::MetricsPusher pusher;
+    ASSERT_EQ(0, pusher.Init(URL, &options));
+    const int64_t before_ms = butil::gettimeofday_ms();
+    const int n1 = pusher.Push();
+    ASSERT_GT(n1, 0);
+
+    std::map<std::string, brpc::prometheus::TimeSeries> m = _svc.TakeSeries();
+    ASSERT_EQ((size_t)n1, m.size());
+    // Labels are sorted by names.
+    const std::string adder_key = "__name__=pusher_test_adder code=overridden ";
+    ASSERT_TRUE(m.count(adder_key));
+    const brpc::prometheus::TimeSeries& ts = m[adder_key];
+    ASSERT_EQ(3, ts.labels_size());
+    ASSERT_EQ("job", ts.labels(2).name());
+    ASSERT_EQ("pusher_test", ts.labels(2).value());
+    ASSERT_EQ(1, ts.samples_size());
+    ASSERT_EQ(10, ts.samples(0).value());
+    ASSERT_LE(before_ms, ts.samples(0).timestamp());
+    ASSERT_GE(butil::gettimeofday_ms(), ts.samples(0).timestamp());
+    // Labels of the series take precedence.
+    const std::string madder_key =
+        "__name__=pusher_test_madder code=200 method=Echo ";
+    ASSERT_TRUE(m.count(madder_key));
+    ASSERT_EQ(1, m[madder_key].samples(0).value());
+    for (auto it = m.begin(); it != m.end(); ++it) {
+        ASSERT_EQ(std::string::npos, it->first.find("pusher_test_string"));
+    }
+
+    // Only changed series are pushed.
+    adder << 5;
+    const int n2 = pusher.Push();
+    ASSERT_GT(n2, 0);
+    ASSERT_LT(n2, n1);
+    m = _svc.TakeSeries();
+    ASSERT_EQ((size_t)n2, m.size());
+    ASSERT_TRUE(m.count(adder_key));
+    ASSERT_EQ(15, m[adder_key].samples(0).value());
+    ASSERT_FALSE(m.count(madder_key));
+}
+
+TEST_F(MetricsPusherTest, full_push_and_batches) {
+    bvar::Adder<int> adder("pusher_test_adder2");
+    brpc::MetricsPusherOptions options;
+    options.full_push_interval_s = 0;
+    options.max_series_per_request = 3;
+    brpc::MetricsPusher pusher;
+    ASSERT_EQ(0, pusher.Init(URL, &options));
+    const int n1 = pusher.Push();
+    ASSERT_GT(n1, 3);
+    ASSERT_EQ((size_t)(n1 + 2) / 3, _svc.TakeRequestCount());
+    // Series not changed are pushed as well.
+    ASSERT_GT(pusher.Push(), 0);
+    ASSERT_TRUE(_svc.TakeSeries().count("__name__=pusher_test_adder2 "));
+}
+
+TEST_F(MetricsPusherTest, failed_push) {
+    bvar::Adder<int> adder("pusher_test_adder3");
+    brpc::MetricsPusher pusher;
+    ASSERT_EQ(0, pusher.Init(URL, nullptr));
+    const int n1 = pusher.Push();
+    ASSERT_GT(n1, 0);
+    _svc.TakeRequestCount();
+
+    _svc.fail = true;
+    ASSERT_EQ(-1, pusher.Push());
+    _svc.fail = false;
+    // All series are pushed again after failures.
+    ASSERT_GT(pusher.Push(), 0);
+    ASSERT_TRUE(_svc.TakeSeries().count("__name__=pusher_test_adder3 "));
+
+    brpc::MetricsPusher pusher2;
+    brpc::MetricsPusherOptions options;
+    options.max_series_per_request = 0;
+    ASSERT_EQ(-1, pusher2.Init(URL, &options));
+}
+
+TEST_F(MetricsPusherTest, push_by_flags) {
+    bvar::Adder<int> adder("pusher_test_adder4");
+    brpc::FLAGS_bvar_push_interval = 1;
+    brpc::FLAGS_bvar_push_labels = "job=by_flags";
+    brpc::FLAGS_bvar_push_url = URL;
+    bool found = false;
+    for (int i = 0; i < 50 && !found; ++i) {
+        bthread_usleep(100000);
+        BAIDU_SCOPED_LOCK(_svc.mutex);
+        for (size_t j = 0; j < _svc.requests.size() && !found; ++j) {
+            const brpc::prometheus::WriteRequest& req = _svc.requests[j];
+            for (int k = 0; k < req.timeseries_size() && !found; ++k) {
+                const brpc::prometheus::TimeSeries& ts = req.timeseries(k);
+                found = (ts.labels_size() == 2 &&
+                         ts.labels(0).value() == "pusher_test_adder4" &&
+                         ts.labels(1).value() == "by_flags");
+            }
+        }
+    }
+    brpc::FLAGS_bvar_push_url.clear();
+    ASSERT_TRUE(found);
+}
+
+} // namespace
@@ -17,16 +17,28 @@
 
 // brpc - A framework to host and access services throughout Baidu.
 
+#include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include "brpc/server.h"
 #include "brpc/channel.h"
 #include "brpc/controller.h"
+#include "brpc/builtin/prometheus_metrics_service.h"
 #include "butil/strings/string_piece.h"
+#include "butil/time.h"
+#include "brpc/policy/gzip_compress.h"
 #include "echo.pb.h"
 #include "bvar/multi_dimension.h"
 
+namespace bvar {
+DECLARE_int32(bvar_max_dump_multi_dimension_metric_number);
+}
+
+DEFINE_int32(scrape_perf_series, 1000000,
+             "Number of series in the synthetic registry of scrape_perf");
+
 int main(int argc, char* argv[]) {
     testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
     return RUN_ALL_TESTS();
 }
 
@@ -195,3 +207,125 @@ TEST(PrometheusMetrics, sanity) {
     ASSERT_EQ(0, server.Stop(0));
     ASSERT_EQ(0, server.Join());
 }
+
+TEST(PrometheusMetrics, histogram) {
+    bvar::LogLinearHistogram h("prometheus_histogram_test");
+    h << 1 << 1000 << 1000 << 5000;
+    butil::IOBuf buf;
+    ASSERT_EQ(0, brpc::DumpPrometheusMetricsToIOBuf(&buf));
+    const std::string res = buf.to_string();
+    const std::string expected =
+        "# HELP prometheus_histogram_test\n"
+        "# TYPE prometheus_histogram_test histogram\n"
+        "prometheus_histogram_test_bucket{le=\"1\"} 1\n"
+        "prometheus_histogram_test_bucket{le=\"1007\"} 3\n"
+        "prometheus_histogram_test_bucket{le=\"5119\"} 4\n"
+        "prometheus_histogram_test_bucket{le=\"+Inf\"} 4\n"
+        "prometheus_histogram_test_sum 7001\n"
+        "prometheus_histogram_test_count 4\n";
+    ASSERT_NE(std::string::npos, res.find(expected)) << res;
+}
+
+TEST(PrometheusMetrics, compression) {
+    brpc::Server server;
+    DummyEchoServiceImpl echo_svc;
+    ASSERT_EQ(0, server.AddService(&echo_svc, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start("127.0.0.1:8615", nullptr));
+    brpc::Channel channel;
+    brpc::ChannelOptions channel_opts;
+    channel_opts.protocol = "http";
+    ASSERT_EQ(0, channel.Init("127.0.0.1:8615", &channel_opts));
+
+    brpc::Controller cntl;
+    cntl.http_request().uri() = "/brpc_metrics";
+    cntl.http_request().SetHeader("Accept-Encoding", "deflate");
+    channel.CallMethod(nullptr, &cntl, nullptr, nullptr, nullptr);
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    const std::string* encoding = cntl.http_response().GetHeader("Content-Encoding");
+    ASSERT_TRUE(encoding != nullptr);
+    ASSERT_EQ("deflate", *encoding);
+    butil::IOBuf text;
+    ASSERT_TRUE(brpc::policy::ZlibDecompress(cntl.response_attachment(), &text));
+    ASSERT_NE(std::string::npos, text.to_string().find("# TYPE "));
+
+    // gzip is preferred.
+    brpc::Controller cntl2;
+    cntl2.http_request().uri() = "/brpc_metrics";
+    cntl2.http_request().SetHeader("Accept-Encoding", "gzip, deflate");
+    channel.CallMethod(nullptr, &cntl2, nullptr, nullptr, nullptr);
+    ASSERT_FALSE(cntl2.Failed()) << cntl2.ErrorText();
+    encoding = cntl2.http_response().GetHeader("Content-Encoding");
+    ASSERT_TRUE(encoding != nullptr);
+    ASSERT_EQ("gzip", *encoding);
+    text.clear();
+    ASSERT_TRUE(brpc::policy::GzipDecompress(cntl2.response_attachment(), &text));
+    ASSERT_NE(std::string::npos, text.to_string().find("# TYPE "));
+
+    brpc::Controller cntl3;
+    cntl3.http_request().uri() = "/brpc_metrics";
+    channel.CallMethod(nullptr, &cntl3, nullptr, nullptr, nullptr);
+    ASSERT_FALSE(cntl3.Failed()) << cntl3.ErrorText();
+    ASSERT_TRUE(cntl3.http_response().GetHeader("Content-Encoding") == nullptr);
+    ASSERT_NE(std::string::npos,
+              cntl3.response_attachment().to_string().find("# TYPE "));
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+}
+
+// Generate `n' series of one metric without creating bvars.
+class SyntheticMVariable : public bvar::MVariableBase {
+public:
+    SyntheticMVariable(const butil::StringPiece& name, size_t n) : _n(n) {
+        expose(name);
+    }
+    ~SyntheticMVariable() override { hide(); }
+
+    void describe(std::ostream& os) override { os << name(); }
+
+    size_t dump(bvar::Dumper* dumper, const bvar::DumpOptions*) override {
+        if (!dumper->dump_comment(name(), "gauge")) {
+            return 0;
+        }
+        std::string key;
+        char buf[64];
+        for (size_t i = 0; i < _n; ++i) {
+            key.assign(name());
+            key.append(buf, snprintf(buf, sizeof(buf),
+                                     "{idc=\"idc%zu\",method=\"method%zu\"}",
+                                     i % 16, i));
+            dumper->dump_mvar(key, butil::StringPiece(buf, snprintf(
+                buf, sizeof(buf), "%zu", i * 7)));
+        }
+        return _n;
+    }
+
+private:
+    size_t _n;
+};
+
+TEST(PrometheusMetrics, scrape_perf) {
+    const int32_t saved_max_dump =
+        bvar::FLAGS_bvar_max_dump_multi_dimension_metric_number;
+    bvar::FLAGS_bvar_max_dump_multi_dimension_metric_number =
+        FLAGS_scrape_perf_series;
+    {
+        SyntheticMVariable mvar("scrape_perf_synthetic", FLAGS_scrape_perf_series);
+        butil::Timer tm;
+        tm.start();
+        butil::IOBuf buf;
+        ASSERT_EQ(0, brpc::DumpPrometheusMetricsToIOBuf(&buf));
+        tm.stop();
+        butil::Timer tm2;
+        tm2.start();
+        butil::IOBuf compressed;
+        ASSERT_TRUE(brpc::policy::GzipCompress(buf, &compressed, nullptr));
+        tm2.stop();
+        ASSERT_NE(std::string::npos, buf.to_string().find(
+            "scrape_perf_synthetic{idc=\"idc1\",method=\"method1\"} 7\n"));
+        LOG(INFO) << "Scraped " << FLAGS_scrape_perf_series << " series ("
+                  << buf.size() << " bytes) in " << tm.m_elapsed()
+                  << "ms, gzip-ed into " << compressed.size() << " bytes in "
+                  << tm2.m_elapsed() << "ms";
+    }
+    bvar::FLAGS_bvar_max_dump_multi_dimension_metric_number = saved_max_dump;
+}
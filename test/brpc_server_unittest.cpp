@@ -64,12 +64,17 @@ int main(int argc, char* argv[]) {
     return RUN_ALL_TESTS();
 }
 
+namespace bthread {
+DECLARE_bool(bthread_deadline_scheduling);
+}
+
 namespace brpc {
 DECLARE_bool(enable_threads_service);
 DECLARE_bool(enable_dir_service);
 
 namespace policy {
 DECLARE_bool(use_http_error_code);
+DECLARE_bool(baidu_std_protocol_deliver_timeout_ms);
 
 extern bool SerializeRpcMessage(const google::protobuf::Message& serializer,
                                 Controller& cntl, ContentType content_type,
@@ -1426,6 +1431,60 @@ TEST_F(ServerTest, serving_requests) {
     ASSERT_EQ(0, server.Join());
 }
 
+class DeadlineEchoService : public test::EchoService {
+public:
+    DeadlineEchoService() : deadline_us(-1) {}
+
+    void Echo(google::protobuf::RpcController*,
+              const test::EchoRequest* req,
+              test::EchoResponse* res,
+              google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        int64_t cur_deadline_us = 0;
+        if (bthread_get_deadline(&cur_deadline_us) == 0) {
+            deadline_us = cur_deadline_us;
+        }
+        res->set_message(req->message());
+    }
+
+    int64_t deadline_us;
+};
+
+TEST_F(ServerTest, timeout_as_deadline_of_processing_bthread) {
+    const bool saved_deliver = brpc::policy::FLAGS_baidu_std_protocol_deliver_timeout_ms;
+    const bool saved_deadline = bthread::FLAGS_bthread_deadline_scheduling;
+    brpc::policy::FLAGS_baidu_std_protocol_deliver_timeout_ms = true;
+    bthread::FLAGS_bthread_deadline_scheduling = true;
+
+    DeadlineEchoService echo_svc;
+    brpc::Server server;
+    ASSERT_EQ(0, server.AddService(&echo_svc,
+                                   brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start(8613, nullptr));
+    brpc::Channel chan;
+    brpc::ChannelOptions opt;
+    opt.timeout_ms = 2000;
+    ASSERT_EQ(0, chan.Init("127.0.0.1:8613", &opt));
+    test::EchoService_Stub stub(&chan);
+    brpc::Controller cntl;
+    test::EchoRequest req;
+    test::EchoResponse res;
+    req.set_message(EXP_REQUEST);
+    const int64_t start_us = butil::gettimeofday_us();
+    stub.Echo(&cntl, &req, &res, nullptr);
+    const int64_t end_us = butil::gettimeofday_us();
+    ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+    // The deadline is the time when the request was received plus the
+    // timeout delivered by the client.
+    ASSERT_GE(echo_svc.deadline_us, start_us + 2000000L - 100000L);
+    ASSERT_LE(echo_svc.deadline_us, end_us + 2000000L + 100000L);
+    ASSERT_EQ(0, server.Stop(0));
+    ASSERT_EQ(0, server.Join());
+
+    brpc::policy::FLAGS_baidu_std_protocol_deliver_timeout_ms = saved_deliver;
+    bthread::FLAGS_bthread_deadline_scheduling = saved_deadline;
+}
+
 TEST_F(ServerTest, create_pid_file) {
     {
         brpc::Server server;
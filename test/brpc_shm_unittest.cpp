@@ -0,0 +1,324 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <gtest/gtest.h>
+#include <gflags/gflags.h>
+#include "butil/build_config.h"
+#if defined(OS_LINUX)
+#include <unistd.h>
+#include "butil/iobuf.h"
+#include "bthread/bthread.h"
+#include "brpc/channel.h"
+#include "brpc/controller.h"
+#include "brpc/server.h"
+#include "brpc/socket.h"
+#include "brpc/shm_transport.h"
+#include "brpc/shm/shm_ring.h"
+#include "echo.pb.h"
+
+namespace {
+
+static const int SHM_PORT = 8734;
+static const int TCP_PORT = 8735;
+
+class EchoServiceImpl : public test::EchoService {
+public:
+    void Echo(google::protobuf::RpcController* cntl_base,
+              const test::EchoRequest* request,
+              test::EchoResponse* response,
+              google::protobuf::Closure* done) override {
+        brpc::ClosureGuard done_guard(done);
+        brpc::Controller* cntl = static_cast<brpc::Controller*>(cntl_base);
+        response->set_message(request->message());
+        brpc::SocketUniquePtr s;
+        if (brpc::Socket::Address(cntl->_current_call.peer_id, &s) == 0 &&
+            s->socket_mode() == brpc::SOCKET_MODE_SHM) {
+            // Report whether the request came through shared memory.
+            brpc::ShmTransport* t =
+                static_cast<brpc::ShmTransport*>(s->_transport.get());
+            response->set_receiving_socket_id(
+                t->_shm_state == brpc::ShmTransport::SHM_ON);
+        }
+        cntl->response_attachment().append(cntl->request_attachment());
+    }
+};
+
+TEST(ShmRingTest, produce_and_consume) {
+    int memfd = -1;
+    butil::intrusive_ptr<brpc::shm::ShmRegion> region =
+        brpc::shm::ShmRegion::Create(4096, 1024, 4, &memfd);
+    ASSERT_TRUE(region != nullptr);
+    butil::intrusive_ptr<brpc::shm::ShmRegion> peer =
+        brpc::shm::ShmRegion::Map(memfd);
+    close(memfd);
+    ASSERT_TRUE(peer != nullptr);
+    ASSERT_EQ(region->size(), peer->size());
+
+    brpc::shm::ShmProducer producer;
+    brpc::shm::ShmConsumer consumer;
+    producer.Init(region.get(), 0);
+    consumer.Init(peer.get(), 0);
+    const int32_t saved_min_size = brpc::shm::FLAGS_shm_block_min_size;
+    brpc::shm::FLAGS_shm_block_min_size = 512;
+
+    std::string sent;
+    butil::IOBuf received;
+    bool notify = false;
+    // The first write notifies since the consumer is not watching yet.
+    butil::IOBuf data;
+    data.append("hello");
+    butil::IOBuf* data_arr[1] = { &data };
+    ASSERT_EQ(5, producer.CutFromIOBufList(data_arr, 1, &notify));
+    ASSERT_TRUE(notify);
+    ASSERT_EQ(5, consumer.AppendTo(&received, 1024 * 1024, &notify));
+    ASSERT_FALSE(notify);
+    ASSERT_EQ("hello", received.to_string());
+    received.clear();
+    ASSERT_FALSE(consumer.WaitForData());
+
+    // Sizes are chosen to wrap the ring and to use blocks.
+    for (int i = 0; i < 200; ++i) {
+        const size_t len = (i * 131) % 3000 + 1;
+        std::string s(len, 0);
+        for (size_t j = 0; j < len; ++j) {
+            s[j] = (char)(i + j);
+        }
+        butil::IOBuf buf;
+        buf.append(s);
+        sent.append(s);
+        butil::IOBuf* bufs[1] = { &buf };
+        while (!buf.empty()) {
+            const ssize_t nw = producer.CutFromIOBufList(bufs, 1, &notify);
+            if (nw < 0) {
+                ASSERT_EQ(EAGAIN, errno);
+                ASSERT_FALSE(producer.WaitForSpace());
+                // Release blocks of previous data as well.
+                received.clear();
+                ASSERT_GT(consumer.AppendTo(&received, 1024 * 1024, &notify), 0);
+                ASSERT_TRUE(notify);
+                ASSERT_TRUE(sent.compare(0, received.size(), received.to_string()) == 0);
+                sent.erase(0, received.size());
+            }
+        }
+    }
+    received.clear();
+    while (!consumer.Empty()) {
+        ASSERT_GT(consumer.AppendTo(&received, 1024 * 1024, &notify), 0);
+    }
+    ASSERT_EQ(sent, received.to_string());
+    ASSERT_EQ(0u, producer.pending_bytes());
+    received.clear();
+    // All blocks are given back.
+    brpc::shm::ShmQueueHeader* qh = region->queue_header(0);
+    ASSERT_EQ(4u, qh->free_tail.load() - qh->free_head.load() +
+                  producer._free_blocks.size());
+    brpc::shm::FLAGS_shm_block_min_size = saved_min_size;
+}
+
+TEST(ShmRingTest, reject_corrupted_ring) {
+    int memfd = -1;
+    butil::intrusive_ptr<brpc::shm::ShmRegion> region =
+        brpc::shm::ShmRegion::Create(4096, 1024, 4, &memfd);
+    ASSERT_TRUE(region != nullptr);
+    close(memfd);
+    brpc::shm::ShmConsumer consumer;
+    consumer.Init(region.get(), 1);
+    brpc::shm::ShmRecord rec = { 100, 4 };  // No such block.
+    memcpy(region->ring(1), &rec, sizeof(rec));
+    region->queue_header(1)->tail.store(sizeof(rec));
+    butil::IOBuf buf;
+    bool notify = false;
+    ASSERT_EQ(-1, consumer.AppendTo(&buf, 1024, &notify));
+    ASSERT_EQ(EPROTO, errno);
+}
+
+class ShmTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        brpc::ServerOptions options;
+        options.socket_mode = brpc::SOCKET_MODE_SHM;
+        ASSERT_EQ(0, _server.AddService(&_svc, brpc::SERVER_DOESNT_OWN_SERVICE));
+        ASSERT_EQ(0, _server.Start(SHM_PORT, &options));
+    }
+
+    void TearDown() override {
+        _server.Stop(0);
+        _server.Join();
+    }
+
+    static void InitChannel(brpc::Channel* channel, int port,
+                            brpc::SocketMode mode = brpc::SOCKET_MODE_SHM) {
+        brpc::ChannelOptions options;
+        options.socket_mode = mode;
+        options.timeout_ms = 5000;
+        options.max_retry = 0;
+        ASSERT_EQ(0, channel->Init(butil::EndPoint(butil::my_ip(), port), &options));
+    }
+
+    EchoServiceImpl _svc;
+    brpc::Server _server;
+};
+
+TEST_F(ShmTest, echo) {
+    brpc::Channel channel;
+    InitChannel(&channel, SHM_PORT);
+    test::EchoService_Stub stub(&channel);
+    for (int i = 0; i < 100; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("hello shm");
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ("hello shm", res.message());
+        ASSERT_EQ(1u, res.receiving_socket_id());
+    }
+}
+
+TEST_F(ShmTest, large_attachment) {
+    brpc::Channel channel;
+    InitChannel(&channel, SHM_PORT);
+    test::EchoService_Stub stub(&channel);
+    // Larger than the ring and all blocks, so that writers wait for space.
+    const size_t len = 16 * 1024 * 1024;
+    std::string data(len, 0);
+    for (size_t i = 0; i < len; ++i) {
+        data[i] = (char)(i * 7);
+    }
+    for (int i = 0; i < 3; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("large");
+        cntl.request_attachment().append(data);
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(1u, res.receiving_socket_id());
+        ASSERT_EQ(len, cntl.response_attachment().size());
+        ASSERT_TRUE(cntl.response_attachment().equals(data));
+    }
+}
+
+struct CallArg {
+    brpc::Channel* channel;
+    int ncall;
+    int nfail;
+};
+
+static void* CallEcho(void* void_arg) {
+    CallArg* arg = static_cast<CallArg*>(void_arg);
+    test::EchoService_Stub stub(arg->channel);
+    for (int i = 0; i < arg->ncall; ++i) {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("concurrent");
+        // Both inline data and blocks.
+        cntl.request_attachment().resize(1000 + i * 100, 'x');
+        stub.Echo(&cntl, &req, &res, nullptr);
+        if (cntl.Failed() ||
+            cntl.response_attachment().size() != 1000u + i * 100) {
+            ++arg->nfail;
+        }
+    }
+    return nullptr;
+}
+
+TEST_F(ShmTest, concurrent_calls_share_connection) {
+    brpc::Channel channel;
+    InitChannel(&channel, SHM_PORT);
+    const int NTHREAD = 8;
+    bthread_t tids[NTHREAD];
+    CallArg args[NTHREAD];
+    for (int i = 0; i < NTHREAD; ++i) {
+        args[i] = { &channel, 200, 0 };
+        ASSERT_EQ(0, bthread_start_background(&tids[i], nullptr, CallEcho, &args[i]));
+    }
+    for (int i = 0; i < NTHREAD; ++i) {
+        bthread_join(tids[i], nullptr);
+        ASSERT_EQ(0, args[i].nfail);
+    }
+}
+
+TEST_F(ShmTest, fallback_to_tcp) {
+    // A tcp server refuses the handshake.
+    brpc::Server tcp_server;
+    ASSERT_EQ(0, tcp_server.AddService(&_svc, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, tcp_server.Start(TCP_PORT, nullptr));
+    brpc::Channel shm_channel;
+    InitChannel(&shm_channel, TCP_PORT);
+    // A tcp client does not handshake.
+    brpc::Channel tcp_channel;
+    InitChannel(&tcp_channel, SHM_PORT, brpc::SOCKET_MODE_TCP);
+    brpc::Channel* channels[] = { &shm_channel, &tcp_channel };
+    for (brpc::Channel* channel : channels) {
+        test::EchoService_Stub stub(channel);
+        for (int i = 0; i < 10; ++i) {
+            brpc::Controller cntl;
+            test::EchoRequest req;
+            test::EchoResponse res;
+            req.set_message("tcp");
+            cntl.request_attachment().resize(100000, 'y');
+            stub.Echo(&cntl, &req, &res, nullptr);
+            ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+            ASSERT_EQ("tcp", res.message());
+            ASSERT_EQ(0u, res.receiving_socket_id());
+            ASSERT_EQ(100000u, cntl.response_attachment().size());
+        }
+    }
+    tcp_server.Stop(0);
+    tcp_server.Join();
+}
+
+TEST_F(ShmTest, server_closes_connection) {
+    brpc::Channel channel;
+    InitChannel(&channel, SHM_PORT);
+    test::EchoService_Stub stub(&channel);
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("before");
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_FALSE(cntl.Failed()) << cntl.ErrorText();
+        ASSERT_EQ(1u, res.receiving_socket_id());
+    }
+    _server.Stop(0);
+    _server.Join();
+    {
+        brpc::Controller cntl;
+        test::EchoRequest req;
+        test::EchoResponse res;
+        req.set_message("after");
+        stub.Echo(&cntl, &req, &res, nullptr);
+        ASSERT_TRUE(cntl.Failed());
+    }
+}
+
+} // namespace
+#endif // OS_LINUX
+
+int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+#if defined(OS_LINUX)
+    // Small rings and few blocks to cover waiting for space.
+    brpc::shm::FLAGS_shm_ring_size = 64 * 1024;
+    brpc::shm::FLAGS_shm_block_num = 8;
+#endif // OS_LINUX
+    return RUN_ALL_TESTS();
+}
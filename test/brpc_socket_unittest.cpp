@@ -63,6 +63,9 @@ DECLARE_int32(socket_keepalive_count);
 DECLARE_int32(socket_recv_buffer_size);
 DECLARE_int32(socket_send_buffer_size);
 DECLARE_int32(socket_tcp_user_timeout_ms);
+DECLARE_bool(socket_zerocopy);
+DECLARE_int32(socket_zerocopy_min_bytes);
+extern SocketVarsCollector* g_vars;
 }
 
 void EchoProcessHuluRequest(brpc::InputMessageBase* msg_base);
@@ -1829,6 +1832,133 @@ TEST_F(SocketTest, shutdown_write) {
     }
 }
 
+#if defined(OS_LINUX)
+static void IgnoreInput(brpc::Socket*) {}
+
+TEST_F(SocketTest, zerocopy_write) {
+    gflags::FlagSaver flag_saver;
+    brpc::FLAGS_socket_zerocopy = true;
+    brpc::FLAGS_socket_zerocopy_min_bytes = 4096;
+
+    butil::EndPoint point;
+    ASSERT_EQ(0, str2endpoint("127.0.0.1:0", &point));
+    butil::fd_guard listening_fd(tcp_listen(point));
+    ASSERT_GT(listening_fd, 0) << berror();
+    ASSERT_EQ(0, butil::get_local_side(listening_fd, &point));
+
+    brpc::SocketOptions options;
+    options.remote_side = point;
+    // Notifications of zerocopy sends are delivered as input events.
+    options.on_edge_triggered_events = IgnoreInput;
+    brpc::SocketId id = brpc::INVALID_SOCKET_ID;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+
+    const int64_t zerocopy_bytes = brpc::g_vars->nzerocopy_bytes.get_value();
+    std::string expected;
+    for (int i = 0; i < 16; ++i) {
+        butil::IOBuf src;
+        // Small data is written by the transport as usual.
+        const size_t len = (i % 4 == 0 ? 100 : 256 * 1024);
+        const std::string piece(len, 'a' + i);
+        src.append(piece);
+        expected.append(piece);
+        ASSERT_EQ(0, s->Write(&src));
+    }
+    butil::fd_guard accepted_fd(accept(listening_fd, nullptr, nullptr));
+    ASSERT_GT(accepted_fd, 0) << berror();
+    std::string received;
+    char buf[65536];
+    while (received.size() < expected.size()) {
+        const ssize_t nr = read(accepted_fd, buf, sizeof(buf));
+        ASSERT_GT(nr, 0) << berror();
+        received.append(buf, nr);
+    }
+    ASSERT_TRUE(expected == received);
+    ASSERT_TRUE(s->_zerocopy != nullptr);
+    ASSERT_LT(zerocopy_bytes, brpc::g_vars->nzerocopy_bytes.get_value());
+
+    // Written blocks are released after the notifications are processed.
+    const int64_t start_time = butil::cpuwide_time_us();
+    while (true) {
+        std::ostringstream oss;
+        brpc::Socket::DebugSocket(oss, id);
+        if (oss.str().find("zerocopy_pending_sends=0\n") != std::string::npos) {
+            break;
+        }
+        ASSERT_LT(butil::cpuwide_time_us(), start_time + 1000000L) << "Too long!";
+        bthread_usleep(1000);
+    }
+    // Nothing left in the error queue, which is not a zerocopy-only event
+    // (e.g. an EPOLLERR carrying a pending SO_ERROR).
+    ASSERT_FALSE(brpc::Socket::HandleZeroCopyNotifications(s->_zerocopy, s->fd()));
+    ASSERT_EQ(0, s->SetFailed());
+}
+#endif
+
+static void WriteAndCheckCoalescing(int32_t coalesce_us, int32_t coalesce_bytes,
+                                    int nmsg, int64_t* elapsed_us) {
+    butil::EndPoint point;
+    ASSERT_EQ(0, str2endpoint("127.0.0.1:0", &point));
+    butil::fd_guard listening_fd(tcp_listen(point));
+    ASSERT_GT(listening_fd, 0) << berror();
+    ASSERT_EQ(0, butil::get_local_side(listening_fd, &point));
+
+    brpc::SocketOptions options;
+    options.remote_side = point;
+    options.write_coalesce_us = coalesce_us;
+    options.write_coalesce_bytes = coalesce_bytes;
+    brpc::SocketId id = brpc::INVALID_SOCKET_ID;
+    ASSERT_EQ(0, brpc::Socket::Create(options, &id));
+    brpc::SocketUniquePtr s;
+    ASSERT_EQ(0, brpc::Socket::Address(id, &s));
+
+    const bvar::Stat nreq0 = brpc::g_vars->coalesced_write_requests.get_value();
+    const bvar::Stat nbytes0 = brpc::g_vars->coalesced_write_bytes.get_value();
+    butil::Timer tm;
+    tm.start();
+    std::string expected;
+    for (int i = 0; i < nmsg; ++i) {
+        const std::string piece(100, 'a' + i);
+        butil::IOBuf src;
+        src.append(piece);
+        expected.append(piece);
+        ASSERT_EQ(0, s->Write(&src));
+    }
+    butil::fd_guard accepted_fd(accept(listening_fd, nullptr, nullptr));
+    ASSERT_GT(accepted_fd, 0) << berror();
+    std::string received;
+    char buf[4096];
+    while (received.size() < expected.size()) {
+        const ssize_t nr = read(accepted_fd, buf, sizeof(buf));
+        ASSERT_GT(nr, 0) << berror();
+        received.append(buf, nr);
+    }
+    tm.stop();
+    *elapsed_us = tm.u_elapsed();
+    ASSERT_EQ(expected, received);
+    // All messages are merged into one write.
+    const bvar::Stat nreq1 = brpc::g_vars->coalesced_write_requests.get_value();
+    const bvar::Stat nbytes1 = brpc::g_vars->coalesced_write_bytes.get_value();
+    ASSERT_EQ(1, nreq1.num - nreq0.num);
+    ASSERT_EQ(nmsg, nreq1.sum - nreq0.sum);
+    ASSERT_EQ((int64_t)expected.size(), nbytes1.sum - nbytes0.sum);
+    // Bytes of the written requests are not left for the next coalescing.
+    ASSERT_EQ(0, s->_coalescing_bytes.load());
+    ASSERT_EQ(0, s->SetFailed());
+}
+
+TEST_F(SocketTest, write_coalescing) {
+    int64_t elapsed_us = 0;
+    // Written once enough bytes are queued.
+    WriteAndCheckCoalescing(5000000, 1000, 10, &elapsed_us);
+    ASSERT_LT(elapsed_us, 2000000);
+    // Written after the window without byte limit.
+    WriteAndCheckCoalescing(100000, 0, 3, &elapsed_us);
+    ASSERT_GE(elapsed_us, 90000);
+}
+
 TEST_F(SocketTest, packed_ptr) {
     brpc::PackedPtr<int> ptr;
     ASSERT_EQ(nullptr, ptr.get());
@@ -45,6 +45,24 @@ TEST(ButexTest, wait_on_already_timedout_butex) {
     ASSERT_EQ(ETIMEDOUT, errno);
 }
 
+TEST(ButexTest, create_with_extra) {
+    uint32_t* butex = static_cast<uint32_t*>(bthread::butex_create_with_extra());
+    ASSERT_TRUE(butex);
+    char* extra = static_cast<char*>(bthread::butex_extra(butex));
+    ASSERT_EQ(0u, (uintptr_t)extra % BAIDU_CACHELINE_SIZE);
+    memset(extra, 0xff, bthread::BUTEX_EXTRA_SIZE);
+    // The extra data doesn't overlap the butex.
+    *butex = 1;
+    ASSERT_EQ(-1, bthread::butex_wait(butex, 0, nullptr));
+    ASSERT_EQ(EWOULDBLOCK, errno);
+    timespec now;
+    ASSERT_EQ(0, clock_gettime(CLOCK_REALTIME, &now));
+    ASSERT_EQ(-1, bthread::butex_wait(butex, 1, &now));
+    ASSERT_EQ(ETIMEDOUT, errno);
+    ASSERT_EQ(0, bthread::butex_wake(butex));
+    bthread::butex_destroy_with_extra(butex);
+}
+
 void* sleeper(void* arg) {
     bthread_usleep((uint64_t)arg);
     return nullptr;
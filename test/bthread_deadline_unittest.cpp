@@ -0,0 +1,222 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <vector>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include "butil/atomicops.h"
+#include "butil/time.h"
+#include "bthread/bthread.h"
+
+namespace bthread {
+DECLARE_bool(bthread_deadline_scheduling);
+DECLARE_int32(bthread_deadline_max_consecutive);
+}
+
+int main(int argc, char* argv[]) {
+    bthread::FLAGS_bthread_deadline_scheduling = true;
+    // Tests checking the order of deadlines don't want other tasks in between.
+    bthread::FLAGS_bthread_deadline_max_consecutive = 1000;
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+void* check_inherited_deadline(void* arg) {
+    int64_t deadline_us = -1;
+    EXPECT_EQ(0, bthread_get_deadline(&deadline_us));
+    EXPECT_EQ((int64_t)(intptr_t)arg, deadline_us);
+    return nullptr;
+}
+
+void* set_and_inherit_deadline(void*) {
+    int64_t deadline_us = -1;
+    EXPECT_EQ(0, bthread_get_deadline(&deadline_us));
+    EXPECT_EQ(0, deadline_us);
+    const int64_t new_deadline_us = butil::gettimeofday_us() + 1000000;
+    EXPECT_EQ(0, bthread_set_deadline(new_deadline_us));
+    EXPECT_EQ(0, bthread_get_deadline(&deadline_us));
+    EXPECT_EQ(new_deadline_us, deadline_us);
+    // Both foreground and background bthreads inherit the deadline.
+    bthread_t th;
+    EXPECT_EQ(0, bthread_start_urgent(&th, nullptr, check_inherited_deadline,
+                                      (void*)(intptr_t)new_deadline_us));
+    EXPECT_EQ(0, bthread_join(th, nullptr));
+    EXPECT_EQ(0, bthread_start_background(&th, nullptr, check_inherited_deadline,
+                                          (void*)(intptr_t)new_deadline_us));
+    EXPECT_EQ(0, bthread_join(th, nullptr));
+    EXPECT_EQ(0, bthread_set_deadline(0));
+    EXPECT_EQ(0, bthread_start_background(&th, nullptr, check_inherited_deadline,
+                                          (void*)(intptr_t)0));
+    EXPECT_EQ(0, bthread_join(th, nullptr));
+    return nullptr;
+}
+
+TEST(BthreadDeadlineTest, set_deadline) {
+    ASSERT_EQ(EINVAL, bthread_set_deadline(1));
+    int64_t deadline_us = 0;
+    ASSERT_EQ(EINVAL, bthread_get_deadline(&deadline_us));
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(
+                  &th, nullptr, set_and_inherit_deadline, nullptr));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+}
+
+const int NDEADLINE = 32;
+const int NTASK = NDEADLINE + 8;
+butil::atomic<int> g_nrun(0);
+int g_run_order[NTASK];
+
+void* record_order(void* arg) {
+    g_run_order[g_nrun.fetch_add(1, butil::memory_order_relaxed)] =
+        (int)(intptr_t)arg;
+    return nullptr;
+}
+
+// Deadlines of the first `nexpired' tasks with deadlines have passed.
+void* start_tasks_with_deadlines(void* nexpired) {
+    g_nrun.store(0, butil::memory_order_relaxed);
+    // Let other workers park, tasks below are started without signalling
+    // them, so that they're run by this worker one by one.
+    bthread_usleep(20000);
+    const int64_t now_us = butil::gettimeofday_us();
+    const int64_t expired_us = now_us - 1000000;
+    std::vector<bthread_t> tids;
+    for (int i = 0; i < NTASK; ++i) {
+        // Tasks without deadlines are started first.
+        // Deadlines are started out of order: 7 is coprime to NDEADLINE.
+        const int index = (i < NTASK - NDEADLINE ? NDEADLINE + i :
+                           (i - (NTASK - NDEADLINE)) * 7 % NDEADLINE);
+        // Started tasks inherit the deadline of this bthread.
+        int64_t deadline_us = 0;
+        if (index < (int)(intptr_t)nexpired) {
+            deadline_us = expired_us + index * 1000;
+        } else if (index < NDEADLINE) {
+            deadline_us = now_us + 1000000 + index * 1000;
+        }
+        EXPECT_EQ(0, bthread_set_deadline(deadline_us));
+        const bthread_attr_t attr = BTHREAD_ATTR_NORMAL | BTHREAD_NOSIGNAL;
+        bthread_t tid;
+        EXPECT_EQ(0, bthread_start_background(
+                      &tid, &attr, record_order, (void*)(intptr_t)index));
+        tids.push_back(tid);
+    }
+    EXPECT_EQ(0, bthread_set_deadline(0));
+    // Sleep instead of joining the tasks, otherwise ending tasks wake up
+    // this bthread and other workers by the way.
+    bthread_usleep(100000);
+    for (size_t i = 0; i < tids.size(); ++i) {
+        bthread_join(tids[i], nullptr);
+    }
+    return nullptr;
+}
+
+TEST(BthreadDeadlineTest, earliest_deadline_first) {
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(
+                  &th, nullptr, start_tasks_with_deadlines, nullptr));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    ASSERT_EQ(NTASK, g_nrun.load());
+    // Tasks with deadlines run before others, earliest deadline first.
+    for (int i = 0; i < NDEADLINE; ++i) {
+        ASSERT_EQ(i, g_run_order[i]);
+    }
+}
+
+TEST(BthreadDeadlineTest, expired_deadlines_are_not_preferred) {
+    const int nexpired = 8;
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(
+                  &th, nullptr, start_tasks_with_deadlines,
+                  (void*)(intptr_t)nexpired));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    ASSERT_EQ(NTASK, g_nrun.load());
+    // Tasks with deadlines not passed yet run first, others run as tasks
+    // without deadlines.
+    for (int i = 0; i < NDEADLINE - nexpired; ++i) {
+        ASSERT_EQ(nexpired + i, g_run_order[i]);
+    }
+}
+
+TEST(BthreadDeadlineTest, max_consecutive) {
+    const int32_t saved_max = bthread::FLAGS_bthread_deadline_max_consecutive;
+    const int max_consecutive = 4;
+    bthread::FLAGS_bthread_deadline_max_consecutive = max_consecutive;
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(
+                  &th, nullptr, start_tasks_with_deadlines, nullptr));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    bthread::FLAGS_bthread_deadline_max_consecutive = saved_max;
+    ASSERT_EQ(NTASK, g_nrun.load());
+    // Tasks without deadlines are not starved: they're run after at most
+    // `max_consecutive' tasks with deadlines.
+    int nconsecutive = 0;
+    int nwithout = 0;
+    for (int i = 0; i < NTASK && nwithout < NTASK - NDEADLINE; ++i) {
+        if (g_run_order[i] < NDEADLINE) {
+            ++nconsecutive;
+            ASSERT_LE(nconsecutive, max_consecutive);
+        } else {
+            nconsecutive = 0;
+            ++nwithout;
+        }
+    }
+}
+
+butil::atomic<int> g_nbatch_run(0);
+
+void* count_batch_run(void*) {
+    g_nbatch_run.fetch_add(1, butil::memory_order_relaxed);
+    return nullptr;
+}
+
+const size_t NBATCH = 16;
+
+void start_and_join_batch() {
+    bthread_t tids[NBATCH];
+    void* (*fns[NBATCH])(void*);
+    for (size_t i = 0; i < NBATCH; ++i) {
+        fns[i] = count_batch_run;
+    }
+    ASSERT_EQ(0, bthread_start_batch(tids, nullptr, fns, nullptr, NBATCH));
+    for (size_t i = 0; i < NBATCH; ++i) {
+        ASSERT_EQ(0, bthread_join(tids[i], nullptr));
+    }
+}
+
+void* start_batch_with_deadline(void*) {
+    EXPECT_EQ(0, bthread_set_deadline(butil::gettimeofday_us() + 1000000));
+    start_and_join_batch();
+    return nullptr;
+}
+
+TEST(BthreadDeadlineTest, start_batch) {
+    g_nbatch_run.store(0, butil::memory_order_relaxed);
+    // Tasks inherit the deadline and go through the deadline queue.
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(
+                  &th, nullptr, start_batch_with_deadline, nullptr));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    ASSERT_EQ((int)NBATCH, g_nbatch_run.load());
+    // Called from a non-worker pthread, tasks go through the remote queue.
+    start_and_join_batch();
+    ASSERT_EQ((int)(2 * NBATCH), g_nbatch_run.load());
+}
+
+}  // namespace
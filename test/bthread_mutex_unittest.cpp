@@ -16,6 +16,7 @@
 // under the License.
 
 #include <gtest/gtest.h>
+#include <gflags/gflags.h>
 #include "butil/compat.h"
 #include "butil/time.h"
 #include "butil/macros.h"
@@ -25,8 +26,14 @@
 #include "bthread/butex.h"
 #include "bthread/task_control.h"
 #include "bthread/mutex.h"
+#include "bvar/variable.h"
 #include "gperftools_helper.h"
 
+namespace bthread {
+DECLARE_int32(bthread_mutex_max_spin_ns);
+DECLARE_int32(bthread_mutex_max_pthread_owner_spin_ns);
+}
+
 namespace {
 inline unsigned* get_butex(bthread_mutex_t & m) {
     return m.butex;
@@ -102,6 +109,86 @@ TEST(MutexTest, timedlock) {
     bthread_mutex_destroy(&m2);
 }
 
+int64_t get_spin_count(const char* name) {
+    return strtoll(bvar::Variable::describe_exposed(name).c_str(), nullptr, 10);
+}
+
+struct SpinArgs {
+    bthread_mutex_t* mutex;
+    butil::atomic<bool> locked;
+};
+
+void* lock_and_sleep(void* arg) {
+    SpinArgs* args = (SpinArgs*)arg;
+    bthread_mutex_lock(args->mutex);
+    args->locked = true;
+    bthread_usleep(50000);
+    bthread_mutex_unlock(args->mutex);
+    return nullptr;
+}
+
+void* lock_and_unlock(void* arg) {
+    bthread_mutex_t* m = (bthread_mutex_t*)arg;
+    bthread_mutex_lock(m);
+    bthread_mutex_unlock(m);
+    return nullptr;
+}
+
+TEST(MutexTest, spin_while_owner_running) {
+    const int32_t saved_max_spin_ns = bthread::FLAGS_bthread_mutex_max_spin_ns;
+    const int32_t saved_max_pthread_owner_spin_ns =
+        bthread::FLAGS_bthread_mutex_max_pthread_owner_spin_ns;
+    bthread::FLAGS_bthread_mutex_max_spin_ns = 1000000000;
+    bthread::FLAGS_bthread_mutex_max_pthread_owner_spin_ns = 1000000000;
+    bthread_mutex_t m;
+    ASSERT_EQ(0, bthread_mutex_init(&m, nullptr));
+
+    // The owner (a pthread) can't be checked, the locker spins until the
+    // mutex is unlocked or -bthread_mutex_max_pthread_owner_spin_ns.
+    int64_t nacquired = get_spin_count("bthread_mutex_spin_acquired_count");
+    ASSERT_EQ(0, bthread_mutex_lock(&m));
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_urgent(&th, nullptr, lock_and_unlock, &m));
+    usleep(10000);
+    ASSERT_EQ(1u, *get_butex(m)); // spinning instead of waiting.
+    ASSERT_EQ(0, bthread_mutex_unlock(&m));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    ASSERT_EQ(nacquired + 1, get_spin_count("bthread_mutex_spin_acquired_count"));
+
+    bthread::FLAGS_bthread_mutex_max_pthread_owner_spin_ns = 1000;
+    int64_t nfailed = get_spin_count("bthread_mutex_spin_failed_count");
+    ASSERT_EQ(0, bthread_mutex_lock(&m));
+    ASSERT_EQ(0, bthread_start_urgent(&th, nullptr, lock_and_unlock, &m));
+    usleep(10000);
+    ASSERT_NE(1u, *get_butex(m)); // waiting after spinning shortly.
+    ASSERT_EQ(0, bthread_mutex_unlock(&m));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    ASSERT_EQ(nfailed + 1, get_spin_count("bthread_mutex_spin_failed_count"));
+
+    // The owner (a bthread) is suspended, the locker waits without spinning.
+    nacquired = get_spin_count("bthread_mutex_spin_acquired_count");
+    nfailed = get_spin_count("bthread_mutex_spin_failed_count");
+    SpinArgs args;
+    args.mutex = &m;
+    args.locked = false;
+    bthread_t owner;
+    ASSERT_EQ(0, bthread_start_background(&owner, nullptr, lock_and_sleep, &args));
+    while (!args.locked) {
+        usleep(1000);
+    }
+    usleep(5000); // wait for the owner to sleep.
+    ASSERT_EQ(0, bthread_start_background(&th, nullptr, lock_and_unlock, &m));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    ASSERT_EQ(0, bthread_join(owner, nullptr));
+    ASSERT_EQ(nacquired, get_spin_count("bthread_mutex_spin_acquired_count"));
+    ASSERT_EQ(nfailed, get_spin_count("bthread_mutex_spin_failed_count"));
+
+    ASSERT_EQ(0, bthread_mutex_destroy(&m));
+    bthread::FLAGS_bthread_mutex_max_spin_ns = saved_max_spin_ns;
+    bthread::FLAGS_bthread_mutex_max_pthread_owner_spin_ns =
+        saved_max_pthread_owner_spin_ns;
+}
+
 TEST(MutexTest, cpp_wrapper) {
     bthread::Mutex mutex;
     ASSERT_TRUE(mutex.try_lock());
@@ -0,0 +1,123 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <sched.h>
+#include <pthread.h>
+#include <string>
+#include <gtest/gtest.h>
+#include "butil/file_util.h"
+#include "butil/files/scoped_temp_dir.h"
+#include "butil/string_printf.h"
+#include "butil/thread_local.h"
+#include "bthread/task_control.h"
+#include "bthread/task_group.h"
+
+namespace bthread {
+EXTERN_BAIDU_VOLATILE_THREAD_LOCAL(TaskGroup*, tls_task_group);
+}
+
+namespace {
+
+const int NCPU = 8;
+
+// Fake sysfs: cpu<i>/node<i/4> and cpu<i>/cache/index3/id = i/2, that is
+// 2 nodes with 2 last level caches each.
+void make_fake_cpu_dir(const butil::FilePath& dir) {
+    for (int i = 0; i < NCPU; ++i) {
+        const butil::FilePath cpu =
+            dir.Append(butil::string_printf("cpu%d", i));
+        ASSERT_TRUE(butil::CreateDirectory(
+            cpu.Append(butil::string_printf("node%d", i / 4))));
+        const butil::FilePath cache = cpu.Append("cache/index3");
+        ASSERT_TRUE(butil::CreateDirectory(cache));
+        const std::string id = butil::string_printf("%d\n", i / 2);
+        ASSERT_EQ((int)id.size(),
+                  butil::WriteFile(cache.Append("id"), id.data(), id.size()));
+    }
+}
+
+bthread::TaskGroup* new_group(bthread::TaskControl* c, int node, int llc) {
+    bthread::TaskGroup* g = new bthread::TaskGroup(c);
+    EXPECT_EQ(0, g->_rq.init(64));
+    EXPECT_EQ(0, g->_remote_rq.init(64));
+    g->set_tag(BTHREAD_TAG_DEFAULT);
+    g->_numa_node = node;
+    g->_llc_id = llc;
+    const size_t n = c->tag_ngroup(BTHREAD_TAG_DEFAULT).load();
+    c->tag_group(BTHREAD_TAG_DEFAULT)[n] = g;
+    c->tag_ngroup(BTHREAD_TAG_DEFAULT).store(n + 1);
+    const size_t nlocal = c->node_ngroup(BTHREAD_TAG_DEFAULT, node).load();
+    c->node_group(BTHREAD_TAG_DEFAULT, node)[nlocal] = g;
+    c->node_ngroup(BTHREAD_TAG_DEFAULT, node).store(nlocal + 1);
+    return g;
+}
+
+// Workers are not started, so the groups are filled in by hand. Neither the
+// control nor the groups are deleted since the vars of the control keep
+// sampling them.
+TEST(NumaTest, steal_order) {
+    butil::ScopedTempDir dir;
+    ASSERT_TRUE(dir.CreateUniqueTempDir());
+    make_fake_cpu_dir(dir.path());
+
+    bthread::TaskControl* c = new bthread::TaskControl;
+    c->_numa_aware = true;
+    c->init_numa_topology(dir.path().value(), NCPU);
+    ASSERT_EQ(2, c->_numa_nnode);
+    ASSERT_EQ(1, c->cpu_numa_node(5));
+    ASSERT_EQ(2, c->cpu_llc_id(5));
+    ASSERT_EQ(-1, c->cpu_llc_id(NCPU));
+
+    bthread::TaskGroup* self = new_group(c, 0, 0);
+    bthread::TaskGroup* remote = new_group(c, 1, 2);
+    bthread::TaskGroup* same_node = new_group(c, 0, 1);
+    bthread::TaskGroup* same_llc = new_group(c, 0, 0);
+    ASSERT_TRUE(remote->_rq.push(3));
+    ASSERT_TRUE(same_node->_rq.push(2));
+    ASSERT_TRUE(same_llc->_rq.push(1));
+
+    const int64_t nsteal = c->_numa_nsteal[0]->get_value();
+    const int64_t nmigration = c->_numa_nmigration[0]->get_value();
+    BAIDU_SET_VOLATILE_THREAD_LOCAL(bthread::tls_task_group, self);
+    size_t seed = 0;
+    for (bthread_t expected = 1; expected <= 3; ++expected) {
+        bthread_t tid = 0;
+        ASSERT_TRUE(c->steal_task(&tid, &seed, 1));
+        ASSERT_EQ(expected, tid);
+    }
+    bthread_t tid = 0;
+    ASSERT_FALSE(c->steal_task(&tid, &seed, 1));
+    BAIDU_SET_VOLATILE_THREAD_LOCAL(bthread::tls_task_group, nullptr);
+    ASSERT_EQ(nsteal + 2, c->_numa_nsteal[0]->get_value());
+    ASSERT_EQ(nmigration + 1, c->_numa_nmigration[0]->get_value());
+    ASSERT_EQ(0, c->_numa_nsteal[1]->get_value());
+
+    // Pin to the current cpu so that the node seen below does not change.
+    cpu_set_t old_cpus;
+    ASSERT_EQ(0, pthread_getaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus));
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    ASSERT_EQ(0, pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus));
+    const int node = c->cpu_numa_node(sched_getcpu());
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(node, c->choose_one_group(BTHREAD_TAG_DEFAULT)->_numa_node);
+    }
+    ASSERT_EQ(0, pthread_setaffinity_np(pthread_self(), sizeof(old_cpus), &old_cpus));
+}
+
+} // namespace
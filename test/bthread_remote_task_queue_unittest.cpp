@@ -0,0 +1,254 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+#include <algorithm>                        // std::sort
+#include <vector>
+#include <gtest/gtest.h>
+#include "butil/containers/bounded_queue.h"
+#include "butil/scoped_lock.h"
+#include "butil/time.h"
+#include "butil/macros.h"
+#include "bthread/remote_task_queue.h"
+
+namespace {
+
+// The previous implementation of RemoteTaskQueue, as the baseline.
+class LockedTaskQueue {
+public:
+    int init(size_t cap) {
+        const size_t memsize = sizeof(bthread_t) * cap;
+        void* q_mem = malloc(memsize);
+        if (q_mem == nullptr) {
+            return -1;
+        }
+        butil::BoundedQueue<bthread_t> q(q_mem, memsize, butil::OWNS_STORAGE);
+        _tasks.swap(q);
+        return 0;
+    }
+    bool pop(bthread_t* task) {
+        if (_tasks.empty()) {
+            return false;
+        }
+        BAIDU_SCOPED_LOCK(_mutex);
+        return _tasks.pop(task);
+    }
+    bool push(bthread_t task) {
+        BAIDU_SCOPED_LOCK(_mutex);
+        return _tasks.push(task);
+    }
+private:
+    butil::BoundedQueue<bthread_t> _tasks;
+    butil::Mutex _mutex;
+};
+
+template <typename Queue>
+struct QueueArgs {
+    Queue* q;
+    size_t begin;
+    size_t end;
+    butil::atomic<size_t>* npopped;
+    size_t total;
+};
+
+template <typename Queue>
+void* push_thread(void* void_arg) {
+    QueueArgs<Queue>* arg = (QueueArgs<Queue>*)void_arg;
+    for (size_t i = arg->begin; i < arg->end;) {
+        if (arg->q->push(i)) {
+            ++i;
+        } else {
+            sched_yield();
+        }
+    }
+    return nullptr;
+}
+
+template <typename Queue>
+void* pop_thread(void* void_arg) {
+    QueueArgs<Queue>* arg = (QueueArgs<Queue>*)void_arg;
+    std::vector<bthread_t>* popped = new std::vector<bthread_t>;
+    while (arg->npopped->load(butil::memory_order_relaxed) < arg->total) {
+        bthread_t val;
+        if (arg->q->pop(&val)) {
+            popped->push_back(val);
+            arg->npopped->fetch_add(1, butil::memory_order_relaxed);
+        } else {
+            sched_yield();
+        }
+    }
+    return popped;
+}
+
+// Push `total' tasks with `nproducer' pthreads and pop them with
+// `nconsumer' pthreads. Returns elapsed microseconds.
+template <typename Queue>
+int64_t run_queue(Queue* q, size_t nproducer, size_t nconsumer, size_t total,
+                  std::vector<bthread_t>* values) {
+    butil::atomic<size_t> npopped(0);
+    std::vector<QueueArgs<Queue>> args(nproducer + 1);
+    std::vector<pthread_t> producers(nproducer);
+    std::vector<pthread_t> consumers(nconsumer);
+    butil::Timer tm;
+    tm.start();
+    for (size_t i = 0; i < nproducer; ++i) {
+        args[i] = { q, total * i / nproducer, total * (i + 1) / nproducer,
+                    &npopped, total };
+        EXPECT_EQ(0, pthread_create(&producers[i], nullptr,
+                                    push_thread<Queue>, &args[i]));
+    }
+    args[nproducer] = { q, 0, 0, &npopped, total };
+    for (size_t i = 0; i < nconsumer; ++i) {
+        EXPECT_EQ(0, pthread_create(&consumers[i], nullptr,
+                                    pop_thread<Queue>, &args[nproducer]));
+    }
+    for (size_t i = 0; i < nproducer; ++i) {
+        pthread_join(producers[i], nullptr);
+    }
+    for (size_t i = 0; i < nconsumer; ++i) {
+        std::vector<bthread_t>* popped = nullptr;
+        pthread_join(consumers[i], (void**)&popped);
+        if (values) {
+            values->insert(values->end(), popped->begin(), popped->end());
+        }
+        delete popped;
+    }
+    tm.stop();
+    return tm.u_elapsed();
+}
+
+TEST(RemoteTaskQueueTest, full_and_empty) {
+    bthread::RemoteTaskQueue q;
+    ASSERT_EQ(0, q.init(6));
+    ASSERT_EQ(8u, q.capacity());
+    bthread_t val;
+    for (int round = 0; round < 3; ++round) {
+        ASSERT_FALSE(q.pop(&val));
+        for (size_t i = 0; i < q.capacity(); ++i) {
+            ASSERT_TRUE(q.push(round * 100 + i));
+        }
+        ASSERT_FALSE(q.push(12345));
+        for (size_t i = 0; i < q.capacity(); ++i) {
+            ASSERT_TRUE(q.pop(&val));
+            ASSERT_EQ(round * 100 + i, val);
+        }
+    }
+    ASSERT_FALSE(q.pop(&val));
+}
+
+TEST(RemoteTaskQueueTest, mpmc) {
+    const size_t N = 200000;
+    bthread::RemoteTaskQueue q;
+    ASSERT_EQ(0, q.init(16));
+    std::vector<bthread_t> values;
+    run_queue(&q, 4, 4, N, &values);
+    std::sort(values.begin(), values.end());
+    ASSERT_EQ(N, values.size());
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(i, values[i]);
+    }
+    bthread_t val;
+    ASSERT_FALSE(q.pop(&val));
+}
+
+void* batch_push_thread(void* void_arg) {
+    QueueArgs<bthread::RemoteTaskQueue>* arg =
+        (QueueArgs<bthread::RemoteTaskQueue>*)void_arg;
+    bthread_t batch[7];
+    for (size_t i = arg->begin; i < arg->end;) {
+        const size_t n = std::min(arraysize(batch), arg->end - i);
+        for (size_t j = 0; j < n; ++j) {
+            batch[j] = i + j;
+        }
+        const size_t pushed = arg->q->push_batch(batch, n);
+        if (pushed == 0) {
+            sched_yield();
+        }
+        i += pushed;
+    }
+    return nullptr;
+}
+
+TEST(RemoteTaskQueueTest, push_batch) {
+    bthread::RemoteTaskQueue q;
+    ASSERT_EQ(0, q.init(8));
+    bthread_t batch[5] = { 1, 2, 3, 4, 5 };
+    ASSERT_EQ(5u, q.push_batch(batch, 5));
+    // Partially pushed when the queue is about to be full.
+    ASSERT_EQ(3u, q.push_batch(batch, 5));
+    ASSERT_EQ(0u, q.push_batch(batch, 5));
+    bthread_t val;
+    const bthread_t expected[] = { 1, 2, 3, 4, 5, 1, 2, 3 };
+    for (size_t i = 0; i < arraysize(expected); ++i) {
+        ASSERT_TRUE(q.pop(&val));
+        ASSERT_EQ(expected[i], val);
+    }
+    ASSERT_FALSE(q.pop(&val));
+
+    // Batches pushed concurrently with single pushes.
+    const size_t N = 200000;
+    bthread::RemoteTaskQueue q2;
+    ASSERT_EQ(0, q2.init(16));
+    butil::atomic<size_t> npopped(0);
+    QueueArgs<bthread::RemoteTaskQueue> args[5];
+    pthread_t producers[4];
+    pthread_t consumers[4];
+    for (size_t i = 0; i < arraysize(producers); ++i) {
+        args[i] = { &q2, N * i / 4, N * (i + 1) / 4, &npopped, N };
+        ASSERT_EQ(0, pthread_create(
+                      &producers[i], nullptr,
+                      (i % 2 ? batch_push_thread : push_thread<bthread::RemoteTaskQueue>),
+                      &args[i]));
+    }
+    args[4] = { &q2, 0, 0, &npopped, N };
+    for (size_t i = 0; i < arraysize(consumers); ++i) {
+        ASSERT_EQ(0, pthread_create(&consumers[i], nullptr,
+                                    pop_thread<bthread::RemoteTaskQueue>, &args[4]));
+    }
+    std::vector<bthread_t> values;
+    for (size_t i = 0; i < arraysize(producers); ++i) {
+        pthread_join(producers[i], nullptr);
+    }
+    for (size_t i = 0; i < arraysize(consumers); ++i) {
+        std::vector<bthread_t>* popped = nullptr;
+        pthread_join(consumers[i], (void**)&popped);
+        values.insert(values.end(), popped->begin(), popped->end());
+        delete popped;
+    }
+    std::sort(values.begin(), values.end());
+    ASSERT_EQ(N, values.size());
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(i, values[i]);
+    }
+}
+
+TEST(RemoteTaskQueueTest, contention) {
+    const size_t N = 1 << 18;
+    const size_t NCONSUMER = 4;
+    std::cout << "producers\tlocked(Mops/s)\tlock-free(Mops/s)" << std::endl;
+    for (size_t nproducer = 1; nproducer <= 64; nproducer *= 2) {
+        LockedTaskQueue lq;
+        ASSERT_EQ(0, lq.init(2048));
+        const int64_t locked_us = run_queue(&lq, nproducer, NCONSUMER, N, nullptr);
+        bthread::RemoteTaskQueue q;
+        ASSERT_EQ(0, q.init(2048));
+        const int64_t lockfree_us = run_queue(&q, nproducer, NCONSUMER, N, nullptr);
+        std::cout << nproducer << "\t\t"
+                  << N / (double)std::max(locked_us, (int64_t)1) << "\t\t"
+                  << N / (double)std::max(lockfree_us, (int64_t)1) << std::endl;
+    }
+}
+
+} // namespace
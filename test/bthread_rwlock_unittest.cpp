@@ -705,4 +705,162 @@ TEST(RWLockTest, pthread_rdlock_performance) {
     pthread_mutex_destroy(&lock1);
 #endif
 }
+TEST(RWLockTest, biased_sanity) {
+    bthread::BiasedRWLock rw(3);
+    ASSERT_EQ(3u, rw._slot_mask);
+    rw.rdlock();
+    ASSERT_TRUE(rw.try_rdlock());
+    ASSERT_FALSE(rw.try_wrlock());
+    timespec abstime = butil::milliseconds_from_now(10);
+    ASSERT_FALSE(rw.timed_wrlock(&abstime));
+    // Failed writers must not leave the bias revoked.
+    ASSERT_TRUE(rw.try_rdlock());
+    rw.unlock();
+    rw.unlock();
+    rw.unlock();
+
+    rw.wrlock();
+    ASSERT_FALSE(rw.try_rdlock());
+    ASSERT_FALSE(rw.try_wrlock());
+    abstime = butil::milliseconds_from_now(10);
+    ASSERT_FALSE(rw.timed_rdlock(&abstime));
+    rw.unlock();
+
+    {
+        std::lock_guard<bthread::BiasedRWLock> guard(rw, true);
+        ASSERT_TRUE(rw.try_rdlock());
+        rw.unlock();
+    }
+    {
+        std::lock_guard<bthread::BiasedRWLock> guard(rw, false);
+        ASSERT_FALSE(rw.try_rdlock());
+    }
+    ASSERT_TRUE(rw.try_wrlock());
+    rw.unlock();
+    ASSERT_EQ(0, rw.nreader());
+}
+
+struct BiasedArgs {
+    bthread::BiasedRWLock* rw;
+    int64_t* shared;
+    int64_t local_inc;
+    bool is_writer;
+};
+
+void* biased_worker(void* arg) {
+    auto* a = (BiasedArgs*)arg;
+    while (!g_stopped) {
+        if (a->is_writer) {
+            a->rw->wrlock();
+            const int64_t v = *a->shared;
+            *a->shared = v + 1;
+            ++a->local_inc;
+            a->rw->unlock();
+        } else {
+            a->rw->rdlock();
+            const int64_t v1 = *a->shared;
+            // Readers may be rescheduled to other workers before unlocking.
+            bthread_yield();
+            EXPECT_EQ(v1, *a->shared);
+            a->rw->unlock();
+        }
+    }
+    return nullptr;
+}
+
+TEST(RWLockTest, biased_data_consistency) {
+    bthread::BiasedRWLock rw;
+    g_stopped = false;
+    const int W = 2;
+    const int R = 8;
+    bthread_setconcurrency(W + R + 4);
+    int64_t shared = 0;
+    std::vector<BiasedArgs> args(W + R);
+    std::vector<bthread_t> threads(W + R);
+    for (int i = 0; i < W + R; ++i) {
+        args[i].rw = &rw;
+        args[i].shared = &shared;
+        args[i].local_inc = 0;
+        args[i].is_writer = (i < W);
+        ASSERT_EQ(0, bthread_start_background(&threads[i], nullptr,
+                                              biased_worker, &args[i]));
+    }
+    bthread_usleep(500 * 1000);
+    g_stopped = true;
+    int64_t total_inc = 0;
+    for (int i = 0; i < W + R; ++i) {
+        bthread_join(threads[i], nullptr);
+        total_inc += args[i].local_inc;
+    }
+    EXPECT_EQ(total_inc, shared);
+    EXPECT_GT(total_inc, 0);
+    ASSERT_EQ(0, rw.nreader());
+}
+
+struct BAIDU_CACHELINE_ALIGNMENT ReadBenchArgs {
+    bthread_rwlock_t* rw;
+    bthread::BiasedRWLock* biased_rw;
+    int64_t counter;
+};
+
+void* read_bench(void* void_arg) {
+    auto args = (ReadBenchArgs*)void_arg;
+    while (!g_started) {
+        bthread_usleep(100);
+    }
+    while (!g_stopped) {
+        if (args->biased_rw) {
+            args->biased_rw->rdlock();
+            ++args->counter;
+            args->biased_rw->unlock();
+        } else {
+            bthread_rwlock_rdlock(args->rw);
+            ++args->counter;
+            bthread_rwlock_unlock(args->rw);
+        }
+    }
+    return nullptr;
+}
+
+double read_bench_mops(int nreader, bool biased) {
+    bthread_rwlock_t rw;
+    bthread_rwlock_init(&rw, nullptr);
+    bthread::BiasedRWLock biased_rw;
+    g_started = false;
+    g_stopped = false;
+    std::vector<bthread_t> threads(nreader);
+    std::vector<ReadBenchArgs> args(nreader);
+    for (int i = 0; i < nreader; ++i) {
+        args[i].rw = &rw;
+        args[i].biased_rw = biased ? &biased_rw : nullptr;
+        args[i].counter = 0;
+        EXPECT_EQ(0, bthread_start_background(&threads[i], nullptr,
+                                              read_bench, &args[i]));
+    }
+    usleep(10 * 1000);
+    butil::Timer tm;
+    tm.start();
+    g_started = true;
+    usleep(200 * 1000);
+    g_stopped = true;
+    tm.stop();
+    int64_t count = 0;
+    for (int i = 0; i < nreader; ++i) {
+        bthread_join(threads[i], nullptr);
+        count += args[i].counter;
+    }
+    bthread_rwlock_destroy(&rw);
+    return count * 1000.0 / tm.n_elapsed();
+}
+
+TEST(RWLockTest, biased_rdlock_performance) {
+    bthread_setconcurrency(std::max(16, bthread_getconcurrency()));
+    for (int nreader = 1; nreader <= 128; nreader *= 2) {
+        const double normal = read_bench_mops(nreader, false);
+        const double biased = read_bench_mops(nreader, true);
+        LOG(INFO) << "readers=" << nreader << " bthread_rwlock_t="
+                  << normal << "Mops/s BiasedRWLock=" << biased << "Mops/s";
+    }
+}
+
 } // namespace
@@ -0,0 +1,100 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include "butil/atomicops.h"
+#include "butil/logging.h"
+#include "bthread/bthread.h"
+#include "bvar/variable.h"
+
+DECLARE_int32(task_group_ntags);
+DECLARE_string(cpu_set);
+
+namespace bthread {
+DECLARE_string(bthread_tag_weights);
+}
+
+int main(int argc, char* argv[]) {
+    FLAGS_task_group_ntags = 2;
+    // All workers share cpu 0 so that tags always contend for cpu.
+    FLAGS_cpu_set = "0";
+    bthread::FLAGS_bthread_tag_weights = "0:3;1:1";
+    testing::InitGoogleTest(&argc, argv);
+    GFLAGS_NAMESPACE::ParseCommandLineFlags(&argc, &argv, true);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+
+butil::atomic<bool> g_stop(false);
+butil::atomic<int64_t> g_nchunk[2];
+
+void* spin_and_yield(void* arg) {
+    const bthread_tag_t tag = (bthread_tag_t)(intptr_t)arg;
+    EXPECT_EQ(tag, bthread_self_tag());
+    while (!g_stop.load(butil::memory_order_relaxed)) {
+        // Fixed amount of work, so that the number of chunks done is in
+        // proportion to the cpu time the tag got.
+        volatile int64_t x = 0;
+        for (int i = 0; i < 20000; ++i) {
+            x = x + i;
+        }
+        g_nchunk[tag].fetch_add(1, butil::memory_order_relaxed);
+        bthread_yield();
+        // Tasks run by workers of other tags are still in their own tags.
+        EXPECT_EQ(tag, bthread_self_tag());
+    }
+    return nullptr;
+}
+
+TEST(BthreadTagShareTest, weighted_share) {
+    std::vector<bthread_t> tids;
+    for (int tag = 0; tag < 2; ++tag) {
+        g_nchunk[tag].store(0, butil::memory_order_relaxed);
+        bthread_attr_t attr = BTHREAD_ATTR_NORMAL;
+        attr.tag = tag;
+        // More tasks than workers so that tags always have queued tasks.
+        for (int i = 0; i < 16; ++i) {
+            bthread_t tid;
+            ASSERT_EQ(0, bthread_start_background(
+                          &tid, &attr, spin_and_yield, (void*)(intptr_t)tag));
+            tids.push_back(tid);
+        }
+    }
+    usleep(200000);
+    const int64_t start0 = g_nchunk[0].load(butil::memory_order_relaxed);
+    const int64_t start1 = g_nchunk[1].load(butil::memory_order_relaxed);
+    usleep(1000000);
+    const int64_t n0 = g_nchunk[0].load(butil::memory_order_relaxed) - start0;
+    const int64_t n1 = g_nchunk[1].load(butil::memory_order_relaxed) - start1;
+    g_stop.store(true, butil::memory_order_relaxed);
+    for (size_t i = 0; i < tids.size(); ++i) {
+        ASSERT_EQ(0, bthread_join(tids[i], nullptr));
+    }
+    LOG(INFO) << "chunks done by tag0=" << n0 << " tag1=" << n1;
+    // Tag 1 is not starved, and tag 0 gets about 3 times as much cpu.
+    ASSERT_GT(n1, 0);
+    ASSERT_GT(n0, n1 * 2);
+    // Workers of tag 1 ran tasks of tag 0 which is owed cpu.
+    const std::string nborrow =
+        bvar::Variable::describe_exposed("bthread_tag_borrow_count_0");
+    ASSERT_GT(atoll(nborrow.c_str()), 0) << nborrow;
+}
+
+}  // namespace
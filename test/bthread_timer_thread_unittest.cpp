@@ -378,4 +378,158 @@ TEST(TimerThreadTest, periodic_wakeup_drains_buckets) {
     timer_thread.stop_and_join();
 }
 
+static bthread::TimerThreadOptions wheel_options(size_t nshard) {
+    bthread::TimerThreadOptions options;
+    options.num_wheel_shards = nshard;
+    options.wheel_tick_us = 1000;
+    return options;
+}
+
+TEST(TimerThreadTest, wheel_run_tasks) {
+    bthread::TimerThread timer_thread;
+    const bthread::TimerThreadOptions options = wheel_options(2);
+    ASSERT_EQ(0, timer_thread.start(&options));
+    ASSERT_NE((pthread_t)0, timer_thread.thread_id());
+
+    // 100ms is in the root wheel, 1s and 2s are cascaded from upper wheels.
+    TimeKeeper keeper1(butil::milliseconds_from_now(100), "keeper1");
+    keeper1.schedule(&timer_thread);
+    TimeKeeper keeper2(butil::seconds_from_now(1), "keeper2");
+    keeper2.schedule(&timer_thread);
+    TimeKeeper keeper3(butil::seconds_from_now(2), "keeper3");
+    keeper3.schedule(&timer_thread);
+    TimeKeeper keeper4(butil::seconds_from_now(2), "keeper4");
+    keeper4.schedule(&timer_thread);
+    timespec future_time = { std::numeric_limits<int>::max(), 0 };
+    TimeKeeper keeper5(future_time, "keeper5");
+    keeper5.schedule(&timer_thread);
+
+    ASSERT_EQ(0, timer_thread.unschedule(keeper4._task_id));
+    ASSERT_EQ(-1, timer_thread.unschedule(keeper4._task_id));
+    timespec old_time = { 0, 0 };
+    TimeKeeper keeper6(old_time, "keeper6");
+    keeper6.schedule(&timer_thread);
+    const timespec keeper6_addtime = butil::seconds_from_now(0);
+
+    sleep(3);
+    ASSERT_EQ(-1, timer_thread.unschedule(keeper1._task_id));
+    ASSERT_EQ(0, timer_thread.unschedule(keeper5._task_id));
+    butil::Timer tm;
+    tm.start();
+    timer_thread.stop_and_join();
+    tm.stop();
+    ASSERT_LE(tm.m_elapsed(), 15);
+    ASSERT_EQ(bthread::TimerThread::INVALID_TASK_ID,
+              timer_thread.schedule(noop_routine, nullptr, old_time));
+
+    keeper1.expect_first_run();
+    keeper2.expect_first_run();
+    keeper3.expect_first_run();
+    keeper4.expect_not_run();
+    keeper5.expect_not_run();
+    keeper6.expect_first_run(keeper6_addtime);
+}
+
+static void count_routine(void* arg) {
+    static_cast<butil::atomic<int>*>(arg)->fetch_add(
+        1, butil::memory_order_relaxed);
+}
+
+// Tasks of all distances run exactly once.
+TEST(TimerThreadTest, wheel_run_all_tasks) {
+    bthread::TimerThread timer_thread;
+    const bthread::TimerThreadOptions options = wheel_options(4);
+    ASSERT_EQ(0, timer_thread.start(&options));
+    butil::atomic<int> nrun(0);
+    const int N = 2000;
+    for (int i = 0; i < N; ++i) {
+        timer_thread.schedule(count_routine, &nrun,
+                              butil::microseconds_from_now(i * 997 % 1500000));
+    }
+    for (int i = 0; i < 30 && nrun.load() < N; ++i) {
+        usleep(100000);
+    }
+    ASSERT_EQ(N, nrun.load());
+    ASSERT_EQ(0, timer_thread._npending.load(butil::memory_order_relaxed));
+    timer_thread.stop_and_join();
+}
+
+// Unscheduled tasks in upper wheels are swept long before their run_time.
+TEST(TimerThreadTest, wheel_sweep_unscheduled_tasks) {
+    bthread::TimerThread timer_thread;
+    const bthread::TimerThreadOptions options = wheel_options(2);
+    ASSERT_EQ(0, timer_thread.start(&options));
+    const size_t N = 20000;
+    std::vector<bthread::TimerThread::TaskId> ids;
+    ids.reserve(N);
+    for (size_t i = 0; i < N; ++i) {
+        ids.push_back(timer_thread.schedule(
+            noop_routine, nullptr, butil::seconds_from_now(100 + i % 1000)));
+    }
+    usleep(100000);
+    ASSERT_EQ((int64_t)N,
+              timer_thread._npending.load(butil::memory_order_relaxed));
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(0, timer_thread.unschedule(ids[i]));
+    }
+    // A whole round of the root wheel sweeps all upper slots.
+    usleep(600000);
+    ASSERT_EQ(0, timer_thread._npending.load(butil::memory_order_relaxed));
+    timer_thread.stop_and_join();
+}
+
+struct BenchArg {
+    bthread::TimerThread* timer_thread;
+    size_t nop;
+    int64_t elapsed_ns;
+};
+
+// Schedule and unschedule like RPC timeouts.
+static void* schedule_and_unschedule(void* void_arg) {
+    BenchArg* arg = static_cast<BenchArg*>(void_arg);
+    butil::Timer tm;
+    tm.start();
+    for (size_t i = 0; i < arg->nop; ++i) {
+        const bthread::TimerThread::TaskId id = arg->timer_thread->schedule(
+            noop_routine, nullptr, butil::milliseconds_from_now(1000 + i % 64));
+        arg->timer_thread->unschedule(id);
+    }
+    tm.stop();
+    arg->elapsed_ns = tm.n_elapsed();
+    return nullptr;
+}
+
+static double bench_timer(const bthread::TimerThreadOptions& options,
+                          size_t nthread, size_t nop) {
+    bthread::TimerThread timer_thread;
+    EXPECT_EQ(0, timer_thread.start(&options));
+    std::vector<pthread_t> threads(nthread);
+    std::vector<BenchArg> args(nthread);
+    butil::Timer tm;
+    tm.start();
+    for (size_t i = 0; i < nthread; ++i) {
+        args[i].timer_thread = &timer_thread;
+        args[i].nop = nop;
+        pthread_create(&threads[i], nullptr, schedule_and_unschedule, &args[i]);
+    }
+    for (size_t i = 0; i < nthread; ++i) {
+        pthread_join(threads[i], nullptr);
+    }
+    tm.stop();
+    timer_thread.stop_and_join();
+    return nthread * nop * 1000.0 / tm.n_elapsed();  // Mops/s
+}
+
+TEST(TimerThreadTest, wheel_vs_heap_performance) {
+    const size_t nop = 200000;
+    const size_t nthreads[] = { 1, 4, 16 };
+    for (size_t i = 0; i < ARRAY_SIZE(nthreads); ++i) {
+        const double heap = bench_timer(bthread::TimerThreadOptions(),
+                                        nthreads[i], nop);
+        const double wheel = bench_timer(wheel_options(4), nthreads[i], nop);
+        LOG(INFO) << "schedule+unschedule threads=" << nthreads[i]
+                  << " heap=" << heap << "Mops/s wheel=" << wheel << "Mops/s";
+    }
+}
+
 } // end namespace
@@ -17,6 +17,7 @@
 
 #include <execinfo.h>
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <memory>
 #include "butil/time.h"
 #include "butil/macros.h"
@@ -24,7 +25,13 @@
 #include "gperftools_helper.h"
 #include "bthread/bthread.h"
 #include "bthread/unstable.h"
+#include "bthread/butex.h"
+#include "bthread/task_control.h"
+#include "bthread/task_group.h"
 #include "bthread/task_meta.h"
+#include "bthread/stack.h"
+#include "bthread/stack_arena.h"
+#include "bvar/variable.h"
 
 int main(int argc, char* argv[]) {
     testing::InitGoogleTest(&argc, argv);
@@ -33,7 +40,11 @@ int main(int argc, char* argv[]) {
     return rc;
 }
 
+DECLARE_int32(bthread_stack_arena_mb);
+DECLARE_int32(bthread_stack_arena_idle_max);
+
 namespace bthread {
+DECLARE_int32(bthread_steal_batch);
 #ifdef BRPC_BTHREAD_TRACER
 extern std::string stack_trace(bthread_t tid);
 #endif // BRPC_BTHREAD_TRACER
@@ -701,4 +712,566 @@ TEST_F(BthreadTest, trace) {
 }
 #endif // BRPC_BTHREAD_TRACER
 
+TEST_F(BthreadTest, stack_arena_sanity) {
+    FLAGS_bthread_stack_arena_mb = 256;
+    const int pagesize = getpagesize();
+    // Not the size of any default stack, which may fill up the arena of the
+    // size when arenas are enabled from the start.
+    bthread::StackStorage stacks[100];
+    for (size_t i = 0; i < arraysize(stacks); ++i) {
+        ASSERT_EQ(0, bthread::allocate_stack_storage(&stacks[i], 65536, pagesize));
+        ASSERT_TRUE(bthread::is_arena_stack(stacks[i].bottom));
+        ASSERT_EQ(65536u, stacks[i].stacksize);
+        ASSERT_EQ((unsigned)pagesize, stacks[i].guardsize);
+        // The whole stack is writable.
+        memset((char*)stacks[i].bottom - stacks[i].stacksize, 1,
+               stacks[i].stacksize);
+    }
+    std::vector<bthread::StackArenaStat> stats;
+    bthread::get_stack_arena_stats(&stats);
+    ASSERT_FALSE(stats.empty());
+    size_t used = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        if (stats[i].stacksize == 65536) {
+            used += stats[i].used;
+        }
+    }
+    ASSERT_EQ(arraysize(stacks), used);
+    std::ostringstream os;
+    bthread::describe_stack_arenas(os);
+    LOG(INFO) << os.str();
+    ASSERT_NE(std::string::npos, os.str().find("stacksize=65536"));
+    for (size_t i = 0; i < arraysize(stacks); ++i) {
+        bthread::deallocate_stack_storage(&stacks[i]);
+    }
+    // Freed slots are reused.
+    bthread::StackStorage s;
+    ASSERT_EQ(0, bthread::allocate_stack_storage(&s, 65536, pagesize));
+    bool reused = false;
+    for (size_t i = 0; i < arraysize(stacks); ++i) {
+        reused = reused || s.bottom == stacks[i].bottom;
+    }
+    ASSERT_TRUE(reused);
+    bthread::deallocate_stack_storage(&s);
+}
+
+TEST_F(BthreadTest, stack_arena_trim) {
+    FLAGS_bthread_stack_arena_mb = 256;
+    const int32_t saved_idle_max = FLAGS_bthread_stack_arena_idle_max;
+    FLAGS_bthread_stack_arena_idle_max = 1000000;
+    const int pagesize = getpagesize();
+    bthread::StackStorage s;
+    ASSERT_EQ(0, bthread::allocate_stack_storage(&s, 65536, pagesize));
+    ASSERT_TRUE(bthread::is_arena_stack(s.bottom));
+    char* const top = (char*)s.bottom - s.stacksize;
+    memset(top, 1, s.stacksize);
+    // Pretend that the stack is pooled with context saved at the last page.
+    char* const sp = (char*)s.bottom - 64;
+    bthread::arena_stack_returned(s, sp);
+    ASSERT_GE(bthread::trim_stack_arenas(), 1u);
+    FLAGS_bthread_stack_arena_idle_max = saved_idle_max;
+    // Pages below the context are released, the context is kept.
+    ASSERT_EQ(0, top[0]);
+    ASSERT_EQ(0, top[s.stacksize - 3 * pagesize]);
+    ASSERT_EQ(1, sp[0]);
+    ASSERT_EQ(1, *((char*)s.bottom - 2 * pagesize));
+    bthread::arena_stack_reused(s);
+    bthread::deallocate_stack_storage(&s);
+}
+
+void* stack_arena_sleeper(void*) {
+    char buf[4096];
+    memset(buf, 0, sizeof(buf));
+    bthread_usleep(10000);
+    return buf[100] ? buf : nullptr;
+}
+
+TEST_F(BthreadTest, stack_arena_run_bthreads) {
+    FLAGS_bthread_stack_arena_mb = 256;
+    const int32_t saved_idle_max = FLAGS_bthread_stack_arena_idle_max;
+    FLAGS_bthread_stack_arena_idle_max = 8;
+    for (int round = 0; round < 3; ++round) {
+        bthread_t th[1024];
+        for (size_t i = 0; i < arraysize(th); ++i) {
+            ASSERT_EQ(0, bthread_start_background(&th[i], nullptr,
+                                                  stack_arena_sleeper, nullptr));
+        }
+        for (size_t i = 0; i < arraysize(th); ++i) {
+            ASSERT_EQ(0, bthread_join(th[i], nullptr));
+        }
+    }
+    FLAGS_bthread_stack_arena_idle_max = saved_idle_max;
+    std::vector<bthread::StackArenaStat> stats;
+    bthread::get_stack_arena_stats(&stats);
+    size_t carved = 0;
+    size_t trimmed = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        if (stats[i].stacksize == 1048576) {
+            carved += stats[i].carved;
+            trimmed += stats[i].trimmed;
+        }
+    }
+    ASSERT_GT(carved, 0u);
+    ASSERT_GT(trimmed, 0u);
+    std::ostringstream os;
+    bthread::describe_stack_arenas(os);
+    LOG(INFO) << os.str();
+}
+
+static int64_t stackless_promoted_count() {
+    std::string value = bvar::Variable::describe_exposed(
+        "bthread_stackless_promoted_count");
+    return value.empty() ? 0 : strtoll(value.c_str(), nullptr, 10);
+}
+
+void* stackless_add(void* arg) {
+    static_cast<butil::atomic<int>*>(arg)->fetch_add(1);
+    return nullptr;
+}
+
+TEST_F(BthreadTest, stackless_sanity) {
+    butil::atomic<int> counter(0);
+    bthread_t th[1000];
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(&th[i], &BTHREAD_ATTR_STACKLESS,
+                                              stackless_add, &counter));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], nullptr));
+    }
+    ASSERT_EQ((int)arraysize(th), counter.load());
+    bthread_attr_t attr;
+    ASSERT_EQ(0, bthread_attr_init(&attr));
+    attr = BTHREAD_ATTR_STACKLESS;
+    ASSERT_EQ(0, bthread_start_urgent(&th[0], &attr, stackless_add, &counter));
+    ASSERT_EQ(0, bthread_join(th[0], nullptr));
+    ASSERT_EQ((int)arraysize(th) + 1, counter.load());
+}
+
+struct StacklessBlockingArg {
+    bthread_mutex_t mutex;
+    int64_t sum;
+    butil::atomic<int> nfinished;
+};
+
+void* stackless_blocker(void* void_arg) {
+    StacklessBlockingArg* arg = static_cast<StacklessBlockingArg*>(void_arg);
+    // Locals live across blocking calls, they'd be corrupted if the stack
+    // were reused by others.
+    char buf[2048];
+    memset(buf, 7, sizeof(buf));
+    EXPECT_EQ(0, bthread_usleep(1000));
+    bthread_t th;
+    butil::atomic<int> counter(0);
+    EXPECT_EQ(0, bthread_start_background(&th, &BTHREAD_ATTR_STACKLESS,
+                                          stackless_add, &counter));
+    EXPECT_EQ(0, bthread_join(th, nullptr));
+    EXPECT_EQ(1, counter.load());
+    bthread_mutex_lock(&arg->mutex);
+    bthread_usleep(100);
+    arg->sum += buf[0] + buf[sizeof(buf) - 1];
+    bthread_mutex_unlock(&arg->mutex);
+    arg->nfinished.fetch_add(1);
+    return nullptr;
+}
+
+void* stackless_blocker_launcher(void* void_arg) {
+    bthread_t th[100];
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        EXPECT_EQ(0, bthread_start_background(
+                      &th[i], &BTHREAD_ATTR_STACKLESS, stackless_blocker, void_arg));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        EXPECT_EQ(0, bthread_join(th[i], nullptr));
+    }
+    return nullptr;
+}
+
+TEST_F(BthreadTest, stackless_blocking) {
+    const int64_t promoted0 = stackless_promoted_count();
+    StacklessBlockingArg arg;
+    bthread_mutex_init(&arg.mutex, nullptr);
+    arg.sum = 0;
+    arg.nfinished = 0;
+    bthread_t th[200];
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &th[i], &BTHREAD_ATTR_STACKLESS, stackless_blocker, &arg));
+    }
+    bthread_t launchers[4];
+    for (size_t i = 0; i < arraysize(launchers); ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &launchers[i], nullptr, stackless_blocker_launcher, &arg));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], nullptr));
+    }
+    for (size_t i = 0; i < arraysize(launchers); ++i) {
+        ASSERT_EQ(0, bthread_join(launchers[i], nullptr));
+    }
+    const int n = arraysize(th) + arraysize(launchers) * 100;
+    ASSERT_EQ(n, arg.nfinished.load());
+    ASSERT_EQ(n * 14, arg.sum);
+    bthread_mutex_destroy(&arg.mutex);
+    // Tasks started from pthread run on idle workers and have to be promoted.
+    ASSERT_GT(stackless_promoted_count(), promoted0);
+    LOG(INFO) << "Promoted " << stackless_promoted_count() - promoted0
+              << " of " << n << " stackless bthreads";
+}
+
+void* stackless_yielder(void* arg) {
+    char buf[2048];
+    memset(buf, 7, sizeof(buf));
+    // Yielding suspends the task, which has to be promoted instead of
+    // calling sched_yield() on the worker.
+    EXPECT_EQ(0, bthread_yield());
+    EXPECT_EQ(7, buf[0]);
+    EXPECT_EQ(7, buf[sizeof(buf) - 1]);
+    static_cast<butil::atomic<int>*>(arg)->fetch_add(1);
+    return nullptr;
+}
+
+TEST_F(BthreadTest, stackless_yield) {
+    const int64_t promoted0 = stackless_promoted_count();
+    butil::atomic<int> counter(0);
+    bthread_t th[100];
+    // Tasks started from pthread run on the stacks of idle workers.
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &th[i], &BTHREAD_ATTR_STACKLESS, stackless_yielder, &counter));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], nullptr));
+    }
+    ASSERT_EQ((int)arraysize(th), counter.load());
+    ASSERT_GT(stackless_promoted_count(), promoted0);
+}
+
+void* stackless_urgent_starter(void* arg) {
+    butil::atomic<int>* counter = static_cast<butil::atomic<int>*>(arg);
+    char buf[2048];
+    memset(buf, 7, sizeof(buf));
+    // The new task runs in foreground, current task is suspended.
+    bthread_t th;
+    EXPECT_EQ(0, bthread_start_urgent(&th, nullptr, stackless_add, counter));
+    EXPECT_EQ(0, bthread_join(th, nullptr));
+    EXPECT_EQ(7, buf[0]);
+    EXPECT_EQ(7, buf[sizeof(buf) - 1]);
+    counter->fetch_add(1);
+    return nullptr;
+}
+
+TEST_F(BthreadTest, stackless_start_urgent) {
+    const int64_t promoted0 = stackless_promoted_count();
+    butil::atomic<int> counter(0);
+    bthread_t th[100];
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_start_background(
+                      &th[i], &BTHREAD_ATTR_STACKLESS, stackless_urgent_starter,
+                      &counter));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, bthread_join(th[i], nullptr));
+    }
+    ASSERT_EQ((int)arraysize(th) * 2, counter.load());
+    ASSERT_GT(stackless_promoted_count(), promoted0);
+}
+
+struct PromotedStopArg {
+    butil::atomic<int>* butex;
+    butil::atomic<bool> finished;
+};
+
+void* stackless_butex_waiter(void* void_arg) {
+    PromotedStopArg* arg = static_cast<PromotedStopArg*>(void_arg);
+    // Started from pthread, the task runs on the pthread stack of the worker
+    // and holds it after being promoted.
+    while (arg->butex->load() == 0) {
+        bthread::butex_wait(arg->butex, 0, nullptr);
+    }
+    arg->finished.store(true);
+    return nullptr;
+}
+
+void* butex_waker(void* void_arg) {
+    PromotedStopArg* arg = static_cast<PromotedStopArg*>(void_arg);
+    arg->butex->store(1);
+    bthread::butex_wake(arg->butex);
+    return nullptr;
+}
+
+void* stop_task_control(void* arg) {
+    static_cast<bthread::TaskControl*>(arg)->stop_and_join();
+    return nullptr;
+}
+
+TEST_F(BthreadTest, stop_with_promoted_stackless_task) {
+    // Never deleted like g_task_control, its vars are still being sampled.
+    bthread::TaskControl* c = new bthread::TaskControl;
+    ASSERT_EQ(0, c->init(1));
+    bthread::TaskGroup* g = c->choose_one_group(BTHREAD_TAG_DEFAULT);
+    PromotedStopArg arg;
+    arg.butex = bthread::butex_create_checked<butil::atomic<int> >();
+    arg.butex->store(0);
+    arg.finished = false;
+    bthread_t th;
+    ASSERT_EQ(0, g->start_background<true>(
+                  &th, &BTHREAD_ATTR_STACKLESS, stackless_butex_waiter, &arg));
+    while (c->_nstackless_promoted.get_value() == 0) {
+        usleep(1000);
+    }
+    // Stop the worker while the promoted task is blocked.
+    pthread_t stopper;
+    ASSERT_EQ(0, pthread_create(&stopper, nullptr, stop_task_control, c));
+    while (!c->_stop) {
+        usleep(1000);
+    }
+    usleep(10000);
+    // Other groups are invisible after stopping, wake up the task from the
+    // queue of the worker, which has to keep running tasks to quit.
+    ASSERT_EQ(0, g->start_background<true>(&th, nullptr, butex_waker, &arg));
+    ASSERT_EQ(0, pthread_join(stopper, nullptr));
+    ASSERT_TRUE(arg.finished.load());
+    bthread::butex_destroy(arg.butex);
+}
+
+struct StacklessPerfArg {
+    const bthread_attr_t* attr;
+    int ntask;
+    int64_t elapsed_ns;
+};
+
+void* run_stackless_perf(void* void_arg) {
+    StacklessPerfArg* arg = static_cast<StacklessPerfArg*>(void_arg);
+    // Start in batches so that the local runqueue does not overflow.
+    bthread_t th[1000];
+    butil::atomic<int> counter(0);
+    butil::Timer tm;
+    tm.start();
+    for (int n = 0; n < arg->ntask; n += arraysize(th)) {
+        for (size_t i = 0; i < arraysize(th); ++i) {
+            EXPECT_EQ(0, bthread_start_background(&th[i], arg->attr,
+                                                  stackless_add, &counter));
+        }
+        for (size_t i = 0; i < arraysize(th); ++i) {
+            EXPECT_EQ(0, bthread_join(th[i], nullptr));
+        }
+    }
+    tm.stop();
+    EXPECT_EQ(arg->ntask, counter.load());
+    arg->elapsed_ns = tm.n_elapsed();
+    return nullptr;
+}
+
+TEST_F(BthreadTest, stackless_perf) {
+    const bthread_attr_t* attrs[] = { &BTHREAD_ATTR_NORMAL, &BTHREAD_ATTR_STACKLESS };
+    const char* names[] = { "normal", "stackless" };
+    for (int from_bthread = 0; from_bthread < 2; ++from_bthread) {
+        for (size_t i = 0; i < arraysize(attrs); ++i) {
+            StacklessPerfArg arg = { attrs[i], 100000, 0 };
+            // Warm up stacks and task metas.
+            run_stackless_perf(&arg);
+            if (from_bthread) {
+                bthread_t th;
+                ASSERT_EQ(0, bthread_start_background(
+                              &th, nullptr, run_stackless_perf, &arg));
+                ASSERT_EQ(0, bthread_join(th, nullptr));
+            } else {
+                run_stackless_perf(&arg);
+            }
+            LOG(INFO) << "Start and join " << names[i] << " bthreads from "
+                      << (from_bthread ? "bthread: " : "pthread: ")
+                      << arg.elapsed_ns / arg.ntask << "ns per bthread";
+        }
+    }
+}
+
+struct StartBatchArg {
+    butil::atomic<int>* counter;
+    int index;
+    bthread_t tid;
+};
+
+void* mark_started(void* void_arg) {
+    StartBatchArg* arg = static_cast<StartBatchArg*>(void_arg);
+    arg->tid = bthread_self();
+    arg->counter->fetch_add(1);
+    return nullptr;
+}
+
+void* start_batch_and_join(void* void_n) {
+    const size_t n = (size_t)void_n;
+    butil::atomic<int> counter(0);
+    std::vector<bthread_t> tids(n);
+    std::vector<StartBatchArg> args(n);
+    std::vector<void*> arg_ptrs(n);
+    std::vector<void* (*)(void*)> fns(n, mark_started);
+    std::vector<bthread_attr_t> attrs(n, BTHREAD_ATTR_NORMAL);
+    for (size_t i = 0; i < n; ++i) {
+        args[i] = { &counter, (int)i, INVALID_BTHREAD };
+        arg_ptrs[i] = &args[i];
+        if (i % 2) {
+            attrs[i] = BTHREAD_ATTR_SMALL;
+        }
+    }
+    EXPECT_EQ(0, bthread_start_batch(&tids[0], &attrs[0], &fns[0],
+                                     &arg_ptrs[0], n));
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(0, bthread_join(tids[i], nullptr));
+        EXPECT_EQ(tids[i], args[i].tid);
+    }
+    EXPECT_EQ((int)n, counter.load());
+    return nullptr;
+}
+
+TEST_F(BthreadTest, start_batch) {
+    ASSERT_EQ(0, bthread_start_batch(nullptr, nullptr, nullptr, nullptr, 0));
+    start_batch_and_join((void*)1);
+    start_batch_and_join((void*)100);
+    // More than the capacity of the remote runqueue.
+    start_batch_and_join((void*)10000);
+    bthread_t th;
+    ASSERT_EQ(0, bthread_start_background(&th, nullptr, start_batch_and_join,
+                                          (void*)100));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+    // More than the capacity of the local runqueue.
+    ASSERT_EQ(0, bthread_start_background(&th, nullptr, start_batch_and_join,
+                                          (void*)10000));
+    ASSERT_EQ(0, bthread_join(th, nullptr));
+
+    // Default attributes and arguments.
+    bthread_t tids[4];
+    void* (*fns[4])(void*) = { do_nothing, do_nothing, do_nothing, do_nothing };
+    ASSERT_EQ(0, bthread_start_batch(tids, nullptr, fns, nullptr, 4));
+    for (size_t i = 0; i < arraysize(tids); ++i) {
+        ASSERT_EQ(0, bthread_join(tids[i], nullptr));
+    }
+    // Nothing is created with invalid arguments.
+    fns[2] = nullptr;
+    ASSERT_EQ(EINVAL, bthread_start_batch(tids, nullptr, fns, nullptr, 4));
+    fns[2] = do_nothing;
+    bthread_attr_t attrs[4] = { BTHREAD_ATTR_NORMAL, BTHREAD_ATTR_NORMAL,
+                                BTHREAD_ATTR_NORMAL, BTHREAD_ATTR_NORMAL };
+    attrs[3].tag = BTHREAD_TAG_DEFAULT;
+    ASSERT_EQ(EINVAL, bthread_start_batch(tids, attrs, fns, nullptr, 4));
+}
+
+struct StartPerfArg {
+    bool batch;
+    size_t batch_size;
+    int64_t elapsed_ns;
+};
+
+void* run_start_perf(void* void_arg) {
+    StartPerfArg* arg = static_cast<StartPerfArg*>(void_arg);
+    const size_t N = 100000;
+    std::vector<bthread_t> tids(arg->batch_size);
+    std::vector<void* (*)(void*)> fns(arg->batch_size, do_nothing);
+    butil::Timer tm;
+    tm.start();
+    for (size_t n = 0; n < N; n += arg->batch_size) {
+        if (arg->batch) {
+            EXPECT_EQ(0, bthread_start_batch(&tids[0], nullptr, &fns[0],
+                                             nullptr, arg->batch_size));
+        } else {
+            for (size_t i = 0; i < arg->batch_size; ++i) {
+                EXPECT_EQ(0, bthread_start_background(&tids[i], nullptr,
+                                                      do_nothing, nullptr));
+            }
+        }
+        for (size_t i = 0; i < arg->batch_size; ++i) {
+            bthread_join(tids[i], nullptr);
+        }
+    }
+    tm.stop();
+    arg->elapsed_ns = tm.n_elapsed() / N;
+    return nullptr;
+}
+
+TEST_F(BthreadTest, start_batch_perf) {
+    const size_t batch_sizes[] = { 8, 64, 512 };
+    for (int from_bthread = 0; from_bthread < 2; ++from_bthread) {
+        for (size_t i = 0; i < arraysize(batch_sizes); ++i) {
+            int64_t elapsed_ns[2];
+            for (int batch = 0; batch < 2; ++batch) {
+                StartPerfArg arg = { (bool)batch, batch_sizes[i], 0 };
+                if (from_bthread) {
+                    bthread_t th;
+                    ASSERT_EQ(0, bthread_start_background(
+                                  &th, nullptr, run_start_perf, &arg));
+                    ASSERT_EQ(0, bthread_join(th, nullptr));
+                } else {
+                    run_start_perf(&arg);
+                }
+                elapsed_ns[batch] = arg.elapsed_ns;
+            }
+            LOG(INFO) << "Start " << batch_sizes[i] << " bthreads from "
+                      << (from_bthread ? "bthread" : "pthread")
+                      << ": loop=" << elapsed_ns[0] << "ns batch="
+                      << elapsed_ns[1] << "ns per bthread";
+        }
+    }
+}
+
+struct ImbalancedTask {
+    int64_t created_ns;
+    int64_t latency_ns;
+};
+
+void* run_imbalanced_task(void* arg) {
+    ImbalancedTask* t = static_cast<ImbalancedTask*>(arg);
+    t->latency_ns = butil::cpuwide_time_ns() - t->created_ns;
+    // Some work so that the creating worker can't drain its runqueue fast.
+    const int64_t end_ns = butil::cpuwide_time_ns() + 5000;
+    while (butil::cpuwide_time_ns() < end_ns) {}
+    return nullptr;
+}
+
+void* flood_local_runqueue(void* arg) {
+    std::vector<ImbalancedTask>* tasks =
+        static_cast<std::vector<ImbalancedTask>*>(arg);
+    std::vector<bthread_t> tids(tasks->size());
+    // All tasks are queued into the runqueue of the worker running this
+    // bthread, other workers get them by stealing.
+    for (size_t i = 0; i < tasks->size(); ++i) {
+        (*tasks)[i].created_ns = butil::cpuwide_time_ns();
+        EXPECT_EQ(0, bthread_start_background(
+                      &tids[i], nullptr, run_imbalanced_task, &(*tasks)[i]));
+    }
+    for (size_t i = 0; i < tids.size(); ++i) {
+        bthread_join(tids[i], nullptr);
+    }
+    return nullptr;
+}
+
+TEST_F(BthreadTest, steal_batch_latency) {
+    const int saved_steal_batch = bthread::FLAGS_bthread_steal_batch;
+    const int steal_batches[] = { 1, 32 };
+    for (size_t i = 0; i < arraysize(steal_batches); ++i) {
+        bthread::FLAGS_bthread_steal_batch = steal_batches[i];
+        std::vector<int64_t> latencies;
+        for (int rep = 0; rep < 10; ++rep) {
+            std::vector<ImbalancedTask> tasks(1000);
+            bthread_t th;
+            ASSERT_EQ(0, bthread_start_background(
+                          &th, nullptr, flood_local_runqueue, &tasks));
+            ASSERT_EQ(0, bthread_join(th, nullptr));
+            for (size_t j = 0; j < tasks.size(); ++j) {
+                latencies.push_back(tasks[j].latency_ns);
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        int64_t sum = 0;
+        for (size_t j = 0; j < latencies.size(); ++j) {
+            sum += latencies[j];
+        }
+        LOG(INFO) << "Scheduling latency with -bthread_steal_batch="
+                  << steal_batches[i] << ": avg=" << sum / (int64_t)latencies.size()
+                  << "ns p50=" << latencies[latencies.size() / 2]
+                  << "ns p99=" << latencies[latencies.size() * 99 / 100]
+                  << "ns max=" << latencies.back() << "ns";
+    }
+    bthread::FLAGS_bthread_steal_batch = saved_steal_batch;
+}
+
 } // namespace
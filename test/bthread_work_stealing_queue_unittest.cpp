@@ -130,4 +130,149 @@ TEST(WSQTest, sanity) {
               << " popped=" << npopped
               << " left=" << (N - nstolen - npopped)  << std::endl;
 }
+
+void* batch_push_thread(void* arg) {
+    bthread::WorkStealingQueue<value_type> *q =
+        (bthread::WorkStealingQueue<value_type>*)arg;
+    value_type batch[5];
+    for (value_type seed = 0; seed < N;) {
+        const size_t n = std::min(ARRAY_SIZE(batch), N - seed);
+        for (size_t i = 0; i < n; ++i) {
+            batch[i] = seed + i;
+        }
+        const size_t pushed = q->push_batch(batch, n);
+        if (pushed == 0) {
+            sched_yield();
+        }
+        seed += pushed;
+    }
+    g_stop = true;
+    return nullptr;
+}
+
+TEST(WSQTest, push_batch) {
+    bthread::WorkStealingQueue<value_type> q;
+    ASSERT_EQ(0, q.init(CAP));
+    value_type batch[5] = { 1, 2, 3, 4, 5 };
+    ASSERT_EQ(5u, q.push_batch(batch, 5));
+    ASSERT_EQ(3u, q.push_batch(batch, 5));
+    ASSERT_EQ(0u, q.push_batch(batch, 5));
+    value_type val;
+    const value_type expected[] = { 3, 2, 1, 5, 4, 3, 2, 1 };
+    for (size_t i = 0; i < ARRAY_SIZE(expected); ++i) {
+        ASSERT_TRUE(q.pop(&val));
+        ASSERT_EQ(expected[i], val);
+    }
+    ASSERT_FALSE(q.pop(&val));
+
+    bthread::WorkStealingQueue<value_type> q2;
+    ASSERT_EQ(0, q2.init(1024));
+    g_stop = false;
+    pthread_t rth[8];
+    pthread_t wth;
+    for (size_t i = 0; i < ARRAY_SIZE(rth); ++i) {
+        ASSERT_EQ(0, pthread_create(&rth[i], nullptr, steal_thread, &q2));
+    }
+    ASSERT_EQ(0, pthread_create(&wth, nullptr, batch_push_thread, &q2));
+    std::vector<value_type> values;
+    values.reserve(N);
+    for (size_t i = 0; i < ARRAY_SIZE(rth); ++i) {
+        std::vector<value_type>* res = nullptr;
+        pthread_join(rth[i], (void**)&res);
+        values.insert(values.end(), res->begin(), res->end());
+        delete res;
+    }
+    pthread_join(wth, nullptr);
+    while (q2.pop(&val)) {
+        values.push_back(val);
+    }
+    std::sort(values.begin(), values.end());
+    ASSERT_EQ(N, values.size());
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(i, values[i]);
+    }
+}
+
+void* steal_batch_thread(void* arg) {
+    std::vector<value_type> *stolen = new std::vector<value_type>;
+    stolen->reserve(N);
+    bthread::WorkStealingQueue<value_type> *q =
+        (bthread::WorkStealingQueue<value_type>*)arg;
+    value_type batch[16];
+    while (!g_stop) {
+        const size_t n = q->steal_batch(batch, ARRAY_SIZE(batch));
+        if (n == 0) {
+            cpu_relax();
+            continue;
+        }
+        for (size_t i = 1; i < n; ++i) {
+            // Items are stolen in FIFO order.
+            EXPECT_LT(batch[i - 1], batch[i]);
+        }
+        stolen->insert(stolen->end(), batch, batch + n);
+    }
+    return stolen;
+}
+
+TEST(WSQTest, steal_batch) {
+    bthread::WorkStealingQueue<value_type> q;
+    ASSERT_EQ(0, q.init(CAP));
+    value_type batch[CAP];
+    ASSERT_EQ(0u, q.steal_batch(batch, CAP));
+    for (value_type i = 0; i < CAP; ++i) {
+        ASSERT_TRUE(q.push(i));
+    }
+    // At most half of the queue is stolen.
+    ASSERT_EQ(4u, q.steal_batch(batch, CAP));
+    for (value_type i = 0; i < 4; ++i) {
+        ASSERT_EQ(i, batch[i]);
+    }
+    ASSERT_EQ(1u, q.steal_batch(batch, 1));
+    ASSERT_EQ(4u, batch[0]);
+    ASSERT_EQ(0u, q.steal_batch(batch, 0));
+    ASSERT_EQ(2u, q.steal_batch(batch, CAP));
+    ASSERT_EQ(5u, batch[0]);
+    ASSERT_EQ(6u, batch[1]);
+    // The last item is stolen as well.
+    ASSERT_EQ(1u, q.steal_batch(batch, CAP));
+    ASSERT_EQ(7u, batch[0]);
+    value_type val;
+    ASSERT_FALSE(q.pop(&val));
+
+    // Every item is either popped or stolen exactly once.
+    bthread::WorkStealingQueue<value_type> q2;
+    ASSERT_EQ(0, q2.init(1024));
+    g_stop = false;
+    pthread_t rth[4];
+    for (size_t i = 0; i < ARRAY_SIZE(rth); ++i) {
+        ASSERT_EQ(0, pthread_create(&rth[i], nullptr, steal_batch_thread, &q2));
+    }
+    std::vector<value_type> values;
+    values.reserve(N);
+    for (value_type seed = 0; seed < N;) {
+        if (q2.push(seed)) {
+            ++seed;
+        } else {
+            sched_yield();
+        }
+        if (seed % 3 == 0 && q2.pop(&val)) {
+            values.push_back(val);
+        }
+    }
+    g_stop = true;
+    for (size_t i = 0; i < ARRAY_SIZE(rth); ++i) {
+        std::vector<value_type>* res = nullptr;
+        pthread_join(rth[i], (void**)&res);
+        values.insert(values.end(), res->begin(), res->end());
+        delete res;
+    }
+    while (q2.pop(&val)) {
+        values.push_back(val);
+    }
+    std::sort(values.begin(), values.end());
+    ASSERT_EQ(N, values.size());
+    for (size_t i = 0; i < N; ++i) {
+        ASSERT_EQ(i, values[i]);
+    }
+}
 } // namespace
@@ -0,0 +1,195 @@
+// Licensed to the Apache Software Foundation (ASF) under one
+// or more contributor license agreements.  See the NOTICE file
+// distributed with this work for additional information
+// regarding copyright ownership.  The ASF licenses this file
+// to you under the Apache License, Version 2.0 (the
+// "License"); you may not use this file except in compliance
+// with the License.  You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+
+#include <pthread.h>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <gflags/gflags.h>
+#include <gtest/gtest.h>
+#include "butil/logging.h"
+#include "bvar/bvar.h"
+
+namespace bvar {
+DECLARE_bool(bvar_latency_histogram);
+}
+
+namespace {
+
+typedef bvar::detail::HistogramBuckets Buckets;
+
+class HistogramTest : public testing::Test {
+protected:
+    void SetUp() {}
+    void TearDown() {}
+};
+
+TEST_F(HistogramTest, bucket_bounds) {
+    for (uint32_t v = 0; v < Buckets::SUB_BUCKET_COUNT; ++v) {
+        ASSERT_EQ(v, Buckets::bucket_index(v));
+        ASSERT_EQ(v, Buckets::bucket_lower_bound(v));
+        ASSERT_EQ(v, Buckets::bucket_upper_bound(v));
+    }
+    ASSERT_EQ(Buckets::NBUCKET - 1,
+              Buckets::bucket_index(std::numeric_limits<uint32_t>::max()));
+    ASSERT_EQ(std::numeric_limits<uint32_t>::max(),
+              Buckets::bucket_upper_bound(Buckets::NBUCKET - 1));
+    // Buckets are contiguous and not wider than 1/32 of the lower bounds.
+    for (size_t i = 1; i < Buckets::NBUCKET; ++i) {
+        const uint32_t lower = Buckets::bucket_lower_bound(i);
+        const uint32_t upper = Buckets::bucket_upper_bound(i);
+        ASSERT_EQ(Buckets::bucket_upper_bound(i - 1) + 1, lower) << "i=" << i;
+        ASSERT_LE(upper - lower, lower / Buckets::SUB_BUCKET_COUNT) << "i=" << i;
+        ASSERT_EQ(i, Buckets::bucket_index(lower));
+        ASSERT_EQ(i, Buckets::bucket_index(upper));
+    }
+}
+
+TEST_F(HistogramTest, percentiles) {
+    bvar::LogLinearHistogram h;
+    for (int i = 1; i <= 100000; ++i) {
+        h << i;
+    }
+    h << -1;  // dropped
+    std::unique_ptr<Buckets> b(new Buckets(h.get_value()));
+    ASSERT_EQ(100000u, b->count);
+    ASSERT_EQ(100000LL * 100001 / 2, b->sum);
+    ASSERT_EQ(0u, Buckets().get_number(0.5));
+    uint32_t last_value = 0;
+    for (int k = 1; k <= 1000; ++k) {
+        const uint32_t expected = k * 100;
+        const uint32_t value = b->get_number(k / 1000.0);
+        ASSERT_GE(value, last_value);
+        ASSERT_GE(value, expected) << "k=" << k;
+        ASSERT_LE(value, expected + expected / 32) << "k=" << k;
+        last_value = value;
+    }
+    ASSERT_EQ(Buckets::bucket_upper_bound(Buckets::bucket_index(100000)),
+              b->get_number(1));
+}
+
+static void* add_values(void* arg) {
+    bvar::LogLinearHistogram* h = static_cast<bvar::LogLinearHistogram*>(arg);
+    for (int i = 0; i < 100000; ++i) {
+        *h << i % 1000;
+    }
+    return nullptr;
+}
+
+TEST_F(HistogramTest, multiple_threads) {
+    bvar::LogLinearHistogram h;
+    pthread_t th[8];
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, pthread_create(&th[i], nullptr, add_values, &h));
+    }
+    for (size_t i = 0; i < arraysize(th); ++i) {
+        ASSERT_EQ(0, pthread_join(th[i], nullptr));
+    }
+    std::unique_ptr<Buckets> b(new Buckets(h.get_value()));
+    ASSERT_EQ(arraysize(th) * 100000, b->count);
+    ASSERT_EQ((int64_t)arraysize(th) * 100 * (999 * 1000 / 2), b->sum);
+    // Values of threads quit are still counted.
+    std::unique_ptr<Buckets> r(new Buckets(h.reset()));
+    ASSERT_TRUE(*b == *r);
+    ASSERT_EQ(0u, h.get_value().count);
+}
+
+TEST_F(HistogramTest, window) {
+    bvar::LogLinearHistogram h;
+    bvar::Window<bvar::LogLinearHistogram> w(&h, 2);
+    // Wait for the first sample.
+    usleep(1100000);
+    h << 100;
+    usleep(1100000);
+    h << 1000 << 1000;
+    usleep(1100000);
+    std::unique_ptr<Buckets> b(new Buckets(w.get_value()));
+    ASSERT_LE(2u, b->count);
+    ASSERT_GE(3u, b->count);
+    ASSERT_EQ(Buckets::bucket_upper_bound(Buckets::bucket_index(1000)),
+              b->get_number(0.99));
+}
+
+TEST_F(HistogramTest, describe_and_parse) {
+    bvar::LogLinearHistogram h1("histogram_test_h1");
+    h1 << 0 << 1 << 31 << 32 << 1000 << 1000;
+    std::ostringstream oss;
+    h1.describe(oss, false);
+    ASSERT_EQ("{\"count\":6,\"sum\":2064,\"buckets\":"
+              "{\"0\":1,\"1\":1,\"31\":1,\"32\":1,\"1007\":2}}", oss.str());
+    ASSERT_EQ(oss.str(), bvar::Variable::describe_exposed("histogram_test_h1"));
+
+    std::unique_ptr<Buckets> b(new Buckets);
+    ASSERT_EQ(0, b->parse(oss.str()));
+    ASSERT_TRUE(*b == h1.get_value());
+
+    // Buckets from different processes are merged exactly.
+    bvar::LogLinearHistogram h2;
+    h2 << 1000 << 5000;
+    std::unique_ptr<Buckets> b2(new Buckets);
+    std::ostringstream oss2;
+    oss2 << h2.get_value();
+    ASSERT_EQ(0, b2->parse(oss2.str()));
+    *b += *b2;
+    ASSERT_EQ(8u, b->count);
+    ASSERT_EQ(8064, b->sum);
+    ASSERT_EQ(3u, b->counts[Buckets::bucket_index(1000)]);
+
+    ASSERT_EQ(0, b->parse("{\"count\":0,\"sum\":0,\"buckets\":{}}"));
+    ASSERT_EQ(0u, b->count);
+    // Not an upper bound of buckets.
+    ASSERT_EQ(-1, b->parse("{\"count\":1,\"sum\":1000,\"buckets\":{\"1000\":1}}"));
+    ASSERT_EQ(-1, b->parse("{\"count\":1,\"sum\":1,\"buckets\":{\"1\":1}"));
+    ASSERT_EQ(-1, b->parse("1"));
+}
+
+TEST_F(HistogramTest, latency_recorder) {
+    bvar::FLAGS_bvar_latency_histogram = true;
+    bvar::LatencyRecorder rec1("histogram_test_rec1");
+    bvar::FLAGS_bvar_latency_histogram = false;
+    bvar::LatencyRecorder rec2("histogram_test_rec2");
+    ASSERT_EQ("histogram_test_rec1_latency_histogram",
+              rec1.latency_histogram_name());
+    ASSERT_TRUE(rec2.latency_histogram_name().empty());
+    // Wait for the first sample.
+    usleep(1100000);
+    for (int i = 1; i <= 10000; ++i) {
+        rec1 << i;
+        rec2 << i;
+    }
+    usleep(1100000);
+    const int64_t p99 = rec1.latency_percentile(0.99);
+    ASSERT_GE(p99, 9900);
+    ASSERT_LE(p99, 9900 + 9900 / 32);
+    const bvar::Vector<int64_t, 4> ps = rec1.latency_percentiles();
+    ASSERT_GE(ps[3], 9990);
+    ASSERT_LE(ps[3], 9990 + 9990 / 32);
+    ASSERT_EQ(ps[3], rec1.latency_percentile(0.999));
+    ASSERT_EQ(10000, rec1.count());
+    ASSERT_EQ(10000, rec1.max_latency());
+
+    std::unique_ptr<Buckets> b(new Buckets);
+    ASSERT_EQ(0, b->parse(bvar::Variable::describe_exposed(
+                  "histogram_test_rec1_latency_histogram")));
+    ASSERT_EQ(10000u, b->count);
+    ASSERT_EQ(10000LL * 10001 / 2, b->sum);
+    rec1.hide();
+    ASSERT_TRUE(bvar::Variable::describe_exposed(
+                    "histogram_test_rec1_latency_histogram").empty());
+}
+
+} // namespace
@@ -22,11 +22,14 @@
 #include <memory>
 #include <iostream>
 #include <array>
+#include <set>
 #include <string>
+#include <vector>
 #include <gflags/gflags.h>
 #include <gtest/gtest.h>
 #include "butil/time.h"
 #include "butil/macros.h"
+#include "butil/string_printf.h"
 #include "bvar/bvar.h"
 #include "bvar/multi_dimension.h"
 #include "butil/third_party/rapidjson/rapidjson.h"
@@ -431,6 +434,59 @@ TEST_F(MultiDimensionTest, mlatencyrecorder) {
     GFLAGS_NAMESPACE::SetCommandLineOption("bvar_latency_p3", old_bvar_latency_p3.c_str());
 }
 
+class VectorDumper : public bvar::Dumper {
+public:
+    bool dump(const std::string&, const butil::StringPiece&) override {
+        return true;
+    }
+    bool dump_mvar(const std::string& name,
+                   const butil::StringPiece& desc) override {
+        lines.push_back(name + ' ' + desc.as_string());
+        return true;
+    }
+    bool dump_comment(const std::string& name, const std::string& type) override {
+        lines.push_back("# " + name + ' ' + type);
+        return true;
+    }
+    std::vector<std::string> lines;
+};
+
+TEST_F(MultiDimensionTest, dump) {
+    const std::list<std::string> dump_labels = {"idc", "method"};
+    bvar::MultiDimension<bvar::Adder<int> > my_madder("dump_madder", dump_labels);
+    *my_madder.get_stats({"tc", "get"}) << 3;
+    bvar::DumpOptions opt;
+    VectorDumper d1;
+    ASSERT_EQ(1u, my_madder.dump(&d1, &opt));
+    ASSERT_EQ(2u, d1.lines.size());
+    ASSERT_EQ("# dump_madder gauge", d1.lines[0]);
+    ASSERT_EQ("dump_madder{idc=\"tc\",method=\"get\"} 3", d1.lines[1]);
+
+    bvar::MultiDimension<bvar::LatencyRecorder> my_mlatency("dump_mlatency", dump_labels);
+    *my_mlatency.get_stats({"tc", "get"}) << 10;
+    *my_mlatency.get_stats({"jx", "set"}) << 20;
+    VectorDumper d2;
+    // 9 series for each stats.
+    ASSERT_EQ(18u, my_mlatency.dump(&d2, &opt));
+    ASSERT_EQ(22u, d2.lines.size());
+    std::set<std::string> lines(d2.lines.begin(), d2.lines.end());
+    ASSERT_EQ(1u, lines.count("# dump_mlatency_latency gauge"));
+    ASSERT_EQ(1u, lines.count("# dump_mlatency_count counter"));
+    ASSERT_EQ(1u, lines.count("dump_mlatency_count{idc=\"tc\",method=\"get\"} 1"));
+    ASSERT_EQ(1u, lines.count("dump_mlatency_count{idc=\"jx\",method=\"set\"} 1"));
+    // Values of percentiles depend on sampling.
+    std::set<std::string> keys;
+    for (auto& line : d2.lines) {
+        keys.insert(line.substr(0, line.rfind(' ')));
+    }
+    ASSERT_EQ(1u, keys.count(
+        "dump_mlatency_latency{idc=\"tc\",method=\"get\",quantile=\"9999\"}"));
+    ASSERT_EQ(1u, keys.count(butil::string_printf(
+        "dump_mlatency_latency{idc=\"jx\",method=\"set\",quantile=\"%d\"}",
+        (int)bvar::FLAGS_bvar_latency_p1)));
+    ASSERT_EQ(1u, keys.count("dump_mlatency_max_latency{idc=\"jx\",method=\"set\"}"));
+}
+
 TEST_F(MultiDimensionTest, mstatus) {
     bvar::MultiDimension<bvar::Status<int> > my_mstatus("my_mstatus", labels);
     std::list<std::string> labels_value {"tc", "get", "200"};
@@ -18,6 +18,7 @@
 #include <limits>                           //std::numeric_limits
 
 #include "bvar/reducer.h"
+#include "bvar/recorder.h"
 
 #include "butil/time.h"
 #include "butil/macros.h"
@@ -26,6 +27,10 @@
 
 #include <gtest/gtest.h>
 
+namespace bvar {
+DECLARE_bool(bvar_percpu_reducer);
+}
+
 namespace {
 class ReducerTest : public testing::Test {
 protected:
@@ -342,4 +347,80 @@ TEST_F(ReducerTest, simple_window) {
     const int64_t v = w.get_value();
     ASSERT_EQ(100, v) << "v=" << v;
 }
+
+struct PerCpuArg {
+    bvar::Adder<uint64_t>* adder;
+    bvar::Maxer<int>* maxer;
+    bvar::IntRecorder* recorder;
+};
+
+static void* add_to_percpu(void* void_arg) {
+    PerCpuArg* arg = (PerCpuArg*)void_arg;
+    for (int i = 1; i <= 1500; ++i) {
+        *arg->adder << 1;
+        *arg->maxer << i;
+        *arg->recorder << i;
+    }
+    return nullptr;
+}
+
+TEST_F(ReducerTest, percpu) {
+    bvar::FLAGS_bvar_percpu_reducer = true;
+    const bool percpu = (bvar::detail::percpu_agent_count() > 0);
+    bvar::detail::AgentCombiner<int64_t, int64_t,
+                                bvar::detail::AddTo<int64_t> > c1;
+    bvar::detail::AgentCombiner<std::string, std::string,
+                                bvar::detail::AddTo<std::string> > c2;
+    bvar::Adder<uint64_t> adder;
+    bvar::Maxer<int> maxer;
+    bvar::IntRecorder recorder;
+    bvar::FLAGS_bvar_percpu_reducer = false;
+    bvar::detail::AgentCombiner<int64_t, int64_t,
+                                bvar::detail::AddTo<int64_t> > c3;
+    LOG(INFO) << "percpu=" << percpu;
+    ASSERT_EQ(percpu, c1.use_percpu_agents());
+    ASSERT_FALSE(c2.use_percpu_agents());
+    ASSERT_FALSE(c3.use_percpu_agents());
+
+    // Values of short-lived threads are put into per-cpu agents, and
+    // IntRecorder flushes per-cpu agents when they're full.
+    PerCpuArg arg = { &adder, &maxer, &recorder };
+    for (int round = 0; round < 10; ++round) {
+        pthread_t th[100];
+        for (size_t i = 0; i < arraysize(th); ++i) {
+            ASSERT_EQ(0, pthread_create(&th[i], nullptr, add_to_percpu, &arg));
+        }
+        for (size_t i = 0; i < arraysize(th); ++i) {
+            ASSERT_EQ(0, pthread_join(th[i], nullptr));
+        }
+    }
+    ASSERT_EQ(1500000u, adder.get_value());
+    ASSERT_EQ(1500, maxer.get_value());
+    const bvar::Stat s = recorder.get_value();
+    ASSERT_EQ(1500000, s.num);
+    ASSERT_EQ(1000LL * 1500 * 1501 / 2, s.sum);
+    ASSERT_EQ(1500000u, adder.reset());
+    ASSERT_EQ(0u, adder.get_value());
+    ASSERT_EQ(1500, maxer.reset());
+    ASSERT_EQ(std::numeric_limits<int>::min(), maxer.get_value());
+
+    for (int i = 0; i < 2; ++i) {
+        bvar::FLAGS_bvar_percpu_reducer = (i == 0);
+        bvar::Adder<uint64_t> a;
+        bvar::FLAGS_bvar_percpu_reducer = false;
+        pthread_t th[4];
+        for (size_t j = 0; j < arraysize(th); ++j) {
+            ASSERT_EQ(0, pthread_create(&th[j], nullptr, thread_counter, &a));
+        }
+        long total_time = 0;
+        for (size_t j = 0; j < arraysize(th); ++j) {
+            void* ret = nullptr;
+            ASSERT_EQ(0, pthread_join(th[j], &ret));
+            total_time += (long)ret;
+        }
+        ASSERT_EQ(2ul * arraysize(th) * OPS_PER_THREAD, a.get_value());
+        LOG(INFO) << (i == 0 ? "Per-cpu" : "Thread-local") << " Adder takes "
+                  << total_time / (OPS_PER_THREAD * arraysize(th)) << "ns";
+    }
+}
 } // namespace
@@ -16,11 +16,20 @@
 // under the License.
 
 #include <limits>                           //std::numeric_limits
+#include <set>
+#include <gflags/gflags.h>
+#include "butil/atomicops.h"
 #include "bvar/detail/sampler.h"
 #include "butil/time.h"
 #include "butil/logging.h"
 #include <gtest/gtest.h>
 
+namespace bvar {
+namespace detail {
+DECLARE_int32(bvar_sampler_thread_num);
+}
+}
+
 namespace {
 
 TEST(SamplerTest, linked_list) {
@@ -136,4 +145,102 @@ TEST(SamplerTest, multi_threaded) {
     }
 #endif
 }
+
+// Record the thread calling take_sample().
+class ThreadSampler : public bvar::detail::Sampler {
+public:
+    ThreadSampler() : _thread(0) {}
+    void take_sample() override {
+        if (_thread == 0) {
+            const int64_t now = butil::cpuwide_time_us();
+            int64_t expected = 0;
+            _s_first_sample_us.compare_exchange_strong(expected, now);
+            _s_last_first_sample_us.store(now, butil::memory_order_relaxed);
+            _s_nsampled.fetch_add(1, butil::memory_order_relaxed);
+        }
+        _thread = pthread_self();
+    }
+    pthread_t thread() const { return _thread; }
+
+    static butil::atomic<int> _s_nsampled;
+    static butil::atomic<int> _s_ndestroy;
+    static butil::atomic<int64_t> _s_first_sample_us;
+    static butil::atomic<int64_t> _s_last_first_sample_us;
+
+protected:
+    ~ThreadSampler() override {
+        _s_ndestroy.fetch_add(1, butil::memory_order_relaxed);
+    }
+
+private:
+    pthread_t _thread;
+};
+butil::atomic<int> ThreadSampler::_s_nsampled(0);
+butil::atomic<int> ThreadSampler::_s_ndestroy(0);
+butil::atomic<int64_t> ThreadSampler::_s_first_sample_us(0);
+butil::atomic<int64_t> ThreadSampler::_s_last_first_sample_us(0);
+
+TEST(SamplerTest, sharded) {
+    const int32_t saved_thread_num = bvar::detail::FLAGS_bvar_sampler_thread_num;
+    bvar::detail::FLAGS_bvar_sampler_thread_num = 4;
+    ThreadSampler::_s_nsampled.store(0);
+    ThreadSampler::_s_ndestroy.store(0);
+    const int N = 100;
+    ThreadSampler* s[N];
+    for (int i = 0; i < N; ++i) {
+        s[i] = new ThreadSampler;
+        s[i]->schedule();
+    }
+    bvar::detail::FLAGS_bvar_sampler_thread_num = saved_thread_num;
+    for (int i = 0; i < 30 && ThreadSampler::_s_nsampled.load() < N; ++i) {
+        usleep(100000);
+    }
+    ASSERT_EQ(N, ThreadSampler::_s_nsampled.load());
+    // Samplers are distributed to all collectors in round-robin.
+    std::set<pthread_t> threads;
+    for (int i = 0; i < N; ++i) {
+        threads.insert(s[i]->thread());
+    }
+    ASSERT_EQ(4u, threads.size());
+    for (int i = 0; i < N; ++i) {
+        s[i]->destroy();
+    }
+    for (int i = 0; i < 30 && ThreadSampler::_s_ndestroy.load() < N; ++i) {
+        usleep(100000);
+    }
+    ASSERT_EQ(N, ThreadSampler::_s_ndestroy.load());
+}
+
+TEST(SamplerTest, stress_1m_samplers) {
+    const int32_t saved_thread_num = bvar::detail::FLAGS_bvar_sampler_thread_num;
+    bvar::detail::FLAGS_bvar_sampler_thread_num = 4;
+    ThreadSampler::_s_nsampled.store(0);
+    ThreadSampler::_s_ndestroy.store(0);
+    ThreadSampler::_s_first_sample_us.store(0);
+    const int N = 1000000;
+    std::vector<ThreadSampler*> s(N);
+    butil::Timer tm;
+    tm.start();
+    for (int i = 0; i < N; ++i) {
+        s[i] = new ThreadSampler;
+        s[i]->schedule();
+    }
+    tm.stop();
+    bvar::detail::FLAGS_bvar_sampler_thread_num = saved_thread_num;
+    for (int i = 0; i < 100 && ThreadSampler::_s_nsampled.load() < N; ++i) {
+        usleep(100000);
+    }
+    ASSERT_EQ(N, ThreadSampler::_s_nsampled.load());
+    LOG(INFO) << "Scheduled " << N << " samplers in " << tm.m_elapsed()
+              << "ms, sampled all of them in "
+              << (ThreadSampler::_s_last_first_sample_us.load() -
+                  ThreadSampler::_s_first_sample_us.load()) / 1000 << "ms";
+    for (int i = 0; i < N; ++i) {
+        s[i]->destroy();
+    }
+    for (int i = 0; i < 100 && ThreadSampler::_s_ndestroy.load() < N; ++i) {
+        usleep(100000);
+    }
+    ASSERT_EQ(N, ThreadSampler::_s_ndestroy.load());
+}
 } // namespace
@@ -25,10 +25,12 @@
 #include "butil/macros.h"
 #include "butil/string_printf.h"
 #include "butil/logging.h"
+#include "butil/fast_rand.h"
 #include "butil/containers/hash_tables.h"
 #include "butil/containers/flat_map.h"
 #include "butil/containers/pooled_map.h"
 #include "butil/containers/case_ignored_flat_map.h"
+#include "butil/containers/swiss_flat_map.h"
 
 namespace {
 class FlatMapTest : public ::testing::Test{
@@ -1626,4 +1628,301 @@ TEST_F(FlatMapTest, multi) {
     ASSERT_EQ(0, g2.x);
 }
 
+TEST_F(FlatMapTest, swiss_sanity) {
+    typedef butil::SwissFlatMap<uint64_t, long> Map;
+    Map m;
+    ASSERT_TRUE(m.initialized());
+    ASSERT_EQ(0UL, m.bucket_count());
+    ASSERT_EQ(nullptr, m.seek(1));
+    ASSERT_EQ(0UL, m.erase(1));
+    ASSERT_EQ(m.end(), m.begin());
+    ASSERT_EQ(0, m.init(1000, 70));
+    ASSERT_EQ(1024UL, m.bucket_count());
+    ASSERT_EQ(70u, m.load_factor());
+    ASSERT_EQ(0UL, m.size());
+    ASSERT_TRUE(m.empty());
+
+    // Initial insertion
+    m[1] = 10;
+    ASSERT_EQ(1UL, m.size());
+    ASSERT_FALSE(m.empty());
+    long* p = m.seek(1);
+    ASSERT_TRUE(p && *p == 10);
+    ASSERT_EQ(nullptr, m.seek(2));
+
+    // Override
+    m[1] = 100;
+    ASSERT_EQ(1UL, m.size());
+    ASSERT_EQ(100, *m.seek(1));
+    ASSERT_EQ(200, *m.insert(1, 200));
+    ASSERT_EQ(1UL, m.size());
+    ASSERT_EQ(300, *m.insert(std::make_pair(3UL, 300L)));
+    ASSERT_EQ(2UL, m.size());
+
+    // Erase exist
+    long old_value = 0;
+    ASSERT_EQ(1UL, m.erase(1, &old_value));
+    ASSERT_EQ(200, old_value);
+    ASSERT_EQ(0UL, m.erase(1));
+    ASSERT_EQ(1UL, m.size());
+    ASSERT_EQ(nullptr, m.seek(1));
+
+    // default constructed
+    ASSERT_EQ(0, m[1]);
+    ASSERT_EQ(0, m[5]);
+    ASSERT_EQ(3UL, m.size());
+
+    std::map<uint64_t, long> visited;
+    for (Map::iterator it = m.begin(); it != m.end(); ++it) {
+        visited[it->first] = it->second;
+    }
+    ASSERT_EQ(3UL, visited.size());
+    ASSERT_EQ(300, visited[3]);
+    const Map& cm = m;
+    size_t n = 0;
+    for (Map::const_iterator it = cm.begin(); it != cm.end(); ++it) {
+        ++n;
+    }
+    ASSERT_EQ(3UL, n);
+
+    // Clear
+    m.clear();
+    ASSERT_EQ(0UL, m.size());
+    ASSERT_TRUE(m.empty());
+    ASSERT_EQ(1024UL, m.bucket_count());
+    ASSERT_EQ(nullptr, m.seek(3));
+    ASSERT_EQ(m.end(), m.begin());
+    m.clear_and_reset_pool();
+    ASSERT_EQ(0UL, m.bucket_count());
+    m[7] = 7;
+    ASSERT_EQ(7, *m.seek(7));
+}
+
+TEST_F(FlatMapTest, swiss_resize_and_tombstones) {
+    butil::SwissFlatMap<int, int> m;
+    const int N = 90000;
+    for (int i = 0; i < N; ++i) {
+        ASSERT_TRUE(m.insert(i, i * 2));
+    }
+    ASSERT_EQ((size_t)N, m.size());
+    ASSERT_LE(m.size() * 100, m.bucket_count() * m.load_factor());
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(i * 2, *m.seek(i)) << i;
+    }
+    ASSERT_EQ(nullptr, m.seek(N));
+    const size_t nbucket = m.bucket_count();
+    // Erasing and inserting different keys repeatedly leaves tombstones,
+    // which are dropped without growing the map.
+    for (int r = 1; r <= 20; ++r) {
+        for (int i = 0; i < N / 2; ++i) {
+            ASSERT_EQ(1UL, m.erase((r - 1) * N + i));
+            ASSERT_TRUE(m.insert(r * N + i, i));
+        }
+        for (int i = N / 2; i < N; ++i) {
+            ASSERT_EQ(1UL, m.erase((r - 1) * N + i));
+            ASSERT_TRUE(m.insert(r * N + i, i));
+        }
+        ASSERT_EQ((size_t)N, m.size());
+    }
+    ASSERT_EQ(nbucket, m.bucket_count());
+    for (int i = 0; i < N; ++i) {
+        ASSERT_EQ(i, *m.seek(20 * N + i));
+        ASSERT_EQ(nullptr, m.seek(19 * N + i));
+    }
+    // Shrink.
+    for (int i = 0; i < N - 10; ++i) {
+        ASSERT_EQ(1UL, m.erase(20 * N + i));
+    }
+    ASSERT_TRUE(m.resize(0));
+    ASSERT_EQ(butil::swiss::GROUP_WIDTH, m.bucket_count());
+    for (int i = N - 10; i < N; ++i) {
+        ASSERT_EQ(i, *m.seek(20 * N + i));
+    }
+}
+
+TEST_F(FlatMapTest, swiss_random_insert_erase) {
+    srand(0);
+    n_con = 0;
+    n_cp_con = 0;
+    n_des = 0;
+    {
+        butil::hash_map<uint64_t, Value> ref[2];
+        typedef butil::SwissFlatMap<uint64_t, Value> Map;
+        Map ht[2];
+        ht[0].init(40);
+        ht[1] = ht[0];
+
+        for (int j = 0; j < 30; ++j) {
+            // Make snapshot
+            ht[1] = ht[0];
+            ref[1] = ref[0];
+
+            for (int i = 0; i < 100000; ++i) {
+                int k = rand() % 0xFFFF;
+                int p = rand() % 1000;
+                ht[0].insert(k, i);
+                ref[0][k] = i;
+                if (p < 600) {
+                } else if(p < 999) {
+                    ht[0].erase(k);
+                    ref[0].erase(k);
+                } else {
+                    ht[0].clear();
+                    ref[0].clear();
+                }
+            }
+
+            for (int i = 0; i < 2; ++i) {
+                for (Map::iterator it = ht[i].begin(); it != ht[i].end(); ++it) {
+                    butil::hash_map<uint64_t, Value>::iterator it2 =
+                        ref[i].find(it->first);
+                    ASSERT_TRUE(it2 != ref[i].end());
+                    ASSERT_EQ(it2->second, it->second);
+                }
+                for (butil::hash_map<uint64_t, Value>::iterator
+                         it = ref[i].begin(); it != ref[i].end(); ++it) {
+                    Value* p_value = ht[i].seek(it->first);
+                    ASSERT_TRUE(p_value != nullptr);
+                    ASSERT_EQ(it->second, p_value->x_);
+                }
+                ASSERT_EQ(ht[i].size(), ref[i].size());
+            }
+        }
+    }
+    // Values moved during resizing are copy-constructed.
+    ASSERT_EQ(n_con + n_cp_con, n_des);
+}
+
+TEST_F(FlatMapTest, swiss_map_of_string) {
+    butil::SwissFlatMap<std::string, int> m;
+    ASSERT_EQ(0, m.init(16));
+    char buf[32];
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(buf, sizeof(buf), "key_%d", i);
+        m[buf] = i;
+    }
+    ASSERT_EQ(1000UL, m.size());
+    for (int i = 0; i < 1000; ++i) {
+        snprintf(buf, sizeof(buf), "key_%d", i);
+        ASSERT_EQ(i, *m.seek(std::string(buf)));
+        ASSERT_EQ(i, *m.seek(butil::StringPiece(buf)));
+        ASSERT_EQ(i, *m.seek((const char*)buf));
+    }
+    ASSERT_EQ(nullptr, m.seek("key_1000"));
+    ASSERT_EQ(1UL, m.erase(butil::StringPiece("key_10")));
+    ASSERT_EQ(nullptr, m.seek("key_10"));
+
+    butil::SwissFlatMap<std::string, int> m2(m);
+    ASSERT_EQ(999UL, m2.size());
+    ASSERT_EQ(11, *m2.seek("key_11"));
+    butil::SwissFlatMap<std::string, int> m3;
+    m3.swap(m2);
+    ASSERT_EQ(0UL, m2.size());
+    ASSERT_EQ(999UL, m3.size());
+    ASSERT_EQ(11, *m3.seek("key_11"));
+}
+
+template <typename Map>
+void fill_map(Map& m, const std::vector<uint64_t>& keys) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+        m[keys[i]] = keys[i];
+    }
+}
+
+template <typename Map>
+long seek_map(Map& m, const std::vector<uint64_t>& keys) {
+    long sum = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const uint64_t* p = m.seek(keys[i]);
+        if (p) {
+            sum += *p;
+        }
+    }
+    return sum;
+}
+
+template <>
+long seek_map(std::unordered_map<uint64_t, uint64_t>& m,
+              const std::vector<uint64_t>& keys) {
+    long sum = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto it = m.find(keys[i]);
+        if (it != m.end()) {
+            sum += it->second;
+        }
+    }
+    return sum;
+}
+
+// Get average nanoseconds of inserting, seeking existing keys and seeking
+// non-existing keys.
+template <typename Map>
+void perf_map(const std::vector<uint64_t>& keys,
+              const std::vector<uint64_t>& hit_keys,
+              const std::vector<uint64_t>& miss_keys,
+              int64_t* insert_ns, int64_t* hit_ns, int64_t* miss_ns) {
+    Map m;
+    butil::Timer tm;
+    tm.start();
+    fill_map(m, keys);
+    tm.stop();
+    *insert_ns = tm.n_elapsed() / keys.size();
+    tm.start();
+    long sum = seek_map(m, hit_keys);
+    tm.stop();
+    *hit_ns = tm.n_elapsed() / hit_keys.size();
+    tm.start();
+    sum += seek_map(m, miss_keys);
+    tm.stop();
+    *miss_ns = tm.n_elapsed() / miss_keys.size();
+    ASSERT_NE(0, sum);
+}
+
+void perf_swiss_flat_map(size_t n, bool aligned_keys) {
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> miss_keys;
+    keys.reserve(n);
+    miss_keys.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        if (aligned_keys) {
+            // Lower bits are all zero, e.g. addresses of aligned objects.
+            keys.push_back((i * 2 + 1) << 12);
+            miss_keys.push_back((i * 2 + 2) << 12);
+        } else {
+            keys.push_back(butil::fast_rand());
+            miss_keys.push_back(butil::fast_rand());
+        }
+    }
+    std::vector<uint64_t> hit_keys = keys;
+    std::random_shuffle(hit_keys.begin(), hit_keys.end());
+
+    int64_t flat[3];
+    int64_t swiss[3];
+    int64_t std_unordered[3];
+    perf_map<butil::FlatMap<uint64_t, uint64_t> >(
+        keys, hit_keys, miss_keys, &flat[0], &flat[1], &flat[2]);
+    perf_map<butil::SwissFlatMap<uint64_t, uint64_t> >(
+        keys, hit_keys, miss_keys, &swiss[0], &swiss[1], &swiss[2]);
+    perf_map<std::unordered_map<uint64_t, uint64_t> >(
+        keys, hit_keys, miss_keys, &std_unordered[0], &std_unordered[1],
+        &std_unordered[2]);
+    LOG(INFO) << "Inserting/Seeking hit/Seeking miss " << keys.size()
+              << (aligned_keys ? " aligned" : " random")
+              << " keys into/from FlatMap/SwissFlatMap/std::unordered_map takes "
+              << flat[0] << "/" << swiss[0] << "/" << std_unordered[0]
+              << " " << flat[1] << "/" << swiss[1] << "/" << std_unordered[1]
+              << " " << flat[2] << "/" << swiss[2] << "/" << std_unordered[2];
+}
+
+TEST_F(FlatMapTest, swiss_perf) {
+    size_t nkeys[] = { 1000, 10000, 100000, 1000000, 10000000 };
+    for (size_t pass = 0; pass < ARRAY_SIZE(nkeys); ++pass) {
+        perf_swiss_flat_map(nkeys[pass], false);
+    }
+    // FlatMap uses lower bits of hash codes (being the keys by default)
+    // directly, which collide in this case.
+    perf_swiss_flat_map(1000, true);
+    perf_swiss_flat_map(10000, true);
+}
+
 }
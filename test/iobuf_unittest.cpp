@@ -32,6 +32,7 @@
 #include <butil/time.h>                 // Timer
 #include <butil/fd_utility.h>           // make_non_blocking
 #include <butil/iobuf.h>
+#include <butil/iobuf_block_allocator.h>
 #include <butil/single_iobuf.h>
 #include <butil/logging.h>
 #include <butil/fd_guard.h>
@@ -2218,6 +2219,80 @@ TEST_F(IOBufTest, as_output_stream_round_trip_with_input_stream) {
     }
 }
 
+static void* free_hugepage_blocks(void* arg) {
+    std::vector<void*>* blocks = (std::vector<void*>*)arg;
+    for (size_t i = 0; i < blocks->size(); ++i) {
+        butil::iobuf::hugepage_block_deallocate((*blocks)[i]);
+    }
+    return nullptr;
+}
+
+static size_t hugepage_arena_free_blocks() {
+    std::vector<butil::iobuf::HugePageArenaStat> stats;
+    butil::iobuf::get_hugepage_arena_stats(&stats);
+    size_t n = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        n += stats[i].free_blocks;
+    }
+    return n;
+}
+
+TEST_F(IOBufTest, hugepage_block_allocator) {
+    const size_t block_size = butil::GetDefaultBlockSize();
+    const size_t N = 1000;
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < N; ++i) {
+        void* p = butil::iobuf::hugepage_block_allocate(block_size);
+        ASSERT_TRUE(p != nullptr);
+        ASSERT_TRUE(butil::iobuf::is_hugepage_block(p));
+        memset(p, (int)i, block_size);
+        blocks.push_back(p);
+    }
+    std::vector<void*> sorted = blocks;
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 1; i < N; ++i) {
+        ASSERT_GE((char*)sorted[i] - (char*)sorted[i - 1], (ptrdiff_t)block_size);
+    }
+    std::vector<butil::iobuf::HugePageArenaStat> stats;
+    butil::iobuf::get_hugepage_arena_stats(&stats);
+    ASSERT_FALSE(stats.empty());
+    size_t carved = 0;
+    size_t mapped = 0;
+    for (size_t i = 0; i < stats.size(); ++i) {
+        ASSERT_EQ(0u, stats[i].mapped_bytes % (2 * 1024 * 1024));
+        ASSERT_LE(stats[i].mapped_bytes, stats[i].reserved_bytes);
+        carved += stats[i].carved_blocks;
+        mapped += stats[i].mapped_bytes;
+    }
+    ASSERT_GE(carved, N);
+    ASSERT_GE(mapped, N * block_size);
+
+    // Larger blocks are malloc-ed.
+    void* big = butil::iobuf::hugepage_block_allocate(block_size * 2);
+    ASSERT_TRUE(big != nullptr);
+    ASSERT_FALSE(butil::iobuf::is_hugepage_block(big));
+    butil::iobuf::hugepage_block_deallocate(big);
+
+    // The most recently freed block is reused first.
+    void* last = blocks.back();
+    blocks.pop_back();
+    butil::iobuf::hugepage_block_deallocate(last);
+    ASSERT_EQ(last, butil::iobuf::hugepage_block_allocate(block_size));
+    blocks.push_back(last);
+
+    // Blocks freed in another thread are given back to the arena when the
+    // thread quits.
+    const size_t nfree_before = hugepage_arena_free_blocks();
+    pthread_t th;
+    ASSERT_EQ(0, pthread_create(&th, nullptr, free_hugepage_blocks, &blocks));
+    ASSERT_EQ(0, pthread_join(th, nullptr));
+    ASSERT_EQ(nfree_before + N, hugepage_arena_free_blocks());
+
+    std::ostringstream os;
+    butil::iobuf::describe_block_allocator(os);
+    ASSERT_NE(std::string::npos, os.str().find("hugepage_arena[node=")) << os.str();
+}
+
 #if HAS_NLOHMANN_JSON
 // End-to-end test that the IOBuf <-> std::iostream adapters work with
 // nlohmann::json — the canonical "RPC handler reads JSON from an IOBuf body